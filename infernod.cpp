@@ -0,0 +1,110 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QJsonDocument>
+#include <QTextStream>
+#include "src/BatchScheduler.h"
+#include "src/Daemon.h"
+#include "src/JobJournal.h"
+#include "src/JobManifest.h"
+#include "src/JobQueue.h"
+#include "src/Metrics.h"
+
+/**
+ * @brief Entry point of infernod, the headless burn-station daemon.
+ *
+ * Keeps one DiskUtility engine (drive table, device profiles, caches) warm
+ * and runs jobs submitted over a local socket (see DaemonServer). Jobs are
+ * journaled (see JobJournal), so after a crash or an update the daemon picks
+ * up where it stopped, resuming image writes from their last checkpoint. The GUI
+ * connects to it when it is running; scripts can speak the JSON-lines
+ * protocol directly, e.g. with socat, or hand a batch over with
+ * "infernod --submit manifest.json" (see JobManifest).
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The command-line arguments array.
+ * @return int The application's exit code.
+ */
+int main(int argc, char *argv[]) {
+    QCoreApplication::setApplicationName("Inferno");
+    QCoreApplication::setApplicationVersion("1.0.0");
+    QCoreApplication::setOrganizationName("AhmedNourAhmed");
+
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Inferno burn-station daemon");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    const QCommandLineOption socketOption("socket", "Local socket to listen on.", "name", DaemonServer::kDefaultName);
+    const QCommandLineOption groupOption("group-access", "Let the socket owner's group submit jobs too.");
+    const QCommandLineOption maxJobsOption("max-jobs", "Jobs to run at once (0: one per free drive).", "count", "0");
+    const QCommandLineOption metricsPortOption("metrics-port", "Serve Prometheus metrics on 127.0.0.1:port (0: off).",
+                                               "port", QString::number(MetricsServer::kDefaultPort));
+    const QCommandLineOption metricsSocketOption("metrics-socket", "Serve Prometheus metrics on a local socket.", "name");
+    const QCommandLineOption journalOption("journal", "Job journal to resume from and append to.", "path",
+                                           JobJournal::defaultPath());
+    const QCommandLineOption submitOption("submit", "Submit a batch manifest to the running daemon and exit.", "manifest");
+    parser.addOptions({socketOption, groupOption, maxJobsOption, metricsPortOption, metricsSocketOption, journalOption,
+                       submitOption});
+    parser.process(app);
+
+    if (parser.isSet(submitOption)) {
+        // Checked here first, so mistakes are reported against the file rather than by the daemon
+        QString errorMessage;
+        JobManifest manifest;
+        if (!manifest.load(parser.value(submitOption), &errorMessage)) {
+            qDebug() << "Invalid manifest:" << errorMessage;
+            return 1;
+        }
+        QFile file(parser.value(submitOption));
+        file.open(QIODevice::ReadOnly);
+        const QJsonObject manifestJson = QJsonDocument::fromJson(file.readAll()).object();
+
+        DaemonClient client;
+        if (!client.connectToDaemon(parser.value(socketOption))) {
+            qDebug() << "Cannot reach infernod:" << client.errorString();
+            return 1;
+        }
+        QList<qint64> ids;
+        const qint64 batch = client.submitManifest(manifestJson, &ids);
+        if (batch == 0) {
+            qDebug() << "The daemon refused the manifest:" << client.errorString();
+            return 1;
+        }
+        QTextStream out(stdout);
+        out << "Batch " << batch << ":";
+        for (const qint64 id : ids) {
+            out << ' ' << id;
+        }
+        out << Qt::endl;
+        return 0;
+    }
+
+    JobJournal journal(parser.value(journalOption));
+    JobQueue queue;
+    queue.setMaxRunning(parser.value(maxJobsOption).toInt());
+    QString journalError;
+    if (!queue.attachJournal(&journal, &journalError)) {
+        qDebug() << "Cannot open the job journal:" << journalError;
+        return 1; // Running without it would lose jobs on the next crash
+    }
+
+    BatchScheduler scheduler(&queue);
+    DaemonServer server(&queue, &scheduler);
+    if (!server.listen(parser.value(socketOption), parser.isSet(groupOption))) {
+        return 1;
+    }
+
+    MetricsServer metrics;
+    const quint16 metricsPort = quint16(parser.value(metricsPortOption).toUInt());
+    if (metricsPort != 0) {
+        metrics.listen(metricsPort); // Failing to serve metrics is not a reason to refuse jobs
+    }
+    if (parser.isSet(metricsSocketOption)) {
+        metrics.listenLocal(parser.value(metricsSocketOption));
+    }
+
+    return app.exec();
+}
@@ -0,0 +1,228 @@
+#include "AdaptiveWriteQueue.h"
+#include "Instrumentation.h"
+#include "Probes.h"
+#include <QMutexLocker>
+#include <algorithm>
+
+namespace {
+// Buffers beyond kMaxDepth let producers fill the next requests while the pool is busy
+const int kSpareBuffers = 2;
+const qint64 kMaxBufferSize = 16 * 1024 * 1024;
+} // namespace
+
+// --- Implementation of AimdController ---
+
+AimdController::AimdController(int maxDepth, qint64 minRequestSize, qint64 maxRequestSize, qint64 initialRequestSize)
+    : maxDepth(maxDepth), minRequestSize(minRequestSize), maxRequestSize(maxRequestSize),
+      currentDepth(std::min(2, maxDepth)),
+      currentRequestSize(std::clamp(initialRequestSize, minRequestSize, maxRequestSize)) {
+}
+
+void AimdController::recordCompletion(qint64 bytes, double latencyMs, qint64 nowMs) {
+    if (windowStart < 0) {
+        windowStart = nowMs - qint64(latencyMs);
+    }
+    windowBytes += bytes;
+    windowLatencies.push_back(latencyMs);
+    if (nowMs - windowStart < kWindowTime || int(windowLatencies.size()) < kWindowCompletions) {
+        return;
+    }
+
+    const double throughput = double(windowBytes) * 1000.0 / double(std::max<qint64>(1, nowMs - windowStart));
+    const size_t p90 = windowLatencies.size() * 9 / 10;
+    std::nth_element(windowLatencies.begin(), windowLatencies.begin() + qsizetype(p90), windowLatencies.end());
+    const double latency = windowLatencies[p90];
+
+    if (latency > kLatencyCeiling) {
+        decrease();
+    } else if (lastThroughput <= 0 || throughput > lastThroughput * kGain) {
+        increase();
+    } else if (throughput < lastThroughput * kLoss && latency > lastLatency) {
+        decrease();
+    } else if (++quietWindows >= kProbeWindows) {
+        increase(); // Conditions may have improved since the last change
+    }
+
+    lastThroughput = throughput;
+    lastLatency = latency;
+    windowStart = nowMs;
+    windowBytes = 0;
+    windowLatencies.clear();
+}
+
+void AimdController::decrease() {
+    quietWindows = 0;
+    if (currentDepth > 1) {
+        currentDepth = std::max(1, currentDepth / 2);
+    } else {
+        currentRequestSize = std::max(minRequestSize, currentRequestSize / 2);
+    }
+}
+
+void AimdController::increase() {
+    quietWindows = 0;
+    if (currentDepth < maxDepth) {
+        ++currentDepth;
+    } else {
+        currentRequestSize = std::min(maxRequestSize, currentRequestSize * 2);
+    }
+}
+
+QueueControlState AimdController::state() const {
+    QueueControlState result;
+    result.depth = currentDepth;
+    result.requestSize = currentRequestSize;
+    result.latencyMs = lastLatency;
+    result.bytesPerSecond = lastThroughput;
+    return result;
+}
+
+// --- Implementation of AdaptiveWriteQueue ---
+
+AdaptiveWriteQueue::AdaptiveWriteQueue(BlockDevice &device, qint64 initialRequestSize, PipelineTrace *trace)
+    : device(device), trace(trace),
+      bufferSize(std::max(initialRequestSize, std::min(2 * initialRequestSize, kMaxBufferSize))),
+      freeBuffers(kMaxDepth + kSpareBuffers),
+      pending(kMaxDepth + kSpareBuffers),
+      controller(kMaxDepth, std::min(kMinRequestSize, initialRequestSize), bufferSize, initialRequestSize) {
+    for (int i = 0; i < kMaxDepth + kSpareBuffers; ++i) {
+        buffers.push_back(std::make_unique<AlignedBuffer>(bufferSize));
+        freeBuffers.push(buffers.back().get());
+    }
+    clock.start();
+    for (int i = 0; i < kMaxDepth; ++i) {
+        writers.push_back(QThread::create([this, i]() { writerLoop(i); }));
+        writers.back()->start();
+    }
+}
+
+AdaptiveWriteQueue::~AdaptiveWriteQueue() {
+    if (!finished) {
+        abort();
+        finish();
+    }
+}
+
+qint64 AdaptiveWriteQueue::requestSize() const {
+    QMutexLocker locker(&mutex);
+    return controller.requestSize();
+}
+
+AlignedBuffer *AdaptiveWriteQueue::acquire() {
+    if (failed()) {
+        return nullptr;
+    }
+    const std::optional<AlignedBuffer *> buffer = freeBuffers.pop();
+    return buffer ? *buffer : nullptr;
+}
+
+void AdaptiveWriteQueue::submit(AlignedBuffer *buffer, qint64 offset, qint64 length, qint64 dataLength) {
+    const PipelineTrace::Span span(trace, "submit", offset, length); // Blocks while every writer is busy
+    INFERNO_PROBE2(buffer_submit, offset, length);
+    {
+        QMutexLocker locker(&mutex);
+        outstanding.insert(offset);
+        submittedEnd = std::max(submittedEnd, offset + length);
+    }
+    if (!pending.push(Request{buffer, offset, length, dataLength})) {
+        freeBuffers.push(buffer); // Aborted; the offset stays outstanding, as it was never written
+    }
+}
+
+void AdaptiveWriteQueue::release(AlignedBuffer *buffer) {
+    freeBuffers.push(buffer);
+}
+
+void AdaptiveWriteQueue::writerLoop(int index) {
+    if (trace) trace->nameThread(QString("queue writer %1").arg(index));
+    while (std::optional<Request> request = pending.pop()) {
+        {
+            QMutexLocker locker(&mutex);
+            while (inFlight >= controller.depth() && !aborted) {
+                slotFree.wait(&mutex);
+            }
+            if (aborted) {
+                freeBuffers.push(request->buffer);
+                continue;
+            }
+            ++inFlight;
+            if (trace) trace->addCounter("in flight", inFlight);
+        }
+
+        const qint64 started = clock.nsecsElapsed();
+        bool ok;
+        QString writeError;
+        {
+            const PipelineTrace::Span span(trace, "write", request->offset, request->length);
+            const Instrumentation::StageTimer timer(Instrumentation::Stage::Write, request->length);
+            ok = device.writeAt(request->buffer->data(), request->length, request->offset, &writeError) == request->length;
+        }
+        const qint64 latencyNs = clock.nsecsElapsed() - started;
+        const double latencyMs = double(latencyNs) / 1e6;
+        INFERNO_PROBE4(buffer_complete, request->offset, request->length, latencyNs, int(ok));
+
+        {
+            QMutexLocker locker(&mutex);
+            --inFlight;
+            if (trace) trace->addCounter("in flight", inFlight);
+            if (ok) {
+                completed += request->dataLength;
+                outstanding.erase(outstanding.find(request->offset));
+                controller.recordCompletion(request->length, latencyMs, clock.elapsed());
+            } else if (error.isEmpty()) {
+                error = writeError;
+                aborted = true;
+            }
+            slotFree.wakeAll();
+        }
+        freeBuffers.push(request->buffer);
+        if (!ok) {
+            freeBuffers.close(); // Producers blocked in acquire() give up
+        }
+    }
+}
+
+bool AdaptiveWriteQueue::finish() {
+    pending.close();
+    for (QThread *writer : writers) {
+        writer->wait();
+        delete writer;
+    }
+    writers.clear();
+    finished = true;
+    return !failed();
+}
+
+void AdaptiveWriteQueue::abort() {
+    {
+        QMutexLocker locker(&mutex);
+        aborted = true;
+        slotFree.wakeAll();
+    }
+    freeBuffers.close();
+}
+
+bool AdaptiveWriteQueue::failed() const {
+    QMutexLocker locker(&mutex);
+    return !error.isEmpty();
+}
+
+QString AdaptiveWriteQueue::errorString() const {
+    QMutexLocker locker(&mutex);
+    return error;
+}
+
+qint64 AdaptiveWriteQueue::bytesCompleted() const {
+    QMutexLocker locker(&mutex);
+    return completed;
+}
+
+qint64 AdaptiveWriteQueue::completedThrough() const {
+    QMutexLocker locker(&mutex);
+    return outstanding.empty() ? submittedEnd : *outstanding.begin();
+}
+
+QueueControlState AdaptiveWriteQueue::state() const {
+    QMutexLocker locker(&mutex);
+    return controller.state();
+}
@@ -0,0 +1,188 @@
+#ifndef ADAPTIVEWRITEQUEUE_H
+#define ADAPTIVEWRITEQUEUE_H
+
+#include "BlockDevice.h"
+#include "BoundedQueue.h"
+#include "PipelineTrace.h"
+#include "ProgressRecord.h"
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+#include <memory>
+#include <set>
+#include <vector>
+
+/**
+ * @brief AIMD control of queue depth and request size from completion latencies.
+ *
+ * Completions are grouped into windows of at least kWindowTime. At the end
+ * of each window the controller compares its throughput and 90th percentile
+ * latency with the previous window:
+ *
+ *  - latency above kLatencyCeiling: multiplicative decrease (halve the depth,
+ *    or the request size once the depth is 1), so a cancel or pause never
+ *    waits long for requests already queued in the stick;
+ *  - throughput up by kGain: additive increase (one more request in flight,
+ *    or double the request size once the depth is at its maximum);
+ *  - throughput down by kLoss while latency grew: the extra depth is only
+ *    queueing inside the stick (SLC cache full, thermal throttling), so
+ *    decrease multiplicatively;
+ *  - otherwise hold, probing upwards again after kProbeWindows quiet windows.
+ *
+ * Not thread-safe; AdaptiveWriteQueue serialises access.
+ */
+class AimdController {
+public:
+    static constexpr qint64 kWindowTime = 500;        // ms
+    static constexpr int kWindowCompletions = 4;
+    static constexpr double kLatencyCeiling = 400.0;  // ms
+    static constexpr double kGain = 1.05;
+    static constexpr double kLoss = 0.90;
+    static constexpr int kProbeWindows = 8;
+
+    AimdController(int maxDepth, qint64 minRequestSize, qint64 maxRequestSize, qint64 initialRequestSize);
+
+    /**
+     * @brief Records one completed request; may adjust depth() and requestSize().
+     */
+    void recordCompletion(qint64 bytes, double latencyMs, qint64 nowMs);
+
+    int depth() const { return currentDepth; }
+    qint64 requestSize() const { return currentRequestSize; }
+    QueueControlState state() const;
+
+private:
+    void decrease();
+    void increase();
+
+    int maxDepth;
+    qint64 minRequestSize;
+    qint64 maxRequestSize;
+    int currentDepth = 2;
+    qint64 currentRequestSize;
+
+    qint64 windowStart = -1;
+    qint64 windowBytes = 0;
+    std::vector<double> windowLatencies;
+    double lastThroughput = 0;
+    double lastLatency = 0;
+    int quietWindows = 0;
+};
+
+/**
+ * @brief A pool of writer threads that keeps an AimdController-chosen number of requests in flight.
+ *
+ * Producers take a buffer with acquire(), fill it with up to requestSize()
+ * bytes (or maxRequestSize(), if they must), and hand it back with submit();
+ * up to kMaxDepth writer threads issue the positional writes, of which only
+ * depth() may be in the device at once. Writes may complete out of order,
+ * which is fine for positional writes to distinct ranges; finish() waits
+ * for all of them.
+ *
+ * After the first write error the queue stops: acquire() returns null and
+ * finish() returns false with errorString() set.
+ */
+class AdaptiveWriteQueue {
+public:
+    static constexpr int kMaxDepth = 6;
+    static constexpr qint64 kMinRequestSize = 1024 * 1024;
+
+    /**
+     * @param device Open, writable device; must outlive the queue.
+     * @param initialRequestSize Starting request size (e.g., from EraseBlockProbe::requestSize).
+     * @param trace Receives "submit" and "write" spans and the "in flight" counter; may be null.
+     */
+    AdaptiveWriteQueue(BlockDevice &device, qint64 initialRequestSize, PipelineTrace *trace = nullptr);
+    ~AdaptiveWriteQueue();
+
+    AdaptiveWriteQueue(const AdaptiveWriteQueue &) = delete;
+    AdaptiveWriteQueue &operator=(const AdaptiveWriteQueue &) = delete;
+
+    /**
+     * @brief Size of every buffer, the largest request the controller will ask for.
+     */
+    qint64 maxRequestSize() const { return bufferSize; }
+
+    /**
+     * @brief Request size producers should use next.
+     */
+    qint64 requestSize() const;
+
+    /**
+     * @brief Waits for a free buffer; null once the queue has failed or been aborted.
+     */
+    AlignedBuffer *acquire();
+
+    /**
+     * @brief Queues a write of length bytes at offset, of which dataLength count as progress.
+     */
+    void submit(AlignedBuffer *buffer, qint64 offset, qint64 length, qint64 dataLength);
+
+    /**
+     * @brief Returns a buffer that is not going to be submitted.
+     */
+    void release(AlignedBuffer *buffer);
+
+    /**
+     * @brief Waits for every submitted write; false if any failed.
+     */
+    bool finish();
+
+    /**
+     * @brief Drops writes not yet started and makes acquire() fail. Thread-safe.
+     */
+    void abort();
+
+    bool failed() const;
+    QString errorString() const;
+
+    /**
+     * @brief Data bytes of the writes completed so far. Thread-safe.
+     */
+    qint64 bytesCompleted() const;
+
+    /**
+     * @brief Offset below which every submitted write has completed. Thread-safe.
+     *
+     * Meaningful when producers submit in ascending offset order, as the
+     * image writers do: after a BlockDevice::sync() the drive then holds
+     * everything the job writes below it, so a restart may resume there.
+     */
+    qint64 completedThrough() const;
+
+    QueueControlState state() const;
+
+private:
+    struct Request {
+        AlignedBuffer *buffer = nullptr;
+        qint64 offset = 0;
+        qint64 length = 0;
+        qint64 dataLength = 0;
+    };
+
+    void writerLoop(int index);
+
+    BlockDevice &device;
+    PipelineTrace *trace;
+    qint64 bufferSize;
+    std::vector<std::unique_ptr<AlignedBuffer>> buffers;
+    BoundedQueue<AlignedBuffer *> freeBuffers;
+    BoundedQueue<Request> pending;
+    std::vector<QThread *> writers;
+
+    mutable QMutex mutex;
+    QWaitCondition slotFree;
+    AimdController controller;
+    QElapsedTimer clock;
+    int inFlight = 0;
+    bool aborted = false;
+    qint64 completed = 0;
+    std::multiset<qint64> outstanding; // Offsets of submitted writes not yet completed
+    qint64 submittedEnd = 0;
+    QString error;
+    bool finished = false;
+};
+
+#endif // ADAPTIVEWRITEQUEUE_H
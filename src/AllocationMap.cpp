@@ -0,0 +1,605 @@
+#include "AllocationMap.h"
+#include "BlockDevice.h"
+#include <QByteArray>
+#include <QStringList>
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+// Unallocated gaps smaller than this are read anyway to keep requests large
+const qint64 kMergeGap = 1024 * 1024;
+// Largest allocation table (FAT, bitmap) read in one go
+const qint64 kMaxTableSize = 512LL * 1024 * 1024;
+const qint64 kTableReadSize = 4 * 1024 * 1024;
+
+struct Partition {
+    qint64 offset = 0;
+    qint64 length = 0;
+};
+
+quint16 le16(const QByteArray &bytes, qsizetype offset) {
+    return offset + 2 <= bytes.size() ? qFromLittleEndian<quint16>(bytes.constData() + offset) : 0;
+}
+
+quint32 le32(const QByteArray &bytes, qsizetype offset) {
+    return offset + 4 <= bytes.size() ? qFromLittleEndian<quint32>(bytes.constData() + offset) : 0;
+}
+
+quint64 le64(const QByteArray &bytes, qsizetype offset) {
+    return offset + 8 <= bytes.size() ? qFromLittleEndian<quint64>(bytes.constData() + offset) : 0;
+}
+
+/**
+ * @brief Reads an arbitrary byte range, handling the alignment O_DIRECT needs.
+ */
+bool readBytes(BlockDevice &device, qint64 offset, qint64 length, QByteArray *out) {
+    const qint64 align = device.logicalBlockSize();
+    if (offset < 0 || length <= 0 || offset + length > device.size()) {
+        return false;
+    }
+    const qint64 start = offset / align * align;
+    const qint64 end = std::min(device.size(), (offset + length + align - 1) / align * align);
+    AlignedBuffer buffer(end - start);
+    if (device.readAt(buffer.data(), end - start, start) != end - start) {
+        return false;
+    }
+    *out = QByteArray(buffer.data() + (offset - start), length);
+    return true;
+}
+
+void addRange(QList<ByteRange> &ranges, qint64 offset, qint64 length) {
+    if (length <= 0) {
+        return;
+    }
+    if (!ranges.isEmpty() && ranges.last().end() == offset) {
+        ranges.last().length += length;
+    } else {
+        ranges.append(ByteRange{offset, length});
+    }
+}
+
+/**
+ * @brief Adds a range for every run of set bits; bit i is unit i at baseOffset + i * unitBytes.
+ */
+void addBitmapRuns(const QByteArray &bitmap, qint64 unitCount, qint64 baseOffset, qint64 unitBytes,
+                   QList<ByteRange> &ranges) {
+    const uchar *bits = reinterpret_cast<const uchar *>(bitmap.constData());
+    unitCount = std::min(unitCount, qint64(bitmap.size()) * 8);
+    qint64 runStart = -1;
+    qint64 i = 0;
+    while (i < unitCount) {
+        // Whole bytes that do not change the current state are skipped at once
+        if ((i & 7) == 0 && i + 8 <= unitCount) {
+            const uchar byte = bits[i >> 3];
+            if ((byte == 0x00 && runStart < 0) || (byte == 0xFF && runStart >= 0)) {
+                i += 8;
+                continue;
+            }
+        }
+        const bool set = (bits[i >> 3] >> (i & 7)) & 1;
+        if (set && runStart < 0) {
+            runStart = i;
+        } else if (!set && runStart >= 0) {
+            addRange(ranges, baseOffset + runStart * unitBytes, (i - runStart) * unitBytes);
+            runStart = -1;
+        }
+        ++i;
+    }
+    if (runStart >= 0) {
+        addRange(ranges, baseOffset + runStart * unitBytes, (unitCount - runStart) * unitBytes);
+    }
+}
+
+// --- Filesystems ---
+
+bool scanFat32(BlockDevice &device, const Partition &part, const QByteArray &boot, QList<ByteRange> &ranges) {
+    const qint64 bytesPerSector = le16(boot, 0x0B);
+    const qint64 sectorsPerCluster = uchar(boot[0x0D]);
+    const qint64 reservedSectors = le16(boot, 0x0E);
+    const qint64 fatCount = uchar(boot[0x10]);
+    const qint64 totalSectors = le32(boot, 0x20);
+    const qint64 fatSectors = le32(boot, 0x24);
+    if (bytesPerSector < 512 || bytesPerSector > 4096 || sectorsPerCluster == 0 || fatCount == 0 || fatSectors == 0) {
+        return false;
+    }
+
+    const qint64 clusterBytes = bytesPerSector * sectorsPerCluster;
+    const qint64 dataStart = (reservedSectors + fatCount * fatSectors) * bytesPerSector;
+    const qint64 volumeBytes = std::min(totalSectors * bytesPerSector, part.length);
+    if (dataStart >= volumeBytes) {
+        return false;
+    }
+    const qint64 entryCount = (volumeBytes - dataStart) / clusterBytes + 2;
+    if (entryCount * 4 > kMaxTableSize) {
+        return false;
+    }
+
+    // Boot sector, reserved sectors and all FAT copies
+    addRange(ranges, part.offset, dataStart);
+
+    // Stream the first FAT; any non-free entry means the cluster is in use
+    const qint64 fatOffset = part.offset + reservedSectors * bytesPerSector;
+    const qint64 entriesPerRead = kTableReadSize / 4;
+    QByteArray fat;
+    for (qint64 first = 0; first < entryCount; first += entriesPerRead) {
+        const qint64 count = std::min(entriesPerRead, entryCount - first);
+        if (!readBytes(device, fatOffset + first * 4, count * 4, &fat)) {
+            return false;
+        }
+        for (qint64 i = 0; i < count; ++i) {
+            const qint64 cluster = first + i;
+            if (cluster >= 2 && (le32(fat, i * 4) & 0x0FFFFFFF) != 0) {
+                addRange(ranges, part.offset + dataStart + (cluster - 2) * clusterBytes, clusterBytes);
+            }
+        }
+    }
+    return true;
+}
+
+bool scanExfat(BlockDevice &device, const Partition &part, const QByteArray &boot, QList<ByteRange> &ranges) {
+    const int sectorShift = uchar(boot[0x6C]);
+    const int clusterShift = uchar(boot[0x6D]);
+    if (sectorShift < 9 || sectorShift > 12 || sectorShift + clusterShift > 25) {
+        return false;
+    }
+
+    const qint64 bytesPerSector = 1LL << sectorShift;
+    const qint64 clusterBytes = bytesPerSector << clusterShift;
+    const qint64 fatOffset = qint64(le32(boot, 0x50)) * bytesPerSector;
+    const qint64 heapOffset = qint64(le32(boot, 0x58)) * bytesPerSector;
+    const qint64 clusterCount = le32(boot, 0x5C);
+    const quint32 rootCluster = le32(boot, 0x60);
+    if (heapOffset >= part.length || (clusterCount + 2) * 4 > kMaxTableSize) {
+        return false;
+    }
+
+    QByteArray fat;
+    if (!readBytes(device, part.offset + fatOffset, (clusterCount + 2) * 4, &fat)) {
+        return false;
+    }
+    auto clusterOffset = [&](quint32 cluster) { return part.offset + heapOffset + qint64(cluster - 2) * clusterBytes; };
+    auto validCluster = [&](quint32 cluster) { return cluster >= 2 && qint64(cluster) < clusterCount + 2; };
+
+    // The allocation bitmap is described by a type 0x81 entry in the root directory
+    quint32 bitmapCluster = 0;
+    qint64 bitmapLength = 0;
+    quint32 cluster = rootCluster;
+    for (int guard = 0; validCluster(cluster) && guard < 4096 && bitmapCluster == 0; ++guard) {
+        QByteArray directory;
+        if (!readBytes(device, clusterOffset(cluster), clusterBytes, &directory)) {
+            return false;
+        }
+        for (qsizetype entry = 0; entry + 32 <= directory.size(); entry += 32) {
+            const uchar type = uchar(directory[entry]);
+            if (type == 0x00) {
+                break; // End of directory
+            }
+            if (type == 0x81 && (uchar(directory[entry + 1]) & 0x01) == 0) {
+                bitmapCluster = le32(directory, entry + 20);
+                bitmapLength = qint64(le64(directory, entry + 24));
+                break;
+            }
+        }
+        cluster = le32(fat, qsizetype(cluster) * 4);
+    }
+    if (!validCluster(bitmapCluster) || bitmapLength < (clusterCount + 7) / 8 || bitmapLength > kMaxTableSize) {
+        return false;
+    }
+
+    // Read the bitmap, following its FAT chain (a zero entry means contiguous)
+    QByteArray bitmap;
+    cluster = bitmapCluster;
+    while (bitmap.size() < bitmapLength && validCluster(cluster)) {
+        QByteArray data;
+        if (!readBytes(device, clusterOffset(cluster), clusterBytes, &data)) {
+            return false;
+        }
+        bitmap.append(data);
+        const quint32 next = le32(fat, qsizetype(cluster) * 4);
+        cluster = next == 0 ? cluster + 1 : next;
+    }
+    if (bitmap.size() < bitmapLength) {
+        return false;
+    }
+
+    addRange(ranges, part.offset, heapOffset); // Boot region and FAT
+    addBitmapRuns(bitmap, clusterCount, part.offset + heapOffset, clusterBytes, ranges);
+    return true;
+}
+
+bool extGroupHasSuperblock(qint64 group, bool sparseSuper) {
+    if (!sparseSuper || group <= 1) {
+        return true;
+    }
+    for (qint64 base : {3, 5, 7}) {
+        qint64 power = base;
+        while (power < group) {
+            power *= base;
+        }
+        if (power == group) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool scanExt(BlockDevice &device, const Partition &part, const QByteArray &superblock, QList<ByteRange> &ranges) {
+    const quint32 logBlockSize = le32(superblock, 0x18);
+    if (logBlockSize > 6) {
+        return false;
+    }
+    const qint64 blockSize = 1024LL << logBlockSize;
+    const quint32 incompat = le32(superblock, 0x60);
+    const bool is64Bit = incompat & 0x80;
+    if (incompat & 0x10) {
+        return false; // META_BG moves the descriptors around; read such volumes whole
+    }
+
+    const qint64 blocksCount = qint64(le32(superblock, 0x04)) | (is64Bit ? qint64(le32(superblock, 0x150)) << 32 : 0);
+    const qint64 firstDataBlock = le32(superblock, 0x14);
+    const qint64 blocksPerGroup = le32(superblock, 0x20);
+    const qint64 descSize = is64Bit ? std::max<qint64>(32, le16(superblock, 0xFE)) : 32;
+    const bool sparseSuper = le32(superblock, 0x64) & 0x1;
+    const qint64 reservedGdtBlocks = le16(superblock, 0xCE);
+    if (blocksPerGroup == 0 || blocksCount * blockSize > part.length) {
+        return false;
+    }
+
+    const qint64 groupCount = (blocksCount - firstDataBlock + blocksPerGroup - 1) / blocksPerGroup;
+    const qint64 gdtBlocks = (groupCount * descSize + blockSize - 1) / blockSize;
+    const qint64 superblockAreaBytes = (1 + gdtBlocks + reservedGdtBlocks) * blockSize;
+    QByteArray descriptors;
+    if (groupCount * descSize > kMaxTableSize
+        || !readBytes(device, part.offset + (firstDataBlock + 1) * blockSize, groupCount * descSize, &descriptors)) {
+        return false;
+    }
+
+    addRange(ranges, part.offset, firstDataBlock * blockSize + superblockAreaBytes);
+
+    QByteArray bitmap;
+    for (qint64 group = 0; group < groupCount; ++group) {
+        const qsizetype desc = qsizetype(group * descSize);
+        const qint64 groupStart = firstDataBlock + group * blocksPerGroup;
+        const qint64 groupBlocks = std::min(blocksPerGroup, blocksCount - groupStart);
+
+        if (le16(descriptors, desc + 0x12) & 0x2) {
+            // BLOCK_UNINIT: bitmap never written; only the superblock backup is in use
+            if (extGroupHasSuperblock(group, sparseSuper)) {
+                addRange(ranges, part.offset + groupStart * blockSize, superblockAreaBytes);
+            }
+            continue;
+        }
+
+        const qint64 bitmapBlock = qint64(le32(descriptors, desc))
+            | (descSize >= 64 ? qint64(le32(descriptors, desc + 0x20)) << 32 : 0);
+        if (bitmapBlock == 0 || bitmapBlock >= blocksCount
+            || !readBytes(device, part.offset + bitmapBlock * blockSize, blockSize, &bitmap)) {
+            return false;
+        }
+        addBitmapRuns(bitmap, groupBlocks, part.offset + groupStart * blockSize, blockSize, ranges);
+    }
+    return true;
+}
+
+bool applyNtfsFixups(QByteArray &record) {
+    const qsizetype usaOffset = le16(record, 0x04);
+    const qsizetype usaCount = le16(record, 0x06);
+    if (usaCount == 0 || usaOffset + usaCount * 2 > record.size()) {
+        return false;
+    }
+    // The last two bytes of every 512-byte stride were swapped out into the update sequence array
+    for (qsizetype i = 1; i < usaCount; ++i) {
+        const qsizetype position = i * 512 - 2;
+        if (position + 2 > record.size()) {
+            break;
+        }
+        if (record[position] != record[usaOffset] || record[position + 1] != record[usaOffset + 1]) {
+            return false;
+        }
+        record[position] = record[usaOffset + i * 2];
+        record[position + 1] = record[usaOffset + i * 2 + 1];
+    }
+    return true;
+}
+
+bool scanNtfs(BlockDevice &device, const Partition &part, const QByteArray &boot, QList<ByteRange> &ranges) {
+    const qint64 bytesPerSector = le16(boot, 0x0B);
+    const int rawSectorsPerCluster = uchar(boot[0x0D]);
+    const qint64 sectorsPerCluster = rawSectorsPerCluster <= 0x80 ? rawSectorsPerCluster : 1LL << (256 - rawSectorsPerCluster);
+    const qint64 totalSectors = qint64(le64(boot, 0x28));
+    const qint64 mftCluster = qint64(le64(boot, 0x30));
+    const qint8 clustersPerRecord = qint8(boot[0x40]);
+    if (bytesPerSector < 512 || bytesPerSector > 4096 || sectorsPerCluster == 0) {
+        return false;
+    }
+
+    const qint64 clusterBytes = bytesPerSector * sectorsPerCluster;
+    const qint64 recordSize = clustersPerRecord > 0 ? clustersPerRecord * clusterBytes : 1LL << -clustersPerRecord;
+    const qint64 clusterCount = totalSectors / sectorsPerCluster;
+    if (recordSize < 512 || recordSize > 65536 || (clusterCount + 7) / 8 > kMaxTableSize) {
+        return false;
+    }
+
+    // MFT record 6 is $Bitmap; its unnamed $DATA attribute holds one bit per cluster
+    QByteArray record;
+    if (!readBytes(device, part.offset + mftCluster * clusterBytes + 6 * recordSize, recordSize, &record)
+        || !record.startsWith("FILE") || !applyNtfsFixups(record)) {
+        return false;
+    }
+
+    struct Run {
+        qint64 lcn;
+        qint64 length;
+        bool sparse;
+    };
+    QList<Run> runs;
+    qint64 bitmapSize = 0;
+    qsizetype attribute = le16(record, 0x14);
+    while (attribute + 16 <= record.size()) {
+        const quint32 type = le32(record, attribute);
+        const quint32 length = le32(record, attribute + 4);
+        if (type == 0xFFFFFFFF || length == 0 || attribute + length > record.size()) {
+            break;
+        }
+        const bool nonResident = record[attribute + 8] != 0;
+        const int nameLength = uchar(record[attribute + 9]);
+        if (type == 0x80 && nonResident && nameLength == 0) {
+            bitmapSize = qint64(le64(record, attribute + 0x30));
+            qsizetype position = attribute + le16(record, attribute + 0x20);
+            const qsizetype attributeEnd = attribute + length;
+            qint64 lcn = 0;
+            while (position < attributeEnd) {
+                const uchar header = uchar(record[position]);
+                if (header == 0) {
+                    break;
+                }
+                const int lengthBytes = header & 0x0F;
+                const int offsetBytes = header >> 4;
+                if (lengthBytes == 0 || lengthBytes > 8 || offsetBytes > 8
+                    || position + 1 + lengthBytes + offsetBytes > attributeEnd) {
+                    return false;
+                }
+                qint64 runLength = 0;
+                for (int b = 0; b < lengthBytes; ++b) {
+                    runLength |= qint64(uchar(record[position + 1 + b])) << (8 * b);
+                }
+                qint64 runOffset = 0;
+                for (int b = 0; b < offsetBytes; ++b) {
+                    runOffset |= qint64(uchar(record[position + 1 + lengthBytes + b])) << (8 * b);
+                }
+                if (offsetBytes > 0 && offsetBytes < 8 && (runOffset >> (8 * offsetBytes - 1)) & 1) {
+                    runOffset -= 1LL << (8 * offsetBytes); // Sign extend
+                }
+                lcn += runOffset;
+                runs.append(Run{lcn, runLength, offsetBytes == 0});
+                position += 1 + lengthBytes + offsetBytes;
+            }
+            break;
+        }
+        attribute += length;
+    }
+    if (runs.isEmpty() || bitmapSize < (clusterCount + 7) / 8 || bitmapSize > kMaxTableSize) {
+        return false;
+    }
+
+    QByteArray bitmap;
+    for (const Run &run : runs) {
+        const qint64 bytes = std::min(run.length * clusterBytes, bitmapSize - bitmap.size());
+        if (bytes <= 0) {
+            break;
+        }
+        if (run.sparse) {
+            bitmap.append(QByteArray(bytes, '\0'));
+            continue;
+        }
+        QByteArray data;
+        if (!readBytes(device, part.offset + run.lcn * clusterBytes, bytes, &data)) {
+            return false;
+        }
+        bitmap.append(data);
+    }
+
+    addBitmapRuns(bitmap, clusterCount, part.offset, clusterBytes, ranges);
+    // The backup boot sector sits in the last sector, after the last cluster
+    addRange(ranges, part.offset + part.length - bytesPerSector, bytesPerSector);
+    return true;
+}
+
+/**
+ * @brief Identifies a partition's filesystem and adds its allocated ranges.
+ */
+QString scanPartition(BlockDevice &device, const Partition &part, QList<ByteRange> &ranges) {
+    QByteArray head;
+    if (part.length < 4096 || !readBytes(device, part.offset, 4096, &head)) {
+        addRange(ranges, part.offset, part.length);
+        return "unreadable";
+    }
+
+    QList<ByteRange> found;
+    QString name;
+    bool recognised = false;
+    if (head.mid(3, 8) == "NTFS    ") {
+        name = "NTFS";
+        recognised = scanNtfs(device, part, head, found);
+    } else if (head.mid(3, 8) == "EXFAT   ") {
+        name = "exFAT";
+        recognised = scanExfat(device, part, head, found);
+    } else if (head.mid(0x52, 8) == "FAT32   ") {
+        name = "FAT32";
+        recognised = scanFat32(device, part, head, found);
+    } else if (le16(head, 1024 + 0x38) == 0xEF53) {
+        name = "ext";
+        recognised = scanExt(device, part, head.mid(1024, 1024), found);
+    }
+
+    if (!recognised) {
+        addRange(ranges, part.offset, part.length);
+        return name.isEmpty() ? QString("unknown") : name + " (unparsed)";
+    }
+    ranges.append(found);
+    return QString("%1, %2 MB used").arg(name).arg(AllocationMap::totalLength(found) / (1024 * 1024));
+}
+
+bool hasFilesystemSignature(const QByteArray &head) {
+    return head.mid(3, 8) == "NTFS    " || head.mid(3, 8) == "EXFAT   " || head.mid(0x52, 8) == "FAT32   "
+        || le16(head, 1024 + 0x38) == 0xEF53;
+}
+
+QList<Partition> readPartitions(BlockDevice &device, const QByteArray &head) {
+    const qint64 sectorSize = device.logicalBlockSize();
+    QList<Partition> parts;
+    if (uchar(head[510]) != 0x55 || uchar(head[511]) != 0xAA) {
+        return parts;
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        const qsizetype entry = 446 + i * 16;
+        const uchar type = uchar(head[entry + 4]);
+        const qint64 start = qint64(le32(head, entry + 8)) * sectorSize;
+        const qint64 length = qint64(le32(head, entry + 12)) * sectorSize;
+        if (type == 0x00) {
+            continue;
+        }
+
+        if (type == 0xEE) {
+            // Protective MBR: the real table is the GPT at LBA 1
+            QByteArray header;
+            QByteArray entries;
+            if (!readBytes(device, sectorSize, sectorSize, &header) || !header.startsWith("EFI PART")) {
+                break;
+            }
+            const qint64 entriesLba = qint64(le64(header, 0x48));
+            const qint64 entryCount = le32(header, 0x50);
+            const qint64 entrySize = le32(header, 0x54);
+            if (entryCount > 1024 || entrySize < 128 || entrySize > 1024
+                || !readBytes(device, entriesLba * sectorSize, entryCount * entrySize, &entries)) {
+                break;
+            }
+            parts.clear();
+            for (qint64 e = 0; e < entryCount; ++e) {
+                const qsizetype base = qsizetype(e * entrySize);
+                if (le64(entries, base) == 0 && le64(entries, base + 8) == 0) {
+                    continue; // Unused entry (zero type GUID)
+                }
+                const qint64 first = qint64(le64(entries, base + 32));
+                const qint64 last = qint64(le64(entries, base + 40));
+                if (last >= first) {
+                    parts.append(Partition{first * sectorSize, (last - first + 1) * sectorSize});
+                }
+            }
+            return parts;
+        }
+
+        if (type == 0x05 || type == 0x0F || type == 0x85) {
+            // Extended partition: walk the chain of EBRs
+            qint64 ebr = start;
+            for (int guard = 0; guard < 128; ++guard) {
+                QByteArray record;
+                if (!readBytes(device, ebr, 512, &record) || uchar(record[510]) != 0x55 || uchar(record[511]) != 0xAA) {
+                    break;
+                }
+                if (uchar(record[446 + 4]) != 0) {
+                    parts.append(Partition{ebr + qint64(le32(record, 446 + 8)) * sectorSize,
+                                           qint64(le32(record, 446 + 12)) * sectorSize});
+                }
+                if (uchar(record[462 + 4]) == 0) {
+                    break;
+                }
+                ebr = start + qint64(le32(record, 462 + 8)) * sectorSize;
+            }
+            continue;
+        }
+
+        parts.append(Partition{start, length});
+    }
+    return parts;
+}
+} // namespace
+
+// --- Implementation of AllocationMap ---
+
+bool AllocationMap::scan(BlockDevice &device, QList<ByteRange> *allocated, QString *summary) {
+    const qint64 total = device.size();
+    QByteArray head;
+    if (!readBytes(device, 0, std::min<qint64>(4096, total), &head) || head.size() < 4096) {
+        return false;
+    }
+
+    QList<Partition> parts;
+    if (hasFilesystemSignature(head)) {
+        parts.append(Partition{0, total}); // No partition table ("superfloppy")
+    } else {
+        parts = readPartitions(device, head);
+    }
+    std::sort(parts.begin(), parts.end(), [](const Partition &a, const Partition &b) { return a.offset < b.offset; });
+
+    QList<ByteRange> ranges;
+    QList<ByteRange> partitionRanges;
+    QStringList descriptions;
+    for (const Partition &part : parts) {
+        if (part.offset < 0 || part.length <= 0 || part.offset + part.length > total) {
+            continue;
+        }
+        partitionRanges.append(ByteRange{part.offset, part.length});
+        descriptions << scanPartition(device, part, ranges);
+    }
+
+    // Partition tables, boot code and gaps between partitions are always kept
+    ranges.append(invert(normalize(partitionRanges, 1, 0, total), total));
+
+    *allocated = normalize(ranges, std::max<qint64>(device.logicalBlockSize(), 4096), kMergeGap, total);
+    if (summary) {
+        *summary = QString("%1 partition(s) [%2]; %3 of %4 MB allocated")
+                       .arg(parts.size())
+                       .arg(descriptions.join("; "))
+                       .arg(totalLength(*allocated) / (1024 * 1024))
+                       .arg(total / (1024 * 1024));
+    }
+    return true;
+}
+
+QList<ByteRange> AllocationMap::invert(const QList<ByteRange> &ranges, qint64 total) {
+    QList<ByteRange> gaps;
+    qint64 cursor = 0;
+    for (const ByteRange &range : ranges) {
+        if (range.offset > cursor) {
+            gaps.append(ByteRange{cursor, range.offset - cursor});
+        }
+        cursor = std::max(cursor, range.end());
+    }
+    if (cursor < total) {
+        gaps.append(ByteRange{cursor, total - cursor});
+    }
+    return gaps;
+}
+
+qint64 AllocationMap::totalLength(const QList<ByteRange> &ranges) {
+    qint64 sum = 0;
+    for (const ByteRange &range : ranges) {
+        sum += range.length;
+    }
+    return sum;
+}
+
+QList<ByteRange> AllocationMap::normalize(QList<ByteRange> ranges, qint64 alignment, qint64 mergeGap, qint64 total) {
+    std::sort(ranges.begin(), ranges.end(), [](const ByteRange &a, const ByteRange &b) { return a.offset < b.offset; });
+
+    QList<ByteRange> merged;
+    for (const ByteRange &range : ranges) {
+        if (range.length <= 0) {
+            continue;
+        }
+        const qint64 start = std::max<qint64>(0, range.offset / alignment * alignment);
+        const qint64 end = std::min(total, (range.end() + alignment - 1) / alignment * alignment);
+        if (end <= start) {
+            continue;
+        }
+        if (!merged.isEmpty() && start <= merged.last().end() + mergeGap) {
+            merged.last().length = std::max(merged.last().end(), end) - merged.last().offset;
+        } else {
+            merged.append(ByteRange{start, end - start});
+        }
+    }
+    return merged;
+}
@@ -0,0 +1,58 @@
+#ifndef ALLOCATIONMAP_H
+#define ALLOCATIONMAP_H
+
+#include <QList>
+#include <QString>
+
+class BlockDevice;
+
+/**
+ * @brief A contiguous byte range on a device.
+ */
+struct ByteRange {
+    qint64 offset = 0;
+    qint64 length = 0;
+
+    qint64 end() const { return offset + length; }
+};
+
+/**
+ * @brief Finds which parts of a drive hold data, so backups can skip the rest.
+ *
+ * The partition table (MBR with extended partitions, or GPT) is parsed and
+ * each partition's filesystem is identified from its boot sector. For FAT32,
+ * exFAT, ext2/3/4 and NTFS the allocation structures (FAT, allocation bitmap,
+ * block group bitmaps, $Bitmap) are read and only allocated clusters plus the
+ * filesystem metadata are reported. Anything not understood (unknown
+ * filesystems, partition gaps, boot code areas) is conservatively reported as
+ * allocated, so a scan can only ever make a backup smaller, never lossy.
+ */
+class AllocationMap {
+public:
+    /**
+     * @brief Scans a device opened for reading.
+     *
+     * @param device The device to scan.
+     * @param allocated Receives sorted, non-overlapping ranges aligned to the device block size.
+     * @param summary Receives a human readable description of what was recognised.
+     * @return bool False only if the device could not be read at all.
+     */
+    static bool scan(BlockDevice &device, QList<ByteRange> *allocated, QString *summary = nullptr);
+
+    /**
+     * @brief Returns the complement of the given ranges within [0, total).
+     */
+    static QList<ByteRange> invert(const QList<ByteRange> &ranges, qint64 total);
+
+    static qint64 totalLength(const QList<ByteRange> &ranges);
+
+    /**
+     * @brief Sorts and merges ranges, aligning them outwards to alignment.
+     *
+     * Gaps smaller than mergeGap are merged too: reading a little unallocated
+     * data is cheaper than splitting one large request into many small ones.
+     */
+    static QList<ByteRange> normalize(QList<ByteRange> ranges, qint64 alignment, qint64 mergeGap, qint64 total);
+};
+
+#endif // ALLOCATIONMAP_H
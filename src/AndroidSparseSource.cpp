@@ -0,0 +1,153 @@
+#include "ImageSource.h"
+#include <QtEndian>
+#include <algorithm>
+
+namespace {
+const quint32 kSparseMagic = 0xED26FF3A;
+const quint16 kChunkRaw = 0xCAC1;
+const quint16 kChunkFill = 0xCAC2;
+const quint16 kChunkDontCare = 0xCAC3;
+const quint16 kChunkCrc32 = 0xCAC4;
+
+/**
+ * @brief Android sparse images (simg, as written by img2simg and fastboot).
+ *
+ * The file is a list of chunks, each covering a whole number of blocks: raw
+ * data, a repeated 4-byte fill value, or "don't care" (a hole). The chunk list
+ * is scanned once in open() to build an offset map, without reading the data.
+ */
+class AndroidSparseSource : public ImageSource {
+public:
+    bool open(const QString &path) override {
+        file.setFileName(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            error = file.errorString();
+            return false;
+        }
+        const QByteArray header = file.peek(28);
+        if (header.size() < 28 || qFromLittleEndian<quint32>(header.constData()) != kSparseMagic) {
+            return false;
+        }
+
+        const quint16 majorVersion = qFromLittleEndian<quint16>(header.constData() + 4);
+        const quint16 fileHeaderSize = qFromLittleEndian<quint16>(header.constData() + 8);
+        const quint16 chunkHeaderSize = qFromLittleEndian<quint16>(header.constData() + 10);
+        const qint64 blockSize = qFromLittleEndian<quint32>(header.constData() + 12);
+        const qint64 totalBlocks = qFromLittleEndian<quint32>(header.constData() + 16);
+        const quint32 totalChunks = qFromLittleEndian<quint32>(header.constData() + 20);
+        if (majorVersion != 1 || fileHeaderSize < 28 || chunkHeaderSize < 12 || blockSize == 0 || blockSize % 4 != 0) {
+            error = "Unsupported sparse image header";
+            return false;
+        }
+
+        qint64 filePosition = fileHeaderSize;
+        qint64 outputPosition = 0;
+        QByteArray chunkHeader(chunkHeaderSize, Qt::Uninitialized);
+        for (quint32 i = 0; i < totalChunks; ++i) {
+            if (!readFile(file, filePosition, chunkHeader.data(), chunkHeaderSize)) {
+                return false;
+            }
+            const quint16 type = qFromLittleEndian<quint16>(chunkHeader.constData());
+            const qint64 blocks = qFromLittleEndian<quint32>(chunkHeader.constData() + 4);
+            const qint64 totalSize = qFromLittleEndian<quint32>(chunkHeader.constData() + 8);
+            const qint64 payload = totalSize - chunkHeaderSize;
+            const qint64 length = blocks * blockSize;
+
+            Chunk chunk{outputPosition, length, type, filePosition + chunkHeaderSize, 0};
+            switch (type) {
+            case kChunkRaw:
+                if (payload != length) {
+                    error = QString("Raw chunk %1 has the wrong size").arg(i);
+                    return false;
+                }
+                break;
+            case kChunkFill: {
+                char fill[4];
+                if (payload != 4 || !readFile(file, chunk.fileOffset, fill, 4)) {
+                    if (error.isEmpty()) error = QString("Fill chunk %1 is malformed").arg(i);
+                    return false;
+                }
+                chunk.fill = qFromLittleEndian<quint32>(fill);
+                break;
+            }
+            case kChunkDontCare:
+            case kChunkCrc32:
+                break;
+            default:
+                error = QString("Unknown chunk type 0x%1").arg(type, 4, 16, QChar('0'));
+                return false;
+            }
+            if (type != kChunkCrc32 && length > 0) {
+                chunks.append(chunk);
+                outputPosition += length;
+            }
+            filePosition += totalSize;
+        }
+        if (outputPosition != totalBlocks * blockSize) {
+            error = "Chunks do not add up to the image size";
+            return false;
+        }
+        expandedSize = outputPosition;
+        return true;
+    }
+
+    QString formatName() const override { return "Android sparse"; }
+    qint64 size() const override { return expandedSize; }
+
+    SourceExtent extentAt(qint64 offset) override {
+        const Chunk *chunk = chunkAt(offset);
+        if (!chunk) {
+            return SourceExtent{};
+        }
+        // A fill of zeros is as good as a hole
+        const bool hole = chunk->type == kChunkDontCare || (chunk->type == kChunkFill && chunk->fill == 0);
+        return SourceExtent{chunk->offset, chunk->length, hole};
+    }
+
+protected:
+    qint64 readData(char *data, qint64 length, qint64 offset) override {
+        const Chunk *chunk = chunkAt(offset);
+        if (!chunk) {
+            return -1;
+        }
+        if (chunk->type == kChunkRaw) {
+            return readFile(file, chunk->fileOffset + (offset - chunk->offset), data, length) ? length : -1;
+        }
+        // Fill chunk: the pattern repeats every 4 bytes from the chunk start
+        char pattern[4];
+        qToLittleEndian(chunk->fill, pattern);
+        const qint64 phase = (offset - chunk->offset) % 4;
+        for (qint64 i = 0; i < length; ++i) {
+            data[i] = pattern[(phase + i) % 4];
+        }
+        return length;
+    }
+
+private:
+    struct Chunk {
+        qint64 offset;
+        qint64 length;
+        quint16 type;
+        qint64 fileOffset;
+        quint32 fill;
+    };
+
+    const Chunk *chunkAt(qint64 offset) const {
+        auto it = std::upper_bound(chunks.cbegin(), chunks.cend(), offset,
+                                   [](qint64 value, const Chunk &chunk) { return value < chunk.offset + chunk.length; });
+        return it != chunks.cend() && it->offset <= offset ? &*it : nullptr;
+    }
+
+    QFile file;
+    QList<Chunk> chunks;
+    qint64 expandedSize = 0;
+};
+} // namespace
+
+namespace ImageSources {
+
+std::unique_ptr<ImageSource> createAndroidSparse() {
+    return std::make_unique<AndroidSparseSource>();
+}
+
+} // namespace ImageSources
@@ -0,0 +1,166 @@
+#include "BatchPlanner.h"
+#include <QSet>
+#include <algorithm>
+#include <functional>
+
+// --- Implementation of PlanStick ---
+
+qint64 PlanStick::millisecondsFor(qint64 bytes) const {
+    // The profile knows the stick's cache, unless its own link is the bottleneck
+    const qint64 predicted = profile.predictMilliseconds(bytes);
+    if (predicted >= 0 && bytesPerSecond >= profile.sustainedBytesPerSecond) {
+        return std::max<qint64>(predicted, 1);
+    }
+    return bytesPerSecond > 0 ? std::max<qint64>(qint64(double(bytes) * 1000.0 / bytesPerSecond), 1) : 1;
+}
+
+// --- Implementation of BatchPlanner ---
+
+void BatchPlanner::addRunning(const PlanStick &stick, qint64 remainingMs) {
+    runningWrites.append(Interval{stick.links, stick.bytesPerSecond, 0, std::max<qint64>(remainingMs, 1)});
+}
+
+BatchPlan BatchPlanner::plan(const QList<PlanTask> &tasks, const QList<PlanStick> &sticks) const {
+    BatchPlan plan;
+    QHash<QString, const PlanStick *> stickOf;
+    for (const PlanStick &stick : sticks) {
+        stickOf.insert(stick.drive, &stick);
+    }
+
+    // Expected duration of each task on an average candidate, for ranking
+    QList<double> duration(tasks.size(), 1.0);
+    for (qsizetype i = 0; i < tasks.size(); ++i) {
+        double total = 0;
+        int count = 0;
+        for (const QString &drive : tasks[i].candidates) {
+            if (const PlanStick *stick = stickOf.value(drive)) {
+                total += double(stick->millisecondsFor(tasks[i].bytes));
+                ++count;
+            }
+        }
+        if (count > 0) duration[i] = std::max(total / count, 1.0);
+    }
+
+    QList<QList<int>> successors(tasks.size());
+    for (qsizetype i = 0; i < tasks.size(); ++i) {
+        for (const int after : tasks[i].after) {
+            if (after >= 0 && after < tasks.size()) successors[after].append(int(i));
+        }
+    }
+    QList<double> rank(tasks.size(), -1.0);
+    std::function<double(int)> upwardRank = [&](int task) {
+        if (rank[task] >= 0) return rank[task];
+        rank[task] = duration[task]; // Also stops a (malformed) cycle
+        double longest = 0;
+        for (const int next : successors[task]) {
+            longest = std::max(longest, upwardRank(next));
+        }
+        return rank[task] = duration[task] + longest;
+    };
+    QList<int> order;
+    for (int i = 0; i < tasks.size(); ++i) {
+        upwardRank(i);
+        order.append(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        if (rank[a] != rank[b]) return rank[a] > rank[b];
+        return tasks[a].image < tasks[b].image;
+    });
+
+    QList<Interval> placed = runningWrites;
+    QHash<int, qint64> finishOf;
+    QSet<QString> used;
+    for (const int task : order) {
+        const PlanTask &current = tasks[task];
+        qint64 ready = current.readyMs;
+        bool blocked = false;
+        for (const int after : current.after) {
+            if (!finishOf.contains(after)) {
+                blocked = true; // Unplaced, or out of range
+                break;
+            }
+            ready = std::max(ready, finishOf.value(after));
+        }
+
+        const PlanStick *best = nullptr;
+        qint64 bestStart = 0;
+        qint64 bestFinish = 0;
+        for (const QString &drive : current.candidates) {
+            const PlanStick *stick = stickOf.value(drive);
+            if (blocked || !stick || used.contains(drive) || (stick->size > 0 && stick->size < std::max(current.size, current.bytes))) {
+                continue;
+            }
+            const qint64 durationMs = stick->millisecondsFor(current.bytes);
+            const qint64 start = earliestStart(placed, *stick, ready, durationMs);
+            const qint64 finish = start + durationMs;
+            // On a tie the slower stick goes, leaving the faster one for a later, bigger image
+            if (!best || finish < bestFinish || (finish == bestFinish && stick->bytesPerSecond < best->bytesPerSecond)) {
+                best = stick;
+                bestStart = start;
+                bestFinish = finish;
+            }
+        }
+        if (!best) {
+            plan.unplaced.append(task);
+            continue;
+        }
+        used.insert(best->drive);
+        finishOf.insert(task, bestFinish);
+        placed.append(Interval{best->links, best->bytesPerSecond, bestStart, bestFinish});
+        plan.entries.append(PlanEntry{task, best->drive, bestStart, bestFinish});
+        plan.makespanMs = std::max(plan.makespanMs, bestFinish);
+    }
+
+    std::stable_sort(plan.entries.begin(), plan.entries.end(),
+                     [](const PlanEntry &a, const PlanEntry &b) { return a.startMs < b.startMs; });
+    return plan;
+}
+
+qint64 BatchPlanner::earliestStart(const QList<Interval> &placed, const PlanStick &stick, qint64 readyMs,
+                                   qint64 durationMs) const {
+    // Room only ever opens up when a write finishes
+    QList<qint64> candidates = {readyMs};
+    qint64 lastFinish = readyMs;
+    for (const Interval &interval : placed) {
+        if (interval.finishMs > readyMs) candidates.append(interval.finishMs);
+        lastFinish = std::max(lastFinish, interval.finishMs);
+    }
+    std::sort(candidates.begin(), candidates.end());
+    for (const qint64 start : candidates) {
+        if (fits(placed, stick, start, start + durationMs)) {
+            return start;
+        }
+    }
+    return lastFinish; // Nothing runs by then, and an idle link admits anything
+}
+
+bool BatchPlanner::fits(const QList<Interval> &placed, const PlanStick &stick, qint64 startMs,
+                        qint64 finishMs) const {
+    // Load only grows when a write starts, so checking those moments suffices
+    QList<qint64> moments = {startMs};
+    for (const Interval &interval : placed) {
+        if (interval.startMs > startMs && interval.startMs < finishMs) moments.append(interval.startMs);
+    }
+    for (const qint64 moment : moments) {
+        int active = 0;
+        QHash<QString, double> load;
+        for (const Interval &interval : placed) {
+            if (interval.startMs > moment || interval.finishMs <= moment) continue;
+            ++active;
+            for (const QString &link : interval.links) {
+                load[link] += interval.bytesPerSecond;
+            }
+        }
+        if (maxRunning > 0 && active >= maxRunning) {
+            return false;
+        }
+        for (const QString &link : stick.links) {
+            const double capacity = linkCapacity.value(link);
+            const double current = load.value(link);
+            if (capacity > 0 && current > 0 && current + stick.bytesPerSecond > capacity) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,96 @@
+#ifndef BATCHPLANNER_H
+#define BATCHPLANNER_H
+
+#include "DeviceProfile.h"
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+/**
+ * @brief A stick the planner may write to.
+ */
+struct PlanStick {
+    QString drive;
+    qint64 size = 0;
+    QStringList links;          // Shared USB links up to the host (UsbLink::name), nearest first
+    double bytesPerSecond = 0;  // Expected sustained rate (see JobQueue::expectedBytesPerSecond)
+    DeviceProfile profile;      // The model's history, if any, for its cache and burst rate
+
+    /**
+     * @brief Expected time to write bytes, from the profile if it has history, otherwise from the rate.
+     */
+    qint64 millisecondsFor(qint64 bytes) const;
+};
+
+/**
+ * @brief An image write to place.
+ */
+struct PlanTask {
+    QString image;           // Writes of the same image start together and share the source's reads
+    qint64 bytes = 0;        // Data bytes the write transfers (holes are usually zeroed without one), for its duration
+    qint64 size = 0;         // Expanded size of the image, which must fit on the stick
+    QStringList candidates;  // Drives the task may go to; one for a fixed drive
+    QList<int> after;        // Tasks (by index) that must finish first
+    qint64 readyMs = 0;      // Earliest start, e.g. when an unplanned dependency finishes
+};
+
+struct PlanEntry {
+    int task = -1;
+    QString drive;
+    qint64 startMs = 0;
+    qint64 finishMs = 0;
+};
+
+struct BatchPlan {
+    QList<PlanEntry> entries; // In order of planned start
+    QList<int> unplaced;      // Tasks no stick is left for (or whose dependencies are unplaced)
+    qint64 makespanMs = 0;
+};
+
+/**
+ * @brief Plans which stick each image write goes to, and in what order, to finish a batch soonest.
+ *
+ * Every stick receives at most one image. The planner simulates JobQueue's
+ * admission: a write reserves its stick's rate on every link up to the host,
+ * and only starts while those links have room (a link with nothing running
+ * admits anything), with at most maxRunning writes at once.
+ *
+ * Tasks are taken in order of their upward rank, i.e. the expected time from
+ * their start to the end of the longest chain of writes waiting for them, so
+ * big images and long dependency chains claim the fast sticks and start
+ * first; ties keep writes of one image next to each other. Each task then goes
+ * to the free candidate stick on which it would finish earliest
+ * (earliest-finish-time list scheduling). Planning is cheap, so callers
+ * simply plan again when sticks fail, appear or finish early.
+ */
+class BatchPlanner {
+public:
+    void setLinkCapacity(const QHash<QString, double> &bytesPerSecond) { linkCapacity = bytesPerSecond; }
+    void setMaxRunning(int count) { maxRunning = count; }
+
+    /**
+     * @brief Accounts for a write already running on a stick until remainingMs from now.
+     */
+    void addRunning(const PlanStick &stick, qint64 remainingMs);
+
+    BatchPlan plan(const QList<PlanTask> &tasks, const QList<PlanStick> &sticks) const;
+
+private:
+    struct Interval {
+        QStringList links;
+        double bytesPerSecond = 0;
+        qint64 startMs = 0;
+        qint64 finishMs = 0;
+    };
+
+    qint64 earliestStart(const QList<Interval> &placed, const PlanStick &stick, qint64 readyMs,
+                         qint64 durationMs) const;
+    bool fits(const QList<Interval> &placed, const PlanStick &stick, qint64 startMs, qint64 finishMs) const;
+
+    QHash<QString, double> linkCapacity;
+    int maxRunning = 0;
+    QList<Interval> runningWrites;
+};
+
+#endif // BATCHPLANNER_H
@@ -0,0 +1,246 @@
+#include "BatchScheduler.h"
+#include "ImageSource.h"
+#include "UsbTopology.h"
+#include <QDebug>
+#include <QFileInfo>
+#include <QTimer>
+#include <algorithm>
+
+// --- Implementation of BatchScheduler ---
+
+BatchScheduler::BatchScheduler(JobQueue *queue, QObject *parent)
+    : QObject(parent), queue(queue), enumerator(new DiskUtility(this)), pollTimer(new QTimer(this)) {
+    pollTimer->setInterval(kPollIntervalMs);
+    connect(pollTimer, &QTimer::timeout, this, &BatchScheduler::pollDrives);
+    connect(queue, &JobQueue::jobChanged, this, &BatchScheduler::observe);
+
+    driveTable = enumerator->enumerateRemovableDrives();
+    const QList<Job> jobs = queue->jobs();
+    QSet<qint64> liveBatches;
+    for (const Job &job : jobs) {
+        if (job.batch != 0 && !job.isFinished()) liveBatches.insert(job.batch);
+    }
+    for (const Job &job : jobs) {
+        // Batches that are over hold on to no drives
+        if (!liveBatches.contains(job.batch)) continue;
+        if (job.state == JobState::Running || (job.isFinished() && job.started.isValid())) markSpent(job);
+        if (!job.isFinished()) lastState.insert(job.id, job.state);
+    }
+    scheduleReplan();
+}
+
+QList<qint64> BatchScheduler::submit(const JobManifest &manifest, const QList<DriveInfo> &drives,
+                                     QString *errorMessage) {
+    QList<Job> jobs;
+    if (!manifest.expand(drives, &jobs, errorMessage)) {
+        return {};
+    }
+    const QList<qint64> ids = queue->submitBatch(jobs, errorMessage);
+    if (ids.isEmpty()) {
+        return {};
+    }
+    driveTable = drives;
+    replan(); // Before the queue's first start pass, so the batch starts in planned order
+    return ids;
+}
+
+void BatchScheduler::observe(const Job &job) {
+    if (job.batch == 0) {
+        return;
+    }
+    if (job.state == JobState::Running) {
+        markSpent(job);
+    }
+    const auto it = lastState.constFind(job.id);
+    if (it != lastState.cend() && *it == job.state) {
+        return; // Progress, or an assignment of our own
+    }
+    if (job.isFinished()) {
+        lastState.remove(job.id);
+        const QList<Job> jobs = queue->jobs();
+        if (std::none_of(jobs.cbegin(), jobs.cend(), [&job](const Job &j) { return j.batch == job.batch && !j.isFinished(); })) {
+            spent.remove(job.batch); // The batch is over
+        }
+    } else {
+        lastState.insert(job.id, job.state);
+    }
+    scheduleReplan();
+}
+
+void BatchScheduler::markSpent(const Job &job) {
+    for (const QString &drive : job.drives) spent[job.batch].insert(drive);
+}
+
+void BatchScheduler::pollDrives() {
+    const QList<DriveInfo> table = enumerator->enumerateRemovableDrives();
+    QSet<QString> now;
+    for (const DriveInfo &drive : table) {
+        now.insert(drive.devicePath);
+    }
+    QSet<QString> before;
+    for (const DriveInfo &drive : std::as_const(driveTable)) {
+        before.insert(drive.devicePath);
+    }
+    if (now == before) {
+        return;
+    }
+    for (const QString &gone : before - now) {
+        for (QSet<QString> &drives : spent) {
+            drives.remove(gone); // Whatever shows up under this path next is another stick
+        }
+    }
+    qDebug() << "Drive table changed: added" << (now - before).values() << "removed" << (before - now).values();
+    driveTable = table;
+    scheduleReplan();
+}
+
+void BatchScheduler::scheduleReplan() {
+    if (replanPending) {
+        return;
+    }
+    replanPending = true;
+    // Coalesces the bursts of changes a finishing or failing job causes
+    QMetaObject::invokeMethod(this, [this]() { if (replanPending) replan(); }, Qt::QueuedConnection);
+}
+
+void BatchScheduler::replan() {
+    replanPending = false;
+    const QList<Job> jobs = queue->jobs();
+
+    QList<const Job *> queued;
+    QSet<QString> taken; // By running jobs and queued ones on fixed drives
+    for (const Job &job : jobs) {
+        if (job.batch != 0 && job.state == JobState::Queued) {
+            queued.append(&job);
+        }
+        const bool movable = job.state == JobState::Queued && job.isPooled();
+        if (!job.isFinished() && !movable) {
+            for (const QString &drive : job.drives) taken.insert(drive);
+        }
+    }
+    if (queued.isEmpty()) {
+        pollTimer->stop();
+        return;
+    }
+    if (!pollTimer->isActive()) pollTimer->start();
+
+    QHash<QString, double> linkCapacity;
+    QList<PlanStick> sticks;
+    for (const DriveInfo &drive : std::as_const(driveTable)) {
+        sticks.append(stickFor(drive, &linkCapacity));
+    }
+    const auto stickOf = [&sticks](const QString &drive) {
+        return std::find_if(sticks.cbegin(), sticks.cend(), [&drive](const PlanStick &s) { return s.drive == drive; });
+    };
+
+    BatchPlanner planner;
+    planner.setLinkCapacity(linkCapacity);
+    planner.setMaxRunning(queue->runningLimit());
+    QHash<qint64, qint64> remainingOf; // Of running jobs, in milliseconds
+    for (const Job &job : jobs) {
+        if (job.state != JobState::Running || job.drives.isEmpty()) continue;
+        const auto stick = stickOf(job.drives.first());
+        if (stick == sticks.cend()) continue;
+        qint64 remaining = job.progress.secondsRemaining >= 0 ? job.progress.secondsRemaining * 1000 : -1;
+        if (remaining < 0) {
+            // Engines count in the units they write, which skip holes
+            qint64 total = job.progress.bytesTotal;
+            if (total <= 0 && job.kind == "image") total = bytesOf(job.imagePath).data;
+            remaining = stick->millisecondsFor(std::max<qint64>(total - job.progress.bytesDone, 0));
+        }
+        planner.addRunning(*stick, remaining);
+        remainingOf.insert(job.id, remaining);
+    }
+
+    QHash<qint64, int> taskOf;
+    for (int i = 0; i < queued.size(); ++i) {
+        taskOf.insert(queued[i]->id, i);
+    }
+    QList<PlanTask> tasks;
+    for (const Job *job : std::as_const(queued)) {
+        PlanTask task;
+        task.image = job->imagePath;
+        if (job->kind == "image") {
+            const ImageBytes bytes = bytesOf(job->imagePath);
+            task.bytes = bytes.data;
+            task.size = bytes.expanded;
+        }
+        // A pooled job with a checkpoint stays on its drive, where it can resume
+        const bool pinned = !job->isPooled() || (!job->drives.isEmpty() && job->checkpoints.contains(job->drives.first()));
+        if (pinned) {
+            task.candidates = job->drives.mid(0, 1);
+        } else {
+            const TargetSelector selector = TargetSelector::fromJson(job->pool);
+            for (const DriveInfo &drive : std::as_const(driveTable)) {
+                if (!spent.value(job->batch).contains(drive.devicePath) && !taken.contains(drive.devicePath) && selector.matches(drive)) {
+                    task.candidates.append(drive.devicePath);
+                }
+            }
+        }
+        for (const qint64 after : job->after) {
+            if (taskOf.contains(after)) task.after.append(taskOf.value(after));
+            task.readyMs = std::max(task.readyMs, remainingOf.value(after));
+        }
+        tasks.append(task);
+    }
+
+    const BatchPlan plan = planner.plan(tasks, sticks);
+    makespanMs = plan.makespanMs;
+
+    // Release moved drives first, so no assignment finds its drive still held by another job
+    QHash<int, QString> driveOfTask;
+    for (const PlanEntry &entry : plan.entries) {
+        driveOfTask.insert(entry.task, entry.drive);
+    }
+    for (int i = 0; i < queued.size(); ++i) {
+        const Job *job = queued[i];
+        if (job->isPooled() && !job->drives.isEmpty() && job->drives.first() != driveOfTask.value(i)) {
+            queue->assign(job->id, QString());
+        }
+    }
+    int rank = 0;
+    for (const PlanEntry &entry : plan.entries) {
+        const qint64 id = queued[entry.task]->id;
+        if (queued[entry.task]->isPooled()) queue->assign(id, entry.drive);
+        queue->setRank(id, ++rank);
+    }
+    for (const int task : plan.unplaced) {
+        queue->setRank(queued[task]->id, rank + 1);
+    }
+    qDebug() << "Planned" << plan.entries.size() << "batch jobs on" << sticks.size() << "drives, expected to take"
+             << plan.makespanMs / 1000 << "s;" << plan.unplaced.size() << "wait for drives";
+}
+
+PlanStick BatchScheduler::stickFor(const DriveInfo &drive, QHash<QString, double> *linkCapacity) {
+    PlanStick stick;
+    stick.drive = drive.devicePath;
+    stick.size = drive.size;
+    const UsbLocation usb = UsbTopology::locate(drive.devicePath);
+    for (const UsbLink &link : usb.upstream) {
+        stick.links.append(link.name);
+        linkCapacity->insert(link.name, link.bytesPerSecond());
+    }
+    const std::optional<DeviceProfile> profile = DeviceProfileStore().find(enumerator->modelOf(drive.devicePath));
+    if (profile) stick.profile = *profile;
+    stick.bytesPerSecond = JobQueue::expectedBytesPerSecond(profile, usb);
+    return stick;
+}
+
+BatchScheduler::ImageBytes BatchScheduler::bytesOf(const QString &imagePath) {
+    const auto cached = imageBytes.constFind(imagePath);
+    if (cached != imageBytes.cend()) {
+        return *cached;
+    }
+    // Compressed and sparse images expand on the stick, but their holes are zeroed without a data transfer
+    // on most sticks, so time goes by data bytes; fall back to the file's size
+    ImageBytes bytes;
+    const std::unique_ptr<ImageSource> source = ImageSource::openImage(imagePath);
+    if (source) {
+        bytes.expanded = source->size();
+        bytes.data = source->dataBytes();
+    }
+    if (bytes.expanded <= 0) bytes.expanded = QFileInfo(imagePath).size();
+    if (bytes.data <= 0) bytes.data = bytes.expanded;
+    imageBytes.insert(imagePath, bytes);
+    return bytes;
+}
@@ -0,0 +1,82 @@
+#ifndef BATCHSCHEDULER_H
+#define BATCHSCHEDULER_H
+
+#include "BatchPlanner.h"
+#include "DiskUtility.h"
+#include "JobManifest.h"
+#include "JobQueue.h"
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QString>
+
+class QTimer;
+
+/**
+ * @brief Keeps the batches in a JobQueue on an earliest-finish plan (see BatchPlanner).
+ *
+ * The queue holds all the state: pooled jobs carry the selector of the
+ * sticks they may use, and the scheduler assigns each a stick and gives
+ * every queued batch job its rank in the planned start order. It plans again
+ * whenever that plan goes stale: when a batch is submitted, when a batch job
+ * starts, finishes or fails (a failed pooled job comes back without a drive,
+ * see JobQueue::kPooledAttempts), and when sticks are plugged in or pulled,
+ * which it polls for while batch jobs are waiting. Queued jobs may move to
+ * a stick that turned up later if they finish sooner there.
+ *
+ * A stick receives one image per batch: once a job of a batch has started on
+ * a drive, the drive is spent for that batch until it disappears from the
+ * drive table, i.e. until the stick is swapped, or until the batch is over.
+ */
+class BatchScheduler : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr int kPollIntervalMs = 3000;
+
+    /**
+     * @brief Attach the queue's journal first, so batches it resumes are planned too.
+     */
+    explicit BatchScheduler(JobQueue *queue, QObject *parent = nullptr);
+
+    /**
+     * @brief Expands a manifest against the drive table, queues it and plans it.
+     * @return The jobs' ids (the first is the batch id), or an empty list.
+     */
+    QList<qint64> submit(const JobManifest &manifest, const QList<DriveInfo> &drives,
+                         QString *errorMessage = nullptr);
+
+    /**
+     * @brief Expected time from the last plan until every planned job has finished.
+     */
+    qint64 plannedMakespanMs() const { return makespanMs; }
+
+private slots:
+    void observe(const Job &job);
+    void pollDrives();
+
+private:
+    void scheduleReplan();
+    void replan();
+    struct ImageBytes {
+        qint64 data = 0;     // Written, for time estimates
+        qint64 expanded = 0; // Needed on the stick
+    };
+
+    PlanStick stickFor(const DriveInfo &drive, QHash<QString, double> *linkCapacity);
+    ImageBytes bytesOf(const QString &imagePath);
+    void markSpent(const Job &job);
+
+    JobQueue *queue;
+    DiskUtility *enumerator;
+    QTimer *pollTimer;
+    QList<DriveInfo> driveTable;
+    QHash<qint64, QSet<QString>> spent; // Drives a job of the batch has started on, by batch id
+    QHash<qint64, JobState> lastState;  // Of unfinished batch jobs, to tell state changes from progress
+    QHash<QString, ImageBytes> imageBytes; // By image path
+    bool replanPending = false;
+    qint64 makespanMs = 0;
+};
+
+#endif // BATCHSCHEDULER_H
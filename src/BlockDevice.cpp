@@ -0,0 +1,372 @@
+#include "BlockDevice.h"
+#include "IoStats.h"
+#include "Probes.h"
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#elif defined(Q_OS_WIN)
+#include <io.h>
+#include <qt_windows.h>
+#include <winioctl.h>
+#else
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+// --- Implementation of AlignedBuffer ---
+
+AlignedBuffer::AlignedBuffer(qsizetype size, qsizetype alignment) : length(size) {
+#ifdef Q_OS_WIN
+    buffer = static_cast<char *>(_aligned_malloc(size_t(size), size_t(alignment)));
+#else
+    void *memory = nullptr;
+    if (posix_memalign(&memory, size_t(alignment), size_t(size)) == 0) {
+        buffer = static_cast<char *>(memory);
+    }
+#endif
+    if (!buffer) {
+        qFatal("AlignedBuffer: out of memory allocating %lld bytes", static_cast<long long>(size));
+    }
+}
+
+AlignedBuffer::~AlignedBuffer() {
+#ifdef Q_OS_WIN
+    _aligned_free(buffer);
+#else
+    free(buffer);
+#endif
+}
+
+// --- Implementation of BlockDevice ---
+
+BlockDevice::~BlockDevice() {
+    close();
+}
+
+qint64 BlockDevice::readAt(char *data, qint64 length, qint64 offset, QString *errorMessage) {
+    if (!ioStats) {
+        return readRaw(data, length, offset, errorMessage);
+    }
+    QElapsedTimer timer;
+    timer.start();
+    const qint64 result = readRaw(data, length, offset, errorMessage);
+    ioStats->record(IoKind::Read, length, timer.nsecsElapsed());
+    return result;
+}
+
+qint64 BlockDevice::writeAt(const char *data, qint64 length, qint64 offset, QString *errorMessage) {
+    if (!ioStats) {
+        return writeRaw(data, length, offset, errorMessage);
+    }
+    QElapsedTimer timer;
+    timer.start();
+    const qint64 result = writeRaw(data, length, offset, errorMessage);
+    ioStats->record(IoKind::Write, length, timer.nsecsElapsed());
+    return result;
+}
+
+#ifdef Q_OS_LINUX
+
+bool BlockDevice::open(const QString &path, bool writable, bool wantDirect, QString *errorMessage) {
+    close();
+    devicePath = path;
+    const QByteArray nativePath = QFile::encodeName(path);
+    const int baseFlags = (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC;
+
+    direct = wantDirect;
+    fd = ::open(nativePath.constData(), baseFlags | (direct ? O_DIRECT : 0));
+    if (fd < 0 && direct && errno == EINVAL) {
+        // Filesystem without O_DIRECT support (tmpfs, some FUSE mounts)
+        direct = false;
+        fd = ::open(nativePath.constData(), baseFlags);
+    }
+    if (fd < 0) {
+        lastError = QString("Cannot open %1: %2").arg(path, QString::fromLocal8Bit(strerror(errno)));
+        if (errorMessage) *errorMessage = lastError;
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        lastError = QString("Cannot stat %1: %2").arg(path, QString::fromLocal8Bit(strerror(errno)));
+        if (errorMessage) *errorMessage = lastError;
+        close();
+        return false;
+    }
+    blockDevice = S_ISBLK(info.st_mode);
+    if (blockDevice) {
+        quint64 bytes = 0;
+        if (ioctl(fd, BLKGETSIZE64, &bytes) != 0) {
+            // A size of 0 would make every capacity check pass
+            lastError = QString("Cannot read the size of %1: %2").arg(path, QString::fromLocal8Bit(strerror(errno)));
+            if (errorMessage) *errorMessage = lastError;
+            close();
+            return false;
+        }
+        deviceSize = qint64(bytes);
+        int sectorSize = 512;
+        if (ioctl(fd, BLKSSZGET, &sectorSize) == 0 && sectorSize > 0) {
+            blockSize = sectorSize;
+        }
+    } else {
+        deviceSize = info.st_size;
+        blockSize = 512;
+    }
+    return true;
+}
+
+void BlockDevice::close() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool BlockDevice::isOpen() const {
+    return fd >= 0;
+}
+
+qint64 BlockDevice::readRaw(char *data, qint64 length, qint64 offset, QString *errorMessage) {
+    qint64 done = 0;
+    while (done < length) {
+        const ssize_t count = pread(fd, data + done, size_t(length - done), off_t(offset + done));
+        if (count < 0) {
+            if (errno == EINTR) {
+                INFERNO_PROBE4(io_retry, 0, offset, done, EINTR);
+                continue;
+            }
+            if (errorMessage) {
+                *errorMessage = QString("Read error at offset %1: %2").arg(offset + done).arg(QString::fromLocal8Bit(strerror(errno)));
+            }
+            return -1;
+        }
+        if (count == 0) {
+            break; // End of device
+        }
+        done += count;
+        if (done < length) {
+            INFERNO_PROBE4(io_retry, 0, offset, done, 0); // Short read, continued
+        }
+    }
+    return done;
+}
+
+qint64 BlockDevice::writeRaw(const char *data, qint64 length, qint64 offset, QString *errorMessage) {
+    qint64 done = 0;
+    while (done < length) {
+        const ssize_t count = pwrite(fd, data + done, size_t(length - done), off_t(offset + done));
+        if (count < 0) {
+            if (errno == EINTR) {
+                INFERNO_PROBE4(io_retry, 1, offset, done, EINTR);
+                continue;
+            }
+            if (errorMessage) {
+                *errorMessage = QString("Write error at offset %1: %2").arg(offset + done).arg(QString::fromLocal8Bit(strerror(errno)));
+            }
+            return -1;
+        }
+        if (count == 0) {
+            if (errorMessage) *errorMessage = QString("No space left at offset %1").arg(offset + done);
+            return -1;
+        }
+        done += count;
+        if (done < length) {
+            INFERNO_PROBE4(io_retry, 1, offset, done, 0); // Short write, continued
+        }
+    }
+    return done;
+}
+
+bool BlockDevice::sync() {
+    if (fsync(fd) != 0) {
+        lastError = QString("Flush failed: %1").arg(QString::fromLocal8Bit(strerror(errno)));
+        return false;
+    }
+    return true;
+}
+
+bool BlockDevice::discard(qint64 offset, qint64 length) {
+    return rangeIoctl(BLKDISCARD, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, "Discard", offset, length);
+}
+
+bool BlockDevice::secureDiscard(qint64 offset, qint64 length) {
+    return rangeIoctl(BLKSECDISCARD, -1, "Secure discard", offset, length);
+}
+
+bool BlockDevice::zeroOut(qint64 offset, qint64 length) {
+    // A punched hole reads back as zeros, and is what FALLOC_FL_ZERO_RANGE would do on most filesystems anyway
+    return rangeIoctl(BLKZEROOUT, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, "Zeroing", offset, length);
+}
+
+bool BlockDevice::rangeIoctl(unsigned long request, int fallocateMode, const char *name, qint64 offset, qint64 length) {
+    // Only whole logical blocks can be discarded or zeroed
+    const qint64 first = (offset + blockSize - 1) / blockSize * blockSize;
+    const qint64 last = std::min(offset + length, deviceSize) / blockSize * blockSize;
+    if (last <= first) {
+        return true;
+    }
+
+    int result = 0;
+    if (blockDevice) {
+        quint64 range[2] = {quint64(first), quint64(last - first)};
+        result = ioctl(fd, request, &range);
+    } else if (fallocateMode >= 0) {
+        result = fallocate(fd, fallocateMode, off_t(first), off_t(last - first));
+    } else {
+        errno = EOPNOTSUPP;
+        result = -1;
+    }
+    if (result != 0) {
+        lastError = QString("%1 of %2 bytes at offset %3 failed: %4")
+                        .arg(name).arg(last - first).arg(first).arg(QString::fromLocal8Bit(strerror(errno)));
+        return false;
+    }
+    return true;
+}
+
+#else // Generic QFile fallback
+
+namespace {
+/**
+ * @brief One positional read or write on file's native handle; -1 with the OS error set on failure.
+ *
+ * QFile's seek() and read()/write() share one file position, so several
+ * writer threads would land their requests at each other's offsets.
+ */
+qint64 transferAt(QFile &file, bool write, char *data, qint64 length, qint64 offset) {
+#ifdef Q_OS_WIN
+    const HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(file.handle()));
+    OVERLAPPED position = {};
+    position.Offset = DWORD(quint64(offset) & 0xffffffff);
+    position.OffsetHigh = DWORD(quint64(offset) >> 32);
+    const DWORD count = DWORD(std::min<qint64>(length, 1 << 30));
+    DWORD done = 0;
+    const BOOL ok = write ? WriteFile(handle, data, count, &done, &position) : ReadFile(handle, data, count, &done, &position);
+    if (!ok) {
+        return !write && GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+    }
+    return qint64(done);
+#else
+    ssize_t done;
+    do {
+        done = write ? pwrite(file.handle(), data, size_t(length), off_t(offset))
+                     : pread(file.handle(), data, size_t(length), off_t(offset));
+    } while (done < 0 && errno == EINTR);
+    return qint64(done);
+#endif
+}
+} // namespace
+
+bool BlockDevice::open(const QString &path, bool writable, bool wantDirect, QString *errorMessage) {
+    Q_UNUSED(wantDirect);
+    close();
+    devicePath = path;
+    direct = false;
+    file.setFileName(path);
+    if (!file.open((writable ? QIODevice::ReadWrite : QIODevice::ReadOnly) | QIODevice::Unbuffered)) {
+        lastError = QString("Cannot open %1: %2").arg(path, file.errorString());
+        if (errorMessage) *errorMessage = lastError;
+        return false;
+    }
+    deviceSize = file.size();
+#ifdef Q_OS_WIN
+    if (deviceSize == 0) {
+        // A disk such as \\.\PhysicalDrive1 has no file size; ask the disk driver
+        GET_LENGTH_INFORMATION length = {};
+        DWORD returned = 0;
+        if (DeviceIoControl(reinterpret_cast<HANDLE>(_get_osfhandle(file.handle())), IOCTL_DISK_GET_LENGTH_INFO,
+                            nullptr, 0, &length, sizeof(length), &returned, nullptr)) {
+            deviceSize = qint64(length.Length.QuadPart);
+        }
+    }
+#endif
+    return true;
+}
+
+void BlockDevice::close() {
+    file.close();
+}
+
+bool BlockDevice::isOpen() const {
+    return file.isOpen();
+}
+
+qint64 BlockDevice::readRaw(char *data, qint64 length, qint64 offset, QString *errorMessage) {
+    qint64 done = 0;
+    while (done < length) {
+        const qint64 count = transferAt(file, false, data + done, length - done, offset + done);
+        if (count < 0) {
+            if (errorMessage) *errorMessage = QString("Read error at offset %1: %2").arg(offset + done).arg(qt_error_string());
+            return -1;
+        }
+        if (count == 0) {
+            break; // End of device
+        }
+        done += count;
+    }
+    return done;
+}
+
+qint64 BlockDevice::writeRaw(const char *data, qint64 length, qint64 offset, QString *errorMessage) {
+    qint64 done = 0;
+    while (done < length) {
+        const qint64 count = transferAt(file, true, const_cast<char *>(data) + done, length - done, offset + done);
+        if (count < 0) {
+            if (errorMessage) *errorMessage = QString("Write error at offset %1: %2").arg(offset + done).arg(qt_error_string());
+            return -1;
+        }
+        if (count == 0) {
+            if (errorMessage) *errorMessage = QString("No space left at offset %1").arg(offset + done);
+            return -1;
+        }
+        done += count;
+    }
+    return done;
+}
+
+bool BlockDevice::sync() {
+    // Writes go to the native handle, past QFile's buffer, so flush that handle
+#ifdef Q_OS_WIN
+    const bool ok = FlushFileBuffers(reinterpret_cast<HANDLE>(_get_osfhandle(file.handle())));
+#else
+    const bool ok = fsync(file.handle()) == 0;
+#endif
+    if (!ok) {
+        lastError = QString("Flush failed: %1").arg(qt_error_string());
+        return false;
+    }
+    return true;
+}
+
+bool BlockDevice::discard(qint64 offset, qint64 length) {
+    Q_UNUSED(offset);
+    Q_UNUSED(length);
+    lastError = "Discard is not supported on this platform";
+    return false;
+}
+
+bool BlockDevice::secureDiscard(qint64 offset, qint64 length) {
+    Q_UNUSED(offset);
+    Q_UNUSED(length);
+    lastError = "Secure discard is not supported on this platform";
+    return false;
+}
+
+bool BlockDevice::zeroOut(qint64 offset, qint64 length) {
+    Q_UNUSED(offset);
+    Q_UNUSED(length);
+    lastError = "Zeroing is not supported on this platform";
+    return false;
+}
+
+#endif
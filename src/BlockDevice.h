@@ -0,0 +1,153 @@
+#ifndef BLOCKDEVICE_H
+#define BLOCKDEVICE_H
+
+#include <QString>
+#include <QFile>
+
+class IoStats;
+
+/**
+ * @brief Heap buffer aligned for direct (unbuffered) device I/O.
+ */
+class AlignedBuffer {
+public:
+    static constexpr qsizetype kDefaultAlignment = 4096;
+
+    explicit AlignedBuffer(qsizetype size, qsizetype alignment = kDefaultAlignment);
+    ~AlignedBuffer();
+
+    AlignedBuffer(const AlignedBuffer &) = delete;
+    AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+
+    char *data() { return buffer; }
+    const char *data() const { return buffer; }
+    qsizetype size() const { return length; }
+
+private:
+    char *buffer = nullptr;
+    qsizetype length = 0;
+};
+
+/**
+ * @brief Positional reads and writes on a raw device (or an image file).
+ *
+ * On Linux the device is opened with O_DIRECT when requested, so large
+ * transfers bypass the page cache and go straight to the stick; callers must
+ * then use AlignedBuffer and multiples of logicalBlockSize(). If the target
+ * does not support O_DIRECT (e.g., a file on tmpfs), it silently falls back
+ * to buffered I/O. Other platforms use QFile, with positional reads and
+ * writes on its native handle.
+ *
+ * readAt() and writeAt() may be called from several threads at once (the
+ * write queue keeps several requests in flight); they report failures
+ * through their own errorMessage rather than errorString().
+ */
+class BlockDevice {
+public:
+    BlockDevice() = default;
+    ~BlockDevice();
+
+    BlockDevice(const BlockDevice &) = delete;
+    BlockDevice &operator=(const BlockDevice &) = delete;
+
+    /**
+     * @brief Opens a device or file.
+     * @param path Device path (e.g., /dev/sdb) or file path.
+     * @param writable Open for writing as well as reading.
+     * @param direct Request unbuffered I/O (O_DIRECT).
+     * @param errorMessage Receives a description of the failure, if any.
+     * @return bool True on success.
+     */
+    bool open(const QString &path, bool writable, bool direct, QString *errorMessage = nullptr);
+    void close();
+    bool isOpen() const;
+
+    QString path() const { return devicePath; }
+    qint64 size() const { return deviceSize; }
+    int logicalBlockSize() const { return blockSize; }
+    bool isDirect() const { return direct; }
+
+    /**
+     * @brief Reads up to length bytes at offset, retrying short reads. Thread-safe.
+     * @param errorMessage Receives a description of the failure, if any.
+     * @return qint64 Bytes read (less than length only at the end), or -1 on error.
+     */
+    qint64 readAt(char *data, qint64 length, qint64 offset, QString *errorMessage = nullptr);
+
+    /**
+     * @brief Writes length bytes at offset, retrying short writes. Thread-safe.
+     * @param errorMessage Receives a description of the failure, if any.
+     * @return qint64 Bytes written, or -1 on error.
+     */
+    qint64 writeAt(const char *data, qint64 length, qint64 offset, QString *errorMessage = nullptr);
+
+    /**
+     * @brief Flushes device caches to stable storage.
+     */
+    bool sync();
+
+    /**
+     * @brief Tells the device a range is unused (BLKDISCARD, or a punched hole in a file).
+     *
+     * Trimmed flash can be written without a read-modify-write of its erase
+     * blocks. What discarded blocks read back as is up to the device, so
+     * callers must not assume zeros. The range is shrunk to whole logical
+     * blocks. Linux only; fails with an error elsewhere or if unsupported.
+     */
+    bool discard(qint64 offset, qint64 length);
+
+    /**
+     * @brief Discards a range so that its data is unrecoverable (BLKSECDISCARD). Linux only.
+     */
+    bool secureDiscard(qint64 offset, qint64 length);
+
+    /**
+     * @brief Makes a range read back as zeros (BLKZEROOUT, or a zeroed range in a file).
+     *
+     * Devices with a write-zeroes or unmap-zeroes command do this without
+     * transferring data; otherwise the kernel writes the zeros itself. Linux
+     * only; fails with an error elsewhere.
+     */
+    bool zeroOut(qint64 offset, qint64 length);
+
+    /**
+     * @brief Why the last open(), sync(), discard(), secureDiscard() or zeroOut() failed.
+     */
+    QString errorString() const { return lastError; }
+
+    /**
+     * @brief Records the latency and size of every readAt() and writeAt() in stats; null to stop.
+     *
+     * stats must outlive the device or be detached first. Calls may come
+     * from several threads at once (see IoStats).
+     */
+    void setIoStats(IoStats *stats) { ioStats = stats; }
+
+#ifdef Q_OS_LINUX
+    /**
+     * @brief The raw file descriptor, for ioctls (Linux only).
+     */
+    int handle() const { return fd; }
+#endif
+
+private:
+    QString devicePath;
+    qint64 deviceSize = 0;
+    int blockSize = 512;
+    bool direct = false;
+    QString lastError;
+    IoStats *ioStats = nullptr;
+
+    qint64 readRaw(char *data, qint64 length, qint64 offset, QString *errorMessage);
+    qint64 writeRaw(const char *data, qint64 length, qint64 offset, QString *errorMessage);
+#ifdef Q_OS_LINUX
+    bool rangeIoctl(unsigned long request, int fallocateMode, const char *name, qint64 offset, qint64 length);
+
+    int fd = -1;
+    bool blockDevice = false;
+#else
+    QFile file;
+#endif
+};
+
+#endif // BLOCKDEVICE_H
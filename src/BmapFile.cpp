@@ -0,0 +1,142 @@
+#include "BmapFile.h"
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QStringList>
+#include <QXmlStreamReader>
+#include <algorithm>
+
+namespace {
+bool fail(QString *errorMessage, const QString &message) {
+    if (errorMessage) *errorMessage = message;
+    return false;
+}
+} // namespace
+
+// --- Implementation of BmapFile ---
+
+bool BmapFile::load(const QString &path, QString *errorMessage) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return fail(errorMessage, file.errorString());
+    }
+    const QByteArray contents = file.readAll();
+
+    *this = BmapFile();
+    QString fileChecksum;
+    QXmlStreamReader xml(contents);
+    if (!xml.readNextStartElement() || xml.name() != QLatin1String("bmap")) {
+        return fail(errorMessage, QString("%1 is not a bmap file").arg(path));
+    }
+    formatVersion = xml.attributes().value("version").toString();
+    const int major = formatVersion.section('.', 0, 0).toInt();
+    if (major < 1 || major > 2) {
+        return fail(errorMessage, QString("Unsupported bmap version %1").arg(formatVersion));
+    }
+    algorithm = QCryptographicHash::Sha1; // 1.x files are always SHA-1
+
+    while (xml.readNextStartElement()) {
+        const QStringView name = xml.name();
+        if (name == QLatin1String("ImageSize")) {
+            size = xml.readElementText().trimmed().toLongLong();
+        } else if (name == QLatin1String("BlockSize")) {
+            block = xml.readElementText().trimmed().toLongLong();
+        } else if (name == QLatin1String("BlocksCount")) {
+            blocks = xml.readElementText().trimmed().toLongLong();
+        } else if (name == QLatin1String("ChecksumType")) {
+            const QString type = xml.readElementText().trimmed().toLower();
+            if (type == "sha1") {
+                algorithm = QCryptographicHash::Sha1;
+            } else if (type == "sha256") {
+                algorithm = QCryptographicHash::Sha256;
+            } else {
+                return fail(errorMessage, QString("Unsupported bmap checksum type %1").arg(type));
+            }
+        } else if (name == QLatin1String("BmapFileChecksum") || name == QLatin1String("BmapFileSHA1")) {
+            fileChecksum = xml.readElementText().trimmed();
+        } else if (name == QLatin1String("BlockMap")) {
+            while (xml.readNextStartElement()) {
+                if (xml.name() != QLatin1String("Range")) {
+                    xml.skipCurrentElement();
+                    continue;
+                }
+                BmapRange range;
+                const QXmlStreamAttributes attributes = xml.attributes();
+                const QStringView digest = attributes.hasAttribute("chksum") ? attributes.value("chksum")
+                                                                             : attributes.value("sha1");
+                range.checksum = QByteArray::fromHex(digest.toLatin1());
+                const QString text = xml.readElementText().trimmed();
+                bool firstOk = false;
+                bool lastOk = false;
+                range.firstBlock = text.section('-', 0, 0).trimmed().toLongLong(&firstOk);
+                range.lastBlock = text.contains('-') ? text.section('-', 1, 1).trimmed().toLongLong(&lastOk)
+                                                     : range.firstBlock;
+                if (!firstOk || (text.contains('-') && !lastOk) || range.lastBlock < range.firstBlock) {
+                    return fail(errorMessage, QString("Bad bmap range \"%1\"").arg(text));
+                }
+                mappedRanges.append(range);
+            }
+        } else {
+            xml.skipCurrentElement(); // MappedBlocksCount and anything newer
+        }
+    }
+    if (xml.hasError()) {
+        return fail(errorMessage, QString("Malformed bmap: %1").arg(xml.errorString()));
+    }
+    if (size <= 0 || block <= 0 || (block & (block - 1)) != 0) {
+        return fail(errorMessage, "Bmap has no valid image or block size");
+    }
+
+    // The file checksum is taken with its own value replaced by zeros
+    if (!fileChecksum.isEmpty()) {
+        QByteArray zeroed = contents;
+        const QByteArray value = fileChecksum.toLatin1();
+        const qsizetype at = zeroed.indexOf(value);
+        if (at >= 0) {
+            zeroed.replace(at, value.size(), QByteArray(value.size(), '0'));
+        }
+        const QCryptographicHash::Algorithm fileAlgorithm =
+            value.size() == 40 ? QCryptographicHash::Sha1 : QCryptographicHash::Sha256;
+        if (QCryptographicHash::hash(zeroed, fileAlgorithm).toHex() != value.toLower()) {
+            return fail(errorMessage, QString("%1 is corrupt (checksum mismatch)").arg(QFileInfo(path).fileName()));
+        }
+    }
+
+    std::sort(mappedRanges.begin(), mappedRanges.end(),
+              [](const BmapRange &a, const BmapRange &b) { return a.firstBlock < b.firstBlock; });
+    const int digestSize = QCryptographicHash::hashLength(algorithm);
+    checksums = !mappedRanges.isEmpty();
+    qint64 previousEnd = 0;
+    for (BmapRange &range : mappedRanges) {
+        range.offset = range.firstBlock * block;
+        range.length = std::min((range.lastBlock + 1) * block, size) - range.offset;
+        if (range.offset < previousEnd || range.length <= 0) {
+            return fail(errorMessage, QString("Bmap range %1-%2 overlaps or lies outside the image")
+                                          .arg(range.firstBlock).arg(range.lastBlock));
+        }
+        if (!range.checksum.isEmpty() && range.checksum.size() != digestSize) {
+            return fail(errorMessage, QString("Bmap range %1-%2 has a malformed checksum")
+                                          .arg(range.firstBlock).arg(range.lastBlock));
+        }
+        checksums = checksums && !range.checksum.isEmpty();
+        previousEnd = range.offset + range.length;
+        mapped += range.length;
+    }
+    return true;
+}
+
+QString BmapFile::findFor(const QString &imagePath) {
+    const QFileInfo info(imagePath);
+    QStringList candidates{imagePath + ".bmap"};
+    QString stem = info.fileName();
+    while (stem.contains('.')) {
+        stem = stem.section('.', 0, -2);
+        candidates << info.dir().filePath(stem + ".bmap");
+    }
+    for (const QString &candidate : candidates) {
+        if (QFileInfo::exists(candidate)) {
+            return candidate;
+        }
+    }
+    return QString();
+}
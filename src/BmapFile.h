@@ -0,0 +1,67 @@
+#ifndef BMAPFILE_H
+#define BMAPFILE_H
+
+#include <QString>
+#include <QList>
+#include <QByteArray>
+#include <QCryptographicHash>
+
+/**
+ * @brief One mapped range of a bmap, converted to bytes.
+ */
+struct BmapRange {
+    qint64 firstBlock = 0;
+    qint64 lastBlock = 0;
+    qint64 offset = 0;   // Byte offset in the image
+    qint64 length = 0;   // Byte length (the last range may end inside a block)
+    QByteArray checksum; // Raw digest of the range's data, empty if the bmap has none
+};
+
+/**
+ * @brief A block map as produced by bmaptool / Yocto (.bmap files).
+ *
+ * The bmap lists which blocks of a sparse raw image actually contain data,
+ * with a checksum per range. Formats 1.x (SHA-1) and 2.x (SHA-1 or SHA-256,
+ * given by ChecksumType) are understood. The file's own checksum
+ * (BmapFileChecksum / BmapFileSHA1) is verified when present.
+ */
+class BmapFile {
+public:
+    /**
+     * @brief Parses a .bmap file.
+     * @param path Path of the .bmap file.
+     * @param errorMessage Receives a description of the failure, if any.
+     * @return bool True if the file was read and is consistent.
+     */
+    bool load(const QString &path, QString *errorMessage = nullptr);
+
+    /**
+     * @brief Looks for the bmap that belongs to an image, as bmaptool does.
+     *
+     * For "foo.img.xz" this tries "foo.img.xz.bmap", "foo.img.bmap" and "foo.bmap".
+     *
+     * @return QString The path of the bmap, or an empty string if there is none.
+     */
+    static QString findFor(const QString &imagePath);
+
+    QString version() const { return formatVersion; }
+    qint64 imageSize() const { return size; }
+    qint64 blockSize() const { return block; }
+    qint64 blocksCount() const { return blocks; }
+    qint64 mappedBytes() const { return mapped; }
+    bool hasChecksums() const { return checksums; }
+    QCryptographicHash::Algorithm checksumAlgorithm() const { return algorithm; }
+    const QList<BmapRange> &ranges() const { return mappedRanges; }
+
+private:
+    QString formatVersion;
+    qint64 size = 0;
+    qint64 block = 0;
+    qint64 blocks = 0;
+    qint64 mapped = 0;
+    bool checksums = false;
+    QCryptographicHash::Algorithm algorithm = QCryptographicHash::Sha256;
+    QList<BmapRange> mappedRanges;
+};
+
+#endif // BMAPFILE_H
@@ -0,0 +1,181 @@
+#include "BmapWriter.h"
+#include "AdaptiveWriteQueue.h"
+#include "BlockDevice.h"
+#include "EraseBlockProbe.h"
+#include "ImageSource.h"
+#include "Instrumentation.h"
+#include "PipelineTrace.h"
+#include "Probes.h"
+#include <QDebug>
+#include <QMutexLocker>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+namespace {
+const qint64 kChunkSize = 4 * 1024 * 1024;
+
+bool isXz(const QString &path) {
+    return path.endsWith(".xz", Qt::CaseInsensitive);
+}
+} // namespace
+
+// --- Implementation of BmapWriter ---
+
+BmapWriter::BmapWriter(const QString &imagePath, const BmapFile &bmap, const QString &drivePath, bool directIo,
+                       const EraseOptions &erase)
+    : imagePath(imagePath), bmap(bmap), drivePath(drivePath), directIo(directIo), erase(erase) {
+}
+
+bool BmapWriter::canRead(const QString &imagePath) {
+#ifdef INFERNO_HAVE_LZMA
+    Q_UNUSED(imagePath);
+    return true;
+#else
+    return !isXz(imagePath);
+#endif
+}
+
+bool BmapWriter::run(const ProgressCallback &progress, QString *errorMessage) {
+    auto fail = [&](const QString &message) {
+        if (errorMessage) *errorMessage = message;
+        return false;
+    };
+
+    // Any container ImageSource understands works; in practice raw or .xz. The bmap says the content is a raw image.
+    std::unique_ptr<ImageSource> input = ImageSource::openImage(imagePath, errorMessage, true);
+    if (!input) {
+        return false;
+    }
+
+    BlockDevice device;
+    if (!device.open(drivePath, true, directIo, errorMessage)) {
+        return false;
+    }
+    device.setIoStats(ioStats);
+    if (device.size() < bmap.imageSize()) {
+        return fail(QString("The drive is too small for this image (%1 < %2 bytes)")
+                        .arg(device.size()).arg(bmap.imageSize()));
+    }
+
+    // Optional pre-write erase; failure only costs the speed-up, not the write.
+    // A resumed write must not erase what the interrupted one wrote.
+    bool skipZeros = false;
+    if (resumeOffset > 0) {
+        qDebug() << "Resuming the bmap write of" << imagePath << "at offset" << resumeOffset;
+    } else if (erase.mode != EraseMode::None) {
+        QList<ByteRange> mapped;
+        for (const BmapRange &range : bmap.ranges()) {
+            mapped.append(ByteRange{range.offset, range.length});
+        }
+        const QList<ByteRange> ranges = erase.unwrittenOnly ? AllocationMap::invert(mapped, device.size())
+                                                            : QList<ByteRange>{ByteRange{0, device.size()}};
+        QString eraseError;
+        if (DriveErase::eraseRanges(device, erase.mode, ranges, cancelled, nullptr, &eraseError)) {
+            skipZeros = erase.zeroesDrive() && erase.skipZeroBlocks;
+        } else if (cancelled) {
+            return fail("Write cancelled.");
+        } else {
+            qWarning() << "Pre-write erase of" << drivePath << "failed, writing without it:" << eraseError;
+        }
+    }
+
+    // Reading and hashing run on this thread while the queue's writer threads keep the drive busy
+    AdaptiveWriteQueue queue(device, EraseBlockProbe::requestSize(eraseBlockSize, kChunkSize), trace);
+    if (trace) trace->nameThread("reader");
+    const qint64 blockSize = device.logicalBlockSize();
+    QCryptographicHash hash(bmap.checksumAlgorithm());
+    qint64 skipped = 0;
+    auto report = [&]() {
+        {
+            QMutexLocker locker(&stateMutex);
+            lastQueueState = queue.state();
+        }
+        if (progress) progress(queue.bytesCompleted() + skipped, bmap.mappedBytes());
+    };
+
+    qint64 nextCheckpoint = resumeOffset + checkpointInterval;
+    auto takeCheckpoint = [&]() {
+        const qint64 mark = queue.completedThrough();
+        if (!checkpoint || mark < nextCheckpoint) {
+            return;
+        }
+        nextCheckpoint = mark + checkpointInterval; // Also after a failed flush, which the final sync will report
+        const PipelineTrace::Span span(trace, "checkpoint", mark);
+        if (device.sync()) checkpoint(mark);
+    };
+
+    for (const BmapRange &range : bmap.ranges()) {
+        if (range.offset + range.length <= resumeOffset) {
+            skipped += range.length; // Written and verified before the interruption
+            continue;
+        }
+        hash.reset();
+        for (qint64 offset = range.offset, length = 0; offset < range.offset + range.length; offset += length) {
+            if (cancelled) {
+                return fail("Write cancelled.");
+            }
+            AlignedBuffer *buffer;
+            {
+                const PipelineTrace::Span span(trace, "acquire"); // Waiting here means the drive is the bottleneck
+                buffer = queue.acquire();
+            }
+            if (!buffer) {
+                return fail(queue.errorString());
+            }
+            // Requests end on erase-block boundaries of the drive, not of the range
+            length = EraseBlockProbe::alignedLength(offset, range.offset + range.length, queue.requestSize());
+            qint64 read;
+            {
+                const PipelineTrace::Span span(trace, "read", offset, length); // Includes decompression
+                const Instrumentation::StageTimer timer(Instrumentation::Stage::Read, length);
+                read = input->readAt(buffer->data(), length, offset);
+            }
+            if (read != length) {
+                queue.release(buffer);
+                return fail(input->errorString().isEmpty() ? QString("Image ends before the bmap says it should")
+                                                           : input->errorString());
+            }
+            {
+                const PipelineTrace::Span span(trace, "hash", offset, length);
+                const Instrumentation::StageTimer timer(Instrumentation::Stage::Hash, length);
+                hash.addData(QByteArrayView(buffer->data(), length));
+            }
+
+            // A range ending inside a device block is padded with zeros for O_DIRECT
+            const qint64 padded = std::min((length + blockSize - 1) / blockSize * blockSize, device.size() - offset);
+            std::memset(buffer->data() + length, 0, size_t(padded - length));
+            bool zero = false;
+            if (skipZeros) {
+                const PipelineTrace::Span span(trace, "zero-scan", offset, padded);
+                const Instrumentation::StageTimer timer(Instrumentation::Stage::ZeroScan, padded);
+                zero = DriveErase::isAllZero(buffer->data(), padded);
+            }
+            if (zero) {
+                queue.release(buffer);
+                skipped += length;
+            } else {
+                queue.submit(buffer, offset, padded, length);
+            }
+            report();
+            takeCheckpoint();
+        }
+
+        if (!range.checksum.isEmpty() && hash.result() != range.checksum) {
+            INFERNO_PROBE2(verify_mismatch, range.offset, range.length);
+            return fail(QString("Checksum mismatch in blocks %1-%2: the image does not match its bmap")
+                            .arg(range.firstBlock).arg(range.lastBlock));
+        }
+    }
+
+    if (!queue.finish()) {
+        return fail(queue.errorString());
+    }
+    report();
+    const PipelineTrace::Span syncSpan(trace, "sync");
+    if (!device.sync()) {
+        return fail(device.errorString());
+    }
+    qDebug() << "Bmap write of" << imagePath << "complete:" << bmap.mappedBytes() << "of" << bmap.imageSize() << "bytes written";
+    return true;
+}
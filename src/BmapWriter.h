@@ -0,0 +1,119 @@
+#ifndef BMAPWRITER_H
+#define BMAPWRITER_H
+
+#include "BmapFile.h"
+#include "DriveErase.h"
+#include "ProgressRecord.h"
+#include <QMutex>
+#include <QString>
+#include <atomic>
+#include <functional>
+
+class IoStats;
+class PipelineTrace;
+
+/**
+ * @brief Writes a raw image (optionally .xz compressed) to a drive, guided by its bmap.
+ *
+ * Only the ranges listed in the bmap are read from the image and written to
+ * the drive; everything else is skipped, which is what makes sparse embedded
+ * images fast to flash. Each range's checksum is computed while its data is
+ * streamed and compared as soon as the range is complete, so a corrupt image
+ * is caught at the first bad range rather than after the whole write.
+ * Writes go through an AdaptiveWriteQueue, so reading and hashing overlap
+ * with several requests in flight to the drive.
+ *
+ * Compressed images are decompressed on the fly; unmapped parts of the stream
+ * are decompressed and discarded since xz cannot seek.
+ *
+ * An erase mode (see EraseOptions) trims or zeroes the drive first, either
+ * whole or only the unmapped ranges. Once the whole drive is zeroed, mapped
+ * chunks that are all zeros are verified but not written.
+ */
+class BmapWriter {
+public:
+    using ProgressCallback = std::function<void(qint64 bytesDone, qint64 bytesTotal)>;
+    using CheckpointCallback = std::function<void(qint64 offset)>;
+
+    BmapWriter(const QString &imagePath, const BmapFile &bmap, const QString &drivePath, bool directIo = true,
+               const EraseOptions &erase = EraseOptions());
+
+    /**
+     * @brief Runs the write on the calling thread.
+     * @param progress Called after each chunk, in mapped bytes.
+     * @param errorMessage Receives a description of the failure, if any.
+     * @return bool True if every mapped range was written and verified.
+     */
+    bool run(const ProgressCallback &progress, QString *errorMessage);
+
+    /**
+     * @brief Aligns write requests to the drive's erase block (see EraseBlockProbe); 0 if unknown.
+     */
+    void setEraseBlockSize(qint64 bytes) { eraseBlockSize = bytes; }
+
+    /**
+     * @brief Records the latency and size of every device read and write in stats (see IoStats); null for none.
+     */
+    void setIoStats(IoStats *stats) { ioStats = stats; }
+
+    /**
+     * @brief State of the write queue as of the last progress report. Thread-safe.
+     */
+    QueueControlState queueState() const {
+        QMutexLocker locker(&stateMutex);
+        return lastQueueState;
+    }
+
+    /**
+     * @brief Records the pipeline stages of the next run() in trace (see PipelineTrace); null for none.
+     */
+    void setTrace(PipelineTrace *trace) { this->trace = trace; }
+
+    /**
+     * @brief Requests cancellation; run() returns false soon after. Thread-safe.
+     */
+    void cancel() { cancelled = true; }
+
+    /**
+     * @brief Continues an interrupted write of the same image from a checkpoint offset.
+     *
+     * Ranges that end below offset are skipped; the range containing it is
+     * written again from its start, so its checksum is still verified. The
+     * pre-write erase is skipped, and zero chunks are written rather than assumed.
+     */
+    void setResumeOffset(qint64 offset) { resumeOffset = offset; }
+
+    /**
+     * @brief Flushes the drive about every interval bytes and passes the offset below which it is complete.
+     *
+     * Called on run()'s thread; the offset can be given to setResumeOffset
+     * after a crash. Null (the default) for no checkpoints.
+     */
+    void setCheckpoint(const CheckpointCallback &callback, qint64 interval) {
+        checkpoint = callback;
+        checkpointInterval = interval;
+    }
+
+    /**
+     * @brief Whether this build can read the given image (.xz needs liblzma).
+     */
+    static bool canRead(const QString &imagePath);
+
+private:
+    QString imagePath;
+    BmapFile bmap;
+    QString drivePath;
+    bool directIo;
+    EraseOptions erase;
+    qint64 eraseBlockSize = 0;
+    qint64 resumeOffset = 0;
+    CheckpointCallback checkpoint;
+    qint64 checkpointInterval = 0;
+    IoStats *ioStats = nullptr;
+    PipelineTrace *trace = nullptr;
+    std::atomic<bool> cancelled{false};
+    mutable QMutex stateMutex;
+    QueueControlState lastQueueState;
+};
+
+#endif // BMAPWRITER_H
@@ -0,0 +1,71 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <deque>
+#include <optional>
+
+/**
+ * @brief Blocking FIFO with a fixed capacity, used between pipeline stages.
+ *
+ * push() blocks while the queue is full and pop() blocks while it is empty,
+ * so a slow stage applies back-pressure to the stages feeding it. close()
+ * wakes everyone up: pushes are refused and pop() drains what is left, then
+ * returns std::nullopt.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(qsizetype capacity) : limit(capacity) {}
+
+    bool push(T value) {
+        QMutexLocker locker(&mutex);
+        while (qsizetype(items.size()) >= limit && !closed) {
+            notFull.wait(&mutex);
+        }
+        if (closed) {
+            return false;
+        }
+        items.push_back(std::move(value));
+        notEmpty.wakeOne();
+        return true;
+    }
+
+    std::optional<T> pop() {
+        QMutexLocker locker(&mutex);
+        while (items.empty() && !closed) {
+            notEmpty.wait(&mutex);
+        }
+        if (items.empty()) {
+            return std::nullopt;
+        }
+        T value = std::move(items.front());
+        items.pop_front();
+        notFull.wakeOne();
+        return value;
+    }
+
+    void close() {
+        QMutexLocker locker(&mutex);
+        closed = true;
+        notEmpty.wakeAll();
+        notFull.wakeAll();
+    }
+
+    qsizetype size() const {
+        QMutexLocker locker(&mutex);
+        return qsizetype(items.size());
+    }
+
+private:
+    mutable QMutex mutex;
+    QWaitCondition notEmpty;
+    QWaitCondition notFull;
+    std::deque<T> items;
+    qsizetype limit;
+    bool closed = false;
+};
+
+#endif // BOUNDEDQUEUE_H
@@ -0,0 +1,157 @@
+#include "CapacityCheck.h"
+#include "BlockDevice.h"
+#include "Probes.h"
+#include <QLocale>
+#include <QRandomGenerator>
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace {
+const char kMagic[8] = {'I', 'N', 'F', 'C', 'A', 'P', 'C', 'K'};
+} // namespace
+
+QString CapacityReport::summary() const {
+    const QLocale locale;
+    if (genuine()) {
+        return QString("Capacity verified: %1 probes up to %2 read back correctly")
+            .arg(probes).arg(locale.formattedDataSize(reportedSize));
+    }
+    return QString("Counterfeit drive: reports %1 but data is lost beyond about %2 (%3 of %4 probes failed%5)")
+        .arg(locale.formattedDataSize(reportedSize), locale.formattedDataSize(verifiedSize))
+        .arg(failures).arg(probes)
+        .arg(wrapsAround ? ", addresses wrap around" : "");
+}
+
+// --- Implementation of CapacityCheck ---
+
+void CapacityCheck::fillProbe(char *data, qint64 length, quint64 nonce, qint64 offset) {
+    std::memcpy(data, kMagic, sizeof(kMagic));
+    qToLittleEndian<quint64>(nonce, data + 8);
+    qToLittleEndian<quint64>(quint64(offset), data + 16);
+    quint64 state = nonce ^ (quint64(offset) * 0x9E3779B97F4A7C15ULL) ^ 0x2545F4914F6CDD1DULL;
+    for (qint64 i = 24; i + 8 <= length; i += 8) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        qToLittleEndian<quint64>(state, data + i);
+    }
+}
+
+CapacityCheck::ProbeResult CapacityCheck::checkProbe(const char *data, const char *expected, qint64 length,
+                                                     quint64 nonce) {
+    if (std::memcmp(data, expected, size_t(length)) == 0) {
+        return ProbeResult::Intact;
+    }
+    // Another probe of this run: the write landed on a lower address
+    if (std::memcmp(data, kMagic, sizeof(kMagic)) == 0 && qFromLittleEndian<quint64>(data + 8) == nonce
+        && qFromLittleEndian<quint64>(data + 16) != qFromLittleEndian<quint64>(expected + 16)) {
+        return ProbeResult::Aliased;
+    }
+    return ProbeResult::Lost;
+}
+
+QList<qint64> CapacityCheck::probeOffsets(qint64 deviceSize, qint64 blockSize) {
+    const qint64 probeSize = std::max(kProbeSize, blockSize);
+    QList<qint64> offsets;
+    auto add = [&](qint64 offset) {
+        offset = offset / probeSize * probeSize;
+        if (offset + probeSize <= deviceSize) {
+            offsets.append(offset);
+        }
+    };
+    for (qint64 offset = kFirstProbe; offset < deviceSize; offset *= 2) {
+        add(offset);
+        add(offset + offset / 2);
+    }
+    add(deviceSize - probeSize); // Fakes most often fail at the very end
+    std::sort(offsets.begin(), offsets.end());
+    offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+    return offsets;
+}
+
+bool CapacityCheck::run(BlockDevice &device, CapacityReport *report, const std::atomic<bool> &cancelled,
+                        QString *errorMessage) {
+    const qint64 probeSize = std::max<qint64>(kProbeSize, device.logicalBlockSize());
+    const QList<qint64> offsets = probeOffsets(device.size(), device.logicalBlockSize());
+    CapacityReport result;
+    result.reportedSize = device.size();
+    result.verifiedSize = device.size();
+    result.probes = int(offsets.size());
+
+    auto fail = [&](const QString &message) {
+        if (errorMessage) *errorMessage = message;
+        if (report) *report = result;
+        return false;
+    };
+
+    // Save what is there now, so the check leaves a genuine drive untouched
+    std::vector<std::unique_ptr<AlignedBuffer>> originals;
+    for (qint64 offset : offsets) {
+        originals.push_back(std::make_unique<AlignedBuffer>(probeSize));
+        QString readError = QString("Cannot read offset %1").arg(offset);
+        if (device.readAt(originals.back()->data(), probeSize, offset, &readError) != probeSize) {
+            return fail(readError);
+        }
+    }
+
+    const quint64 nonce = QRandomGenerator::global()->generate64();
+    AlignedBuffer expected(probeSize);
+    AlignedBuffer actual(probeSize);
+    QString ioError;
+    qsizetype written = 0;
+    for (; written < offsets.size() && !cancelled; ++written) {
+        fillProbe(expected.data(), probeSize, nonce, offsets[written]);
+        if (device.writeAt(expected.data(), probeSize, offsets[written], &ioError) != probeSize) {
+            break;
+        }
+    }
+    if (ioError.isEmpty() && !cancelled && !device.sync()) {
+        ioError = device.errorString();
+    }
+
+    // Read back from the top down, so a small controller cache holds nothing useful
+    if (ioError.isEmpty() && !cancelled) {
+        for (qsizetype i = offsets.size() - 1; i >= 0; --i) {
+            fillProbe(expected.data(), probeSize, nonce, offsets[i]);
+            if (device.readAt(actual.data(), probeSize, offsets[i], &ioError) != probeSize) {
+                if (ioError.isEmpty()) ioError = QString("Cannot read offset %1").arg(offsets[i]);
+                break;
+            }
+            const ProbeResult probe = checkProbe(actual.data(), expected.data(), probeSize, nonce);
+            if (probe != ProbeResult::Intact) {
+                INFERNO_PROBE2(verify_mismatch, offsets[i], probeSize);
+                ++result.failures;
+                result.verifiedSize = std::min(result.verifiedSize, offsets[i]);
+                if (probe == ProbeResult::Aliased) result.wrapsAround = true;
+            }
+        }
+    }
+
+    // Restore from the top down: on a fake whose high addresses alias low ones,
+    // the real low blocks are then written last and end up correct
+    for (qsizetype i = written - 1; i >= 0; --i) {
+        QString restoreError;
+        if (device.writeAt(originals[size_t(i)]->data(), probeSize, offsets[i], &restoreError) != probeSize
+            && ioError.isEmpty()) {
+            ioError = restoreError;
+        }
+    }
+    if (written > 0 && !device.sync() && ioError.isEmpty()) {
+        ioError = device.errorString();
+    }
+
+    if (cancelled) {
+        return fail("Capacity check cancelled.");
+    }
+    if (!ioError.isEmpty()) {
+        // Some fakes fail hard at the first address beyond their flash instead of losing data quietly
+        return fail(QString("Capacity check failed: %1").arg(ioError));
+    }
+    qDebug() << "Capacity check of" << device.path() << ":" << result.summary();
+    if (report) *report = result;
+    return true;
+}
@@ -0,0 +1,76 @@
+#ifndef CAPACITYCHECK_H
+#define CAPACITYCHECK_H
+
+#include <QString>
+#include <QList>
+#include <atomic>
+
+class BlockDevice;
+
+/**
+ * @brief Outcome of a capacity check.
+ */
+struct CapacityReport {
+    qint64 reportedSize = 0;
+    qint64 verifiedSize = 0;   // Every probe below this offset read back correctly
+    int probes = 0;
+    int failures = 0;
+    bool wrapsAround = false;  // A probe read back another probe's data (address aliasing)
+
+    bool genuine() const { return failures == 0; }
+    QString summary() const;
+};
+
+/**
+ * @brief Detects counterfeit drives that report more capacity than they have, in seconds.
+ *
+ * Fake sticks either ignore writes beyond their real flash or wrap them
+ * around onto lower addresses. Instead of filling the drive like f3 or
+ * H2testw, one block is written at each of a few dozen offsets spaced
+ * logarithmically up to the last block (1 MiB, 1.5 MiB, 2 MiB, 3 MiB, ...),
+ * each tagged with a per-run nonce and its own offset. They are all written
+ * first and flushed, then read back: a missing tag means the write was lost,
+ * and another probe's tag means the addresses alias.
+ *
+ * The original contents of the probed blocks are saved first and written
+ * back afterwards, so a genuine drive is left as it was. The device must be
+ * open for writing with O_DIRECT, or the page cache would answer the reads.
+ */
+class CapacityCheck {
+public:
+    static constexpr qint64 kFirstProbe = 1024 * 1024;
+    static constexpr qint64 kProbeSize = 4096;
+
+    enum class ProbeResult {
+        Intact,  // The block holds the probe written there
+        Lost,    // Something else: the write never reached the flash
+        Aliased  // Another probe of the same run: the address wrapped around
+    };
+
+    /**
+     * @brief Runs the check on an open device.
+     * @param report Receives the result (also on failure, as far as it got).
+     * @param errorMessage Receives the I/O error if the check could not be completed.
+     * @return bool True if the check ran to completion; see report->genuine() for the verdict.
+     */
+    static bool run(BlockDevice &device, CapacityReport *report, const std::atomic<bool> &cancelled,
+                    QString *errorMessage);
+
+    /**
+     * @brief The probe offsets for a device of the given size, aligned to blockSize.
+     */
+    static QList<qint64> probeOffsets(qint64 deviceSize, qint64 blockSize);
+
+    /**
+     * @brief Fills a probe block: magic, nonce and offset, then a pattern derived from both.
+     */
+    static void fillProbe(char *data, qint64 length, quint64 nonce, qint64 offset);
+
+    /**
+     * @brief Classifies a block read back from a probed offset.
+     * @param expected The probe written there (see fillProbe).
+     */
+    static ProbeResult checkProbe(const char *data, const char *expected, qint64 length, quint64 nonce);
+};
+
+#endif // CAPACITYCHECK_H
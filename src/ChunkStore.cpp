@@ -0,0 +1,445 @@
+#include "ChunkStore.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace {
+const char kIndexMagic[8] = {'I', 'N', 'F', 'C', 'I', 'D', 'X', '1'};
+const char *kIndexSuffix = ".cidx";
+const qint64 kImportReadSize = 4 * 1024 * 1024;
+const int kHashSize = 32;
+
+// Normalized chunking: a stricter mask before the average size and a looser
+// one after it pulls chunk sizes towards the average (64 KB = 2^16).
+const quint64 kMaskStrict = ((1ULL << 18) - 1) << (64 - 18);
+const quint64 kMaskLoose = ((1ULL << 14) - 1) << (64 - 14);
+
+// Gear table for the rolling hash, generated deterministically with splitmix64
+// so chunk boundaries are identical on every station.
+const std::array<quint64, 256> kGearTable = [] {
+    std::array<quint64, 256> table{};
+    quint64 state = 0x496e6665726e6f31ULL; // "Inferno1"
+    for (quint64 &value : table) {
+        state += 0x9e3779b97f4a7c15ULL;
+        quint64 z = state;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        value = z ^ (z >> 31);
+    }
+    return table;
+}();
+
+/**
+ * @brief Returns the length of the next chunk starting at data.
+ */
+qsizetype findCutPoint(const uchar *data, qsizetype length) {
+    if (length <= qsizetype(ChunkStore::kMinChunkSize)) {
+        return length;
+    }
+    const qsizetype limit = std::min<qsizetype>(length, ChunkStore::kMaxChunkSize);
+    const qsizetype normal = std::min<qsizetype>(limit, ChunkStore::kAvgChunkSize);
+
+    quint64 hash = 0;
+    qsizetype i = ChunkStore::kMinChunkSize;
+    for (; i < normal; ++i) {
+        hash = (hash << 1) + kGearTable[data[i]];
+        if (!(hash & kMaskStrict)) {
+            return i + 1;
+        }
+    }
+    for (; i < limit; ++i) {
+        hash = (hash << 1) + kGearTable[data[i]];
+        if (!(hash & kMaskLoose)) {
+            return i + 1;
+        }
+    }
+    return limit;
+}
+
+bool writeFileAtomically(const QString &path, const QByteArray &data) {
+    QDir().mkpath(QFileInfo(path).path());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    if (file.write(data) != data.size()) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+} // namespace
+
+// --- Implementation of ChunkStore ---
+
+ChunkStore::ChunkStore(const QString &rootPath) : root(rootPath) {
+    QDir().mkpath(root + "/chunks");
+    QDir().mkpath(root + "/indexes");
+}
+
+bool ChunkStore::open(QString *errorMessage) {
+    refCounts.clear();
+    chunkSizes.clear();
+    stored = 0;
+
+    QDir indexDir(root + "/indexes");
+    const QStringList indexFiles = indexDir.entryList({QString("*") + kIndexSuffix}, QDir::Files);
+    for (const QString &fileName : indexFiles) {
+        ChunkIndex index;
+        QString error;
+        if (!readIndex(indexDir.filePath(fileName), &index, &error)) {
+            qDebug() << "Skipping unreadable chunk index" << fileName << ":" << error;
+            continue;
+        }
+        addReferences(index);
+    }
+
+    // Remove chunks left behind by an import or transfer that never finished
+    QDirIterator it(root + "/chunks", QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString path = it.next();
+        const QByteArray hash = QByteArray::fromHex(QFileInfo(path).fileName().toLatin1());
+        if (hash.size() != kHashSize || !refCounts.contains(hash)) {
+            QFile::remove(path);
+        }
+    }
+
+    Q_UNUSED(errorMessage);
+    return true;
+}
+
+bool ChunkStore::importImage(const QString &id, QIODevice *source, QString *errorMessage, ChunkIndex *imported) {
+    if (hasImage(id)) {
+        removeImage(id);
+    }
+
+    ChunkIndex index;
+    if (!chunkImage(root, source, &index, errorMessage)) {
+        return false;
+    }
+    if (!writeIndex(id, index, errorMessage)) {
+        return false;
+    }
+    addReferences(index);
+    qDebug() << "Chunked image" << id << ":" << index.chunks.size() << "chunks," << index.imageSize << "bytes";
+    if (imported) *imported = index;
+    return true;
+}
+
+bool ChunkStore::chunkImage(const QString &root, QIODevice *source, ChunkIndex *index, QString *errorMessage) {
+    *index = ChunkIndex();
+    QByteArray buffer;
+    qsizetype cursor = 0;
+    bool endOfInput = false;
+
+    while (true) {
+        // Keep at least one maximum-size chunk buffered so cut points are stable
+        while (!endOfInput && buffer.size() - cursor < qsizetype(kMaxChunkSize)) {
+            if (cursor > 0) {
+                buffer.remove(0, cursor);
+                cursor = 0;
+            }
+            const QByteArray more = source->read(kImportReadSize);
+            if (more.isEmpty()) {
+                // An empty read before the end is an I/O error, not the end of the image
+                if (!source->atEnd()) {
+                    if (errorMessage) *errorMessage = QString("Failed to read the image: %1").arg(source->errorString());
+                    return false;
+                }
+                endOfInput = true;
+            } else {
+                buffer.append(more);
+            }
+        }
+        if (cursor >= buffer.size()) {
+            break;
+        }
+
+        const uchar *data = reinterpret_cast<const uchar *>(buffer.constData()) + cursor;
+        const qsizetype length = findCutPoint(data, buffer.size() - cursor);
+        const QByteArray chunk = QByteArray::fromRawData(buffer.constData() + cursor, length);
+        const QByteArray hash = QCryptographicHash::hash(chunk, QCryptographicHash::Sha256);
+
+        const QString path = chunkPathInStore(root, hash);
+        if (!QFile::exists(path) && !writeFileAtomically(path, chunk)) {
+            if (errorMessage) *errorMessage = QString("Failed to write chunk %1").arg(QString::fromLatin1(hash.toHex()));
+            return false;
+        }
+
+        ChunkRef ref;
+        ref.hash = hash;
+        ref.size = quint32(length);
+        index->offsets.append(index->imageSize);
+        index->chunks.append(ref);
+        index->imageSize += length;
+        cursor += length;
+    }
+
+    if (!source->isSequential() && index->imageSize != source->size()) {
+        if (errorMessage) {
+            *errorMessage = QString("The image ended after %1 of %2 bytes").arg(index->imageSize).arg(source->size());
+        }
+        return false;
+    }
+    return true;
+}
+
+bool ChunkStore::addIndex(const QString &id, const ChunkIndex &index, QString *errorMessage) {
+    for (const ChunkRef &ref : index.chunks) {
+        if (!hasChunk(ref.hash)) {
+            if (errorMessage) *errorMessage = QString("Missing chunk %1").arg(QString::fromLatin1(ref.hash.toHex()));
+            return false;
+        }
+    }
+    if (hasImage(id)) {
+        removeImage(id);
+    }
+    if (!writeIndex(id, index, errorMessage)) {
+        return false;
+    }
+    addReferences(index);
+    return true;
+}
+
+bool ChunkStore::removeImage(const QString &id) {
+    ChunkIndex index;
+    if (!readIndex(indexPath(id), &index)) {
+        return false;
+    }
+    QFile::remove(indexPath(id));
+
+    for (const ChunkRef &ref : index.chunks) {
+        auto it = refCounts.find(ref.hash);
+        if (it == refCounts.end()) {
+            continue;
+        }
+        if (--it.value() == 0) {
+            refCounts.erase(it);
+            stored -= chunkSizes.take(ref.hash);
+            QFile::remove(chunkPath(ref.hash));
+        }
+    }
+    return true;
+}
+
+bool ChunkStore::hasImage(const QString &id) const {
+    return QFile::exists(indexPath(id));
+}
+
+QString ChunkStore::indexPath(const QString &id) const {
+    return QString("%1/indexes/%2%3").arg(root, id, QLatin1String(kIndexSuffix));
+}
+
+QString ChunkStore::chunkPath(const QByteArray &hash) const {
+    return chunkPathInStore(root, hash);
+}
+
+qint64 ChunkStore::uniqueBytes(const QString &id) const {
+    ChunkIndex index;
+    if (!readIndex(indexPath(id), &index)) {
+        return 0;
+    }
+    // A chunk can repeat inside one image, so count each hash's references once
+    QHash<QByteArray, quint32> ownRefs;
+    for (const ChunkRef &ref : index.chunks) {
+        ownRefs[ref.hash]++;
+    }
+    qint64 bytes = 0;
+    for (auto it = ownRefs.constBegin(); it != ownRefs.constEnd(); ++it) {
+        if (refCounts.value(it.key()) == it.value()) {
+            bytes += chunkSizes.value(it.key());
+        }
+    }
+    return bytes;
+}
+
+bool ChunkStore::hasChunk(const QByteArray &hash) const {
+    return refCounts.contains(hash) || QFile::exists(chunkPath(hash));
+}
+
+bool ChunkStore::readChunk(const QByteArray &hash, QByteArray *data) const {
+    QFile file(chunkPath(hash));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    *data = file.readAll();
+    return true;
+}
+
+bool ChunkStore::storeChunk(const QByteArray &hash, const QByteArray &data) {
+    if (refCounts.contains(hash)) {
+        return true;
+    }
+    return writeChunkFile(root, hash, data);
+}
+
+bool ChunkStore::writeChunkFile(const QString &root, const QByteArray &hash, const QByteArray &data) {
+    if (hash.size() != kHashSize || QCryptographicHash::hash(data, QCryptographicHash::Sha256) != hash) {
+        return false;
+    }
+    const QString path = chunkPathInStore(root, hash);
+    if (QFile::exists(path)) {
+        return true;
+    }
+    return writeFileAtomically(path, data);
+}
+
+bool ChunkStore::readIndex(const QString &indexPath, ChunkIndex *index, QString *errorMessage) {
+    QFile file(indexPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorMessage) *errorMessage = file.errorString();
+        return false;
+    }
+    return parseIndex(file.readAll(), index, errorMessage);
+}
+
+bool ChunkStore::parseIndex(const QByteArray &bytes, ChunkIndex *index, QString *errorMessage) {
+    QDataStream in(bytes);
+    in.setByteOrder(QDataStream::LittleEndian);
+
+    char magic[sizeof(kIndexMagic)];
+    quint64 imageSize = 0;
+    quint32 count = 0;
+    if (in.readRawData(magic, sizeof(magic)) != int(sizeof(magic))
+        || memcmp(magic, kIndexMagic, sizeof(magic)) != 0) {
+        if (errorMessage) *errorMessage = "Not a chunk index";
+        return false;
+    }
+    in >> imageSize >> count;
+    // Indexes can come from peers, so never trust the count beyond the data present
+    if (qint64(count) * (kHashSize + 4) > bytes.size()) {
+        if (errorMessage) *errorMessage = "Truncated or corrupt chunk index";
+        return false;
+    }
+
+    index->imageSize = 0;
+    index->chunks.clear();
+    index->offsets.clear();
+    index->chunks.reserve(count);
+    index->offsets.reserve(count);
+    for (quint32 i = 0; i < count; ++i) {
+        ChunkRef ref;
+        ref.hash.resize(kHashSize);
+        in.readRawData(ref.hash.data(), kHashSize);
+        in >> ref.size;
+        if (ref.size == 0 || ref.size > kMaxChunkSize) {
+            if (errorMessage) *errorMessage = "Invalid chunk size in chunk index";
+            return false;
+        }
+        index->offsets.append(index->imageSize);
+        index->imageSize += ref.size;
+        index->chunks.append(ref);
+    }
+
+    if (in.status() != QDataStream::Ok || quint64(index->imageSize) != imageSize) {
+        if (errorMessage) *errorMessage = "Truncated or corrupt chunk index";
+        return false;
+    }
+    return true;
+}
+
+QString ChunkStore::chunkPathInStore(const QString &root, const QByteArray &hash) {
+    const QString hex = QString::fromLatin1(hash.toHex());
+    return QString("%1/chunks/%2/%3").arg(root, hex.left(2), hex);
+}
+
+QString ChunkStore::storeRootForIndex(const QString &indexPath) {
+    QDir dir = QFileInfo(indexPath).dir(); // .../indexes
+    dir.cdUp();
+    return dir.path();
+}
+
+bool ChunkStore::writeIndex(const QString &id, const ChunkIndex &index, QString *errorMessage) const {
+    QByteArray bytes;
+    QDataStream out(&bytes, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData(kIndexMagic, sizeof(kIndexMagic));
+    out << quint64(index.imageSize) << quint32(index.chunks.size());
+    for (const ChunkRef &ref : index.chunks) {
+        out.writeRawData(ref.hash.constData(), kHashSize);
+        out << ref.size;
+    }
+
+    if (!writeFileAtomically(indexPath(id), bytes)) {
+        if (errorMessage) *errorMessage = QString("Failed to write chunk index for %1").arg(id);
+        return false;
+    }
+    return true;
+}
+
+void ChunkStore::addReferences(const ChunkIndex &index) {
+    for (const ChunkRef &ref : index.chunks) {
+        if (refCounts[ref.hash]++ == 0) {
+            chunkSizes.insert(ref.hash, ref.size);
+            stored += ref.size;
+        }
+    }
+}
+
+// --- Implementation of ChunkedImageReader ---
+
+ChunkedImageReader::ChunkedImageReader(const QString &indexPath, QObject *parent)
+    : QIODevice(parent), indexFile(indexPath), storeRoot(ChunkStore::storeRootForIndex(indexPath)) {
+}
+
+bool ChunkedImageReader::open(OpenMode mode) {
+    if (mode & QIODevice::WriteOnly) {
+        setErrorString("Chunked images are read-only");
+        return false;
+    }
+    QString error;
+    if (!ChunkStore::readIndex(indexFile, &index, &error)) {
+        setErrorString(error);
+        return false;
+    }
+    cachedChunk = -1;
+    cachedData.clear();
+    // Unbuffered so that pos() in readData() is always the device position
+    return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+qint64 ChunkedImageReader::readData(char *data, qint64 maxSize) {
+    qint64 position = pos();
+    qint64 copied = 0;
+
+    while (copied < maxSize && position < index.imageSize) {
+        const auto next = std::upper_bound(index.offsets.cbegin(), index.offsets.cend(), position);
+        const int chunk = int(next - index.offsets.cbegin()) - 1;
+
+        if (chunk != cachedChunk) {
+            QFile file(chunkPathInStore(storeRoot, index.chunks[chunk].hash));
+            if (!file.open(QIODevice::ReadOnly)) {
+                setErrorString(QString("Missing chunk: %1").arg(file.fileName()));
+                return copied > 0 ? copied : -1;
+            }
+            cachedData = file.readAll();
+            if (cachedData.size() != qsizetype(index.chunks[chunk].size)) {
+                setErrorString(QString("Corrupt chunk: %1").arg(file.fileName()));
+                cachedChunk = -1;
+                return copied > 0 ? copied : -1;
+            }
+            cachedChunk = chunk;
+        }
+
+        const qint64 inChunk = position - index.offsets[chunk];
+        const qint64 count = std::min(maxSize - copied, qint64(cachedData.size()) - inChunk);
+        memcpy(data + copied, cachedData.constData() + inChunk, size_t(count));
+        copied += count;
+        position += count;
+    }
+    return copied;
+}
+
+qint64 ChunkedImageReader::writeData(const char *data, qint64 maxSize) {
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
@@ -0,0 +1,181 @@
+#ifndef CHUNKSTORE_H
+#define CHUNKSTORE_H
+
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QByteArray>
+#include <QIODevice>
+
+/**
+ * @brief Reference to one chunk of an image, in image order.
+ */
+struct ChunkRef {
+    QByteArray hash; // Raw SHA-256 of the chunk contents (32 bytes)
+    quint32 size = 0;
+};
+
+/**
+ * @brief Parsed per-image chunk index.
+ */
+struct ChunkIndex {
+    qint64 imageSize = 0;
+    QList<ChunkRef> chunks;
+    QList<qint64> offsets; // Start offset of each chunk, for seeking
+};
+
+/**
+ * @brief Deduplicated, content-addressed chunk store for library images.
+ *
+ * Images are split with content-defined chunking (FastCDC-style gear hash with
+ * normalized chunk sizes, 16 KB min / 64 KB average / 256 KB max), so a byte
+ * inserted or removed in one release only changes the chunks around it. Each
+ * chunk is stored once under chunks/<first two hex digits>/<sha256>, and each
+ * image gets an index file under indexes/<id>.cidx listing its chunks.
+ *
+ * Reference counts are not persisted; they are rebuilt from the index files in
+ * open(), which keeps the store consistent after a crash at any point.
+ */
+class ChunkStore {
+public:
+    static constexpr quint32 kMinChunkSize = 16 * 1024;
+    static constexpr quint32 kAvgChunkSize = 64 * 1024;
+    static constexpr quint32 kMaxChunkSize = 256 * 1024;
+
+    explicit ChunkStore(const QString &rootPath);
+
+    /**
+     * @brief Scans the index files and rebuilds reference counts.
+     * @param errorMessage Receives a description of the failure, if any.
+     * @return bool True on success.
+     */
+    bool open(QString *errorMessage = nullptr);
+
+    /**
+     * @brief Chunks an image and stores every chunk not already present.
+     *
+     * A read error fails the import; only the end of the device ends the image.
+     *
+     * @param id The image id; its index is written to indexPath(id).
+     * @param source An open, readable device positioned at the start of the image.
+     * @param errorMessage Receives a description of the failure, if any.
+     * @param imported Receives the index that was written; may be null.
+     * @return bool True on success.
+     */
+    bool importImage(const QString &id, QIODevice *source, QString *errorMessage = nullptr,
+                     ChunkIndex *imported = nullptr);
+
+    /**
+     * @brief Deletes an image's index and every chunk no other image uses.
+     */
+    bool removeImage(const QString &id);
+
+    QString rootPath() const { return root; }
+    bool hasImage(const QString &id) const;
+    QString indexPath(const QString &id) const;
+    QString chunkPath(const QByteArray &hash) const;
+
+    /**
+     * @brief Physical bytes used by the unique chunks in the store.
+     */
+    qint64 storedBytes() const { return stored; }
+
+    /**
+     * @brief Bytes that would be freed by removing the image (chunks only it uses).
+     */
+    qint64 uniqueBytes(const QString &id) const;
+
+    bool hasChunk(const QByteArray &hash) const;
+    bool readChunk(const QByteArray &hash, QByteArray *data) const;
+
+    /**
+     * @brief Stores a chunk received from elsewhere after checking its hash.
+     * @return bool False if the data does not match the hash or cannot be written.
+     */
+    bool storeChunk(const QByteArray &hash, const QByteArray &data);
+
+    /**
+     * @brief Writes an index file and takes references on its chunks, which must all be present.
+     */
+    bool addIndex(const QString &id, const ChunkIndex &index, QString *errorMessage = nullptr);
+
+    /**
+     * @brief Reads and validates an index file.
+     */
+    static bool readIndex(const QString &indexPath, ChunkIndex *index, QString *errorMessage = nullptr);
+
+    /**
+     * @brief Parses index file contents (e.g., received from a peer).
+     */
+    static bool parseIndex(const QByteArray &bytes, ChunkIndex *index, QString *errorMessage = nullptr);
+
+    /**
+     * @brief Verifies a chunk against its hash and writes it under the store at root.
+     *
+     * Does not touch any ChunkStore instance, so it is safe to call from a
+     * worker thread; the new chunk is referenced once addIndex() runs.
+     */
+    static bool writeChunkFile(const QString &root, const QByteArray &hash, const QByteArray &data);
+
+    /**
+     * @brief Chunks an image into the store at root without registering it.
+     *
+     * Like writeChunkFile() this touches no ChunkStore instance, so the
+     * expensive chunking and hashing can run on a worker thread; the image is
+     * listed once addIndex() is called with the result on the owning thread.
+     *
+     * @param index Receives the image's chunk list.
+     * @return bool False on a read or write error.
+     */
+    static bool chunkImage(const QString &root, QIODevice *source, ChunkIndex *index,
+                           QString *errorMessage = nullptr);
+
+    /**
+     * @brief Path a chunk has (or would have) in the store at root.
+     */
+    static QString chunkPathInStore(const QString &root, const QByteArray &hash);
+
+    /**
+     * @brief Locates the store an index file belongs to (the directory above indexes/).
+     */
+    static QString storeRootForIndex(const QString &indexPath);
+
+private:
+    bool writeIndex(const QString &id, const ChunkIndex &index, QString *errorMessage) const;
+    void addReferences(const ChunkIndex &index);
+
+    QString root;
+    QHash<QByteArray, quint32> refCounts;
+    QHash<QByteArray, quint32> chunkSizes;
+    qint64 stored = 0;
+};
+
+/**
+ * @brief Read-only, seekable device that streams an image straight from its chunks.
+ *
+ * This lets the writer and hashing code treat a chunked library image like a
+ * plain file without ever reassembling it on disk.
+ */
+class ChunkedImageReader : public QIODevice {
+    Q_OBJECT
+
+public:
+    explicit ChunkedImageReader(const QString &indexPath, QObject *parent = nullptr);
+
+    bool open(OpenMode mode) override;
+    qint64 size() const override { return index.imageSize; }
+    bool isSequential() const override { return false; }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    QString indexFile;
+    QString storeRoot;
+    ChunkIndex index;
+    int cachedChunk = -1;
+    QByteArray cachedData;
+};
+
+#endif // CHUNKSTORE_H
@@ -0,0 +1,350 @@
+#include "Daemon.h"
+#include "BatchScheduler.h"
+#include "UsbTopology.h"
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+namespace {
+const int kMaxRequestLine = 1024 * 1024; // Jobs carry options, but nothing near this
+const int kIoTimeoutMs = 10000;
+
+QByteArray encode(const QJsonObject &obj) {
+    return QJsonDocument(obj).toJson(QJsonDocument::Compact) + '\n';
+}
+
+QJsonObject errorReply(const QString &message) {
+    QJsonObject reply;
+    reply["ok"] = false;
+    reply["error"] = message;
+    return reply;
+}
+} // namespace
+
+// --- Implementation of DaemonServer ---
+
+DaemonServer::DaemonServer(JobQueue *queue, BatchScheduler *scheduler, QObject *parent)
+    : QObject(parent), queue(queue), scheduler(scheduler), server(new QLocalServer(this)),
+      enumerator(new DiskUtility(this)) {
+    connect(server, &QLocalServer::newConnection, this, &DaemonServer::acceptConnections);
+    connect(queue, &JobQueue::jobChanged, this, &DaemonServer::publish);
+}
+
+bool DaemonServer::listen(const QString &name, bool groupAccess) {
+    // Clients can overwrite drives, so nobody but the owner (and maybe their group) gets in
+    QLocalServer::SocketOptions access = QLocalServer::UserAccessOption;
+    if (groupAccess) access |= QLocalServer::GroupAccessOption;
+    server->setSocketOptions(access);
+    QLocalServer::removeServer(name); // A stale socket file from a crashed run
+    if (!server->listen(name)) {
+        qDebug() << "Daemon failed to listen on" << name << ":" << server->errorString();
+        return false;
+    }
+    qDebug() << "Daemon listening on" << server->fullServerName();
+    return true;
+}
+
+QString DaemonServer::fullServerName() const {
+    return server->fullServerName();
+}
+
+QJsonObject DaemonServer::driveToJson(const DriveInfo &drive) {
+    QJsonObject obj;
+    obj["devicePath"] = drive.devicePath;
+    obj["driveLetter"] = drive.driveLetter;
+    obj["model"] = drive.model;
+    obj["size"] = QString::number(drive.size);
+    obj["isRemovable"] = drive.isRemovable;
+    const UsbLocation usb = UsbTopology::locate(drive.devicePath);
+    if (usb.isValid()) obj["usb"] = usb.toJson();
+    return obj;
+}
+
+DriveInfo DaemonServer::driveFromJson(const QJsonObject &obj) {
+    DriveInfo drive;
+    drive.devicePath = obj["devicePath"].toString();
+    drive.driveLetter = obj["driveLetter"].toString();
+    drive.model = obj["model"].toString();
+    drive.size = obj["size"].toString().toLongLong();
+    drive.isRemovable = obj["isRemovable"].toBool();
+    return drive;
+}
+
+void DaemonServer::acceptConnections() {
+    while (QLocalSocket *socket = server->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::readyRead, this, &DaemonServer::readRequests);
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket]() {
+            pending.remove(socket);
+            subscribers.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void DaemonServer::readRequests() {
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+    if (!socket) {
+        return;
+    }
+
+    QByteArray &buffer = pending[socket];
+    buffer.append(socket->readAll());
+
+    qsizetype newline;
+    while ((newline = buffer.indexOf('\n')) >= 0) {
+        const QByteArray line = buffer.left(newline).trimmed();
+        buffer.remove(0, newline + 1);
+        if (line.isEmpty()) {
+            continue;
+        }
+        QJsonParseError parseError;
+        const QJsonDocument document = QJsonDocument::fromJson(line, &parseError);
+        QJsonObject reply = document.isObject() ? handleRequest(socket, document.object())
+                                                : errorReply("Request is not a JSON object: " + parseError.errorString());
+        if (document.object().contains("request")) {
+            reply["reply"] = document.object().value("request");
+        }
+        socket->write(encode(reply));
+    }
+
+    if (buffer.size() > kMaxRequestLine) {
+        socket->write(encode(errorReply("Request too long.")));
+        socket->disconnectFromServer();
+    }
+}
+
+void DaemonServer::publish(const Job &job) {
+    if (subscribers.isEmpty()) {
+        return;
+    }
+    QJsonObject event;
+    event["event"] = "job";
+    event["job"] = job.toJson();
+    const QByteArray line = encode(event);
+    for (QLocalSocket *socket : std::as_const(subscribers)) {
+        socket->write(line);
+    }
+}
+
+QJsonObject DaemonServer::handleRequest(QLocalSocket *socket, const QJsonObject &request) {
+    const QString command = request["command"].toString();
+    QJsonObject reply;
+    reply["ok"] = true;
+
+    if (command == "submit") {
+        QString errorMessage;
+        const qint64 id = queue->submit(Job::fromJson(request["job"].toObject()), &errorMessage);
+        if (id == 0) {
+            return errorReply(errorMessage);
+        }
+        reply["id"] = double(id);
+        return reply;
+    }
+
+    if (command == "batch") {
+        QString errorMessage;
+        JobManifest manifest;
+        if (!manifest.parse(request["manifest"].toObject(), &errorMessage)) {
+            return errorReply(errorMessage);
+        }
+        const QList<qint64> ids = scheduler->submit(manifest, drives(request["refresh"].toBool()), &errorMessage);
+        if (ids.isEmpty()) {
+            return errorReply(errorMessage);
+        }
+        QJsonArray idArray;
+        for (const qint64 id : ids) {
+            idArray.append(double(id));
+        }
+        reply["batch"] = double(ids.first());
+        reply["ids"] = idArray;
+        reply["estimatedSeconds"] = double(scheduler->plannedMakespanMs() / 1000);
+        return reply;
+    }
+
+    if (command == "status") {
+        if (request.contains("id")) {
+            const Job *job = queue->find(qint64(request["id"].toDouble()));
+            if (!job) {
+                return errorReply("Unknown job.");
+            }
+            reply["job"] = job->toJson();
+            return reply;
+        }
+        QJsonArray jobs;
+        for (const Job &job : queue->jobs()) {
+            jobs.append(job.toJson());
+        }
+        reply["jobs"] = jobs;
+        return reply;
+    }
+
+    if (command == "cancel") {
+        if (!queue->cancel(qint64(request["id"].toDouble()))) {
+            return errorReply("No such job, or it has already finished.");
+        }
+        return reply;
+    }
+
+    if (command == "drives") {
+        QJsonArray array;
+        for (const DriveInfo &drive : drives(request["refresh"].toBool())) {
+            array.append(driveToJson(drive));
+        }
+        reply["drives"] = array;
+        return reply;
+    }
+
+    if (command == "subscribe") {
+        subscribers.insert(socket);
+        return reply;
+    }
+
+    return errorReply(QString("Unknown command \"%1\".").arg(command));
+}
+
+const QList<DriveInfo> &DaemonServer::drives(bool refresh) {
+    if (refresh || !drivesLoaded) {
+        driveTable = enumerator->enumerateRemovableDrives();
+        drivesLoaded = true;
+    }
+    return driveTable;
+}
+
+// --- Implementation of DaemonClient ---
+
+DaemonClient::DaemonClient(QObject *parent) : QObject(parent), socket(new QLocalSocket(this)) {
+    connect(socket, &QLocalSocket::readyRead, this, &DaemonClient::readMessages);
+    connect(socket, &QLocalSocket::disconnected, this, &DaemonClient::disconnected);
+}
+
+bool DaemonClient::connectToDaemon(const QString &name, int timeoutMs) {
+    socket->connectToServer(name);
+    if (!socket->waitForConnected(timeoutMs)) {
+        lastError = QString("Cannot reach the daemon at %1 (%2)").arg(name, socket->errorString());
+        return false;
+    }
+    return true;
+}
+
+bool DaemonClient::isConnected() const {
+    return socket->state() == QLocalSocket::ConnectedState;
+}
+
+bool DaemonClient::listDrives(QList<DriveInfo> *drives, bool refresh) {
+    QJsonObject request;
+    request["command"] = "drives";
+    request["refresh"] = refresh;
+    QJsonObject reply;
+    if (!call(request, &reply)) {
+        return false;
+    }
+    drives->clear();
+    for (const QJsonValue &value : reply["drives"].toArray()) {
+        drives->append(DaemonServer::driveFromJson(value.toObject()));
+    }
+    return true;
+}
+
+bool DaemonClient::listJobs(QList<Job> *jobs) {
+    QJsonObject request;
+    request["command"] = "status";
+    QJsonObject reply;
+    if (!call(request, &reply)) {
+        return false;
+    }
+    jobs->clear();
+    for (const QJsonValue &value : reply["jobs"].toArray()) {
+        jobs->append(Job::fromJson(value.toObject()));
+    }
+    return true;
+}
+
+qint64 DaemonClient::submit(const Job &job) {
+    QJsonObject request;
+    request["command"] = "submit";
+    request["job"] = job.toJson();
+    QJsonObject reply;
+    return call(request, &reply) ? qint64(reply["id"].toDouble()) : 0;
+}
+
+qint64 DaemonClient::submitManifest(const QJsonObject &manifest, QList<qint64> *ids) {
+    QJsonObject request;
+    request["command"] = "batch";
+    request["manifest"] = manifest;
+    request["refresh"] = true;
+    QJsonObject reply;
+    if (!call(request, &reply)) {
+        return 0;
+    }
+    if (ids) {
+        ids->clear();
+        for (const QJsonValue &id : reply["ids"].toArray()) {
+            ids->append(qint64(id.toDouble()));
+        }
+    }
+    return qint64(reply["batch"].toDouble());
+}
+
+bool DaemonClient::cancel(qint64 id) {
+    QJsonObject request;
+    request["command"] = "cancel";
+    request["id"] = double(id);
+    QJsonObject reply;
+    return call(request, &reply);
+}
+
+bool DaemonClient::subscribe() {
+    QJsonObject request;
+    request["command"] = "subscribe";
+    QJsonObject reply;
+    return call(request, &reply);
+}
+
+bool DaemonClient::call(QJsonObject request, QJsonObject *reply) {
+    const qint64 id = nextRequest++;
+    request["request"] = double(id);
+    if (socket->write(encode(request)) < 0) {
+        lastError = socket->errorString();
+        return false;
+    }
+    socket->flush();
+
+    // readMessages() runs from within waitForReadyRead and files the answer
+    while (!replies.contains(id)) {
+        if (!socket->waitForReadyRead(kIoTimeoutMs)) {
+            lastError = QString("Daemon did not answer: %1").arg(socket->errorString());
+            return false;
+        }
+    }
+    *reply = replies.take(id);
+    if (!reply->value("ok").toBool()) {
+        lastError = reply->value("error").toString();
+        return false;
+    }
+    return true;
+}
+
+void DaemonClient::readMessages() {
+    buffer.append(socket->readAll());
+
+    // Take all complete lines first: a jobChanged receiver may issue requests of its own
+    QList<QJsonObject> messages;
+    qsizetype newline;
+    while ((newline = buffer.indexOf('\n')) >= 0) {
+        const QJsonDocument document = QJsonDocument::fromJson(buffer.left(newline));
+        buffer.remove(0, newline + 1);
+        if (document.isObject()) {
+            messages.append(document.object());
+        }
+    }
+
+    for (const QJsonObject &message : messages) {
+        if (message.contains("reply")) {
+            replies.insert(qint64(message["reply"].toDouble()), message);
+        } else if (message["event"].toString() == "job") {
+            emit jobChanged(Job::fromJson(message["job"].toObject()));
+        }
+    }
+}
@@ -0,0 +1,128 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "DiskUtility.h"
+#include "JobQueue.h"
+#include <QByteArray>
+#include <QHash>
+#include <QJsonObject>
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QString>
+
+class BatchScheduler;
+class QLocalServer;
+class QLocalSocket;
+
+/**
+ * @brief Serves a JobQueue to local clients (the GUI, scripts) over a local socket.
+ *
+ * The protocol is JSON lines: every request and every response is one JSON
+ * object on a line of its own. Requests carry a "command" and, optionally, a
+ * "request" number that the response echoes as "reply"; responses have "ok"
+ * and, when it is false, "error".
+ *
+ *   {"command":"submit","job":{...}}       -> {"ok":true,"id":7}  (see Job::toJson)
+ *   {"command":"batch","manifest":{...}}   -> {"ok":true,"batch":7,"ids":[7,8,9],"estimatedSeconds":1800}
+ *                                             (see JobManifest, BatchScheduler; "refresh":true
+ *                                             re-enumerates drives before matching)
+ *   {"command":"status"}                   -> {"ok":true,"jobs":[...]}
+ *   {"command":"status","id":7}            -> {"ok":true,"job":{...}}
+ *   {"command":"cancel","id":7}            -> {"ok":true}
+ *   {"command":"drives","refresh":true}    -> {"ok":true,"drives":[...]}  (with "usb", see UsbLocation::toJson)
+ *   {"command":"subscribe"}                -> {"ok":true}, then {"event":"job","job":{...}}
+ *                                             lines for every change of every job
+ *
+ * The drive table is enumerated once and kept until a client asks for a
+ * refresh, so a submission does not wait for enumeration.
+ */
+class DaemonServer : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr const char *kDefaultName = "infernod";
+
+    explicit DaemonServer(JobQueue *queue, BatchScheduler *scheduler, QObject *parent = nullptr);
+
+    /**
+     * @brief Starts listening on a local socket (a Unix domain socket, or a named pipe on Windows).
+     * @param groupAccess Also admit the owner's group; otherwise only the owner may connect.
+     * @return bool True if the server is listening.
+     */
+    bool listen(const QString &name = kDefaultName, bool groupAccess = false);
+    QString fullServerName() const;
+
+    static QJsonObject driveToJson(const DriveInfo &drive);
+    static DriveInfo driveFromJson(const QJsonObject &obj);
+
+private slots:
+    void acceptConnections();
+    void readRequests();
+    void publish(const Job &job);
+
+private:
+    QJsonObject handleRequest(QLocalSocket *socket, const QJsonObject &request);
+    const QList<DriveInfo> &drives(bool refresh);
+
+    JobQueue *queue;
+    BatchScheduler *scheduler; // Plans the batches in the queue
+    QLocalServer *server;
+    DiskUtility *enumerator; // Only enumerates; jobs run on the queue's own instances
+    QList<DriveInfo> driveTable;
+    bool drivesLoaded = false;
+    QHash<QLocalSocket *, QByteArray> pending; // Partial request lines per connection
+    QSet<QLocalSocket *> subscribers;
+};
+
+/**
+ * @brief Client for DaemonServer.
+ *
+ * Requests block until the daemon answers (which it does right away; jobs run
+ * in the background), so they suit the GUI thread. Job events arrive through
+ * jobChanged once subscribe() has been called.
+ */
+class DaemonClient : public QObject {
+    Q_OBJECT
+
+public:
+    explicit DaemonClient(QObject *parent = nullptr);
+
+    bool connectToDaemon(const QString &name = DaemonServer::kDefaultName, int timeoutMs = 1000);
+    bool isConnected() const;
+
+    bool listDrives(QList<DriveInfo> *drives, bool refresh = false);
+    bool listJobs(QList<Job> *jobs);
+
+    /**
+     * @brief Submits a job (see Job::validate for what it needs).
+     * @return The job id, or 0 if the daemon refused it (see errorString()).
+     */
+    qint64 submit(const Job &job);
+
+    /**
+     * @brief Submits a JobManifest; the daemon matches its targets against freshly enumerated drives.
+     * @return The batch id, or 0 if the daemon refused the manifest.
+     */
+    qint64 submitManifest(const QJsonObject &manifest, QList<qint64> *ids = nullptr);
+    bool cancel(qint64 id);
+    bool subscribe();
+
+    QString errorString() const { return lastError; }
+
+signals:
+    void jobChanged(const Job &job);
+    void disconnected();
+
+private:
+    bool call(QJsonObject request, QJsonObject *reply);
+    void readMessages();
+
+    QLocalSocket *socket;
+    QByteArray buffer;
+    QHash<qint64, QJsonObject> replies; // Answers not yet claimed by call()
+    qint64 nextRequest = 1;
+    QString lastError;
+};
+
+#endif // DAEMON_H
@@ -0,0 +1,182 @@
+#include "DeviceProfile.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QLockFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <algorithm>
+
+namespace {
+const int kFormatVersion = 1;
+
+// Writes shorter than this say little about caches and throttling
+const qint64 kMinProfiledWrite = 256 * 1024 * 1024;
+const int kAveragedWrites = 4;
+
+// Serialises read-modify-write cycles within this process
+QMutex storeMutex;
+// Longest wait for another process's update; each one is a small file rewrite
+const int kLockTimeoutMs = 5000;
+} // namespace
+
+void DeviceProfile::addWrite(const ThroughputTelemetry &telemetry) {
+    const QList<ThroughputPhase> phases = telemetry.phases();
+    qint64 bytes = 0;
+    qint64 milliseconds = 0;
+    for (const ThroughputPhase &phase : phases) {
+        bytes += phase.bytes;
+        milliseconds += phase.durationMs;
+    }
+    if (bytes < kMinProfiledWrite || milliseconds <= 0) {
+        return; // Too short to say anything about the stick
+    }
+
+    qsizetype cacheEnd = -1;
+    for (qsizetype i = 0; i < phases.size() && cacheEnd < 0; ++i) {
+        if (phases[i].cause == PhaseCause::CacheExhausted) cacheEnd = i;
+    }
+    const double burst = phases.first().bytesPerSecond();
+    double sustained = double(bytes) * 1000.0 / double(milliseconds);
+    if (cacheEnd > 0) {
+        qint64 afterBytes = 0;
+        qint64 afterMs = 0;
+        for (qsizetype i = cacheEnd; i < phases.size(); ++i) {
+            afterBytes += phases[i].bytes;
+            afterMs += phases[i].durationMs;
+        }
+        if (afterMs > 0) sustained = double(afterBytes) * 1000.0 / double(afterMs);
+    }
+
+    // Running average over the last few writes, so one odd stick does not rewrite the profile
+    const int weight = std::min(writes, kAveragedWrites - 1);
+    auto blend = [weight](double old, double value) { return old > 0 ? (old * weight + value) / (weight + 1) : value; };
+    burstBytesPerSecond = blend(burstBytesPerSecond, burst);
+    sustainedBytesPerSecond = blend(sustainedBytesPerSecond, sustained);
+    if (cacheEnd > 0) {
+        cacheBytes = qint64(blend(double(cacheBytes), double(phases[cacheEnd].startBytes)));
+    }
+    ++writes;
+    lastPhases = telemetry.phasesToJson();
+    updated = QDateTime::currentDateTimeUtc();
+}
+
+qint64 DeviceProfile::predictMilliseconds(qint64 bytes) const {
+    if (sustainedBytesPerSecond <= 0) {
+        return -1;
+    }
+    double seconds = 0;
+    qint64 remaining = bytes;
+    if (cacheBytes > 0 && burstBytesPerSecond > 0) {
+        const qint64 cached = std::min(bytes, cacheBytes);
+        seconds += double(cached) / burstBytesPerSecond;
+        remaining -= cached;
+    }
+    seconds += double(remaining) / sustainedBytesPerSecond;
+    return qint64(seconds * 1000.0);
+}
+
+QJsonObject DeviceProfile::toJson() const {
+    QJsonObject object;
+    if (eraseBlockSize > 0) {
+        object["eraseBlockSize"] = QString::number(eraseBlockSize);
+    }
+    if (writes > 0) {
+        object["burstBytesPerSecond"] = burstBytesPerSecond;
+        object["sustainedBytesPerSecond"] = sustainedBytesPerSecond;
+        object["cacheBytes"] = QString::number(cacheBytes);
+        object["writes"] = writes;
+        object["lastPhases"] = lastPhases;
+    }
+    object["updated"] = updated.toString(Qt::ISODate);
+    return object;
+}
+
+DeviceProfile DeviceProfile::fromJson(const QString &model, const QJsonObject &object) {
+    DeviceProfile profile;
+    profile.model = model;
+    profile.eraseBlockSize = object.value("eraseBlockSize").toString().toLongLong();
+    profile.updated = QDateTime::fromString(object.value("updated").toString(), Qt::ISODate);
+    profile.burstBytesPerSecond = object.value("burstBytesPerSecond").toDouble();
+    profile.sustainedBytesPerSecond = object.value("sustainedBytesPerSecond").toDouble();
+    profile.cacheBytes = object.value("cacheBytes").toString().toLongLong();
+    profile.writes = object.value("writes").toInt();
+    profile.lastPhases = object.value("lastPhases").toArray();
+    return profile;
+}
+
+// --- Implementation of DeviceProfileStore ---
+
+DeviceProfileStore::DeviceProfileStore(const QString &filePath) : path(filePath) {
+}
+
+QString DeviceProfileStore::defaultPath() {
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/device-profiles.json";
+}
+
+QJsonObject DeviceProfileStore::readAll() const {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QJsonObject();
+    }
+    const QJsonObject top = QJsonDocument::fromJson(file.readAll()).object();
+    return top.value("version").toInt() == kFormatVersion ? top.value("devices").toObject() : QJsonObject();
+}
+
+std::optional<DeviceProfile> DeviceProfileStore::find(const QString &model) const {
+    if (model.isEmpty()) {
+        return std::nullopt;
+    }
+    QMutexLocker locker(&storeMutex);
+    const QJsonObject devices = readAll();
+    if (!devices.contains(model)) {
+        return std::nullopt;
+    }
+    return DeviceProfile::fromJson(model, devices.value(model).toObject());
+}
+
+bool DeviceProfileStore::store(const DeviceProfile &profile, QString *errorMessage) {
+    return update(profile.model, [&profile](DeviceProfile &stored) { stored = profile; }, errorMessage);
+}
+
+bool DeviceProfileStore::update(const QString &model, const std::function<void(DeviceProfile &)> &change,
+                                QString *errorMessage) {
+    if (model.isEmpty()) {
+        if (errorMessage) *errorMessage = "Device profiles need a model name.";
+        return false;
+    }
+    // The mutex covers this process's threads, the lock file the GUI and the daemon
+    QMutexLocker locker(&storeMutex);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QLockFile lock(path + ".lock");
+    if (!lock.tryLock(kLockTimeoutMs)) {
+        if (errorMessage) *errorMessage = QString("Device profiles are locked by another process (%1).").arg(path);
+        return false;
+    }
+
+    QJsonObject devices = readAll();
+    DeviceProfile profile = devices.contains(model) ? DeviceProfile::fromJson(model, devices.value(model).toObject())
+                                                    : DeviceProfile{model};
+    change(profile);
+    profile.model = model;
+    devices[model] = profile.toJson();
+
+    QJsonObject top;
+    top["version"] = kFormatVersion;
+    top["devices"] = devices;
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorMessage) *errorMessage = file.errorString();
+        return false;
+    }
+    file.write(QJsonDocument(top).toJson(QJsonDocument::Indented));
+    if (!file.commit()) {
+        if (errorMessage) *errorMessage = file.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,84 @@
+#ifndef DEVICEPROFILE_H
+#define DEVICEPROFILE_H
+
+#include "ThroughputTelemetry.h"
+#include <QString>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <functional>
+#include <optional>
+
+/**
+ * @brief What Inferno has learned about a model of stick, keyed by DriveInfo::model.
+ */
+struct DeviceProfile {
+    QString model;
+    qint64 eraseBlockSize = 0; // Estimated erase block / allocation unit in bytes, 0 if unknown
+    QDateTime updated;
+
+    // Write behaviour, averaged over the last few writes (see ThroughputTelemetry)
+    double burstBytesPerSecond = 0;     // Until the first slowdown
+    double sustainedBytesPerSecond = 0; // After it, or overall if there was none
+    qint64 cacheBytes = 0;              // Written before the SLC cache ran out, 0 if never seen
+    int writes = 0;
+    QJsonArray lastPhases;              // Phases of the most recent write
+
+    /**
+     * @brief Folds the phases of a completed write into the averages.
+     */
+    void addWrite(const ThroughputTelemetry &telemetry);
+
+    /**
+     * @brief Expected time to write bytes onto a stick of this model, or -1 if there is no history.
+     */
+    qint64 predictMilliseconds(qint64 bytes) const;
+
+    QJsonObject toJson() const;
+    static DeviceProfile fromJson(const QString &model, const QJsonObject &object);
+};
+
+/**
+ * @brief Persistent per-model device profiles in a small JSON file (device-profiles.json).
+ *
+ * Sticks of the same model share their flash geometry, so anything measured
+ * once (such as the erase block size) is reused for every later stick of
+ * that model instead of being probed again. The file is re-read on every
+ * lookup and replaced atomically on every store, and updates hold a lock
+ * file, so several jobs and processes can share it. Thread-safe.
+ */
+class DeviceProfileStore {
+public:
+    explicit DeviceProfileStore(const QString &filePath = defaultPath());
+
+    /**
+     * @brief The store in the application data directory.
+     */
+    static QString defaultPath();
+
+    /**
+     * @brief Looks up the profile of a model.
+     */
+    std::optional<DeviceProfile> find(const QString &model) const;
+
+    /**
+     * @brief Adds or replaces the profile of profile.model.
+     */
+    bool store(const DeviceProfile &profile, QString *errorMessage = nullptr);
+
+    /**
+     * @brief Applies change to the stored profile of model (or a new one) as one atomic read-modify-write.
+     *
+     * Use this instead of find() followed by store() whenever the new profile
+     * depends on the old one, so concurrent writes are not lost.
+     */
+    bool update(const QString &model, const std::function<void(DeviceProfile &)> &change,
+                QString *errorMessage = nullptr);
+
+private:
+    QJsonObject readAll() const;
+
+    QString path;
+};
+
+#endif // DEVICEPROFILE_H
@@ -1,6 +1,162 @@
 #include "DiskUtility.h"
+#include "BlockDevice.h"
+#include "BmapWriter.h"
+#include "CapacityCheck.h"
+#include "DeviceProfile.h"
+#include "DriveBackup.h"
+#include "DriveClone.h"
+#include "DriveErase.h"
+#include "EraseBlockProbe.h"
+#include "FormatProbe.h"
+#include "ImageSource.h"
+#include "ImageWriter.h"
+#include "Instrumentation.h"
+#include "IoStats.h"
+#include "Metrics.h"
+#include "PipelineTrace.h"
+#include "Probes.h"
+#include "ThroughputTelemetry.h"
+#include "TransferProgress.h"
+#include "UsbTopology.h"
 #include <QDebug>
-#include <QTimer>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+#include <QThread>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#ifdef Q_OS_WIN
+#include <qt_windows.h>
+#include <winioctl.h>
+#endif
+
+namespace {
+// Durable progress of image writes is recorded this often, at the cost of one flush each
+const qint64 kCheckpointInterval = 256LL * 1024 * 1024;
+
+// Sticks that passed the capacity check in this process, so a batch burning
+// the same sticks again does not test them again (see checkCapacity)
+QMutex verifiedMutex;
+QSet<QString> verifiedDrives;
+
+// Keeps Metrics up to date for one job: the active count, live I/O statistics, the result and throughput
+class JobMetrics {
+public:
+    explicit JobMetrics(const QString &kind) : kind(kind) {
+        Metrics::instance().jobStarted();
+        clock.start();
+    }
+    ~JobMetrics() {
+        if (!finished) finish(false);
+    }
+
+    void attach(const QString &devicePath, IoStats *stats) {
+        Metrics::instance().attachIoStats(devicePath, stats);
+        attached.append({devicePath, stats});
+    }
+
+    // Gauges of a device follow the job's write queue
+    std::function<QueueControlState()> queueState(const QString &devicePath, std::function<QueueControlState()> read) {
+        Metrics::Device *device = Metrics::instance().device(devicePath);
+        return [device, read]() {
+            const QueueControlState state = read();
+            device->queueDepth = state.depth;
+            device->bytesPerSecond = qint64(state.bytesPerSecond);
+            return state;
+        };
+    }
+
+    void finish(bool success) {
+        finished = true;
+        qint64 bytes = 0; // Of the busiest device: the target of a write, the source of a backup
+        for (const auto &[path, stats] : attached) {
+            const IoHistograms histograms = stats->merged();
+            bytes = std::max({bytes, qint64(histograms.writeSize.valueSum()), qint64(histograms.readSize.valueSum())});
+            Metrics::instance().attachIoStats(path, nullptr);
+            Metrics::Device *device = Metrics::instance().device(path);
+            device->queueDepth = 0;
+            device->bytesPerSecond = 0;
+        }
+        Metrics::instance().jobFinished(kind, success, bytes, clock.elapsed());
+    }
+
+private:
+    QString kind;
+    QElapsedTimer clock;
+    QList<QPair<QString, IoStats *>> attached;
+    bool finished = false;
+};
+// Single-line sysfs attribute, e.g. /sys/block/sdb/size; empty if absent
+QString readSysfs(const QString &path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QString();
+    }
+    return QString::fromUtf8(file.readAll()).trimmed();
+}
+
+#ifdef Q_OS_WIN
+// \\.\PhysicalDrive0 and up are probed; disks past the first gap are still found
+const int kMaxPhysicalDrives = 32;
+
+HANDLE openForQuery(const QString &path) {
+    // No access rights are needed for the storage IOCTLs, so this works without elevation
+    return CreateFileW(reinterpret_cast<LPCWSTR>(path.utf16()), 0, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                       OPEN_EXISTING, 0, nullptr);
+}
+
+// Disk number of the physical drive behind a volume such as \\.\E:, or -1
+int diskNumberOf(const QString &volumePath) {
+    const HANDLE handle = openForQuery(volumePath);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    STORAGE_DEVICE_NUMBER number = {};
+    DWORD returned = 0;
+    const bool ok = DeviceIoControl(handle, IOCTL_STORAGE_GET_DEVICE_NUMBER, nullptr, 0, &number, sizeof(number),
+                                    &returned, nullptr);
+    CloseHandle(handle);
+    return ok && number.DeviceType == FILE_DEVICE_DISK ? int(number.DeviceNumber) : -1;
+}
+
+// Bus, removable flag, vendor/product and size of a physical drive; false if it cannot be queried
+bool describeDisk(const QString &path, DriveInfo *drive, bool *external) {
+    const HANDLE handle = openForQuery(path);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    STORAGE_PROPERTY_QUERY query = {};
+    query.PropertyId = StorageDeviceProperty;
+    query.QueryType = PropertyStandardQuery;
+    char buffer[1024] = {};
+    DWORD returned = 0;
+    bool ok = DeviceIoControl(handle, IOCTL_STORAGE_QUERY_PROPERTY, &query, sizeof(query), buffer, sizeof(buffer),
+                              &returned, nullptr);
+    if (ok) {
+        const auto *descriptor = reinterpret_cast<const STORAGE_DEVICE_DESCRIPTOR *>(buffer);
+        auto text = [&](DWORD offset) {
+            return offset > 0 && offset < returned ? QString::fromLatin1(buffer + offset).trimmed() : QString();
+        };
+        *external = descriptor->RemovableMedia || descriptor->BusType == BusTypeUsb
+                    || descriptor->BusType == BusTypeSd || descriptor->BusType == BusTypeMmc;
+        drive->model = QString("%1 %2").arg(text(descriptor->VendorIdOffset), text(descriptor->ProductIdOffset)).trimmed();
+        GET_LENGTH_INFORMATION length = {};
+        ok = DeviceIoControl(handle, IOCTL_DISK_GET_LENGTH_INFO, nullptr, 0, &length, sizeof(length), &returned,
+                             nullptr);
+        drive->size = ok ? qint64(length.Length.QuadPart) : 0;
+        ok = true; // An empty card reader has no length; the caller skips it
+    }
+    CloseHandle(handle);
+    return ok;
+}
+#endif
+} // namespace
 
 // --- Implementation of DiskUtility ---
 
@@ -9,50 +165,496 @@ DiskUtility::DiskUtility(QObject *parent) : QObject(parent) {
 }
 
 QList<DriveInfo> DiskUtility::enumerateRemovableDrives() {
-    // NOTE: In a real Windows application, this function would use WinAPI calls
-    // like GetLogicalDrives, GetDriveType, and DeviceIoControl to get detailed info.
-    // For this example, we return dummy data.
-    
     QList<DriveInfo> drives;
-    
-    DriveInfo drive1;
-    drive1.devicePath = "\\\\.\\PhysicalDrive1";
-    drive1.driveLetter = "E:";
-    drive1.model = "SanDisk Cruzer Blade (16 GB)";
-    drive1.size = 16000000000LL; // 16 GB
-    drive1.isRemovable = true;
-    drives.append(drive1);
-
-    DriveInfo drive2;
-    drive2.devicePath = "\\\\.\\PhysicalDrive2";
-    drive2.driveLetter = "F:";
-    drive2.model = "Kingston DataTraveler (32 GB)";
-    drive2.size = 32000000000LL; // 32 GB
-    drive2.isRemovable = true;
-    drives.append(drive2);
-
-    qDebug() << "Simulated removable drives enumerated.";
+#ifdef Q_OS_LINUX
+    const QDir blockDir("/sys/block");
+    for (const QString &name : blockDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::System, QDir::Name)) {
+        // Sticks and card readers either say they are removable or hang off USB
+        const bool removable = readSysfs(blockDir.filePath(name + "/removable")) == "1";
+        if (!removable && !UsbTopology::locate("/dev/" + name).isValid()) {
+            continue;
+        }
+        const DriveIdentity identity = identify("/dev/" + name);
+        if (identity.size <= 0) {
+            continue; // Empty card reader slot
+        }
+        DriveInfo drive;
+        drive.devicePath = "/dev/" + name;
+        drive.model = identity.model.isEmpty() ? name : identity.model;
+        drive.size = identity.size;
+        drive.isRemovable = true;
+        drives.append(drive);
+    }
+#elif defined(Q_OS_WIN)
+    // Volume letters, by the disk that holds them
+    QMap<int, QStringList> letters;
+    const DWORD mask = GetLogicalDrives();
+    for (int i = 0; i < 26; ++i) {
+        if (mask & (DWORD(1) << i)) {
+            const QString letter = QString("%1:").arg(QChar('A' + i));
+            const int number = diskNumberOf("\\\\.\\" + letter);
+            if (number >= 0) letters[number].append(letter);
+        }
+    }
+    for (int number = 0; number < kMaxPhysicalDrives; ++number) {
+        DriveInfo drive;
+        drive.devicePath = QString("\\\\.\\PhysicalDrive%1").arg(number);
+        bool external = false;
+        if (!describeDisk(drive.devicePath, &drive, &external) || !external || drive.size <= 0) {
+            continue; // Missing, internal, or an empty card reader slot
+        }
+        if (drive.model.isEmpty()) drive.model = QString("Disk %1").arg(number);
+        drive.driveLetter = letters.value(number).join(", ");
+        drive.isRemovable = true;
+        drives.append(drive);
+    }
+#else
+    // No enumeration on this platform; jobs must name their device paths
+#endif
+    qDebug() << "Enumerated" << drives.size() << "removable drives.";
     return drives;
 }
 
 bool DiskUtility::startImageWrite(const QString &imagePath, const QString &drivePath, const QMap<QString, QVariant> &options) {
-    // NOTE: In a real application, this would start a QThread or a separate process
-    // to handle the low-level, time-consuming disk write operation.
-    
-    qDebug() << "Starting simulated image write:" << imagePath << "to" << drivePath;
+    // The probe reads only the first and last few KB, so this is cheap even for huge images
+    const ProbeResult probe = FormatProbe::probe(imagePath, options.value("acceptRaw", false).toBool());
+    if (!probe.writable()) {
+        qDebug() << "Cannot write" << imagePath << ":" << probe.error;
+        return false;
+    }
+    qDebug() << "Image format:" << probe.description;
+
+    // Sparse raw images that come with a bmap are written range by range
+    const QString bmapPath = options.value("bmapPath", probe.bmapPath).toString();
+    if (!bmapPath.isEmpty()) {
+        return startBmapWrite(imagePath, bmapPath, drivePath, options);
+    }
+
+    // Plain ISO/raw data goes through the same pipeline as container formats
+    // (qcow2, VHD/VHDX, VMDK, Android sparse, ...), which expand in the stream
+    return startSourceWrite(imagePath, probe.formatName, drivePath, options);
+}
+
+bool DiskUtility::startBmapWrite(const QString &imagePath, const QString &bmapPath, const QString &drivePath, const QMap<QString, QVariant> &options) {
+    BmapFile bmap;
+    QString errorMessage;
+    if (!bmap.load(bmapPath, &errorMessage)) {
+        qDebug() << "Cannot use bmap" << bmapPath << ":" << errorMessage;
+        return false;
+    }
+    if (!BmapWriter::canRead(imagePath)) {
+        qDebug() << "Bmap write of" << imagePath << "needs xz support, which is not compiled in.";
+        return false;
+    }
+
+    qDebug() << "Starting bmap write:" << imagePath << "to" << drivePath << "using" << bmapPath;
     qDebug() << "Options:" << options;
 
-    // Simulate the asynchronous writing process with a QTimer
-    QTimer::singleShot(1000, [this]() {
-        emit progressUpdated(25, "Formatting drive and preparing partitions...");
+    auto writer = std::make_shared<BmapWriter>(imagePath, bmap, drivePath, options.value("directIo", true).toBool(),
+                                               EraseOptions::fromMap(options));
+    writer->setResumeOffset(options.value("resumeOffset", 0).toLongLong());
+    writer->setCheckpoint([this, drivePath](qint64 offset) { emit checkpointReached(drivePath, offset); },
+                          kCheckpointInterval);
+    const bool probe = options.value("probeEraseBlock", true).toBool();
+    const bool verify = options.value("verifyCapacity", false).toBool();
+    const QString traceFile = options.value("traceFile").toString();
+    cancelJob = [writer]() { writer->cancel(); };
+    QThread *worker = QThread::create([this, writer, drivePath, probe, verify, traceFile]() {
+        const QString message = tr("Writing mapped blocks (bmap)...");
+        QString errorMessage;
+        INFERNO_PROBE2(job_start, "bmap", drivePath.toLocal8Bit().constData());
+        IoStats ioStats;
+        JobMetrics metrics("bmap");
+        metrics.attach(drivePath, &ioStats);
+        const std::unique_ptr<PipelineTrace> trace = traceFile.isEmpty() ? nullptr : std::make_unique<PipelineTrace>();
+        bool capacityOk = true;
+        if (verify) {
+            const PipelineTrace::Span span(trace.get(), "verify");
+            capacityOk = checkCapacity(drivePath, &errorMessage, &ioStats, nullptr, true);
+        }
+        if (!capacityOk) {
+            reportIoStats(drivePath, ioStats);
+            saveTrace(trace.get(), traceFile);
+            INFERNO_PROBE3(job_end, "bmap", drivePath.toLocal8Bit().constData(), 0);
+            emit writeCompleted(false, errorMessage);
+            return;
+        }
+        if (probe) writer->setEraseBlockSize(eraseBlockSize(drivePath));
+        writer->setIoStats(&ioStats);
+        writer->setTrace(trace.get());
+        auto telemetry = std::make_shared<ThroughputTelemetry>();
+        const auto queueState = metrics.queueState(drivePath, [writer]() { return writer->queueState(); });
+        const bool success = writer->run(progressReporter(message, queueState, telemetry), &errorMessage);
+        if (success) recordWrite(drivePath, *telemetry);
+        reportIoStats(drivePath, ioStats);
+        saveTrace(trace.get(), traceFile);
+        metrics.finish(success);
+        INFERNO_PROBE3(job_end, "bmap", drivePath.toLocal8Bit().constData(), int(success));
+        emit writeCompleted(success, errorMessage);
     });
-    QTimer::singleShot(3000, [this]() {
-        emit progressUpdated(75, "Writing image data (Superior Asynchronous I/O in progress)...");
+    connect(worker, &QThread::finished, worker, &QObject::deleteLater);
+    worker->start();
+    return true;
+}
+
+bool DiskUtility::startSourceWrite(const QString &imagePath, const QString &formatName, const QString &drivePath, const QMap<QString, QVariant> &options) {
+    qDebug() << "Starting" << formatName << "image write:" << imagePath << "to" << drivePath;
+    qDebug() << "Options:" << options;
+
+    auto writer = std::make_shared<ImageWriter>(imagePath, drivePath, options.value("directIo", true).toBool(),
+                                                EraseOptions::fromMap(options));
+    writer->setAcceptRaw(options.value("acceptRaw", false).toBool());
+    writer->setResumeOffset(options.value("resumeOffset", 0).toLongLong());
+    writer->setCheckpoint([this, drivePath](qint64 offset) { emit checkpointReached(drivePath, offset); },
+                          kCheckpointInterval);
+    const bool probe = options.value("probeEraseBlock", true).toBool();
+    const bool verify = options.value("verifyCapacity", false).toBool();
+    const QString traceFile = options.value("traceFile").toString();
+    cancelJob = [writer]() { writer->cancel(); };
+    QThread *worker = QThread::create([this, writer, formatName, drivePath, probe, verify, traceFile]() {
+        const QString message = tr("Writing %1 image...").arg(formatName);
+        QString errorMessage;
+        INFERNO_PROBE2(job_start, "image", drivePath.toLocal8Bit().constData());
+        IoStats ioStats;
+        JobMetrics metrics("image");
+        metrics.attach(drivePath, &ioStats);
+        const std::unique_ptr<PipelineTrace> trace = traceFile.isEmpty() ? nullptr : std::make_unique<PipelineTrace>();
+        bool capacityOk = true;
+        if (verify) {
+            const PipelineTrace::Span span(trace.get(), "verify");
+            capacityOk = checkCapacity(drivePath, &errorMessage, &ioStats, nullptr, true);
+        }
+        if (!capacityOk) {
+            reportIoStats(drivePath, ioStats);
+            saveTrace(trace.get(), traceFile);
+            INFERNO_PROBE3(job_end, "image", drivePath.toLocal8Bit().constData(), 0);
+            emit writeCompleted(false, errorMessage);
+            return;
+        }
+        if (probe) writer->setEraseBlockSize(eraseBlockSize(drivePath));
+        writer->setIoStats(&ioStats);
+        writer->setTrace(trace.get());
+        auto telemetry = std::make_shared<ThroughputTelemetry>();
+        const auto queueState = metrics.queueState(drivePath, [writer]() { return writer->queueState(); });
+        const bool success = writer->run(progressReporter(message, queueState, telemetry), &errorMessage);
+        if (success) recordWrite(drivePath, *telemetry);
+        reportIoStats(drivePath, ioStats);
+        saveTrace(trace.get(), traceFile);
+        metrics.finish(success);
+        INFERNO_PROBE3(job_end, "image", drivePath.toLocal8Bit().constData(), int(success));
+        emit writeCompleted(success, errorMessage);
     });
-    QTimer::singleShot(5000, [this]() {
-        emit progressUpdated(100, "Verification and finalization complete.");
-        emit writeCompleted(true, "");
+    connect(worker, &QThread::finished, worker, &QObject::deleteLater);
+    worker->start();
+    return true;
+}
+
+bool DiskUtility::startDriveBackup(const QString &drivePath, const QString &imagePath, const QMap<QString, QVariant> &options) {
+    if (!DriveBackup::isSupported()) {
+        qDebug() << "Drive backup requested but zstd support is not compiled in.";
+        return false;
+    }
+
+    qDebug() << "Starting drive backup:" << drivePath << "to" << imagePath;
+    qDebug() << "Options:" << options;
+
+    auto backup = std::make_shared<DriveBackup>(drivePath, imagePath, BackupOptions::fromMap(options));
+    const QString traceFile = options.value("traceFile").toString();
+    cancelJob = [backup]() { backup->cancel(); };
+    QThread *worker = QThread::create([this, backup, drivePath, traceFile]() {
+        const QString message = tr("Backing up %1 (compressing)...").arg(drivePath);
+        QString errorMessage;
+        INFERNO_PROBE2(job_start, "backup", drivePath.toLocal8Bit().constData());
+        IoStats ioStats;
+        JobMetrics metrics("backup");
+        metrics.attach(drivePath, &ioStats);
+        const std::unique_ptr<PipelineTrace> trace = traceFile.isEmpty() ? nullptr : std::make_unique<PipelineTrace>();
+        backup->setIoStats(&ioStats);
+        backup->setTrace(trace.get());
+        const bool success = backup->run(progressReporter(message), &errorMessage);
+        reportIoStats(drivePath, ioStats);
+        saveTrace(trace.get(), traceFile);
+        metrics.finish(success);
+        INFERNO_PROBE3(job_end, "backup", drivePath.toLocal8Bit().constData(), int(success));
+        emit writeCompleted(success, errorMessage);
     });
+    connect(worker, &QThread::finished, worker, &QObject::deleteLater);
+    worker->start();
+    return true;
+}
 
+bool DiskUtility::startDriveClone(const QString &sourceDrivePath, const QStringList &targetDrivePaths, const QMap<QString, QVariant> &options) {
+    if (targetDrivePaths.isEmpty() || targetDrivePaths.contains(sourceDrivePath)) {
+        qDebug() << "Drive clone needs at least one target that is not the source.";
+        return false;
+    }
+
+    qDebug() << "Starting drive clone:" << sourceDrivePath << "to" << targetDrivePaths;
+    qDebug() << "Options:" << options;
+
+    auto clone = std::make_shared<DriveClone>(sourceDrivePath, targetDrivePaths, CloneOptions::fromMap(options));
+    const QString traceFile = options.value("traceFile").toString();
+    cancelJob = [clone]() { clone->cancel(); };
+    QThread *worker = QThread::create([this, clone, sourceDrivePath, targetDrivePaths, traceFile]() {
+        const QString message = tr("Cloning %1 to %n drive(s)...", nullptr, targetDrivePaths.size()).arg(sourceDrivePath);
+        QString errorMessage;
+        INFERNO_PROBE2(job_start, "clone", sourceDrivePath.toLocal8Bit().constData());
+        const QStringList devicePaths = QStringList{sourceDrivePath} + targetDrivePaths;
+        std::vector<std::unique_ptr<IoStats>> ioStats;
+        JobMetrics metrics("clone");
+        for (const QString &devicePath : devicePaths) {
+            ioStats.push_back(std::make_unique<IoStats>());
+            clone->setIoStats(devicePath, ioStats.back().get());
+            metrics.attach(devicePath, ioStats.back().get());
+        }
+        const std::unique_ptr<PipelineTrace> trace = traceFile.isEmpty() ? nullptr : std::make_unique<PipelineTrace>();
+        clone->setTrace(trace.get());
+        const bool success = clone->run(progressReporter(message), &errorMessage);
+        for (qsizetype i = 0; i < devicePaths.size(); ++i) {
+            reportIoStats(devicePaths[i], *ioStats[size_t(i)]);
+        }
+        saveTrace(trace.get(), traceFile);
+        metrics.finish(success);
+        INFERNO_PROBE3(job_end, "clone", sourceDrivePath.toLocal8Bit().constData(), int(success));
+        emit writeCompleted(success, errorMessage);
+    });
+    connect(worker, &QThread::finished, worker, &QObject::deleteLater);
+    worker->start();
     return true;
 }
+
+bool DiskUtility::startDriveErase(const QStringList &drivePaths, const QMap<QString, QVariant> &options) {
+    EraseOptions eraseOptions = EraseOptions::fromMap(options);
+    if (eraseOptions.mode == EraseMode::None) {
+        eraseOptions.mode = EraseMode::Discard;
+    }
+    if (drivePaths.isEmpty()) {
+        qDebug() << "Drive erase needs at least one drive.";
+        return false;
+    }
+
+    qDebug() << "Starting drive erase:" << drivePaths;
+    qDebug() << "Options:" << options;
+
+    auto erase = std::make_shared<DriveErase>(drivePaths, eraseOptions);
+    cancelJob = [erase]() { erase->cancel(); };
+    QThread *worker = QThread::create([this, erase, drivePaths]() {
+        const QString message = tr("Erasing %n drive(s)...", nullptr, drivePaths.size());
+        QString errorMessage;
+        INFERNO_PROBE2(job_start, "erase", drivePaths.join(',').toLocal8Bit().constData());
+        JobMetrics metrics("erase");
+        const bool success = erase->run(progressReporter(message), &errorMessage);
+        metrics.finish(success);
+        INFERNO_PROBE3(job_end, "erase", drivePaths.join(',').toLocal8Bit().constData(), int(success));
+        emit writeCompleted(success, errorMessage);
+    });
+    connect(worker, &QThread::finished, worker, &QObject::deleteLater);
+    worker->start();
+    return true;
+}
+
+bool DiskUtility::startCapacityCheck(const QString &drivePath) {
+    qDebug() << "Starting capacity check of" << drivePath;
+
+    auto cancelled = std::make_shared<std::atomic<bool>>(false);
+    cancelJob = [cancelled]() { *cancelled = true; };
+    QThread *worker = QThread::create([this, drivePath, cancelled]() {
+        emit progressUpdated(0, tr("Checking the real capacity of %1...").arg(drivePath));
+        QString errorMessage;
+        IoStats ioStats;
+        INFERNO_PROBE2(job_start, "capacity", drivePath.toLocal8Bit().constData());
+        JobMetrics metrics("capacity");
+        metrics.attach(drivePath, &ioStats);
+        const bool success = checkCapacity(drivePath, &errorMessage, &ioStats, cancelled.get());
+        metrics.finish(success);
+        reportIoStats(drivePath, ioStats);
+        INFERNO_PROBE3(job_end, "capacity", drivePath.toLocal8Bit().constData(), int(success));
+        emit writeCompleted(success, errorMessage);
+    });
+    connect(worker, &QThread::finished, worker, &QObject::deleteLater);
+    worker->start();
+    return true;
+}
+
+void DiskUtility::cancel() {
+    if (cancelJob) cancelJob();
+}
+
+bool DiskUtility::checkCapacity(const QString &drivePath, QString *errorMessage, IoStats *ioStats,
+                                const std::atomic<bool> *cancelled, bool reusePass) {
+    // Only a serial tells one stick from another of the same model and size
+    const DriveIdentity identity = identify(drivePath);
+    const QString key = identity.serial.isEmpty()
+        ? QString()
+        : QString("%1|%2|%3").arg(identity.model, identity.serial).arg(identity.size);
+    if (reusePass && !key.isEmpty()) {
+        QMutexLocker locker(&verifiedMutex);
+        if (verifiedDrives.contains(key)) {
+            qDebug() << "Capacity of" << drivePath << "was verified earlier, not checking again.";
+            return true;
+        }
+    }
+
+    BlockDevice device;
+    if (!device.open(drivePath, true, true, errorMessage)) {
+        return false;
+    }
+    device.setIoStats(ioStats);
+    const std::atomic<bool> notCancelled{false};
+    CapacityReport report;
+    if (!CapacityCheck::run(device, &report, cancelled ? *cancelled : notCancelled, errorMessage)) {
+        return false;
+    }
+    if (!report.genuine()) {
+        Metrics::instance().device(drivePath)->verifyFailures += report.failures;
+        if (errorMessage) *errorMessage = report.summary();
+        return false;
+    }
+    if (!key.isEmpty()) {
+        QMutexLocker locker(&verifiedMutex);
+        verifiedDrives.insert(key);
+    }
+    return true;
+}
+
+DriveIdentity DiskUtility::identify(const QString &devicePath, const QString &sysfsRoot) {
+    DriveIdentity identity;
+#ifdef Q_OS_LINUX
+    const QString device = QFileInfo(devicePath).canonicalFilePath(); // Resolves /dev/disk/by-id links
+    const QString name = QFileInfo(device.isEmpty() ? devicePath : device).fileName();
+    QString blockDir = QFileInfo(sysfsRoot + "/class/block/" + name).canonicalFilePath();
+    if (blockDir.isEmpty()) {
+        return identity;
+    }
+    if (QFileInfo::exists(blockDir + "/partition")) {
+        blockDir = QFileInfo(blockDir).path(); // Partitions sit in their disk's directory
+    }
+    identity.size = readSysfs(blockDir + "/size").toLongLong() * 512; // Always in 512-byte units
+    identity.model = (readSysfs(blockDir + "/device/vendor") + ' ' + readSysfs(blockDir + "/device/model"))
+                         .simplified();
+
+    // SCSI disks behind a USB bridge have no serial; the USB device above them does
+    const QString devicesRoot = QFileInfo(sysfsRoot + "/devices").canonicalFilePath();
+    for (QString dir = QFileInfo(blockDir + "/device").canonicalFilePath();
+         !dir.isEmpty() && dir.startsWith(devicesRoot + '/'); dir = QFileInfo(dir).path()) {
+        identity.serial = readSysfs(dir + "/serial");
+        if (!identity.serial.isEmpty()) {
+            break;
+        }
+    }
+#else
+    Q_UNUSED(devicePath);
+    Q_UNUSED(sysfsRoot);
+#endif
+    return identity;
+}
+
+QString DiskUtility::modelOf(const QString &drivePath) {
+    const DriveIdentity identity = identify(drivePath);
+    if (identity.isValid()) {
+        return identity.profileKey();
+    }
+    for (const DriveInfo &drive : enumerateRemovableDrives()) {
+        if (drive.devicePath == drivePath) {
+            return drive.model;
+        }
+    }
+    return QString();
+}
+
+void DiskUtility::reportIoStats(const QString &devicePath, const IoStats &stats) {
+    qDebug() << "I/O latency of" << devicePath << ":" << stats.summary();
+    if constexpr (Instrumentation::kEnabled) {
+        qDebug().noquote() << "Stage totals since start:\n" + Instrumentation::report();
+    }
+    emit ioStatistics(devicePath, stats.toJson());
+}
+
+void DiskUtility::saveTrace(const PipelineTrace *trace, const QString &path) {
+    if (!trace) {
+        return;
+    }
+    QString errorMessage;
+    if (trace->save(path, &errorMessage)) {
+        qDebug() << "Pipeline trace saved to" << path;
+    } else {
+        qDebug() << "Cannot save the pipeline trace to" << path << ":" << errorMessage;
+    }
+}
+
+void DiskUtility::recordWrite(const QString &drivePath, const ThroughputTelemetry &telemetry) {
+    const QString model = modelOf(drivePath);
+    if (model.isEmpty()) {
+        return;
+    }
+    QString errorMessage;
+    if (!DeviceProfileStore().update(model, [&telemetry](DeviceProfile &profile) { profile.addWrite(telemetry); },
+                                     &errorMessage)) {
+        qDebug() << "Cannot save the device profile of" << model << ":" << errorMessage;
+    }
+}
+
+qint64 DiskUtility::eraseBlockSize(const QString &drivePath) {
+    const QString model = modelOf(drivePath);
+    if (model.isEmpty()) {
+        // The result could not be saved, so every burn would pay for the probe again
+        qDebug() << "Not probing the erase block of" << drivePath << ": its model is unknown.";
+        return 0;
+    }
+
+    // Sticks of one model share their geometry, so each model is probed once
+    DeviceProfileStore profiles;
+    const std::optional<DeviceProfile> profile = profiles.find(model);
+    if (profile && profile->eraseBlockSize > 0) {
+        return profile->eraseBlockSize;
+    }
+
+    BlockDevice device;
+    if (!device.open(drivePath, false, true)) {
+        return 0;
+    }
+    QList<EraseBlockProbe::Sample> samples;
+    const qint64 bytes = EraseBlockProbe::probe(device, &samples);
+    for (const EraseBlockProbe::Sample &sample : samples) {
+        qDebug() << "Erase block probe" << sample.alignment << "bytes: before" << sample.before << "us, across"
+                 << sample.across << "us, after" << sample.after << "us";
+    }
+    qDebug() << "Estimated erase block of" << drivePath << "(" + model + ") :" << bytes;
+
+    if (bytes > 0) {
+        QString errorMessage;
+        const auto setEraseBlock = [bytes](DeviceProfile &stored) {
+            stored.eraseBlockSize = bytes;
+            stored.updated = QDateTime::currentDateTimeUtc();
+        };
+        if (!profiles.update(model, setEraseBlock, &errorMessage)) {
+            qDebug() << "Cannot save the device profile of" << model << ":" << errorMessage;
+        }
+    }
+    return bytes;
+}
+
+std::function<void(qint64, qint64)> DiskUtility::progressReporter(const QString &message,
+                                                                 const std::function<QueueControlState()> &queueState,
+                                                                 const std::shared_ptr<ThroughputTelemetry> &telemetry) {
+    // Engines report in units of work (expanded or data-only bytes), so the ETA is meaningful
+    auto tracker = std::make_shared<TransferProgress>();
+    return [this, tracker, message, queueState, telemetry](qint64 bytesDone, qint64 bytesTotal) {
+        const bool phaseChanged = telemetry && telemetry->sample(bytesDone);
+        if (!tracker->update(bytesDone, bytesTotal) && !phaseChanged) {
+            return;
+        }
+        ProgressRecord record = tracker->record();
+        if (queueState) record.queue = queueState();
+        if (telemetry && telemetry->currentPhase().cause != PhaseCause::Initial) {
+            record.phase = telemetry->currentPhase().description();
+        }
+
+        QString status = message;
+        const QString remaining = tracker->remainingText();
+        if (!remaining.isEmpty()) status += QString(" (%1)").arg(remaining);
+        if (!record.phase.isEmpty()) status += QString(" - %1").arg(record.phase);
+        emit progressUpdated(tracker->percentage(), status);
+        emit transferProgress(record);
+    };
+}
@@ -1,25 +1,55 @@
 #ifndef DISKUTILITY_H
 #define DISKUTILITY_H
 
+#include "ProgressRecord.h"
 #include <QString>
+#include <QStringList>
 #include <QList>
 #include <QObject>
+#include <QMap>
+#include <QVariant>
+#include <QJsonObject>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+class IoStats;
+class PipelineTrace;
+class ThroughputTelemetry;
 
 /**
  * @brief Structure to hold information about a removable drive.
  */
 struct DriveInfo {
-    QString devicePath; // e.g., \\\\.\\PhysicalDrive1 or \\\\.\\E:
-    QString driveLetter; // e.g., E:
+    QString devicePath; // e.g., /dev/sdb, \\\\.\\PhysicalDrive1 or \\\\.\\E:
+    QString driveLetter; // e.g., E: (Windows only)
     QString model;
-    qint64 size; // Size in bytes
-    bool isRemovable;
+    qint64 size = 0; // Size in bytes
+    bool isRemovable = false;
+};
+
+/**
+ * @brief What the kernel reports about a drive, to recognise its model and the stick itself.
+ */
+struct DriveIdentity {
+    QString model;  // Vendor and model, e.g. "SanDisk Cruzer Blade"
+    QString serial; // Of the drive or its USB device; empty if it reports none
+    qint64 size = 0;
+
+    bool isValid() const { return !model.isEmpty() || !serial.isEmpty(); }
+
+    /**
+     * @brief Key of the drive's device profile: the model, or the serial for drives without one.
+     */
+    QString profileKey() const { return model.isEmpty() && !serial.isEmpty() ? "serial " + serial : model; }
 };
 
 /**
- * @brief Utility class for low-level disk operations (Windows-specific).
+ * @brief Utility class for low-level disk operations.
  * 
- * This class handles drive enumeration, formatting, and raw data writing.
+ * This class handles drive enumeration and starts the write, backup, clone
+ * and erase jobs. Drives are found through sysfs on Linux and through the
+ * storage IOCTLs on Windows.
  */
 class DiskUtility : public QObject {
     Q_OBJECT
@@ -29,38 +59,202 @@ public:
     
     /**
      * @brief Enumerates all removable drives connected to the system.
+     *
+     * On Linux these are the /sys/block disks that are removable or on USB;
+     * on Windows, the \\.\PhysicalDriveN disks on a USB or SD bus or with
+     * removable media, with the letters of their volumes. Other platforms
+     * report no drives; jobs there must name the device path themselves.
+     *
      * @return QList<DriveInfo> A list of detected removable drives.
      */
     QList<DriveInfo> enumerateRemovableDrives();
 
+    /**
+     * @brief Reads the model, serial and size of a drive such as /dev/sdb from sysfs.
+     *
+     * Partitions report their disk. Invalid if the drive is unknown or this is not Linux.
+     */
+    static DriveIdentity identify(const QString &devicePath, const QString &sysfsRoot = "/sys");
+
+    /**
+     * @brief Key of a drive's device profile (see DriveIdentity::profileKey); empty if the drive has no identity.
+     */
+    QString modelOf(const QString &drivePath);
+
     /**
      * @brief Starts the asynchronous process of writing an image to a drive.
      * 
      * @param imagePath Path to the ISO/IMG file.
      * @param drivePath Device path of the target drive (e.g., \\\\.\\PhysicalDriveX).
-     * @param options Burning options (e.g., persistence, multi-boot).
+     * The format is identified by content (see FormatProbe), and the probe
+     * picks the write engine. If the image has a bmap next to it (see BmapFile::findFor), or options
+     * contains "bmapPath", only the mapped ranges are written and each one is
+     * verified against the bmap's checksum. Virtual-disk and sparse containers
+     * (qcow2, VHD/VHDX, VMDK, Android sparse, seekable zstd, xz) are expanded
+     * while writing, and their holes are zeroed on the drive (see ImageWriter);
+     * plain ISO and raw images are copied through the same pipeline. Data no
+     * format recognises is refused unless it is named .img, .iso or .bin, or
+     * options has "acceptRaw" set after the user confirmed it.
+     *
+     * With options "erase" (discard, zero or secure) the drive is trimmed or zeroed
+     * first, only where the image has no data unless "eraseScope" is "all" (see EraseOptions).
+     *
+     * Write requests are aligned to the drive's erase block, probed once per model
+     * and cached (see EraseBlockProbe, DeviceProfileStore) unless "probeEraseBlock" is false.
+     *
+     * With "verifyCapacity" set, the drive is first checked for fake capacity
+     * (see CapacityCheck) and the write is refused if it fails. A stick that
+     * passed earlier in this process is not checked again.
+     *
+     * With a "traceFile" path, the timing of every pipeline stage is saved there
+     * as a Chrome trace when the job ends (see PipelineTrace).
+     *
+     * Image writes report durable progress through checkpointReached;
+     * passing such an offset back as "resumeOffset" continues an interrupted
+     * write of the same image there instead of starting over.
+     *
+     * @param options Burning options (e.g., persistence, multi-boot, bmapPath, directIo, erase, eraseScope, traceFile, resumeOffset).
      * @return bool True if the process started successfully, false otherwise.
      */
     bool startImageWrite(const QString &imagePath, const QString &drivePath, const QMap<QString, QVariant> &options);
 
+    /**
+     * @brief Starts the asynchronous backup of a drive into a compressed image (the reverse of a write).
+     *
+     * The image is a seekable zstd file (see DriveBackup). Progress and completion are
+     * reported through the same signals as an image write.
+     *
+     * @param drivePath Device path of the drive to back up.
+     * @param imagePath Path of the .zst image to create.
+     * @param options Backup options (compressionLevel, frameSizeMiB, threads, directIo, allocatedOnly, traceFile).
+     * @return bool True if the process started successfully, false otherwise.
+     */
+    bool startDriveBackup(const QString &drivePath, const QString &imagePath, const QMap<QString, QVariant> &options);
+
+    /**
+     * @brief Starts the asynchronous clone of one drive onto one or more others (see DriveClone).
+     *
+     * The source is read once and written to all targets in parallel, without an
+     * intermediate image file. Progress follows the slowest target.
+     *
+     * @param sourceDrivePath Device path of the drive to copy (from enumerateRemovableDrives).
+     * @param targetDrivePaths Device paths of the drives to overwrite.
+     * @param options Clone options (chunkSizeMiB, directIo, allocatedOnly, traceFile).
+     * @return bool True if the process started successfully, false otherwise.
+     */
+    bool startDriveClone(const QString &sourceDrivePath, const QStringList &targetDrivePaths, const QMap<QString, QVariant> &options);
+
+    /**
+     * @brief Starts the asynchronous fast erase of one or more drives (see DriveErase).
+     *
+     * Drives are trimmed (or zeroed, or securely discarded) in parallel instead of
+     * being overwritten. Progress and completion are reported through the same
+     * signals as an image write.
+     *
+     * @param drivePaths Device paths of the drives to erase.
+     * @param options Erase options ("erase": discard (default), zero or secure; directIo).
+     * @return bool True if the process started successfully, false otherwise.
+     */
+    bool startDriveErase(const QStringList &drivePaths, const QMap<QString, QVariant> &options);
+
+    /**
+     * @brief Starts an asynchronous check that a drive really has the capacity it reports (see CapacityCheck).
+     *
+     * Takes seconds and leaves a genuine drive's contents as they were. The verdict
+     * is reported through writeCompleted, with the details in the error message.
+     *
+     * @param drivePath Device path of the drive to check.
+     * @return bool True if the check started successfully, false otherwise.
+     */
+    bool startCapacityCheck(const QString &drivePath);
+
+    /**
+     * @brief Requests cancellation of the job this instance started last.
+     *
+     * The job ends soon after with writeCompleted(false, ...). Run concurrent
+     * jobs on separate instances to cancel them one by one.
+     */
+    void cancel();
+
 signals:
     /**
-     * @brief Signal emitted to report the progress of the write operation.
+     * @brief Signal emitted to report the progress of the write (or backup, or clone) operation.
      * @param percentage The current progress (0-100).
      * @param message A status message.
      */
     void progressUpdated(int percentage, const QString &message);
 
     /**
-     * @brief Signal emitted when the write operation is complete.
+     * @brief Signal emitted alongside progressUpdated with the figures behind it.
+     * @param record Bytes done and total, throughput, ETA and write queue state.
+     */
+    void transferProgress(const ProgressRecord &record);
+
+    /**
+     * @brief Signal emitted when the write (or backup, or clone) operation is complete.
      * @param success True if the operation succeeded, false otherwise.
      * @param errorMessage Error message if failure occurred.
      */
     void writeCompleted(bool success, const QString &errorMessage);
 
+    /**
+     * @brief Signal emitted at the end of a job, before writeCompleted, once for every device it used.
+     * @param devicePath The drive (or image file) the figures are for.
+     * @param stats Latency and size histograms of its reads and writes (see IoStats::toJson).
+     */
+    void ioStatistics(const QString &devicePath, const QJsonObject &stats);
+
+    /**
+     * @brief Signal emitted during an image write once everything below offset is flushed to the drive.
+     * @param drivePath The drive being written.
+     * @param offset Where a restarted write may resume (the "resumeOffset" option of startImageWrite).
+     */
+    void checkpointReached(const QString &drivePath, qint64 offset);
+
 private:
-    // Private implementation details for Windows API calls
-    // ...
+    bool startBmapWrite(const QString &imagePath, const QString &bmapPath, const QString &drivePath, const QMap<QString, QVariant> &options);
+    bool startSourceWrite(const QString &imagePath, const QString &formatName, const QString &drivePath, const QMap<QString, QVariant> &options);
+
+    /**
+     * @brief Runs CapacityCheck on a drive; false with a description if it fails or the drive is fake.
+     * @param reusePass Skip the check if this stick (by model, serial and size) already passed it in this process.
+     */
+    bool checkCapacity(const QString &drivePath, QString *errorMessage, IoStats *ioStats = nullptr,
+                       const std::atomic<bool> *cancelled = nullptr, bool reusePass = false);
+
+    /**
+     * @brief Logs the latency percentiles of a device and emits ioStatistics.
+     */
+    void reportIoStats(const QString &devicePath, const IoStats &stats);
+
+    /**
+     * @brief Writes a job's pipeline trace to path; does nothing without a trace.
+     */
+    void saveTrace(const PipelineTrace *trace, const QString &path);
+
+    /**
+     * @brief Folds a completed write's throughput phases into the drive model's profile.
+     */
+    void recordWrite(const QString &drivePath, const ThroughputTelemetry &telemetry);
+
+    /**
+     * @brief Erase block size of a drive, from its model's profile or probed (and saved) if unknown.
+     *
+     * Returns 0 if the probe was unclear, and does not probe a drive without a
+     * profile key, since the result could not be kept for the next burn.
+     */
+    qint64 eraseBlockSize(const QString &drivePath);
+
+    /**
+     * @brief Builds an engine progress callback that emits progressUpdated and transferProgress, with an ETA.
+     * @param queueState Reads the engine's write queue state for the record; may be null.
+     * @param telemetry Receives every sample, and explains slowdowns in the status; may be null.
+     */
+    std::function<void(qint64, qint64)> progressReporter(const QString &message,
+                                                         const std::function<QueueControlState()> &queueState = nullptr,
+                                                         const std::shared_ptr<ThroughputTelemetry> &telemetry = nullptr);
+
+    std::function<void()> cancelJob; // Cancels the job started last; thread-safe to call
 };
 
 #endif // DISKUTILITY_H
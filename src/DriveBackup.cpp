@@ -0,0 +1,340 @@
+#include "DriveBackup.h"
+#include "AllocationMap.h"
+#include "BlockDevice.h"
+#include "BoundedQueue.h"
+#include "Instrumentation.h"
+#include "PipelineTrace.h"
+#include "ZstdSeekable.h"
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QList>
+#include <QMutex>
+#include <QSaveFile>
+#include <QSemaphore>
+#include <QThread>
+#include <QWaitCondition>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#ifdef INFERNO_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+struct RawFrame {
+    qint64 index = 0;
+    AlignedBuffer *buffer = nullptr; // Null for frames with no allocated data
+    qint64 length = 0;
+};
+
+bool writeHolesFile(const QString &path, qint64 total, const QList<ByteRange> &holes) {
+    QJsonArray ranges;
+    for (const ByteRange &hole : holes) {
+        ranges.append(QJsonArray{QString::number(hole.offset), QString::number(hole.length)});
+    }
+    QJsonObject root;
+    root["size"] = QString::number(total);
+    root["holes"] = ranges;
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+} // namespace
+
+BackupOptions BackupOptions::fromMap(const QMap<QString, QVariant> &options) {
+    BackupOptions result;
+    result.compressionLevel = options.value("compressionLevel", result.compressionLevel).toInt();
+    result.frameSize = options.value("frameSizeMiB", 4).toLongLong() * 1024 * 1024;
+    result.threads = options.value("threads", 0).toInt();
+    result.directIo = options.value("directIo", true).toBool();
+    result.allocatedOnly = options.value("allocatedOnly", false).toBool();
+    return result;
+}
+
+// --- Implementation of DriveBackup ---
+
+DriveBackup::DriveBackup(const QString &drivePath, const QString &imagePath, const BackupOptions &options)
+    : drivePath(drivePath), imagePath(imagePath), options(options) {
+}
+
+bool DriveBackup::isSupported() {
+#ifdef INFERNO_HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef INFERNO_HAVE_ZSTD
+
+bool DriveBackup::run(const ProgressCallback &progress, QString *errorMessage) {
+    BlockDevice device;
+    if (!device.open(drivePath, false, options.directIo, errorMessage)) {
+        return false;
+    }
+    device.setIoStats(ioStats);
+
+    QFile output(imagePath);
+    if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (errorMessage) *errorMessage = output.errorString();
+        return false;
+    }
+
+    const qint64 total = device.size();
+    const qint64 blockSize = device.logicalBlockSize();
+    // Frames must be whole device blocks for O_DIRECT, and fit the 32-bit seek table
+    const qint64 frameSize = std::clamp<qint64>(options.frameSize / blockSize * blockSize, blockSize, 1LL << 30);
+    const qint64 frameCount = (total + frameSize - 1) / frameSize;
+    const int compressors = options.threads > 0 ? options.threads : std::max(1, QThread::idealThreadCount());
+    const int slots = compressors * 2 + 2;
+
+    QList<ByteRange> allocated{ByteRange{0, total}};
+    if (options.allocatedOnly) {
+        QString summary;
+        if (AllocationMap::scan(device, &allocated, &summary)) {
+            qDebug() << "Allocation scan of" << drivePath << ":" << summary;
+        } else {
+            qWarning() << "Allocation scan of" << drivePath << "failed; backing up every block";
+            allocated = {ByteRange{0, total}};
+        }
+    }
+
+    // Pipeline state
+    BoundedQueue<RawFrame> readQueue(slots);
+    BoundedQueue<AlignedBuffer *> freeBuffers(slots);
+    std::vector<std::unique_ptr<AlignedBuffer>> buffers;
+    for (int i = 0; i < slots; ++i) {
+        buffers.push_back(std::make_unique<AlignedBuffer>(frameSize));
+        freeBuffers.push(buffers.back().get());
+    }
+    QSemaphore inFlight(slots); // Frames read but not yet written
+    QMutex doneMutex;
+    QWaitCondition frameDone;
+    QHash<qint64, QByteArray> compressed;
+    std::atomic<bool> failed{false};
+    QString failure;
+
+    auto fail = [&](const QString &message) {
+        {
+            QMutexLocker locker(&doneMutex);
+            if (failure.isEmpty()) {
+                failure = message;
+            }
+            failed = true;
+            frameDone.wakeAll();
+        }
+        readQueue.close();
+        freeBuffers.close();
+        inFlight.release(slots);
+    };
+
+    // Stage 1: sequential reads into aligned buffers
+    QThread *reader = QThread::create([&]() {
+        if (trace) trace->nameThread("reader");
+        qsizetype nextRange = 0;
+        for (qint64 index = 0; index < frameCount; ++index) {
+            inFlight.acquire();
+            if (failed || cancelled) {
+                break;
+            }
+            const qint64 offset = index * frameSize;
+            const qint64 length = std::min(frameSize, total - offset);
+            const qint64 end = offset + length;
+            while (nextRange < allocated.size() && allocated[nextRange].end() <= offset) {
+                ++nextRange;
+            }
+            if (nextRange == allocated.size() || allocated[nextRange].offset >= end) {
+                readQueue.push(RawFrame{index, nullptr, length}); // Nothing to read
+                continue;
+            }
+
+            std::optional<AlignedBuffer *> buffer;
+            {
+                const PipelineTrace::Span span(trace, "acquire"); // Waiting here means compression or the output is the bottleneck
+                buffer = freeBuffers.pop();
+            }
+            if (!buffer) {
+                break;
+            }
+            // Read only the allocated parts of the frame; the rest is zero
+            char *data = (*buffer)->data();
+            qint64 filled = offset;
+            bool ok = true;
+            QString readError;
+            {
+                const PipelineTrace::Span span(trace, "read", offset, length);
+                const Instrumentation::StageTimer timer(Instrumentation::Stage::Read, length);
+                for (qsizetype r = nextRange; ok && r < allocated.size() && allocated[r].offset < end; ++r) {
+                    const qint64 from = std::max(offset, allocated[r].offset);
+                    const qint64 to = std::min(end, allocated[r].end());
+                    std::memset(data + (filled - offset), 0, size_t(from - filled));
+                    ok = device.readAt(data + (from - offset), to - from, from, &readError) == to - from;
+                    filled = to;
+                }
+            }
+            if (!ok) {
+                fail(readError.isEmpty() ? QString("Unexpected end of %1").arg(device.path()) : readError);
+                break;
+            }
+            std::memset(data + (filled - offset), 0, size_t(end - filled));
+            readQueue.push(RawFrame{index, *buffer, length});
+        }
+        readQueue.close();
+    });
+
+    // Stage 2: each frame compressed independently on its own context
+    QList<QThread *> workers;
+    for (int i = 0; i < compressors; ++i) {
+        workers.append(QThread::create([&, i]() {
+            if (trace) trace->nameThread(QString("compressor %1").arg(i));
+            ZSTD_CCtx *context = ZSTD_createCCtx();
+            ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, options.compressionLevel);
+            ZSTD_CCtx_setParameter(context, ZSTD_c_checksumFlag, 1);
+            QHash<qint64, QByteArray> zeroFrames; // Compressed all-zero frames by length
+            while (std::optional<RawFrame> frame = readQueue.pop()) {
+                if (!frame->buffer && zeroFrames.contains(frame->length)) {
+                    QMutexLocker locker(&doneMutex);
+                    compressed.insert(frame->index, zeroFrames.value(frame->length));
+                    frameDone.wakeAll();
+                    continue;
+                }
+
+                const QByteArray zeros = frame->buffer ? QByteArray() : QByteArray(frame->length, '\0');
+                const char *input = frame->buffer ? frame->buffer->data() : zeros.constData();
+                QByteArray out(qsizetype(ZSTD_compressBound(size_t(frame->length))), Qt::Uninitialized);
+                size_t written;
+                {
+                    const PipelineTrace::Span span(trace, "compress", frame->index * frameSize, frame->length);
+                    const Instrumentation::StageTimer timer(Instrumentation::Stage::Compress, frame->length);
+                    written = ZSTD_compress2(context, out.data(), size_t(out.size()), input, size_t(frame->length));
+                }
+                if (frame->buffer) {
+                    freeBuffers.push(frame->buffer);
+                }
+                if (ZSTD_isError(written)) {
+                    fail(QString("Compression failed: %1").arg(ZSTD_getErrorName(written)));
+                    break;
+                }
+                out.resize(qsizetype(written));
+                if (!frame->buffer) {
+                    zeroFrames.insert(frame->length, out);
+                }
+
+                QMutexLocker locker(&doneMutex);
+                compressed.insert(frame->index, out);
+                frameDone.wakeAll();
+            }
+            ZSTD_freeCCtx(context);
+        }));
+    }
+
+    reader->start();
+    for (QThread *worker : workers) {
+        worker->start();
+    }
+
+    // Stage 3 (this thread): frames written strictly in order
+    QList<SeekTableEntry> seekTable;
+    seekTable.reserve(frameCount);
+    // Progress counts only bytes read from the drive; unallocated frames cost next to nothing
+    const qint64 workTotal = AllocationMap::totalLength(allocated);
+    qsizetype workRange = 0;
+    qint64 bytesDone = 0;
+    if (trace) trace->nameThread("writer");
+    for (qint64 index = 0; index < frameCount; ++index) {
+        QByteArray frame;
+        {
+            const PipelineTrace::Span span(trace, "wait-frame"); // Waiting here means compression is the bottleneck
+            QMutexLocker locker(&doneMutex);
+            while (!compressed.contains(index) && !failed && !cancelled) {
+                frameDone.wait(&doneMutex, 100); // Timed so cancellation is noticed
+            }
+            if (failed || cancelled) {
+                break;
+            }
+            frame = compressed.take(index);
+        }
+
+        bool written;
+        {
+            const PipelineTrace::Span span(trace, "write", index * frameSize, frame.size());
+            const Instrumentation::StageTimer timer(Instrumentation::Stage::Write, frame.size());
+            written = output.write(frame) == frame.size();
+        }
+        if (!written) {
+            fail(output.errorString());
+            break;
+        }
+        inFlight.release();
+
+        const qint64 length = std::min(frameSize, total - index * frameSize);
+        seekTable.append(SeekTableEntry{quint32(frame.size()), quint32(length)});
+        const qint64 frameEnd = index * frameSize + length;
+        for (; workRange < allocated.size() && allocated[workRange].offset < frameEnd; ++workRange) {
+            const ByteRange &range = allocated[workRange];
+            bytesDone += std::min(frameEnd, range.end()) - std::max(index * frameSize, range.offset);
+            if (range.end() > frameEnd) {
+                break; // Continues into the next frame
+            }
+        }
+        if (progress) progress(bytesDone, workTotal);
+    }
+
+    if (cancelled) {
+        fail("Backup cancelled.");
+    }
+    reader->wait();
+    for (QThread *worker : workers) {
+        worker->wait();
+        delete worker;
+    }
+    delete reader;
+
+    if (failed) {
+        output.close();
+        QFile::remove(imagePath);
+        if (errorMessage) *errorMessage = failure;
+        return false;
+    }
+
+    const QByteArray table = ZstdSeekable::encodeSeekTable(seekTable);
+    if (output.write(table) != table.size() || !output.flush()) {
+        if (errorMessage) *errorMessage = output.errorString();
+        output.close();
+        QFile::remove(imagePath);
+        return false;
+    }
+    output.close();
+
+    const QString holesPath = imagePath + ".holes";
+    if (options.allocatedOnly) {
+        if (!writeHolesFile(holesPath, total, AllocationMap::invert(allocated, total))) {
+            qWarning() << "Could not write" << holesPath;
+        }
+    } else {
+        QFile::remove(holesPath); // Stale from an earlier backup to the same path
+    }
+    qDebug() << "Backup of" << drivePath << "complete:" << total << "bytes ->" << QFile(imagePath).size();
+    return true;
+}
+
+#else
+
+bool DriveBackup::run(const ProgressCallback &progress, QString *errorMessage) {
+    Q_UNUSED(progress);
+    if (errorMessage) *errorMessage = "This build of Inferno was compiled without zstd support.";
+    return false;
+}
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef DRIVEBACKUP_H
+#define DRIVEBACKUP_H
+
+#include <QString>
+#include <QMap>
+#include <QVariant>
+#include <atomic>
+#include <functional>
+
+class IoStats;
+class PipelineTrace;
+
+/**
+ * @brief Options for a drive backup, usually built from the job's option map.
+ */
+struct BackupOptions {
+    int compressionLevel = 3;
+    qint64 frameSize = 4 * 1024 * 1024; // Uncompressed bytes per seekable frame
+    int threads = 0;                    // Compression threads, 0 = one per core
+    bool directIo = true;
+    bool allocatedOnly = false;         // Skip blocks no filesystem has allocated
+
+    static BackupOptions fromMap(const QMap<QString, QVariant> &options);
+};
+
+/**
+ * @brief Reads a drive into a seekable, multi-threaded zstd image.
+ *
+ * The work is split into three pipelined stages so that the stick is read
+ * continuously while earlier data is still being compressed:
+ *
+ *   reader (O_DIRECT, aligned buffers) -> N compressor threads -> ordered writer
+ *
+ * Each frameSize block is compressed as an independent zstd frame by its own
+ * compression context, which is how the work is spread across cores, and the
+ * file ends with a zstd seek table so it can be restored with frames
+ * decompressed in parallel. The number of blocks in flight is bounded, so a
+ * slow output disk throttles the reader instead of growing memory.
+ *
+ * With allocatedOnly set, the drive is first scanned with AllocationMap and
+ * unallocated space is never read: frames that are entirely free are emitted
+ * as compressed zeros, and partly used frames have their free parts zeroed.
+ * The skipped ranges are listed in a "<image>.holes" JSON file next to the
+ * image so a restore can skip writing them as well.
+ */
+class DriveBackup {
+public:
+    using ProgressCallback = std::function<void(qint64 bytesDone, qint64 bytesTotal)>;
+
+    DriveBackup(const QString &drivePath, const QString &imagePath, const BackupOptions &options);
+
+    /**
+     * @brief Runs the backup on the calling thread (which becomes the writer stage).
+     * @param progress Called after each frame is written, in bytes read from the drive (only allocated ones with allocatedOnly).
+     * @param errorMessage Receives a description of the failure, if any.
+     * @return bool True if the image was written completely.
+     */
+    bool run(const ProgressCallback &progress, QString *errorMessage);
+
+    /**
+     * @brief Records the latency and size of every device read and write in stats (see IoStats); null for none.
+     */
+    void setIoStats(IoStats *stats) { ioStats = stats; }
+
+    /**
+     * @brief Records the pipeline stages of the next run() in trace (see PipelineTrace); null for none.
+     */
+    void setTrace(PipelineTrace *trace) { this->trace = trace; }
+
+    /**
+     * @brief Requests cancellation; run() returns false soon after. Thread-safe.
+     */
+    void cancel() { cancelled = true; }
+
+    /**
+     * @brief Whether this build can write compressed backups (zstd available).
+     */
+    static bool isSupported();
+
+private:
+    QString drivePath;
+    QString imagePath;
+    BackupOptions options;
+    IoStats *ioStats = nullptr;
+    PipelineTrace *trace = nullptr;
+    std::atomic<bool> cancelled{false};
+};
+
+#endif // DRIVEBACKUP_H
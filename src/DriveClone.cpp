@@ -0,0 +1,237 @@
+#include "DriveClone.h"
+#include "AllocationMap.h"
+#include "BlockDevice.h"
+#include "BoundedQueue.h"
+#include "Instrumentation.h"
+#include "PipelineTrace.h"
+#include <QFileInfo>
+#include <QThread>
+#include <QDebug>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace {
+// Blocks in the shared pool; also the depth of each target's queue
+const int kPoolBlocks = 6;
+
+struct SharedBlock {
+    explicit SharedBlock(qint64 size) : buffer(size) {}
+
+    AlignedBuffer buffer;
+    qint64 offset = 0;
+    qint64 length = 0;
+    std::atomic<int> users{0}; // Targets that have yet to write this block
+};
+
+struct CloneTarget {
+    QString path;
+    BlockDevice device;
+    BoundedQueue<SharedBlock *> queue{kPoolBlocks};
+    std::atomic<qint64> bytesWritten{0};
+    std::atomic<bool> failed{false};
+    QString error;
+    QThread *writer = nullptr;
+};
+} // namespace
+
+CloneOptions CloneOptions::fromMap(const QMap<QString, QVariant> &options) {
+    CloneOptions result;
+    result.chunkSize = options.value("chunkSizeMiB", 8).toLongLong() * 1024 * 1024;
+    result.directIo = options.value("directIo", true).toBool();
+    result.allocatedOnly = options.value("allocatedOnly", false).toBool();
+    return result;
+}
+
+// --- Implementation of DriveClone ---
+
+DriveClone::DriveClone(const QString &sourcePath, const QStringList &targetPaths, const CloneOptions &options)
+    : sourcePath(sourcePath), targetPaths(targetPaths), options(options) {
+}
+
+bool DriveClone::run(const ProgressCallback &progress, QString *errorMessage) {
+    failed.clear();
+    if (targetPaths.isEmpty()) {
+        if (errorMessage) *errorMessage = "No target drives selected.";
+        return false;
+    }
+
+    BlockDevice source;
+    if (!source.open(sourcePath, false, options.directIo, errorMessage)) {
+        return false;
+    }
+    source.setIoStats(ioStats.value(sourcePath));
+    const qint64 total = source.size();
+
+    QList<ByteRange> ranges{ByteRange{0, total}};
+    if (options.allocatedOnly) {
+        QString summary;
+        if (AllocationMap::scan(source, &ranges, &summary)) {
+            qDebug() << "Allocation scan of" << sourcePath << ":" << summary;
+        } else {
+            qWarning() << "Allocation scan of" << sourcePath << "failed; cloning every block";
+            ranges = {ByteRange{0, total}};
+        }
+    }
+    const qint64 bytesTotal = AllocationMap::totalLength(ranges);
+    const qint64 requiredSize = ranges.isEmpty() ? 0 : ranges.last().end();
+
+    // Open every target up front so a bad one is reported before anything is written
+    const QString sourceIdentity = QFileInfo(sourcePath).canonicalFilePath();
+    std::vector<std::unique_ptr<CloneTarget>> targets;
+    for (const QString &path : targetPaths) {
+        auto target = std::make_unique<CloneTarget>();
+        target->path = path;
+        if (QFileInfo(path).canonicalFilePath() == sourceIdentity) {
+            target->error = "Target is the source drive";
+            target->failed = true;
+        } else if (!target->device.open(path, true, options.directIo, &target->error)) {
+            target->failed = true;
+        } else if (target->device.size() < requiredSize) {
+            target->error = QString("Drive is smaller than the source (%1 < %2 bytes)")
+                                .arg(target->device.size()).arg(requiredSize);
+            target->failed = true;
+        }
+        target->device.setIoStats(ioStats.value(path));
+        targets.push_back(std::move(target));
+    }
+
+    // Whole blocks on both sides, so O_DIRECT works for every device involved
+    qint64 alignment = std::max(qint64(AlignedBuffer::kDefaultAlignment), qint64(source.logicalBlockSize()));
+    for (const auto &target : targets) {
+        if (!target->failed) {
+            alignment = std::max(alignment, qint64(target->device.logicalBlockSize()));
+        }
+    }
+    const qint64 chunkSize = std::max(alignment, options.chunkSize / alignment * alignment);
+
+    BoundedQueue<SharedBlock *> freeBlocks(kPoolBlocks);
+    std::vector<std::unique_ptr<SharedBlock>> blocks;
+    for (int i = 0; i < kPoolBlocks; ++i) {
+        blocks.push_back(std::make_unique<SharedBlock>(chunkSize));
+        freeBlocks.push(blocks.back().get());
+    }
+    auto release = [&](SharedBlock *block) {
+        if (--block->users == 0) {
+            freeBlocks.push(block);
+        }
+    };
+
+    // One writer per usable target. Failed writers keep draining so shared blocks are still released.
+    QList<CloneTarget *> writers;
+    for (const auto &target : targets) {
+        if (target->failed) {
+            continue;
+        }
+        CloneTarget *t = target.get();
+        t->writer = QThread::create([this, t, &release]() {
+            if (trace) trace->nameThread(QString("writer %1").arg(t->path));
+            while (std::optional<SharedBlock *> block = t->queue.pop()) {
+                if (!t->failed && !cancelled) {
+                    SharedBlock *b = *block;
+                    const PipelineTrace::Span span(trace, "write", b->offset, b->length);
+                    const Instrumentation::StageTimer timer(Instrumentation::Stage::Write, b->length);
+                    QString writeError;
+                    if (t->device.writeAt(b->buffer.data(), b->length, b->offset, &writeError) != b->length) {
+                        t->error = writeError;
+                        t->failed = true;
+                    } else {
+                        t->bytesWritten += b->length;
+                    }
+                }
+                release(*block);
+            }
+            const PipelineTrace::Span span(trace, "sync");
+            if (!t->failed && !cancelled && !t->device.sync()) {
+                t->error = t->device.errorString();
+                t->failed = true;
+            }
+        });
+        t->writer->start();
+        writers.append(t);
+    }
+
+    auto slowestTarget = [&]() {
+        qint64 slowest = -1;
+        for (CloneTarget *t : writers) {
+            if (!t->failed) {
+                slowest = slowest < 0 ? t->bytesWritten.load() : std::min(slowest, t->bytesWritten.load());
+            }
+        }
+        return slowest;
+    };
+
+    // Reader (this thread): each block is read once and queued to every writer
+    if (trace) trace->nameThread(QString("reader %1").arg(sourcePath));
+    QString readError;
+    for (const ByteRange &range : ranges) {
+        for (qint64 offset = range.offset; offset < range.end() && readError.isEmpty(); offset += chunkSize) {
+            if (cancelled || slowestTarget() < 0) {
+                break;
+            }
+            std::optional<SharedBlock *> block;
+            {
+                const PipelineTrace::Span span(trace, "acquire"); // Waiting here means the slowest target is the bottleneck
+                block = freeBlocks.pop();
+            }
+            if (!block) {
+                break;
+            }
+            SharedBlock *b = *block;
+            b->offset = offset;
+            b->length = std::min(chunkSize, range.end() - offset);
+            qint64 read;
+            {
+                const PipelineTrace::Span span(trace, "read", b->offset, b->length);
+                const Instrumentation::StageTimer timer(Instrumentation::Stage::Read, b->length);
+                read = source.readAt(b->buffer.data(), b->length, b->offset, &readError);
+            }
+            if (read != b->length) {
+                if (readError.isEmpty()) readError = QString("%1 ended at offset %2").arg(sourcePath).arg(b->offset + std::max<qint64>(0, read));
+                freeBlocks.push(b);
+                break;
+            }
+            b->users = int(writers.size());
+            for (CloneTarget *t : writers) {
+                t->queue.push(b);
+            }
+            if (progress) progress(std::max<qint64>(0, slowestTarget()), bytesTotal);
+        }
+        if (cancelled || !readError.isEmpty()) {
+            break;
+        }
+    }
+
+    for (CloneTarget *t : writers) {
+        t->queue.close();
+    }
+    for (CloneTarget *t : writers) {
+        t->writer->wait();
+        delete t->writer;
+        t->writer = nullptr;
+    }
+
+    QStringList problems;
+    if (!readError.isEmpty()) {
+        problems << QString("%1: %2").arg(sourcePath, readError);
+    }
+    for (const auto &target : targets) {
+        if (target->failed || !readError.isEmpty() || cancelled) {
+            failed << target->path;
+        }
+        if (target->failed) {
+            problems << QString("%1: %2").arg(target->path, target->error);
+        }
+    }
+    if (cancelled) {
+        problems.prepend("Clone cancelled.");
+    }
+
+    if (!problems.isEmpty()) {
+        if (errorMessage) *errorMessage = problems.join('\n');
+        return false;
+    }
+    if (progress) progress(bytesTotal, bytesTotal);
+    qDebug() << "Cloned" << sourcePath << "to" << targetPaths << ":" << bytesTotal << "of" << total << "bytes copied";
+    return true;
+}
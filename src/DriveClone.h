@@ -0,0 +1,82 @@
+#ifndef DRIVECLONE_H
+#define DRIVECLONE_H
+
+#include <QString>
+#include <QStringList>
+#include <QMap>
+#include <QVariant>
+#include <atomic>
+#include <functional>
+
+class IoStats;
+class PipelineTrace;
+
+/**
+ * @brief Options for a drive-to-drive clone, usually built from the job's option map.
+ */
+struct CloneOptions {
+    qint64 chunkSize = 8 * 1024 * 1024; // Bytes per read request
+    bool directIo = true;
+    bool allocatedOnly = false;         // Copy only blocks a filesystem has allocated
+
+    static CloneOptions fromMap(const QMap<QString, QVariant> &options);
+};
+
+/**
+ * @brief Copies one drive onto one or more other drives without an intermediate image.
+ *
+ * The source is read once, sequentially, in large O_DIRECT requests. Every
+ * block read is handed to all targets, each of which has its own writer
+ * thread and queue; a buffer goes back to the pool once the last target has
+ * written it, so targets share the data instead of copying it and the
+ * slowest stick sets the pace. A target that fails drops out without
+ * stopping the others.
+ *
+ * With allocatedOnly set, the source is scanned with AllocationMap first and
+ * space no filesystem uses is neither read nor written.
+ */
+class DriveClone {
+public:
+    using ProgressCallback = std::function<void(qint64 bytesDone, qint64 bytesTotal)>;
+
+    DriveClone(const QString &sourcePath, const QStringList &targetPaths, const CloneOptions &options);
+
+    /**
+     * @brief Runs the clone on the calling thread (which becomes the reader).
+     * @param progress Called after each block; bytesDone is that of the slowest working target.
+     * @param errorMessage Receives a description of every failure, if any.
+     * @return bool True if every target was written completely.
+     */
+    bool run(const ProgressCallback &progress, QString *errorMessage);
+
+    /**
+     * @brief Records the latency and size of every read or write of one device (source or target) in stats.
+     */
+    void setIoStats(const QString &devicePath, IoStats *stats) { ioStats[devicePath] = stats; }
+
+    /**
+     * @brief Records the pipeline stages of the next run() in trace (see PipelineTrace); null for none.
+     */
+    void setTrace(PipelineTrace *trace) { this->trace = trace; }
+
+    /**
+     * @brief Requests cancellation; run() returns false soon after. Thread-safe.
+     */
+    void cancel() { cancelled = true; }
+
+    /**
+     * @brief Targets that did not receive a complete copy in the last run().
+     */
+    QStringList failedTargets() const { return failed; }
+
+private:
+    QString sourcePath;
+    QStringList targetPaths;
+    CloneOptions options;
+    QStringList failed;
+    QMap<QString, IoStats *> ioStats;
+    PipelineTrace *trace = nullptr;
+    std::atomic<bool> cancelled{false};
+};
+
+#endif // DRIVECLONE_H
@@ -0,0 +1,162 @@
+#include "DriveErase.h"
+#include "BlockDevice.h"
+#include "Probes.h"
+#include <QThread>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace {
+struct EraseTarget {
+    QString path;
+    BlockDevice device;
+    std::atomic<qint64> bytesErased{0};
+    bool ok = false;
+    QString error;
+    QThread *worker = nullptr;
+};
+
+bool eraseStep(BlockDevice &device, EraseMode mode, qint64 offset, qint64 length) {
+    switch (mode) {
+    case EraseMode::Discard:
+        return device.discard(offset, length);
+    case EraseMode::ZeroOut:
+        return device.zeroOut(offset, length);
+    case EraseMode::SecureDiscard:
+        return device.secureDiscard(offset, length);
+    case EraseMode::None:
+        break;
+    }
+    return true;
+}
+} // namespace
+
+EraseOptions EraseOptions::fromMap(const QMap<QString, QVariant> &options) {
+    EraseOptions result;
+    const QString mode = options.value("erase", "none").toString().toLower();
+    if (mode == "discard" || mode == "trim") {
+        result.mode = EraseMode::Discard;
+    } else if (mode == "zero" || mode == "zeroout") {
+        result.mode = EraseMode::ZeroOut;
+    } else if (mode == "secure") {
+        result.mode = EraseMode::SecureDiscard;
+    }
+    result.unwrittenOnly = options.value("eraseScope", "unwritten").toString().toLower() != "all";
+    result.skipZeroBlocks = options.value("skipZeroBlocks", true).toBool();
+    result.directIo = options.value("directIo", true).toBool();
+    return result;
+}
+
+// --- Implementation of DriveErase ---
+
+DriveErase::DriveErase(const QStringList &targetPaths, const EraseOptions &options)
+    : targetPaths(targetPaths), options(options) {
+}
+
+bool DriveErase::eraseRanges(BlockDevice &device, EraseMode mode, const QList<ByteRange> &ranges,
+                             const std::atomic<bool> &cancelled, const std::function<void(qint64)> &advanced,
+                             QString *errorMessage) {
+    for (const ByteRange &range : ranges) {
+        for (qint64 offset = range.offset; offset < range.end(); offset += kStep) {
+            if (cancelled) {
+                if (errorMessage) *errorMessage = "Erase cancelled.";
+                return false;
+            }
+            const qint64 length = std::min(kStep, range.end() - offset);
+            if (!eraseStep(device, mode, offset, length)) {
+                if (errorMessage) *errorMessage = device.errorString();
+                return false;
+            }
+            if (advanced) advanced(length);
+        }
+    }
+    return true;
+}
+
+bool DriveErase::isAllZero(const char *data, qint64 length) {
+    // Comparing the buffer with itself shifted by one byte runs at memcmp speed
+    return length <= 0 || (data[0] == 0 && std::memcmp(data, data + 1, size_t(length - 1)) == 0);
+}
+
+bool DriveErase::run(const ProgressCallback &progress, QString *errorMessage) {
+    failed.clear();
+    if (targetPaths.isEmpty() || options.mode == EraseMode::None) {
+        if (errorMessage) *errorMessage = "Nothing to erase.";
+        return false;
+    }
+
+    std::vector<std::unique_ptr<EraseTarget>> targets;
+    qint64 bytesTotal = 0;
+    QStringList problems;
+    for (const QString &path : targetPaths) {
+        auto target = std::make_unique<EraseTarget>();
+        target->path = path;
+        if (!target->device.open(path, true, options.directIo, &target->error)) {
+            problems << QString("%1: %2").arg(path, target->error);
+            failed << path;
+            continue;
+        }
+        bytesTotal += target->device.size();
+        targets.push_back(std::move(target));
+    }
+
+    for (const auto &target : targets) {
+        EraseTarget *t = target.get();
+        t->worker = QThread::create([this, t]() {
+            const QList<ByteRange> whole{ByteRange{0, t->device.size()}};
+            auto advanced = [t](qint64 bytes) { t->bytesErased += bytes; };
+            EraseMode mode = options.mode;
+            t->ok = eraseRanges(t->device, mode, whole, cancelled, advanced, &t->error);
+            if (!t->ok && !cancelled && mode == EraseMode::Discard && t->bytesErased == 0) {
+                // Sticks without TRIM still get a clean drive, just more slowly
+                qDebug() << t->path << "does not support discard (" << t->error << "); zeroing instead";
+                INFERNO_PROBE1(erase_retry, t->path.toLocal8Bit().constData());
+                mode = EraseMode::ZeroOut;
+                t->error.clear();
+                t->ok = eraseRanges(t->device, mode, whole, cancelled, advanced, &t->error);
+            }
+            if (t->ok && !t->device.sync()) {
+                t->ok = false;
+                t->error = t->device.errorString();
+            }
+        });
+        t->worker->start();
+    }
+
+    // This thread only reports progress
+    for (const auto &target : targets) {
+        while (!target->worker->wait(200)) {
+            if (progress) {
+                qint64 bytesDone = 0;
+                for (const auto &t : targets) {
+                    bytesDone += t->bytesErased;
+                }
+                progress(bytesDone, bytesTotal);
+            }
+        }
+    }
+
+    for (const auto &target : targets) {
+        delete target->worker;
+        target->worker = nullptr;
+        if (!target->ok) {
+            failed << target->path;
+            if (!cancelled) {
+                problems << QString("%1: %2").arg(target->path, target->error);
+            }
+        }
+    }
+    if (cancelled) {
+        problems.prepend("Erase cancelled.");
+    }
+
+    if (!problems.isEmpty()) {
+        if (errorMessage) *errorMessage = problems.join('\n');
+        return false;
+    }
+    if (progress) progress(bytesTotal, bytesTotal);
+    qDebug() << "Erased" << targetPaths << ":" << bytesTotal << "bytes";
+    return true;
+}
@@ -0,0 +1,102 @@
+#ifndef DRIVEERASE_H
+#define DRIVEERASE_H
+
+#include "AllocationMap.h"
+#include <QString>
+#include <QStringList>
+#include <QMap>
+#include <QVariant>
+#include <atomic>
+#include <functional>
+
+class BlockDevice;
+
+/**
+ * @brief How a range of flash is erased.
+ */
+enum class EraseMode {
+    None,
+    Discard,       // BLKDISCARD: fast trim; contents afterwards are device-defined
+    ZeroOut,       // BLKZEROOUT: reads back as zeros, offloaded to the device where possible
+    SecureDiscard  // BLKSECDISCARD: trim that also purges the old data
+};
+
+/**
+ * @brief Erase settings, for a standalone erase or before a write, usually built from the job's option map.
+ */
+struct EraseOptions {
+    EraseMode mode = EraseMode::None;
+    bool unwrittenOnly = true;  // Before a write: erase only what the write will not cover
+    bool skipZeroBlocks = true; // Before a write: leave all-zero blocks unwritten once the drive is zeroed
+    bool directIo = true;
+
+    /**
+     * @brief True if the whole drive will read as zeros before the write starts.
+     *
+     * Only then may a writer skip all-zero blocks, and image holes come out as
+     * zeros instead of whatever the drive held before.
+     */
+    bool zeroesDrive() const { return mode == EraseMode::ZeroOut && !unwrittenOnly; }
+
+    static EraseOptions fromMap(const QMap<QString, QVariant> &options);
+};
+
+/**
+ * @brief Erases whole drives with discard or zeroing commands instead of writing them.
+ *
+ * Every target gets its own thread, so several sticks are erased in parallel.
+ * The work is issued in kStep pieces to keep cancellation and progress
+ * responsive. If a drive does not support discard, it is zeroed instead.
+ *
+ * The write engines call eraseRanges() directly to trim or zero the drive
+ * before writing: freshly trimmed flash takes writes faster on many
+ * controllers, and a zeroed drive lets them skip blocks that are all zeros.
+ */
+class DriveErase {
+public:
+    using ProgressCallback = std::function<void(qint64 bytesDone, qint64 bytesTotal)>;
+
+    static constexpr qint64 kStep = 1024LL * 1024 * 1024;
+
+    DriveErase(const QStringList &targetPaths, const EraseOptions &options);
+
+    /**
+     * @brief Runs the erase; targets are processed in parallel while this thread reports progress.
+     * @param progress Called periodically with the bytes erased over all targets.
+     * @param errorMessage Receives a description of every failure, if any.
+     * @return bool True if every target was erased completely.
+     */
+    bool run(const ProgressCallback &progress, QString *errorMessage);
+
+    /**
+     * @brief Requests cancellation; run() returns false soon after. Thread-safe.
+     */
+    void cancel() { cancelled = true; }
+
+    /**
+     * @brief Targets that were not erased completely in the last run().
+     */
+    QStringList failedTargets() const { return failed; }
+
+    /**
+     * @brief Erases ranges of an open device in kStep pieces.
+     * @param advanced Called with the byte count of each piece done; may be null.
+     * @return bool True if everything was erased; false with errorMessage set otherwise.
+     */
+    static bool eraseRanges(BlockDevice &device, EraseMode mode, const QList<ByteRange> &ranges,
+                            const std::atomic<bool> &cancelled, const std::function<void(qint64)> &advanced,
+                            QString *errorMessage);
+
+    /**
+     * @brief Whether a buffer holds only zero bytes.
+     */
+    static bool isAllZero(const char *data, qint64 length);
+
+private:
+    QStringList targetPaths;
+    EraseOptions options;
+    QStringList failed;
+    std::atomic<bool> cancelled{false};
+};
+
+#endif // DRIVEERASE_H
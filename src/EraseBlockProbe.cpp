@@ -0,0 +1,93 @@
+#include "EraseBlockProbe.h"
+#include "BlockDevice.h"
+#include <QElapsedTimer>
+#include <QDebug>
+#include <algorithm>
+#include <limits>
+
+namespace {
+// Largest request an engine uses once the erase block is known; bigger blocks are split into aligned parts
+const qint64 kMaxRequestSize = 16 * 1024 * 1024;
+
+/**
+ * @brief Fastest of kRepeats timed reads at offset, in microseconds, or -1 on a read error.
+ */
+double timeRead(BlockDevice &device, AlignedBuffer &buffer, qint64 offset, QString *error) {
+    double best = std::numeric_limits<double>::max();
+    QElapsedTimer timer;
+    for (int i = 0; i < EraseBlockProbe::kRepeats; ++i) {
+        timer.start();
+        if (device.readAt(buffer.data(), EraseBlockProbe::kReadSize, offset, error) != EraseBlockProbe::kReadSize) {
+            return -1;
+        }
+        best = std::min(best, double(timer.nsecsElapsed()) / 1000.0);
+    }
+    return best;
+}
+
+bool hasStep(const EraseBlockProbe::Sample &sample) {
+    return sample.difference() > EraseBlockProbe::kThreshold * (sample.before + sample.after) / 2;
+}
+} // namespace
+
+// --- Implementation of EraseBlockProbe ---
+
+qint64 EraseBlockProbe::probe(BlockDevice &device, QList<Sample> *samples) {
+    if (!device.isDirect() || device.size() < 4 * kMinCandidate || kReadSize % device.logicalBlockSize() != 0) {
+        return 0;
+    }
+
+    AlignedBuffer buffer(kReadSize);
+    QList<Sample> results;
+    for (qint64 alignment = kMinCandidate; alignment <= kMaxCandidate; alignment *= 2) {
+        Sample sample;
+        sample.alignment = alignment;
+        int measured = 0;
+        for (int k = 0; k < kBoundaries; ++k) {
+            // Odd multiples are boundaries of this size but not of the next larger one
+            const qint64 boundary = (2 * k + 1) * alignment;
+            if (boundary + kReadSize > device.size()) {
+                break;
+            }
+            QString error;
+            const double before = timeRead(device, buffer, boundary - kReadSize, &error);
+            const double across = timeRead(device, buffer, boundary - kReadSize / 2, &error);
+            const double after = timeRead(device, buffer, boundary, &error);
+            if (before < 0 || across < 0 || after < 0) {
+                qDebug() << "Erase block probe of" << device.path() << "stopped:" << error;
+                return 0;
+            }
+            sample.before += before;
+            sample.across += across;
+            sample.after += after;
+            ++measured;
+        }
+        if (measured == 0) {
+            break;
+        }
+        sample.before /= measured;
+        sample.across /= measured;
+        sample.after /= measured;
+        results.append(sample);
+    }
+    if (samples) *samples = results;
+
+    // The step must persist at the next size too, so a single noisy candidate is not taken
+    for (qsizetype i = 0; i + 1 < results.size(); ++i) {
+        if (hasStep(results[i]) && hasStep(results[i + 1])) {
+            return results[i].alignment;
+        }
+    }
+    return 0;
+}
+
+qint64 EraseBlockProbe::requestSize(qint64 eraseBlockSize, qint64 preferred) {
+    if (eraseBlockSize <= preferred) {
+        return preferred; // Powers of two, so this is a whole number of erase blocks
+    }
+    return std::min(eraseBlockSize, std::max(preferred, kMaxRequestSize));
+}
+
+qint64 EraseBlockProbe::alignedLength(qint64 offset, qint64 end, qint64 requestSize) {
+    return std::min(end, (offset / requestSize + 1) * requestSize) - offset;
+}
@@ -0,0 +1,65 @@
+#ifndef ERASEBLOCKPROBE_H
+#define ERASEBLOCKPROBE_H
+
+#include <QList>
+#include <QString>
+
+class BlockDevice;
+
+/**
+ * @brief Estimates the erase block (allocation unit) size of a flash drive by timing reads.
+ *
+ * This is the alignment test of flashbench: for every candidate size A, small
+ * reads are timed just before, across and just after boundaries at odd
+ * multiples of A. Crossing a real allocation-unit boundary costs the
+ * controller an extra lookup, so "across" is measurably slower than the
+ * average of "before" and "after" once A reaches the erase block size, and
+ * not below it. The smallest candidate that shows the step (confirmed by the
+ * next one) is the estimate.
+ *
+ * Only reads are issued, so probing is safe on a drive that holds data, and
+ * it takes a second or two. It needs O_DIRECT; through the page cache the
+ * timings are meaningless and no estimate is made.
+ */
+class EraseBlockProbe {
+public:
+    static constexpr qint64 kReadSize = 16 * 1024;
+    static constexpr qint64 kMinCandidate = 64 * 1024;
+    static constexpr qint64 kMaxCandidate = 64 * 1024 * 1024;
+    static constexpr int kBoundaries = 8;  // Boundaries sampled per candidate
+    static constexpr int kRepeats = 3;     // Timings per read; the fastest is kept
+    static constexpr double kThreshold = 0.15; // Minimum slowdown across a boundary, relative to the average
+
+    /**
+     * @brief Timings for one candidate alignment, in microseconds.
+     */
+    struct Sample {
+        qint64 alignment = 0;
+        double before = 0;
+        double across = 0;
+        double after = 0;
+
+        double difference() const { return across - (before + after) / 2; }
+    };
+
+    /**
+     * @brief Probes an open device.
+     * @param samples Receives the timings of every candidate, for logging; may be null.
+     * @return qint64 The estimated erase block size in bytes, or 0 if there is no clear step.
+     */
+    static qint64 probe(BlockDevice &device, QList<Sample> *samples = nullptr);
+
+    /**
+     * @brief Write request size for a drive: a multiple of the erase block, or one that divides it.
+     * @param eraseBlockSize Estimated erase block size, or 0 if unknown.
+     * @param preferred The engine's usual request size (a power of two).
+     */
+    static qint64 requestSize(qint64 eraseBlockSize, qint64 preferred);
+
+    /**
+     * @brief Length of the next request at offset, so that requests never straddle a requestSize boundary.
+     */
+    static qint64 alignedLength(qint64 offset, qint64 end, qint64 requestSize);
+};
+
+#endif // ERASEBLOCKPROBE_H
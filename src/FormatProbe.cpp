@@ -0,0 +1,236 @@
+#include "FormatProbe.h"
+#include "BmapFile.h"
+#include "ZstdSeekable.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+bool hasBytes(const QByteArray &bytes, qsizetype offset, const char *magic, qsizetype length) {
+    return offset >= 0 && bytes.size() >= offset + length && memcmp(bytes.constData() + offset, magic, size_t(length)) == 0;
+}
+
+quint32 le32At(const QByteArray &bytes, qsizetype offset) {
+    return bytes.size() >= offset + 4 ? qFromLittleEndian<quint32>(bytes.constData() + offset) : 0;
+}
+
+bool hasMbr(const ProbeData &data) {
+    return hasBytes(data.head, 510, "\x55\xAA", 2);
+}
+
+bool hasGpt(const ProbeData &data) {
+    return hasBytes(data.head, 512, "EFI PART", 8) || hasBytes(data.head, 4096, "EFI PART", 8);
+}
+
+bool isIso(const ProbeData &data) {
+    return hasBytes(data.head, 0x8001, "CD001", 5);
+}
+
+ImageFormat makeFormat(const QString &name, int priority, std::function<bool(const ProbeData &)> matches,
+                       std::function<std::unique_ptr<ImageSource>()> createReader) {
+    ImageFormat format;
+    format.name = name;
+    format.priority = priority;
+    format.matches = std::move(matches);
+    format.createReader = std::move(createReader);
+    return format;
+}
+
+/**
+ * @brief Returns the creator if this build has the reader compiled in, or null.
+ */
+std::function<std::unique_ptr<ImageSource>()> ifAvailable(std::unique_ptr<ImageSource> (*create)()) {
+    return create() ? std::function<std::unique_ptr<ImageSource>()>(create) : nullptr;
+}
+
+QList<ImageFormat> builtinFormats() {
+    QList<ImageFormat> formats;
+
+    ImageFormat sparse = makeFormat("Android sparse", 100, [](const ProbeData &d) {
+        return le32At(d.head, 0) == 0xED26FF3A;
+    }, ImageSources::createAndroidSparse);
+    sparse.sparse = true;
+    formats << sparse;
+
+    ImageFormat qcow2 = makeFormat("qcow2", 100, [](const ProbeData &d) {
+        return hasBytes(d.head, 0, "QFI\xFB", 4);
+    }, ImageSources::createQcow2);
+    qcow2.sparse = true;
+    formats << qcow2;
+
+    ImageFormat vhdx = makeFormat("VHDX", 100, [](const ProbeData &d) {
+        return hasBytes(d.head, 0, "vhdxfile", 8);
+    }, ImageSources::createVhdx);
+    vhdx.sparse = true;
+    formats << vhdx;
+
+    ImageFormat vhd = makeFormat("VHD", 90, [](const ProbeData &d) {
+        return hasBytes(d.tail, d.tail.size() - 512, "conectix", 8);
+    }, ImageSources::createVhd);
+    vhd.sparse = true;
+    formats << vhd;
+
+    ImageFormat vmdk = makeFormat("VMDK", 100, [](const ProbeData &d) {
+        return hasBytes(d.head, 0, "KDMV", 4) || hasBytes(d.head, 0, "# Disk DescriptorFile", 21);
+    }, ImageSources::createVmdk);
+    vmdk.sparse = true;
+    formats << vmdk;
+
+    ImageFormat chunked = makeFormat("Inferno library image", 100, [](const ProbeData &d) {
+        return hasBytes(d.head, 0, "INFCIDX1", 8);
+    }, ImageSources::createChunked);
+    formats << chunked;
+
+    ImageFormat seekableZstd = makeFormat("zstd (seekable)", 100, [](const ProbeData &d) {
+        return le32At(d.head, 0) == 0xFD2FB528 && le32At(d.tail, d.tail.size() - 4) == ZstdSeekable::kSeekableMagic;
+    }, ifAvailable(ImageSources::createZstdSeekable));
+    seekableZstd.unsupportedReason = "This build of Inferno was compiled without zstd support.";
+    seekableZstd.compressed = true;
+    seekableZstd.sparse = true; // Backups may carry a .holes map
+    formats << seekableZstd;
+
+    ImageFormat zstd = makeFormat("zstd", 90, [](const ProbeData &d) {
+        return le32At(d.head, 0) == 0xFD2FB528;
+    }, nullptr);
+    zstd.unsupportedReason = "Plain zstd files cannot be read at random offsets; decompress the image first.";
+    zstd.compressed = true;
+    formats << zstd;
+
+    ImageFormat xz = makeFormat("xz", 100, [](const ProbeData &d) {
+        return hasBytes(d.head, 0, "\xFD" "7zXZ\0", 6);
+    }, ifAvailable(ImageSources::createXz));
+    xz.unsupportedReason = "This build of Inferno was compiled without xz support.";
+    xz.compressed = true;
+    xz.bmapApplies = true;
+    formats << xz;
+
+    ImageFormat gzip = makeFormat("gzip", 100, [](const ProbeData &d) {
+        return hasBytes(d.head, 0, "\x1F\x8B", 2);
+    }, nullptr);
+    gzip.unsupportedReason = "gzip images are not supported; decompress the image first.";
+    gzip.compressed = true;
+    formats << gzip;
+
+    ImageFormat bzip2 = makeFormat("bzip2", 100, [](const ProbeData &d) {
+        return hasBytes(d.head, 0, "BZh", 3) && d.head.size() > 3 && d.head[3] >= '1' && d.head[3] <= '9';
+    }, nullptr);
+    bzip2.unsupportedReason = "bzip2 images are not supported; decompress the image first.";
+    bzip2.compressed = true;
+    formats << bzip2;
+
+    ImageFormat iso = makeFormat("ISO 9660", 50, isIso, ImageSources::createRaw);
+    iso.bmapApplies = true;
+    formats << iso;
+
+    ImageFormat disk = makeFormat("Raw disk image", 40, [](const ProbeData &d) {
+        return hasMbr(d) || hasGpt(d);
+    }, ImageSources::createRaw);
+    disk.bmapApplies = true;
+    formats << disk;
+
+    ImageFormat raw = makeFormat("raw", 0, [](const ProbeData &d) {
+        return d.acceptRaw || FormatProbe::kRawSuffixes.contains(QFileInfo(d.path).suffix().toLower());
+    }, ImageSources::createRaw);
+    raw.bmapApplies = true;
+    formats << raw;
+
+    return formats;
+}
+
+QMutex registryMutex;
+
+QList<ImageFormat> &registry() {
+    static QList<ImageFormat> formats = builtinFormats();
+    return formats;
+}
+} // namespace
+
+// --- Implementation of FormatProbe ---
+
+const QStringList FormatProbe::kRawSuffixes = {"img", "iso", "bin"};
+
+void FormatProbe::registerFormat(const ImageFormat &format) {
+    QMutexLocker locker(&registryMutex);
+    registry().append(format);
+}
+
+QList<ImageFormat> FormatProbe::formats() {
+    QMutexLocker locker(&registryMutex);
+    return registry();
+}
+
+ProbeResult FormatProbe::probe(const QString &path, bool acceptRaw) {
+    ProbeResult result;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        result.error = file.errorString();
+        return result;
+    }
+
+    ProbeData data;
+    data.path = path;
+    data.fileSize = file.size();
+    data.acceptRaw = acceptRaw;
+    data.head = file.read(kHeadSize);
+    if (data.fileSize > kHeadSize && file.seek(std::max(kHeadSize, data.fileSize - kTailSize))) {
+        data.tail = file.read(kTailSize);
+    } else {
+        data.tail = data.head.right(kTailSize);
+    }
+
+    const QList<ImageFormat> candidates = formats();
+    const ImageFormat *best = nullptr;
+    for (const ImageFormat &format : candidates) {
+        if ((!best || format.priority > best->priority) && format.matches && format.matches(data)) {
+            best = &format;
+        }
+    }
+    if (!best) {
+        result.error = QString("Unrecognised image format; only .%1 files are written as raw data without asking.")
+                           .arg(kRawSuffixes.join(", ."));
+        result.unrecognised = true;
+        return result;
+    }
+
+    result.formatName = best->name;
+    result.createReader = best->createReader;
+    result.compressed = best->compressed;
+    result.sparse = best->sparse;
+    result.iso = isIso(data);
+    result.hybrid = result.iso && (hasMbr(data) || hasGpt(data));
+
+    QString description = best->name;
+    if (result.hybrid) {
+        description += QString(" (hybrid, %1)").arg(hasGpt(data) ? "MBR + GPT" : "MBR");
+    } else if (best->name == "Raw disk image") {
+        description += hasGpt(data) ? " (GPT)" : " (MBR)";
+    } else if (best->priority == 0) {
+        description = "Unrecognised data (written as raw)";
+    }
+
+    if (!best->createReader) {
+        result.error = best->unsupportedReason.isEmpty() ? QString("%1 images cannot be written.").arg(best->name)
+                                                         : best->unsupportedReason;
+        result.description = description;
+        return result;
+    }
+
+    if (best->bmapApplies) {
+        result.bmapPath = BmapFile::findFor(path);
+    }
+    if (!result.bmapPath.isEmpty()) {
+        result.engine = WriteEngine::Bmap;
+        description += QString(", block map %1").arg(QFileInfo(result.bmapPath).fileName());
+    } else if (best->compressed || best->sparse || !best->bmapApplies) {
+        result.engine = WriteEngine::Decode;
+        if (best->sparse) description += ", holes skipped";
+    } else {
+        result.engine = WriteEngine::Direct;
+    }
+    result.description = description;
+    return result;
+}
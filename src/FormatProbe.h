@@ -0,0 +1,103 @@
+#ifndef FORMATPROBE_H
+#define FORMATPROBE_H
+
+#include "ImageSource.h"
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QList>
+#include <functional>
+#include <memory>
+
+/**
+ * @brief The few bytes a probe may look at: the start and the end of the file.
+ */
+struct ProbeData {
+    QString path;
+    qint64 fileSize = 0;
+    QByteArray head; // First FormatProbe::kHeadSize bytes (less for small files)
+    QByteArray tail; // Last FormatProbe::kTailSize bytes
+    bool acceptRaw = false; // The user confirmed that unrecognised data may be written as is
+};
+
+/**
+ * @brief A registered image format.
+ */
+struct ImageFormat {
+    QString name;
+    int priority = 0; // The highest-priority match wins; unrecognised raw data is 0
+    std::function<bool(const ProbeData &)> matches;
+    std::function<std::unique_ptr<ImageSource>()> createReader; // Null if this build cannot read it
+    QString unsupportedReason;  // Shown when createReader is null
+    bool compressed = false;
+    bool sparse = false;        // May contain holes that need not be written
+    bool bmapApplies = false;   // Content is a raw image, so a .bmap can guide the write
+};
+
+/**
+ * @brief How an image will be written, as decided by the probe.
+ */
+enum class WriteEngine {
+    Unsupported,
+    Direct,       // Raw or ISO data, written as is
+    Bmap,         // Raw data with a bmap: only mapped, checksummed ranges
+    Decode        // Container expanded in the stream, holes skipped
+};
+
+struct ProbeResult {
+    QString formatName;
+    QString description;   // One line for the UI, e.g. "ISO 9660 (hybrid MBR + GPT)"
+    WriteEngine engine = WriteEngine::Unsupported;
+    QString bmapPath;
+    QString error;         // Why the image cannot be written, if engine is Unsupported
+    bool unrecognised = false; // No format matched; probing again with acceptRaw writes it as raw data
+    std::function<std::unique_ptr<ImageSource>()> createReader;
+    bool compressed = false;
+    bool sparse = false;
+    bool iso = false;
+    bool hybrid = false;   // ISO that also carries a partition table (boots when written raw)
+
+    bool writable() const { return engine != WriteEngine::Unsupported; }
+};
+
+/**
+ * @brief Identifies disk images by content, using only their first and last few KB.
+ *
+ * Formats are kept in a registry of magic-number probes, each paired with the
+ * ImageSource that reads it, so adding a format is one registerFormat() call.
+ * Probing never scans the file, which keeps image selection instant even for
+ * huge images on network shares, and the result tells the caller which write
+ * engine (direct, bmap or decode) will be fastest.
+ *
+ * Data no format recognises is written as raw only if the file name says it
+ * is a raw image (kRawSuffixes) or the caller passes acceptRaw, after asking
+ * the user; a stray document or archive is never burned by accident.
+ */
+class FormatProbe {
+public:
+    static constexpr qint64 kHeadSize = 40 * 1024; // Covers the ISO 9660 volume descriptor at 32 KiB
+    static constexpr qint64 kTailSize = 4 * 1024;
+
+    /**
+     * @brief File name suffixes under which unrecognised data is taken to be a raw image.
+     */
+    static const QStringList kRawSuffixes;
+
+    /**
+     * @brief Probes an image file.
+     * @param acceptRaw Write unrecognised data as raw whatever the file is called.
+     */
+    static ProbeResult probe(const QString &path, bool acceptRaw = false);
+
+    /**
+     * @brief Adds a format to the registry. Thread-safe.
+     */
+    static void registerFormat(const ImageFormat &format);
+
+    /**
+     * @brief All registered formats, built-in ones included. Thread-safe.
+     */
+    static QList<ImageFormat> formats();
+};
+
+#endif // FORMATPROBE_H
@@ -0,0 +1,253 @@
+#include "ImageFetcher.h"
+#include "ImageLibrary.h"
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QThread>
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+// Chunk requests kept in flight per peer connection
+const int kPeerRequestWindow = 16;
+// Peers are on the same LAN, so their copies are cheap to get again
+const double kPeerFetchCost = 1.0;
+} // namespace
+
+// --- Implementation of ImageFetcher ---
+
+ImageFetcher::ImageFetcher(ImageLibrary *library, QObject *parent)
+    : QObject(parent), library(library), network(new QNetworkAccessManager(this)) {
+    connect(library, &ImageLibrary::importFinished, this, &ImageFetcher::importFinished);
+}
+
+ImageFetcher::~ImageFetcher() {
+    if (peerWorker) {
+        // Queued calls the worker still posts are dropped along with this object
+        peerCancelled->store(true);
+        peerWorker->wait();
+        delete peerWorker;
+    }
+}
+
+QList<PeerAddress> ImageFetcher::parsePeers(const QStringList &entries) {
+    QList<PeerAddress> result;
+    for (const QString &entry : entries) {
+        const QString trimmed = entry.trimmed();
+        if (trimmed.isEmpty()) {
+            continue;
+        }
+        PeerAddress peer;
+        const qsizetype colon = trimmed.lastIndexOf(':');
+        bool ok = false;
+        const uint port = colon > 0 ? trimmed.mid(colon + 1).toUInt(&ok) : 0;
+        if (ok && port > 0 && port <= 65535) {
+            peer.host = trimmed.left(colon);
+            peer.port = quint16(port);
+        } else {
+            peer.host = trimmed;
+            peer.port = PeerCacheServer::kDefaultPort;
+        }
+        result.append(peer);
+    }
+    return result;
+}
+
+bool ImageFetcher::fetch(const QString &imageName, const QList<QUrl> &mirrors, const QByteArray &expectedSha256) {
+    if (busy) {
+        return false;
+    }
+    busy = true;
+    name = QFileInfo(imageName).fileName(); // Used as a file name, so never a path
+    pendingMirrors = mirrors;
+    // Accept the digest either raw or as the hex string mirrors publish
+    expectedHash = expectedSha256.size() == 64 ? QByteArray::fromHex(expectedSha256) : expectedSha256;
+    lastError.clear();
+
+    // 1. Already local
+    if (const LibraryEntry *entry = library->findByName(name)) {
+        const QString id = entry->id;
+        QMetaObject::invokeMethod(this, [this, id]() { finish(true, id, QString()); }, Qt::QueuedConnection);
+        return true;
+    }
+
+    // 2. LAN peers (chunk store required to receive chunks)
+    if (!peers.isEmpty() && library->deduplicationEnabled()) {
+        fetchFromPeers();
+    } else {
+        startNextMirror();
+    }
+    return true;
+}
+
+void ImageFetcher::fetchFromPeers() {
+    const QList<PeerAddress> peerList = peers;
+    const QByteArray peerToken = token;
+    const QString imageName = name;
+    const QString storeRoot = library->chunkStore()->rootPath();
+    const std::shared_ptr<std::atomic<bool>> cancelled = std::make_shared<std::atomic<bool>>(false);
+    peerCancelled = cancelled;
+
+    // The peer client blocks, so it runs on its own thread. It only writes
+    // verified chunk files; the library is updated back on this thread. The
+    // destructor joins the worker, so posting to this object stays valid.
+    peerWorker = QThread::create([this, peerList, peerToken, imageName, storeRoot, cancelled]() {
+        QString error = tr("No peer has %1").arg(imageName);
+        for (const PeerAddress &peer : peerList) {
+            if (cancelled->load()) {
+                return;
+            }
+            PeerCacheClient client;
+            QList<PeerImage> images;
+            if (!client.connectToPeer(peer, peerToken) || !client.listImages(&images)) {
+                qDebug() << "Peer unavailable:" << client.errorString();
+                continue;
+            }
+
+            const auto match = std::find_if(images.cbegin(), images.cend(),
+                                            [&](const PeerImage &image) { return image.displayName == imageName; });
+            if (match == images.cend()) {
+                continue;
+            }
+
+            ChunkIndex index;
+            const qint64 total = match->size;
+            const QString message = tr("Copying %1 from station %2...").arg(imageName, peer.host);
+            const bool ok = client.fetchIndex(match->id, &index)
+                && client.fetchChunks(storeRoot, index.chunks, kPeerRequestWindow,
+                                      [this, total, message](qint64 received) {
+                                          QMetaObject::invokeMethod(this, [this, received, total, message]() {
+                                              emit fetchProgress(received, total, message);
+                                          }, Qt::QueuedConnection);
+                                      },
+                                      cancelled.get());
+            if (ok) {
+                QMetaObject::invokeMethod(this, [this, index]() { peerFetchFinished(true, index, QString()); },
+                                          Qt::QueuedConnection);
+                return;
+            }
+            error = client.errorString();
+            qDebug() << "Peer transfer from" << peer.host << "failed:" << error;
+        }
+        QMetaObject::invokeMethod(this, [this, error]() { peerFetchFinished(false, ChunkIndex(), error); },
+                                  Qt::QueuedConnection);
+    });
+    peerWorker->start();
+}
+
+void ImageFetcher::peerFetchFinished(bool success, const ChunkIndex &index, const QString &errorMessage) {
+    // Posted as the worker's last act, so it is about to return
+    peerWorker->wait();
+    delete peerWorker;
+    peerWorker = nullptr;
+    peerCancelled.reset();
+    if (success) {
+        QString error;
+        const QString id = library->addChunkedImage(name, index, kPeerFetchCost, &error);
+        if (!id.isEmpty()) {
+            finish(true, id, QString());
+            return;
+        }
+        lastError = error;
+    } else {
+        lastError = errorMessage;
+    }
+    // 3. Internet mirrors
+    startNextMirror();
+}
+
+void ImageFetcher::startNextMirror() {
+    if (pendingMirrors.isEmpty()) {
+        finish(false, QString(), lastError.isEmpty() ? tr("No source available for %1").arg(name) : lastError);
+        return;
+    }
+
+    const QUrl url = pendingMirrors.takeFirst();
+    // Downloaded under its own name so the library entry gets the right display name
+    const QString downloadDir = QDir(library->rootPath()).filePath("downloads");
+    QDir().mkpath(downloadDir);
+    downloadFile = new QFile(QDir(downloadDir).filePath(name), this);
+    if (!downloadFile->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        lastError = downloadFile->errorString();
+        delete downloadFile;
+        downloadFile = nullptr;
+        startNextMirror();
+        return;
+    }
+    downloadHash.reset();
+    downloadTimer.start();
+
+    QNetworkRequest request(url);
+    request.setAttribute(QNetworkRequest::RedirectPolicyAttribute, QNetworkRequest::NoLessSafeRedirectPolicy);
+    reply = network->get(request);
+    connect(reply, &QNetworkReply::readyRead, this, &ImageFetcher::downloadReadyRead);
+    connect(reply, &QNetworkReply::finished, this, &ImageFetcher::downloadFinished);
+    connect(reply, &QNetworkReply::downloadProgress, this, [this, url](qint64 received, qint64 total) {
+        emit fetchProgress(received, total, tr("Downloading %1 from %2...").arg(name, url.host()));
+    });
+}
+
+void ImageFetcher::downloadReadyRead() {
+    const QByteArray data = reply->readAll();
+    downloadHash.addData(data); // Hash while downloading so verification is free at the end
+    if (downloadFile->write(data) != data.size()) {
+        lastError = downloadFile->errorString();
+        reply->abort();
+    }
+}
+
+void ImageFetcher::downloadFinished() {
+    downloadReadyRead();
+    const QString path = downloadFile->fileName();
+    downloadFile->close();
+    delete downloadFile;
+    downloadFile = nullptr;
+
+    const bool failed = reply->error() != QNetworkReply::NoError;
+    if (failed && lastError.isEmpty()) {
+        lastError = reply->errorString();
+    }
+    reply->deleteLater();
+    reply = nullptr;
+
+    if (!failed && !expectedHash.isEmpty() && downloadHash.result() != expectedHash) {
+        lastError = tr("Downloaded image does not match the expected SHA-256.");
+        QFile::remove(path);
+        startNextMirror();
+        return;
+    }
+    if (failed) {
+        QFile::remove(path);
+        startNextMirror();
+        return;
+    }
+
+    // Download time is the cost of getting it again, so slow images stay cached longer
+    const double fetchCost = std::max(1.0, downloadTimer.elapsed() / 1000.0);
+    // Chunking and hashing the image takes a while, so the library does it on a worker thread
+    importingPath = path;
+    const qint64 size = QFileInfo(path).size();
+    emit fetchProgress(size, size, tr("Adding %1 to the library...").arg(name));
+    library->importImageAsync(path, fetchCost, true);
+}
+
+void ImageFetcher::importFinished(const QString &sourcePath, const QString &id, const QString &errorMessage) {
+    if (sourcePath != importingPath) {
+        return; // Someone else's import
+    }
+    importingPath.clear();
+    QFile::remove(sourcePath);
+    if (id.isEmpty()) {
+        finish(false, QString(), errorMessage);
+        return;
+    }
+    finish(true, id, QString());
+}
+
+void ImageFetcher::finish(bool success, const QString &id, const QString &errorMessage) {
+    busy = false;
+    emit fetchCompleted(success, id, errorMessage);
+}
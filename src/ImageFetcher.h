@@ -0,0 +1,117 @@
+#ifndef IMAGEFETCHER_H
+#define IMAGEFETCHER_H
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QUrl>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QCryptographicHash>
+#include <atomic>
+#include <memory>
+#include "PeerCache.h"
+
+class QNetworkAccessManager;
+class QNetworkReply;
+class QFile;
+class QThread;
+class ImageLibrary;
+
+/**
+ * @brief Gets an image into the library, preferring LAN peers over internet mirrors.
+ *
+ * A fetch first checks the local library, then asks each configured peer
+ * station for an image with the same name and copies only the chunks this
+ * station is missing (each verified against its SHA-256). Only when no peer
+ * has the image does it download from the mirrors in order.
+ */
+class ImageFetcher : public QObject {
+    Q_OBJECT
+
+public:
+    explicit ImageFetcher(ImageLibrary *library, QObject *parent = nullptr);
+
+    /**
+     * @brief Cancels a running peer transfer and waits for its thread.
+     */
+    ~ImageFetcher() override;
+
+    /**
+     * @brief Sets the stations to ask and the site's shared token (see PeerCacheServer).
+     */
+    void setPeers(const QList<PeerAddress> &peerList, const QByteArray &peerToken) {
+        peers = peerList;
+        token = peerToken;
+    }
+
+    /**
+     * @brief Parses "host:port" strings (port defaults to PeerCacheServer::kDefaultPort).
+     */
+    static QList<PeerAddress> parsePeers(const QStringList &entries);
+
+    /**
+     * @brief Starts fetching an image. Completion is reported via fetchCompleted().
+     *
+     * @param imageName File name of the image, used to match library and peer entries.
+     * @param mirrors Download URLs tried in order if no peer has the image.
+     * @param expectedSha256 Optional SHA-256 of the whole image for mirror downloads.
+     * @return bool False if another fetch is already running.
+     */
+    bool fetch(const QString &imageName, const QList<QUrl> &mirrors, const QByteArray &expectedSha256 = QByteArray());
+
+    bool isBusy() const { return busy; }
+
+signals:
+    /**
+     * @brief Signal emitted as image data arrives.
+     * @param received Bytes received (or already present) so far.
+     * @param total Total image size, or -1 if unknown.
+     * @param message A status message.
+     */
+    void fetchProgress(qint64 received, qint64 total, const QString &message);
+
+    /**
+     * @brief Signal emitted when the fetch finishes.
+     * @param success True if the image is now in the library.
+     * @param id The library id of the image.
+     * @param errorMessage Error message if failure occurred.
+     */
+    void fetchCompleted(bool success, const QString &id, const QString &errorMessage);
+
+private slots:
+    void downloadReadyRead();
+    void downloadFinished();
+    void importFinished(const QString &sourcePath, const QString &id, const QString &errorMessage);
+
+private:
+    void fetchFromPeers();
+    void peerFetchFinished(bool success, const ChunkIndex &index, const QString &errorMessage);
+    void startNextMirror();
+    void finish(bool success, const QString &id, const QString &errorMessage);
+
+    ImageLibrary *library;
+    QList<PeerAddress> peers;
+    QByteArray token;
+    QNetworkAccessManager *network;
+    bool busy = false;
+
+    // Current peer transfer; the worker only touches this object through queued calls
+    QThread *peerWorker = nullptr;
+    std::shared_ptr<std::atomic<bool>> peerCancelled;
+
+    // Current request
+    QString name;
+    QList<QUrl> pendingMirrors;
+    QByteArray expectedHash;
+    QString lastError;
+
+    // Current mirror download
+    QNetworkReply *reply = nullptr;
+    QFile *downloadFile = nullptr;
+    QCryptographicHash downloadHash{QCryptographicHash::Sha256};
+    QElapsedTimer downloadTimer;
+    QString importingPath; // Download being added to the library
+};
+
+#endif // IMAGEFETCHER_H
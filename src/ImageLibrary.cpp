@@ -0,0 +1,539 @@
+#include "ImageLibrary.h"
+#include "ChunkStore.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QThread>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+const char *kIndexFileName = "library.json";
+const int kIndexVersion = 1;
+const char *kStagingDirName = "staging";
+
+QJsonObject entryToJson(const LibraryEntry &entry) {
+    QJsonObject obj;
+    obj["id"] = entry.id;
+    obj["displayName"] = entry.displayName;
+    obj["size"] = QString::number(entry.size); // qint64 does not fit a JSON double exactly
+    obj["accessCount"] = QString::number(entry.accessCount);
+    obj["added"] = entry.added.toString(Qt::ISODate);
+    obj["lastAccess"] = entry.lastAccess.toString(Qt::ISODate);
+    obj["fetchCost"] = entry.fetchCost;
+    obj["priority"] = entry.priority;
+    obj["pinned"] = entry.pinned;
+    obj["chunked"] = entry.chunked;
+    return obj;
+}
+
+LibraryEntry entryFromJson(const QJsonObject &obj) {
+    LibraryEntry entry;
+    entry.id = obj["id"].toString();
+    entry.displayName = obj["displayName"].toString();
+    entry.size = obj["size"].toString().toLongLong();
+    entry.accessCount = obj["accessCount"].toString().toULongLong();
+    entry.added = QDateTime::fromString(obj["added"].toString(), Qt::ISODate);
+    entry.lastAccess = QDateTime::fromString(obj["lastAccess"].toString(), Qt::ISODate);
+    entry.fetchCost = obj["fetchCost"].toDouble(1.0);
+    entry.priority = obj["priority"].toDouble();
+    entry.pinned = obj["pinned"].toBool();
+    entry.chunked = obj["chunked"].toBool();
+    return entry;
+}
+} // namespace
+
+// --- Implementation of ImageLibrary ---
+
+ImageLibrary::ImageLibrary(const QString &rootPath, qint64 byteBudget, QObject *parent)
+    : QObject(parent), root(rootPath), budget(byteBudget),
+      store(std::make_unique<ChunkStore>(QDir(rootPath).filePath("chunkstore"))) {
+    QDir().mkpath(root);
+}
+
+ImageLibrary::~ImageLibrary() {
+    // Results the workers still post are dropped along with this object
+    for (QThread *worker : std::as_const(importWorkers)) {
+        worker->wait();
+        delete worker;
+    }
+}
+
+qint64 ImageLibrary::usedBytes() const {
+    return used + store->storedBytes();
+}
+
+bool ImageLibrary::load(QString *errorMessage) {
+    index.clear();
+    used = 0;
+    clock = 0.0;
+    invalidateListing();
+
+    if (!store->open(errorMessage)) {
+        return false;
+    }
+    if (importWorkers.isEmpty()) {
+        // Copies left behind by imports that never finished
+        QDir(QDir(root).filePath(kStagingDirName)).removeRecursively();
+    }
+
+    QFile file(QDir(root).filePath(kIndexFileName));
+    if (!file.exists()) {
+        return true; // Empty library
+    }
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorMessage) *errorMessage = file.errorString();
+        return false;
+    }
+
+    QJsonParseError parseError;
+    const QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &parseError);
+    if (doc.isNull()) {
+        if (errorMessage) *errorMessage = parseError.errorString();
+        return false;
+    }
+
+    const QJsonObject top = doc.object();
+    clock = top["clock"].toDouble();
+    for (const QJsonValue &value : top["entries"].toArray()) {
+        LibraryEntry entry = entryFromJson(value.toObject());
+        if (entry.chunked) {
+            entry.filePath = store->indexPath(entry.id);
+            if (entry.id.isEmpty() || !store->hasImage(entry.id)) {
+                qDebug() << "Library entry missing from chunk store, dropping:" << entry.id;
+                continue;
+            }
+        } else {
+            entry.filePath = QDir(root).filePath(entry.id);
+            const QFileInfo info(entry.filePath);
+            if (entry.id.isEmpty() || !info.exists()) {
+                qDebug() << "Library entry missing on disk, dropping:" << entry.id;
+                continue;
+            }
+            entry.size = info.size();
+            used += entry.size;
+        }
+        index.insert(entry.id, entry);
+    }
+
+    // The budget may have been lowered since the index was written
+    if (usedBytes() > budget) {
+        makeRoom(0);
+        save();
+    }
+    return true;
+}
+
+bool ImageLibrary::save(QString *errorMessage) const {
+    QJsonArray array;
+    for (const LibraryEntry &entry : index) {
+        array.append(entryToJson(entry));
+    }
+
+    QJsonObject top;
+    top["version"] = kIndexVersion;
+    top["clock"] = clock;
+    top["entries"] = array;
+
+    QSaveFile file(QDir(root).filePath(kIndexFileName));
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorMessage) *errorMessage = file.errorString();
+        return false;
+    }
+    file.write(QJsonDocument(top).toJson(QJsonDocument::Indented));
+    if (!file.commit()) {
+        if (errorMessage) *errorMessage = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+void ImageLibrary::setByteBudget(qint64 bytes) {
+    budget = bytes;
+    makeRoom(0);
+    save();
+}
+
+QString ImageLibrary::importImage(const QString &sourcePath, double fetchCost, bool moveFile, QString *errorMessage) {
+    const QFileInfo sourceInfo(sourcePath);
+    if (!sourceInfo.isFile()) {
+        if (errorMessage) *errorMessage = tr("Image not found: %1").arg(sourcePath);
+        return QString();
+    }
+
+    const QString id = uniqueId(sourceInfo.fileName());
+    if (deduplicate) {
+        // Only the chunks the store lacks count against the budget, which is known once they are stored
+        return importChunked(id, sourcePath, fetchCost, moveFile, errorMessage);
+    }
+
+    const qint64 size = sourceInfo.size();
+    if (!canFit(size)) {
+        if (errorMessage) *errorMessage = tr("Not enough unpinned space in the library.");
+        return QString();
+    }
+
+    const QString targetPath = QDir(root).filePath(id);
+    bool stored = false;
+    if (moveFile) {
+        stored = QFile::rename(sourcePath, targetPath);
+    }
+    if (!stored) {
+        // Copy under a temporary name so a partial copy is never listed
+        const QString partialPath = targetPath + ".part";
+        QFile::remove(partialPath);
+        stored = QFile::copy(sourcePath, partialPath) && QFile::rename(partialPath, targetPath);
+        if (!stored) {
+            QFile::remove(partialPath);
+        } else if (moveFile) {
+            QFile::remove(sourcePath);
+        }
+    }
+    if (!stored) {
+        if (errorMessage) *errorMessage = tr("Failed to store %1 in the library.").arg(sourceInfo.fileName());
+        return QString();
+    }
+
+    // Evict only now, so a failed copy costs no other image
+    if (!makeRoom(size)) {
+        const bool restored = !moveFile || QFile::rename(targetPath, sourcePath) || QFile::copy(targetPath, sourcePath);
+        if (restored) QFile::remove(targetPath);
+        if (errorMessage) *errorMessage = tr("Not enough unpinned space in the library.");
+        return QString();
+    }
+
+    LibraryEntry entry;
+    entry.id = id;
+    entry.displayName = sourceInfo.fileName();
+    entry.filePath = targetPath;
+    entry.size = size;
+    entry.added = QDateTime::currentDateTimeUtc();
+    entry.lastAccess = entry.added;
+    entry.accessCount = 1;
+    entry.fetchCost = fetchCost;
+    entry.priority = computePriority(entry);
+
+    index.insert(id, entry);
+    used += size;
+    invalidateListing();
+    save();
+    return id;
+}
+
+void ImageLibrary::importImageAsync(const QString &sourcePath, double fetchCost, bool moveFile) {
+    const QFileInfo sourceInfo(sourcePath);
+    const QString fileName = sourceInfo.fileName();
+    QString error;
+    if (!sourceInfo.isFile()) {
+        error = tr("Image not found: %1").arg(sourcePath);
+    } else if (!deduplicate && !canFit(sourceInfo.size())) {
+        error = tr("Not enough unpinned space in the library.");
+    }
+    if (!error.isEmpty()) {
+        QMetaObject::invokeMethod(this, [this, sourcePath, error]() {
+            emit importFinished(sourcePath, QString(), error);
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    struct Result {
+        bool chunked = false;
+        ChunkIndex chunkIndex;
+        QString stagedPath; // Whole-file imports: the copy, named like the source
+        bool movedSource = false;
+        QString error;
+    };
+    const std::shared_ptr<Result> result = std::make_shared<Result>();
+    const bool chunked = deduplicate;
+    const QString storeRoot = store->rootPath();
+    const QString stagingDir = QDir(root).filePath(QString("%1/%2").arg(kStagingDirName).arg(++importSerial));
+
+    // The worker only reads the source and writes files no entry refers to
+    // yet (chunk files, or a copy in its own staging directory); the index is
+    // only changed back on this thread.
+    QThread *worker = QThread::create([result, chunked, sourcePath, fileName, moveFile, storeRoot, stagingDir]() {
+        if (chunked) {
+            QFile source(sourcePath);
+            if (!source.open(QIODevice::ReadOnly)) {
+                result->error = source.errorString();
+                return;
+            }
+            result->chunked = ChunkStore::chunkImage(storeRoot, &source, &result->chunkIndex, &result->error);
+            return;
+        }
+        const QString staged = QDir(stagingDir).filePath(fileName);
+        if (!QDir().mkpath(stagingDir)) {
+            result->error = tr("Failed to create %1").arg(stagingDir);
+            return;
+        }
+        result->movedSource = moveFile && QFile::rename(sourcePath, staged);
+        if (!result->movedSource && !QFile::copy(sourcePath, staged)) {
+            result->error = tr("Failed to store %1 in the library.").arg(fileName);
+            return;
+        }
+        result->stagedPath = staged;
+    });
+    importWorkers.insert(worker);
+    connect(worker, &QThread::finished, this,
+            [this, worker, result, sourcePath, fileName, fetchCost, moveFile, stagingDir]() {
+        importWorkers.remove(worker);
+        worker->deleteLater();
+
+        QString id;
+        QString error = result->error;
+        if (result->chunked) {
+            id = addChunkedImage(fileName, result->chunkIndex, fetchCost, &error);
+            if (!id.isEmpty() && moveFile) {
+                QFile::remove(sourcePath);
+            }
+        } else if (!result->stagedPath.isEmpty()) {
+            // Same file system as the library, so this is a rename
+            id = importImage(result->stagedPath, fetchCost, true, &error);
+            if (id.isEmpty() && result->movedSource) {
+                QFile::rename(result->stagedPath, sourcePath); // The caller still owns its file
+            } else if (!id.isEmpty() && moveFile && !result->movedSource) {
+                QFile::remove(sourcePath);
+            }
+        }
+        QDir(stagingDir).removeRecursively();
+        emit importFinished(sourcePath, id, error);
+    });
+    worker->start();
+}
+
+QString ImageLibrary::importChunked(const QString &id, const QString &sourcePath, double fetchCost, bool moveFile,
+                                   QString *errorMessage) {
+    QFile source(sourcePath);
+    if (!source.open(QIODevice::ReadOnly)) {
+        if (errorMessage) *errorMessage = source.errorString();
+        return QString();
+    }
+    // Chunks shared with other releases cost nothing, so the space needed is
+    // only known afterwards; evict down to the budget once the import is done.
+    ChunkIndex chunkIndex;
+    if (!store->importImage(id, &source, errorMessage, &chunkIndex)) {
+        return QString();
+    }
+    source.close();
+    if (!insertChunkedEntry(id, QFileInfo(sourcePath).fileName(), chunkIndex.imageSize, fetchCost, errorMessage)) {
+        return QString();
+    }
+    if (moveFile) {
+        QFile::remove(sourcePath);
+    }
+    return id;
+}
+
+QString ImageLibrary::addChunkedImage(const QString &displayName, const ChunkIndex &chunkIndex, double fetchCost,
+                                      QString *errorMessage) {
+    const QString id = uniqueId(displayName);
+    if (!store->addIndex(id, chunkIndex, errorMessage)) {
+        return QString();
+    }
+    if (!insertChunkedEntry(id, displayName, chunkIndex.imageSize, fetchCost, errorMessage)) {
+        return QString();
+    }
+    return id;
+}
+
+bool ImageLibrary::insertChunkedEntry(const QString &id, const QString &displayName, qint64 size, double fetchCost,
+                                      QString *errorMessage) {
+    // The image's chunks are in the store by now, so the store's size already includes what it added
+    if (!canFit(0, id)) {
+        store->removeImage(id); // Drops the chunks no other image uses, i.e. the ones just added
+        if (errorMessage) *errorMessage = tr("Not enough unpinned space in the library.");
+        return false;
+    }
+
+    LibraryEntry entry;
+    entry.id = id;
+    entry.displayName = displayName;
+    entry.filePath = store->indexPath(id);
+    entry.size = size;
+    entry.added = QDateTime::currentDateTimeUtc();
+    entry.lastAccess = entry.added;
+    entry.accessCount = 1;
+    entry.fetchCost = fetchCost;
+    entry.priority = computePriority(entry);
+    entry.chunked = true;
+
+    index.insert(id, entry);
+    if (!makeRoom(0, id)) {
+        index.remove(id);
+        store->removeImage(id);
+        invalidateListing();
+        save();
+        if (errorMessage) *errorMessage = tr("Not enough unpinned space in the library.");
+        return false;
+    }
+    invalidateListing();
+    save();
+    return true;
+}
+
+bool ImageLibrary::canFit(qint64 bytes, const QString &keepId) const {
+    if (bytes > budget) {
+        return false;
+    }
+    qint64 evictable = 0;
+    for (const LibraryEntry &entry : index) {
+        if (entry.pinned || entry.id == keepId) {
+            continue;
+        }
+        // Chunks shared between evictable images are not counted, so this errs on the safe side
+        evictable += entry.chunked ? store->uniqueBytes(entry.id) : entry.size;
+    }
+    return usedBytes() - evictable + bytes <= budget;
+}
+
+QString ImageLibrary::acquire(const QString &id) {
+    auto it = index.find(id);
+    if (it == index.end()) {
+        return QString();
+    }
+    it->accessCount++;
+    it->lastAccess = QDateTime::currentDateTimeUtc();
+    it->priority = computePriority(*it);
+    invalidateListing();
+    save();
+    return it->filePath;
+}
+
+QList<LibraryEntry> ImageLibrary::entries() const {
+    if (listingDirty) {
+        listingCache = index.values();
+        std::sort(listingCache.begin(), listingCache.end(), [](const LibraryEntry &a, const LibraryEntry &b) {
+            if (a.accessCount != b.accessCount) {
+                return a.accessCount > b.accessCount;
+            }
+            return a.lastAccess > b.lastAccess;
+        });
+        listingDirty = false;
+    }
+    return listingCache;
+}
+
+QIODevice *ImageLibrary::openImage(const QString &id) const {
+    const LibraryEntry *entry = find(id);
+    if (!entry) {
+        return nullptr;
+    }
+
+    QIODevice *device = nullptr;
+    if (entry->chunked) {
+        device = new ChunkedImageReader(entry->filePath);
+    } else {
+        device = new QFile(entry->filePath);
+    }
+    if (!device->open(QIODevice::ReadOnly)) {
+        qDebug() << "Failed to open library image" << id << ":" << device->errorString();
+        delete device;
+        return nullptr;
+    }
+    return device;
+}
+
+const LibraryEntry *ImageLibrary::find(const QString &id) const {
+    auto it = index.constFind(id);
+    return it == index.constEnd() ? nullptr : &it.value();
+}
+
+const LibraryEntry *ImageLibrary::findByName(const QString &displayName) const {
+    for (const LibraryEntry &entry : entries()) {
+        if (entry.displayName == displayName) {
+            return find(entry.id); // entries() is sorted, so this is the most used match
+        }
+    }
+    return nullptr;
+}
+
+bool ImageLibrary::remove(const QString &id) {
+    auto it = index.find(id);
+    if (it == index.end()) {
+        return false;
+    }
+    dropEntryData(*it);
+    index.erase(it);
+    invalidateListing();
+    save();
+    return true;
+}
+
+void ImageLibrary::setPinned(const QString &id, bool pinned) {
+    auto it = index.find(id);
+    if (it != index.end() && it->pinned != pinned) {
+        it->pinned = pinned;
+        invalidateListing();
+        save();
+    }
+}
+
+double ImageLibrary::computePriority(const LibraryEntry &entry) const {
+    // Size in MiB so that the frequency/cost term stays in a sensible range
+    const double sizeMiB = std::max(1.0, entry.size / (1024.0 * 1024.0));
+    return clock + (entry.accessCount * entry.fetchCost) / sizeMiB;
+}
+
+bool ImageLibrary::makeRoom(qint64 bytesNeeded, const QString &keepId) {
+    bool evicted = false;
+    while (usedBytes() + bytesNeeded > budget) {
+        auto victim = index.end();
+        for (auto it = index.begin(); it != index.end(); ++it) {
+            if (it->pinned || it->id == keepId) {
+                continue;
+            }
+            if (victim == index.end() || it->priority < victim->priority
+                || (it->priority == victim->priority && it->lastAccess < victim->lastAccess)) {
+                victim = it;
+            }
+        }
+        if (victim == index.end()) {
+            if (evicted) {
+                invalidateListing();
+                save(); // The evicted files are gone; the index must not list them
+            }
+            return false; // Everything left is pinned
+        }
+
+        qDebug() << "Evicting library image:" << victim->id << "priority" << victim->priority;
+        const QString id = victim->id;
+        clock = victim->priority;
+        dropEntryData(*victim);
+        index.erase(victim);
+        evicted = true;
+        emit entryEvicted(id);
+    }
+
+    if (evicted) {
+        invalidateListing();
+        save();
+    }
+    return true;
+}
+
+void ImageLibrary::dropEntryData(const LibraryEntry &entry) {
+    if (entry.chunked) {
+        store->removeImage(entry.id);
+    } else {
+        QFile::remove(entry.filePath);
+        used -= entry.size;
+    }
+}
+
+QString ImageLibrary::uniqueId(const QString &fileName) const {
+    QString id = fileName;
+    int suffix = 1;
+    while (index.contains(id) || QFileInfo::exists(QDir(root).filePath(id)) || store->hasImage(id)) {
+        id = QString("%1-%2").arg(suffix++).arg(fileName);
+    }
+    return id;
+}
+
+void ImageLibrary::invalidateListing() {
+    listingDirty = true;
+    emit libraryChanged();
+}
@@ -0,0 +1,213 @@
+#ifndef IMAGELIBRARY_H
+#define IMAGELIBRARY_H
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QDateTime>
+#include <QSet>
+#include <memory>
+
+class ChunkStore;
+struct ChunkIndex;
+class QIODevice;
+class QThread;
+
+/**
+ * @brief Structure to hold information about an image stored in the local library.
+ */
+struct LibraryEntry {
+    QString id;          // Stable key, also the file name inside the library directory
+    QString displayName; // e.g., ubuntu-24.04-desktop-amd64.iso
+    QString filePath;    // Absolute path of the stored image; for chunked entries the index, which
+                         // FormatProbe recognises and ImageSource reassembles from the store
+    qint64 size = 0;     // Size in bytes
+    quint64 accessCount = 0;
+    QDateTime added;
+    QDateTime lastAccess;
+    double fetchCost = 1.0; // Relative cost of getting the image back (e.g., download time)
+    double priority = 0.0;  // Eviction priority, lowest is evicted first
+    bool pinned = false;    // Pinned images are never evicted
+    bool chunked = false;   // Stored in the deduplicated chunk store
+};
+
+/**
+ * @brief Local image library with a byte budget and cost-aware eviction.
+ *
+ * Downloaded and imported images are kept in a single directory together with
+ * a JSON index (library.json). The index is what the GUI lists, so showing the
+ * library never touches the image files themselves.
+ *
+ * When an import would exceed the byte budget, entries are evicted using
+ * GreedyDual-Size-Frequency: each entry's priority is the current "clock" plus
+ * accessCount * fetchCost / size. The lowest priority entry is evicted and the
+ * clock advances to its priority, so images that are popular or expensive to
+ * fetch again stay local while large, rarely used ones are dropped first.
+ *
+ * With deduplication enabled, new imports go to a ChunkStore under
+ * <root>/chunkstore instead of being copied whole, and the budget counts the
+ * physical bytes of the unique chunks.
+ */
+class ImageLibrary : public QObject {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor for ImageLibrary.
+     * @param rootPath Directory holding the images and the index.
+     * @param byteBudget Maximum number of bytes the stored images may use.
+     * @param parent The parent object (default is nullptr).
+     */
+    explicit ImageLibrary(const QString &rootPath, qint64 byteBudget, QObject *parent = nullptr);
+
+    /**
+     * @brief Waits for imports still running on worker threads.
+     */
+    ~ImageLibrary() override;
+
+    /**
+     * @brief Loads the index from disk, dropping entries whose files have disappeared.
+     * @param errorMessage Receives a description of the failure, if any.
+     * @return bool True if the index was loaded (or did not exist yet).
+     */
+    bool load(QString *errorMessage = nullptr);
+
+    /**
+     * @brief Writes the index to disk atomically.
+     * @param errorMessage Receives a description of the failure, if any.
+     * @return bool True on success.
+     */
+    bool save(QString *errorMessage = nullptr) const;
+
+    QString rootPath() const { return root; }
+    qint64 byteBudget() const { return budget; }
+    qint64 usedBytes() const;
+
+    /**
+     * @brief Enables storing new imports as deduplicated chunks.
+     */
+    void setDeduplication(bool enabled) { deduplicate = enabled; }
+    bool deduplicationEnabled() const { return deduplicate; }
+    ChunkStore *chunkStore() const { return store.get(); }
+
+    /**
+     * @brief Changes the byte budget, evicting entries if the library no longer fits.
+     */
+    void setByteBudget(qint64 bytes);
+
+    /**
+     * @brief Copies (or moves) an image into the library, evicting others if needed.
+     *
+     * @param sourcePath Path of the image to import.
+     * @param fetchCost Relative cost of getting the image again (1.0 for local files).
+     * @param moveFile If true, the source is renamed into the library instead of copied.
+     * @param errorMessage Receives a description of the failure, if any.
+     * @return QString The id of the new entry, or an empty string on failure.
+     */
+    QString importImage(const QString &sourcePath, double fetchCost = 1.0, bool moveFile = false,
+                        QString *errorMessage = nullptr);
+
+    /**
+     * @brief Imports an image like importImage(), but reads it on a worker thread.
+     *
+     * Copying or chunking and hashing a multi-gigabyte image takes minutes, so
+     * that part runs off the calling thread; the entry is added back on this
+     * object's thread and the result is reported via importFinished().
+     */
+    void importImageAsync(const QString &sourcePath, double fetchCost = 1.0, bool moveFile = false);
+
+    /**
+     * @brief Checks, without evicting anything, whether bytes more would fit once unpinned entries are evicted.
+     */
+    bool canFit(qint64 bytes, const QString &keepId = QString()) const;
+
+    /**
+     * @brief Registers an image whose chunks are already in the chunk store (e.g., copied from a peer).
+     * @return QString The id of the new entry, or an empty string on failure.
+     */
+    QString addChunkedImage(const QString &displayName, const ChunkIndex &chunkIndex, double fetchCost = 1.0,
+                            QString *errorMessage = nullptr);
+
+    /**
+     * @brief Records a use of an image (e.g., a burn) and returns its path.
+     * @param id The entry id.
+     * @return QString The stored file path, or an empty string if the id is unknown.
+     */
+    QString acquire(const QString &id);
+
+    /**
+     * @brief Returns the listing sorted by access frequency, then recency.
+     *
+     * The sorted listing is cached and only rebuilt after the library changes.
+     */
+    QList<LibraryEntry> entries() const;
+
+    /**
+     * @brief Looks up an entry by id.
+     * @return const LibraryEntry* The entry, or nullptr if the id is unknown.
+     */
+    const LibraryEntry *find(const QString &id) const;
+
+    /**
+     * @brief Looks up the most used entry with the given display name.
+     */
+    const LibraryEntry *findByName(const QString &displayName) const;
+
+    /**
+     * @brief Opens an entry for reading, whether stored as a file or as chunks.
+     * @return QIODevice* An open device owned by the caller, or nullptr on failure.
+     */
+    QIODevice *openImage(const QString &id) const;
+
+    bool contains(const QString &id) const { return index.contains(id); }
+    bool remove(const QString &id);
+    void setPinned(const QString &id, bool pinned);
+
+signals:
+    /**
+     * @brief Signal emitted whenever entries are added, removed or evicted.
+     */
+    void libraryChanged();
+
+    /**
+     * @brief Signal emitted when an importImageAsync() call finishes.
+     * @param sourcePath The path that was imported.
+     * @param id The id of the new entry, or an empty string on failure.
+     * @param errorMessage Error message if failure occurred.
+     */
+    void importFinished(const QString &sourcePath, const QString &id, const QString &errorMessage);
+
+    /**
+     * @brief Signal emitted when an entry is evicted to stay within the budget.
+     * @param id The id of the evicted entry.
+     */
+    void entryEvicted(const QString &id);
+
+private:
+    QString importChunked(const QString &id, const QString &sourcePath, double fetchCost, bool moveFile,
+                          QString *errorMessage);
+    bool insertChunkedEntry(const QString &id, const QString &displayName, qint64 size, double fetchCost,
+                            QString *errorMessage);
+    double computePriority(const LibraryEntry &entry) const;
+    bool makeRoom(qint64 bytesNeeded, const QString &keepId = QString());
+    void dropEntryData(const LibraryEntry &entry);
+    QString uniqueId(const QString &fileName) const;
+    void invalidateListing();
+
+    QString root;
+    qint64 budget;
+    qint64 used = 0; // Bytes of whole-file entries; chunk bytes come from the store
+    bool deduplicate = false;
+    std::unique_ptr<ChunkStore> store;
+    double clock = 0.0; // GreedyDual "inflation" value, raised on every eviction
+    QHash<QString, LibraryEntry> index;
+
+    QSet<QThread *> importWorkers;
+    quint64 importSerial = 0; // Names each import's staging directory
+
+    mutable QList<LibraryEntry> listingCache;
+    mutable bool listingDirty = true;
+};
+
+#endif // IMAGELIBRARY_H
@@ -0,0 +1,451 @@
+#include "ImageSource.h"
+#include "ChunkStore.h"
+#include "FormatProbe.h"
+#include "ZstdSeekable.h"
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+#ifdef INFERNO_HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef INFERNO_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// --- Implementation of ImageSource ---
+
+qint64 ImageSource::readAt(char *data, qint64 length, qint64 offset) {
+    length = std::min(length, size() - offset);
+    if (length <= 0) {
+        return 0;
+    }
+    qint64 done = 0;
+    while (done < length) {
+        const qint64 position = offset + done;
+        const SourceExtent extent = extentAt(position);
+        if (extent.length <= 0 || extent.end() <= position) {
+            if (error.isEmpty()) error = QString("Cannot map offset %1 of the image").arg(position);
+            return -1;
+        }
+        const qint64 count = std::min(length - done, extent.end() - position);
+        if (extent.hole) {
+            std::memset(data + done, 0, size_t(count));
+        } else if (readData(data + done, count, position) != count) {
+            if (error.isEmpty()) error = QString("Image is truncated at offset %1").arg(position);
+            return -1;
+        }
+        done += count;
+    }
+    return done;
+}
+
+QList<SourceExtent> ImageSource::extents() {
+    QList<SourceExtent> result;
+    qint64 position = 0;
+    while (position < size()) {
+        const SourceExtent extent = extentAt(position);
+        if (extent.length <= 0 || extent.end() <= position) {
+            break;
+        }
+        const qint64 length = extent.end() - position;
+        if (!result.isEmpty() && result.last().hole == extent.hole) {
+            result.last().length += length;
+        } else {
+            result.append(SourceExtent{position, length, extent.hole});
+        }
+        position = extent.end();
+    }
+    return result;
+}
+
+qint64 ImageSource::dataBytes() {
+    qint64 bytes = 0;
+    for (const SourceExtent &extent : extents()) {
+        if (!extent.hole) {
+            bytes += extent.length;
+        }
+    }
+    return bytes;
+}
+
+bool ImageSource::readFile(QFile &file, qint64 offset, char *data, qint64 length) {
+    if (!file.seek(offset)) {
+        error = file.errorString();
+        return false;
+    }
+    qint64 done = 0;
+    while (done < length) {
+        const qint64 count = file.read(data + done, length - done);
+        if (count <= 0) {
+            error = count < 0 ? file.errorString() : QString("Unexpected end of %1").arg(QFileInfo(file).fileName());
+            return false;
+        }
+        done += count;
+    }
+    return true;
+}
+
+std::unique_ptr<ImageSource> ImageSource::openImage(const QString &path, QString *errorMessage, bool acceptRaw) {
+    const ProbeResult probe = FormatProbe::probe(path, acceptRaw);
+    if (!probe.createReader) {
+        if (errorMessage) *errorMessage = probe.error;
+        return nullptr;
+    }
+    std::unique_ptr<ImageSource> source = probe.createReader();
+    if (!source->open(path)) {
+        if (errorMessage) *errorMessage = QString("%1 image: %2").arg(probe.formatName, source->errorString());
+        return nullptr;
+    }
+    return source;
+}
+
+namespace {
+
+// --- Raw images ---
+
+class RawSource : public ImageSource {
+public:
+    bool open(const QString &path) override {
+        file.setFileName(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            error = file.errorString();
+            return false;
+        }
+        return true;
+    }
+
+    QString formatName() const override { return "raw"; }
+    qint64 size() const override { return file.size(); }
+
+    SourceExtent extentAt(qint64 offset) override {
+        return offset < size() ? SourceExtent{0, size(), false} : SourceExtent{};
+    }
+
+protected:
+    qint64 readData(char *data, qint64 length, qint64 offset) override {
+        return readFile(file, offset, data, length) ? length : -1;
+    }
+
+private:
+    QFile file;
+};
+
+// --- xz-compressed raw images ---
+
+#ifdef INFERNO_HAVE_LZMA
+class XzSource : public ImageSource {
+public:
+    ~XzSource() override { lzma_end(&stream); }
+
+    bool open(const QString &path) override {
+        file.setFileName(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            error = file.errorString();
+            return false;
+        }
+        if (file.peek(6) != QByteArray("\xFD" "7zXZ\0", 6)) {
+            return false;
+        }
+        if (!readUncompressedSize()) {
+            if (error.isEmpty()) error = "Cannot read the xz index";
+            return false;
+        }
+        if (lzma_stream_decoder(&stream, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+            error = "Cannot initialise the xz decoder";
+            return false;
+        }
+        compressed.resize(1024 * 1024);
+        return true;
+    }
+
+    QString formatName() const override { return "xz"; }
+    qint64 size() const override { return expandedSize; }
+    bool isSequential() const override { return true; }
+
+    SourceExtent extentAt(qint64 offset) override {
+        return offset < expandedSize ? SourceExtent{0, expandedSize, false} : SourceExtent{};
+    }
+
+protected:
+    qint64 readData(char *data, qint64 length, qint64 offset) override {
+        if (offset < position) {
+            error = "xz images can only be read forwards";
+            return -1;
+        }
+        // Skipping forward means decoding and discarding
+        if (offset > position) {
+            QByteArray scratch(std::min<qint64>(4 * 1024 * 1024, offset - position), Qt::Uninitialized);
+            while (position < offset) {
+                const qint64 want = std::min<qint64>(scratch.size(), offset - position);
+                if (decode(scratch.data(), want) != want) {
+                    return -1;
+                }
+            }
+        }
+        return decode(data, length);
+    }
+
+private:
+    qint64 decode(char *data, qint64 length) {
+        stream.next_out = reinterpret_cast<uint8_t *>(data);
+        stream.avail_out = size_t(length);
+        while (stream.avail_out > 0 && !finished) {
+            if (stream.avail_in == 0 && !file.atEnd()) {
+                const qint64 count = file.read(compressed.data(), compressed.size());
+                if (count < 0) {
+                    error = file.errorString();
+                    return -1;
+                }
+                stream.next_in = reinterpret_cast<const uint8_t *>(compressed.constData());
+                stream.avail_in = size_t(count);
+            }
+            const lzma_ret result = lzma_code(&stream, file.atEnd() ? LZMA_FINISH : LZMA_RUN);
+            if (result == LZMA_STREAM_END) {
+                finished = true;
+            } else if (result != LZMA_OK) {
+                error = QString("xz decompression failed (error %1)").arg(int(result));
+                return -1;
+            }
+        }
+        const qint64 produced = length - qint64(stream.avail_out);
+        position += produced;
+        return produced;
+    }
+
+    /**
+     * @brief Sums the uncompressed sizes recorded in the index of every stream, walking back from the end.
+     */
+    bool readUncompressedSize() {
+        qint64 end = file.size();
+        while (end > 0) {
+            QByteArray footer(12, Qt::Uninitialized);
+            if (!readFile(file, end - 12, footer.data(), 12)) {
+                return false;
+            }
+            if (footer.endsWith(QByteArray(4, '\0'))) {
+                end -= 4; // Stream padding
+                continue;
+            }
+            if (!footer.endsWith("YZ")) {
+                return false;
+            }
+            const qint64 indexSize = (qint64(qFromLittleEndian<quint32>(footer.constData() + 4)) + 1) * 4;
+            if (indexSize > end - 24) {
+                return false;
+            }
+            QByteArray indexData(indexSize, Qt::Uninitialized);
+            if (!readFile(file, end - 12 - indexSize, indexData.data(), indexSize)) {
+                return false;
+            }
+            lzma_index *index = nullptr;
+            uint64_t memoryLimit = UINT64_MAX;
+            size_t inPosition = 0;
+            if (lzma_index_buffer_decode(&index, &memoryLimit, nullptr, reinterpret_cast<const uint8_t *>(indexData.constData()),
+                                         &inPosition, size_t(indexSize)) != LZMA_OK) {
+                return false;
+            }
+            expandedSize += qint64(lzma_index_uncompressed_size(index));
+            end -= qint64(lzma_index_file_size(index));
+            lzma_index_end(index, nullptr);
+        }
+        file.seek(0);
+        return end == 0;
+    }
+
+    QFile file;
+    QByteArray compressed;
+    lzma_stream stream = LZMA_STREAM_INIT;
+    qint64 expandedSize = 0;
+    qint64 position = 0;
+    bool finished = false;
+};
+#endif
+
+// --- Seekable zstd images (Inferno's own backups) ---
+
+#ifdef INFERNO_HAVE_ZSTD
+class ZstdSeekableSource : public ImageSource {
+public:
+    ~ZstdSeekableSource() override { ZSTD_freeDCtx(context); }
+
+    bool open(const QString &path) override {
+        file.setFileName(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            error = file.errorString();
+            return false;
+        }
+        if (file.size() < 4 || qFromLittleEndian<quint32>(file.peek(4).constData()) != ZSTD_MAGICNUMBER) {
+            return false;
+        }
+        QList<SeekTableEntry> frames;
+        if (!ZstdSeekable::readSeekTable(&file, &frames, &error)) {
+            return false; // A plain .zst without a seek table cannot be read at random
+        }
+        qint64 compressedOffset = 0;
+        for (const SeekTableEntry &frame : frames) {
+            frameStarts.append(expandedSize);
+            frameOffsets.append(compressedOffset);
+            frameSizes.append(frame);
+            expandedSize += frame.decompressedSize;
+            compressedOffset += frame.compressedSize;
+        }
+        frameStarts.append(expandedSize);
+        context = ZSTD_createDCtx();
+        loadHoles(path + ".holes");
+        return true;
+    }
+
+    QString formatName() const override { return "zstd"; }
+    qint64 size() const override { return expandedSize; }
+
+    SourceExtent extentAt(qint64 offset) override {
+        if (offset >= expandedSize) {
+            return SourceExtent{};
+        }
+        // Holes recorded by an allocated-only backup; everything else is data
+        auto next = std::upper_bound(holes.cbegin(), holes.cend(), offset,
+                                     [](qint64 value, const SourceExtent &hole) { return value < hole.end(); });
+        if (next != holes.cend() && next->offset <= offset) {
+            return *next;
+        }
+        const qint64 start = next == holes.cbegin() ? 0 : std::prev(next)->end();
+        const qint64 end = next == holes.cend() ? expandedSize : next->offset;
+        return SourceExtent{start, end - start, false};
+    }
+
+protected:
+    qint64 readData(char *data, qint64 length, qint64 offset) override {
+        qint64 done = 0;
+        while (done < length) {
+            const int frame = int(std::upper_bound(frameStarts.cbegin(), frameStarts.cend(), offset + done)
+                                  - frameStarts.cbegin()) - 1;
+            if (frame < 0 || frame >= frameSizes.size() || !loadFrame(frame)) {
+                return -1;
+            }
+            const qint64 within = offset + done - frameStarts[frame];
+            const qint64 count = std::min(length - done, qint64(cachedData.size()) - within);
+            std::memcpy(data + done, cachedData.constData() + within, size_t(count));
+            done += count;
+        }
+        return done;
+    }
+
+private:
+    bool loadFrame(int frame) {
+        if (frame == cachedFrame) {
+            return true;
+        }
+        QByteArray input(frameSizes[frame].compressedSize, Qt::Uninitialized);
+        if (!readFile(file, frameOffsets[frame], input.data(), input.size())) {
+            return false;
+        }
+        cachedData.resize(frameSizes[frame].decompressedSize);
+        const size_t result = ZSTD_decompressDCtx(context, cachedData.data(), size_t(cachedData.size()),
+                                                  input.constData(), size_t(input.size()));
+        if (ZSTD_isError(result) || result != size_t(cachedData.size())) {
+            error = QString("Corrupt zstd frame %1").arg(frame);
+            cachedFrame = -1;
+            return false;
+        }
+        cachedFrame = frame;
+        return true;
+    }
+
+    void loadHoles(const QString &holesPath) {
+        QFile holesFile(holesPath);
+        if (!holesFile.open(QIODevice::ReadOnly)) {
+            return;
+        }
+        const QJsonObject root = QJsonDocument::fromJson(holesFile.readAll()).object();
+        if (root.value("size").toString().toLongLong() != expandedSize) {
+            return; // Belongs to another backup
+        }
+        for (const QJsonValue &value : root.value("holes").toArray()) {
+            const QJsonArray pair = value.toArray();
+            const SourceExtent hole{pair.at(0).toString().toLongLong(), pair.at(1).toString().toLongLong(), true};
+            if (hole.length > 0 && hole.end() <= expandedSize
+                && (holes.isEmpty() || hole.offset >= holes.last().end())) {
+                holes.append(hole);
+            }
+        }
+    }
+
+    QFile file;
+    ZSTD_DCtx *context = nullptr;
+    qint64 expandedSize = 0;
+    QList<qint64> frameStarts;
+    QList<qint64> frameOffsets;
+    QList<SeekTableEntry> frameSizes;
+    QList<SourceExtent> holes;
+    int cachedFrame = -1;
+    QByteArray cachedData;
+};
+#endif
+
+// --- Deduplicated library images ---
+
+class ChunkedSource : public ImageSource {
+public:
+    bool open(const QString &path) override {
+        reader = std::make_unique<ChunkedImageReader>(path);
+        if (!reader->open(QIODevice::ReadOnly)) {
+            error = reader->errorString();
+            return false;
+        }
+        return true;
+    }
+
+    QString formatName() const override { return "Inferno library image"; }
+    qint64 size() const override { return reader ? reader->size() : 0; }
+
+    SourceExtent extentAt(qint64 offset) override {
+        return offset < size() ? SourceExtent{0, size(), false} : SourceExtent{};
+    }
+
+protected:
+    qint64 readData(char *data, qint64 length, qint64 offset) override {
+        if (!reader->seek(offset) || reader->read(data, length) != length) {
+            error = reader->errorString();
+            return -1;
+        }
+        return length;
+    }
+
+private:
+    std::unique_ptr<ChunkedImageReader> reader;
+};
+
+} // namespace
+
+namespace ImageSources {
+
+std::unique_ptr<ImageSource> createRaw() {
+    return std::make_unique<RawSource>();
+}
+
+std::unique_ptr<ImageSource> createXz() {
+#ifdef INFERNO_HAVE_LZMA
+    return std::make_unique<XzSource>();
+#else
+    return nullptr;
+#endif
+}
+
+std::unique_ptr<ImageSource> createZstdSeekable() {
+#ifdef INFERNO_HAVE_ZSTD
+    return std::make_unique<ZstdSeekableSource>();
+#else
+    return nullptr;
+#endif
+}
+
+std::unique_ptr<ImageSource> createChunked() {
+    return std::make_unique<ChunkedSource>();
+}
+
+} // namespace ImageSources
@@ -0,0 +1,130 @@
+#ifndef IMAGESOURCE_H
+#define IMAGESOURCE_H
+
+#include <QString>
+#include <QList>
+#include <QFile>
+#include <memory>
+
+/**
+ * @brief A run of the expanded image that is either all data or all hole.
+ *
+ * Holes are ranges the image format does not store (unallocated clusters,
+ * "don't care" chunks, explicit zero blocks). They read back as zeros. A
+ * writer may skip them only where the target already reads as zeros;
+ * otherwise it must zero them, or the drive keeps its old data there.
+ */
+struct SourceExtent {
+    qint64 offset = 0;
+    qint64 length = 0;
+    bool hole = false;
+
+    qint64 end() const { return offset + length; }
+};
+
+/**
+ * @brief Reader that expands an image file into the raw bytes to be written.
+ *
+ * Every supported container (raw, xz, seekable zstd, Android sparse, qcow2,
+ * VHD, VHDX, VMDK) implements this interface, so the write engines never see
+ * the container format: they walk extentAt() to find data and holes, and call
+ * readAt() for the data. Decoding happens in the stream; nothing is converted
+ * to a temporary raw file first.
+ *
+ * Sources that cannot seek (xz) report isSequential(); they must be read in
+ * increasing offset order, and skipping forward costs a decode.
+ */
+class ImageSource {
+public:
+    virtual ~ImageSource() = default;
+
+    /**
+     * @brief Opens the image and reads its metadata.
+     * @return bool True if the file is valid for this format; otherwise errorString() says why.
+     */
+    virtual bool open(const QString &path) = 0;
+
+    /**
+     * @brief Short, user-visible name of the format (e.g., "qcow2").
+     */
+    virtual QString formatName() const = 0;
+
+    /**
+     * @brief Size of the expanded image in bytes.
+     */
+    virtual qint64 size() const = 0;
+
+    /**
+     * @brief Describes the data or hole extent that contains offset.
+     *
+     * The extent may start before offset. For offsets at or beyond size(), or
+     * if the metadata cannot be read, an extent of length 0 is returned.
+     */
+    virtual SourceExtent extentAt(qint64 offset) = 0;
+
+    virtual bool isSequential() const { return false; }
+
+    /**
+     * @brief Reads expanded bytes; holes read as zeros.
+     * @return qint64 Bytes read (less than length only at the end of the image), or -1 on error.
+     */
+    qint64 readAt(char *data, qint64 length, qint64 offset);
+
+    /**
+     * @brief Walks the whole image and returns its extents, with neighbours of the same kind merged.
+     */
+    QList<SourceExtent> extents();
+
+    /**
+     * @brief Bytes that are not holes.
+     */
+    qint64 dataBytes();
+
+    QString errorString() const { return error; }
+
+    /**
+     * @brief Opens an image with the reader FormatProbe picks for its contents.
+     *
+     * Formats are identified by their magic numbers, not by the file extension.
+     * Files no other reader claims are treated as raw only if they are named
+     * like a raw image or acceptRaw is set (see FormatProbe).
+     *
+     * @param path Path of the image.
+     * @param errorMessage Receives a description of the failure, if any.
+     * @param acceptRaw Read unrecognised data as raw whatever the file is called.
+     * @return std::unique_ptr<ImageSource> The opened source, or nullptr.
+     */
+    static std::unique_ptr<ImageSource> openImage(const QString &path, QString *errorMessage = nullptr,
+                                                  bool acceptRaw = false);
+
+protected:
+    /**
+     * @brief Reads bytes that lie within a single data extent.
+     */
+    virtual qint64 readData(char *data, qint64 length, qint64 offset) = 0;
+
+    /**
+     * @brief Positional read from the container file, retrying short reads.
+     * @return bool True if exactly length bytes were read.
+     */
+    bool readFile(QFile &file, qint64 offset, char *data, qint64 length);
+
+    QString error;
+};
+
+/**
+ * @brief Constructors for the built-in readers, one per container format.
+ */
+namespace ImageSources {
+std::unique_ptr<ImageSource> createRaw();
+std::unique_ptr<ImageSource> createXz();          // Requires liblzma (INFERNO_HAVE_LZMA)
+std::unique_ptr<ImageSource> createZstdSeekable(); // Requires zstd (INFERNO_HAVE_ZSTD)
+std::unique_ptr<ImageSource> createAndroidSparse();
+std::unique_ptr<ImageSource> createQcow2();
+std::unique_ptr<ImageSource> createVhd();
+std::unique_ptr<ImageSource> createVhdx();
+std::unique_ptr<ImageSource> createVmdk();
+std::unique_ptr<ImageSource> createChunked();      // Deduplicated library images (.cidx)
+} // namespace ImageSources
+
+#endif // IMAGESOURCE_H
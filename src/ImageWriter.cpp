@@ -0,0 +1,220 @@
+#include "ImageWriter.h"
+#include "AdaptiveWriteQueue.h"
+#include "BlockDevice.h"
+#include "EraseBlockProbe.h"
+#include "ImageSource.h"
+#include "Instrumentation.h"
+#include "PipelineTrace.h"
+#include <QMutexLocker>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+namespace {
+const qint64 kBlockSize = 4 * 1024 * 1024;
+// Holes are zeroed in pieces of this size, so progress and cancellation stay responsive
+const qint64 kZeroStep = 64 * 1024 * 1024;
+} // namespace
+
+// --- Implementation of ImageWriter ---
+
+ImageWriter::ImageWriter(const QString &imagePath, const QString &drivePath, bool directIo, const EraseOptions &erase)
+    : imagePath(imagePath), drivePath(drivePath), directIo(directIo), erase(erase) {
+}
+
+bool ImageWriter::run(const ProgressCallback &progress, QString *errorMessage) {
+    std::unique_ptr<ImageSource> source = ImageSource::openImage(imagePath, errorMessage, acceptRaw);
+    if (!source) {
+        return false;
+    }
+
+    BlockDevice device;
+    if (!device.open(drivePath, true, directIo, errorMessage)) {
+        return false;
+    }
+    device.setIoStats(ioStats);
+    if (device.size() < source->size()) {
+        if (errorMessage) {
+            *errorMessage = QString("The drive is too small for this image (%1 < %2 bytes)")
+                                .arg(device.size()).arg(source->size());
+        }
+        return false;
+    }
+
+    const QList<SourceExtent> extents = source->extents();
+    qint64 dataTotal = 0;
+    for (const SourceExtent &extent : extents) {
+        if (!extent.hole) dataTotal += extent.length;
+    }
+    qDebug() << "Writing" << source->formatName() << "image" << imagePath << ":" << dataTotal << "of"
+             << source->size() << "bytes are data";
+
+    // Optional pre-write erase; failure only costs the speed-up, not the write.
+    // A resumed write must not erase what the interrupted one wrote.
+    bool skipZeros = false;
+    bool holesZeroed = false;
+    if (resumeOffset > 0) {
+        qDebug() << "Resuming the write of" << imagePath << "at offset" << resumeOffset;
+    } else if (erase.mode != EraseMode::None) {
+        QList<ByteRange> written;
+        for (const SourceExtent &extent : extents) {
+            if (!extent.hole) written.append(ByteRange{extent.offset, extent.length});
+        }
+        const QList<ByteRange> ranges = erase.unwrittenOnly ? AllocationMap::invert(written, device.size())
+                                                            : QList<ByteRange>{ByteRange{0, device.size()}};
+        QString eraseError;
+        if (DriveErase::eraseRanges(device, erase.mode, ranges, cancelled, nullptr, &eraseError)) {
+            holesZeroed = erase.mode == EraseMode::ZeroOut; // The whole drive, or exactly the holes
+            skipZeros = erase.zeroesDrive() && erase.skipZeroBlocks;
+        } else if (cancelled) {
+            if (errorMessage) *errorMessage = "Write cancelled.";
+            return false;
+        } else {
+            qWarning() << "Pre-write erase of" << drivePath << "failed, writing without it:" << eraseError;
+        }
+    }
+
+    // Decoding runs on this thread while the queue's writer threads keep the drive busy
+    AdaptiveWriteQueue queue(device, EraseBlockProbe::requestSize(eraseBlockSize, kBlockSize), trace);
+    if (trace) trace->nameThread("reader");
+    const qint64 sectorSize = device.logicalBlockSize();
+    const qint64 bytesTotal = holesZeroed ? dataTotal : source->size();
+    qint64 skipped = 0;
+    qint64 zeroed = 0;
+    QString readError;
+    auto report = [&]() {
+        {
+            QMutexLocker locker(&stateMutex);
+            lastQueueState = queue.state();
+        }
+        if (progress) progress(queue.bytesCompleted() + skipped + zeroed, bytesTotal);
+    };
+
+    qint64 nextCheckpoint = resumeOffset + checkpointInterval;
+    auto takeCheckpoint = [&]() {
+        const qint64 mark = queue.completedThrough();
+        if (!checkpoint || mark < nextCheckpoint) {
+            return;
+        }
+        nextCheckpoint = mark + checkpointInterval; // Also after a failed flush, which the final sync will report
+        const PipelineTrace::Span span(trace, "checkpoint", mark);
+        if (device.sync()) checkpoint(mark);
+    };
+
+    // Holes must read back as zeros; zeroOut() is tried first, then zero blocks through the queue
+    bool zeroOutWorks = true;
+    auto zeroHole = [&](qint64 start, qint64 end) {
+        for (qint64 offset = start, length = 0; offset < end; offset += length) {
+            if (cancelled) {
+                return false;
+            }
+            length = std::min(kZeroStep, end - offset);
+            if (zeroOutWorks) {
+                const PipelineTrace::Span span(trace, "zero-out", offset, length);
+                if (device.zeroOut(offset, length)) {
+                    zeroed += length;
+                    report();
+                    continue;
+                }
+                qDebug() << "Zeroing is not available on" << drivePath << "(" << device.errorString()
+                         << "); writing zero blocks for holes";
+                zeroOutWorks = false;
+            }
+            for (qint64 piece = 0, pieceLength = 0; piece < length; piece += pieceLength) {
+                AlignedBuffer *buffer = nullptr;
+                {
+                    const PipelineTrace::Span span(trace, "acquire");
+                    buffer = cancelled ? nullptr : queue.acquire();
+                }
+                if (!buffer) {
+                    return false;
+                }
+                pieceLength = std::min(queue.requestSize(), length - piece);
+                const qint64 padded = std::min((pieceLength + sectorSize - 1) / sectorSize * sectorSize,
+                                               device.size() - offset - piece);
+                std::memset(buffer->data(), 0, size_t(padded));
+                queue.submit(buffer, offset + piece, padded, pieceLength);
+                report();
+            }
+        }
+        return true;
+    };
+
+    bool stopped = false;
+    for (qsizetype e = 0; e < extents.size() && !stopped; ++e) {
+        const SourceExtent &extent = extents[e];
+        if (extent.hole && holesZeroed) {
+            continue;
+        }
+        // Data (and holes) below the resume offset were written before the interruption
+        const qint64 start = std::clamp(resumeOffset, extent.offset, extent.end());
+        skipped += start - extent.offset;
+        if (extent.hole) {
+            stopped = !zeroHole(start, extent.end());
+            takeCheckpoint();
+            continue;
+        }
+        // Requests end on erase-block boundaries of the drive, not of the extent
+        for (qint64 offset = start, length = 0; offset < extent.end(); offset += length) {
+            AlignedBuffer *buffer = nullptr;
+            if (!cancelled) {
+                const PipelineTrace::Span span(trace, "acquire"); // Waiting here means the drive is the bottleneck
+                buffer = queue.acquire();
+            }
+            if (!buffer) {
+                stopped = true;
+                break;
+            }
+            length = EraseBlockProbe::alignedLength(offset, extent.end(), queue.requestSize());
+            qint64 read;
+            {
+                const PipelineTrace::Span span(trace, "read", offset, length); // Includes decompression
+                const Instrumentation::StageTimer timer(Instrumentation::Stage::Read, length);
+                read = source->readAt(buffer->data(), length, offset);
+            }
+            if (read != length) {
+                readError = source->errorString();
+                queue.release(buffer);
+                stopped = true;
+                break;
+            }
+            // Extents are block aligned except possibly at the end of the image
+            const qint64 padded = std::min((length + sectorSize - 1) / sectorSize * sectorSize, device.size() - offset);
+            std::memset(buffer->data() + length, 0, size_t(padded - length));
+            bool zero = false;
+            if (skipZeros) {
+                const PipelineTrace::Span span(trace, "zero-scan", offset, padded);
+                const Instrumentation::StageTimer timer(Instrumentation::Stage::ZeroScan, padded);
+                zero = DriveErase::isAllZero(buffer->data(), padded);
+            }
+            if (zero) {
+                queue.release(buffer);
+                skipped += length; // Already zero on the drive
+            } else {
+                queue.submit(buffer, offset, padded, length);
+            }
+            report();
+            takeCheckpoint();
+        }
+    }
+    if (cancelled || !readError.isEmpty()) {
+        queue.abort();
+    }
+    const bool written = queue.finish();
+    report();
+
+    QString failure = cancelled ? QString("Write cancelled.") : !readError.isEmpty() ? readError
+                    : !written ? queue.errorString() : QString();
+    if (failure.isEmpty()) {
+        const PipelineTrace::Span span(trace, "sync");
+        if (!device.sync()) failure = device.errorString();
+    }
+    if (!failure.isEmpty()) {
+        if (errorMessage) *errorMessage = failure;
+        return false;
+    }
+    qDebug() << "Image write of" << imagePath << "complete:" << queue.bytesCompleted() << "bytes written,"
+             << zeroed << "zeroed," << skipped << "zero bytes skipped";
+    return true;
+}
@@ -0,0 +1,118 @@
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+
+#include "DriveErase.h"
+#include "ProgressRecord.h"
+#include <QMutex>
+#include <QString>
+#include <atomic>
+#include <functional>
+
+class IoStats;
+class PipelineTrace;
+
+/**
+ * @brief Writes any image ImageSource can read to a drive, skipping its holes.
+ *
+ * The image is expanded in the stream by its reader (qcow2, VHD/VHDX, VMDK,
+ * Android sparse, xz, seekable zstd or raw) on the calling thread, while an
+ * AdaptiveWriteQueue writes earlier blocks, so decompression and device
+ * writes overlap. The queue adjusts how many requests are in flight, and how
+ * big they are, to the drive's latency as the write goes on. Requests are cut
+ * at erase-block boundaries so the controller never has to merge a partly
+ * written block. Holes in the image are zeroed with BlockDevice::zeroOut(),
+ * which needs no data transfer on drives with a write-zeroes command, or
+ * written as zero blocks where that is not supported, so the drive reads
+ * back exactly as the image does.
+ *
+ * An erase mode (see EraseOptions) trims or zeroes the drive first, either
+ * whole or only where the image has holes. After a zeroing erase the holes
+ * already read as zeros and are skipped; once the whole drive is zeroed,
+ * data blocks that are all zeros are skipped too.
+ */
+class ImageWriter {
+public:
+    using ProgressCallback = std::function<void(qint64 bytesDone, qint64 bytesTotal)>;
+    using CheckpointCallback = std::function<void(qint64 offset)>;
+
+    ImageWriter(const QString &imagePath, const QString &drivePath, bool directIo = true,
+                const EraseOptions &erase = EraseOptions());
+
+    /**
+     * @brief Runs the write on the calling thread (which becomes the writer stage).
+     * @param progress Called after each block, in bytes of data plus holes that have to be zeroed.
+     * @param errorMessage Receives a description of the failure, if any.
+     * @return bool True if all data was written and flushed.
+     */
+    bool run(const ProgressCallback &progress, QString *errorMessage);
+
+    /**
+     * @brief Aligns write requests to the drive's erase block (see EraseBlockProbe); 0 if unknown.
+     */
+    void setEraseBlockSize(qint64 bytes) { eraseBlockSize = bytes; }
+
+    /**
+     * @brief Records the latency and size of every device read and write in stats (see IoStats); null for none.
+     */
+    void setIoStats(IoStats *stats) { ioStats = stats; }
+
+    /**
+     * @brief State of the write queue as of the last progress report. Thread-safe.
+     */
+    QueueControlState queueState() const {
+        QMutexLocker locker(&stateMutex);
+        return lastQueueState;
+    }
+
+    /**
+     * @brief Records the pipeline stages of the next run() in trace (see PipelineTrace); null for none.
+     */
+    void setTrace(PipelineTrace *trace) { this->trace = trace; }
+
+    /**
+     * @brief Writes data no format recognises as raw, whatever the file is called (see FormatProbe).
+     */
+    void setAcceptRaw(bool accept) { acceptRaw = accept; }
+
+    /**
+     * @brief Requests cancellation; run() returns false soon after. Thread-safe.
+     */
+    void cancel() { cancelled = true; }
+
+    /**
+     * @brief Continues an interrupted write of the same image from a checkpoint offset.
+     *
+     * Data below offset is taken to be on the drive already. The pre-write
+     * erase is skipped, and zero blocks are written rather than assumed.
+     */
+    void setResumeOffset(qint64 offset) { resumeOffset = offset; }
+
+    /**
+     * @brief Flushes the drive about every interval bytes and passes the offset below which it is complete.
+     *
+     * Called on run()'s thread; the offset can be given to setResumeOffset
+     * after a crash. Null (the default) for no checkpoints.
+     */
+    void setCheckpoint(const CheckpointCallback &callback, qint64 interval) {
+        checkpoint = callback;
+        checkpointInterval = interval;
+    }
+
+private:
+    QString imagePath;
+    QString drivePath;
+    bool directIo;
+    EraseOptions erase;
+    qint64 eraseBlockSize = 0;
+    bool acceptRaw = false;
+    qint64 resumeOffset = 0;
+    CheckpointCallback checkpoint;
+    qint64 checkpointInterval = 0;
+    IoStats *ioStats = nullptr;
+    PipelineTrace *trace = nullptr;
+    std::atomic<bool> cancelled{false};
+    mutable QMutex stateMutex;
+    QueueControlState lastQueueState;
+};
+
+#endif // IMAGEWRITER_H
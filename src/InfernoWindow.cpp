@@ -3,13 +3,63 @@
 #include <QHBoxLayout>
 #include <QWidget>
 #include <QFileDialog>
+#include <QFile>
+#include <QJsonDocument>
 #include <QMessageBox>
 #include <QDebug>
+#include <QInputDialog>
+#include <QHostAddress>
+#include <QSettings>
+#include <QStandardPaths>
+#include "Daemon.h"
 #include "DiskUtility.h"
+#include "FormatProbe.h"
+#include "ImageFetcher.h"
+#include "ImageLibrary.h"
+#include "JobManifest.h"
+#include "PeerCache.h"
+
+// Default library budget when none is configured (64 GB)
+static const qint64 kDefaultLibraryBudget = 64LL * 1024 * 1024 * 1024;
 
 // --- Implementation of InfernoWindow ---
 
 InfernoWindow::InfernoWindow(QWidget *parent) : QMainWindow(parent), diskUtility(new DiskUtility(this)) {
+    QSettings settings;
+    const QString libraryPath = settings.value("library/path",
+        QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/library").toString();
+    const qint64 libraryBudget = settings.value("library/byteBudget", kDefaultLibraryBudget).toLongLong();
+    imageLibrary = new ImageLibrary(libraryPath, libraryBudget, this);
+    imageLibrary->setDeduplication(settings.value("library/deduplicate", true).toBool());
+    QString libraryError;
+    if (!imageLibrary->load(&libraryError)) {
+        qDebug() << "Failed to load image library:" << libraryError;
+    }
+
+    // Hand jobs to the burn-station daemon when it runs; otherwise burn in this process
+    daemon = new DaemonClient(this);
+    if (daemon->connectToDaemon(settings.value("daemon/socket", DaemonServer::kDefaultName).toString(), 200)
+        && daemon->subscribe()) {
+        qDebug() << "Connected to the burn-station daemon.";
+    } else {
+        qDebug() << "Running jobs in process:" << daemon->errorString();
+    }
+
+    // Serving is opt-in: the station's LAN address and the site's token must both be configured
+    const QByteArray peerToken = settings.value("peers/token").toString().toUtf8();
+    peerServer = new PeerCacheServer(imageLibrary, this);
+    if (settings.value("peers/serve", false).toBool()) {
+        const QHostAddress address(settings.value("peers/address").toString());
+        if (address.isNull()) {
+            qDebug() << "Peer cache server not started: peers/address is not a valid interface address.";
+        } else {
+            peerServer->listen(address, quint16(settings.value("peers/port", PeerCacheServer::kDefaultPort).toUInt()),
+                               peerToken);
+        }
+    }
+    imageFetcher = new ImageFetcher(imageLibrary, this);
+    imageFetcher->setPeers(ImageFetcher::parsePeers(settings.value("peers/list").toStringList()), peerToken);
+
     setupUI();
     setWindowTitle("Inferno - Bootable USB Creator (Developed by Ahmed Nour Ahmed)");
     setFixedSize(600, 450); // Fixed size for a clean look
@@ -37,13 +87,22 @@ void InfernoWindow::setupUI() {
     isoLayout->addWidget(isoPathLabel);
     mainLayout->addLayout(isoLayout);
 
+    // 2b. Image Library (cached images, most used first)
+    QHBoxLayout *libraryLayout = new QHBoxLayout();
+    libraryLayout->addWidget(new QLabel("Library:", this));
+    libraryComboBox = new QComboBox(this);
+    updateLibraryList();
+    libraryLayout->addWidget(libraryComboBox);
+    fetchImageButton = new QPushButton("Fetch...", this);
+    libraryLayout->addWidget(fetchImageButton);
+    mainLayout->addLayout(libraryLayout);
+
     // 3. Drive Selection
     QHBoxLayout *driveLayout = new QHBoxLayout();
     driveLayout->addWidget(new QLabel("Target Drive:", this));
     driveComboBox = new QComboBox(this);
     driveComboBox->addItem("Select a USB Drive...");
     updateDriveList(); // Populate the list on startup
-    // TODO: Populate with actual detected drives using DiskUtility
     driveLayout->addWidget(driveComboBox);
     mainLayout->addLayout(driveLayout);
 
@@ -67,6 +126,10 @@ void InfernoWindow::setupUI() {
     win11BypassCheckBox = new QCheckBox("Bypass Windows 11 Requirements (TPM/RAM)", advancedGroup);
     advancedLayout->addWidget(win11BypassCheckBox);
     
+    // Feature 4: Fake capacity check (opt-in, it adds a pass over the drive)
+    verifyCapacityCheckBox = new QCheckBox("Check for Fake Capacity Before Writing", advancedGroup);
+    advancedLayout->addWidget(verifyCapacityCheckBox);
+    
     advancedGroup->setLayout(advancedLayout);
     advancedGroup->setVisible(false); // Initially hidden
     mainLayout->addWidget(advancedGroup);
@@ -76,6 +139,9 @@ void InfernoWindow::setupUI() {
     startButton->setEnabled(false); // Disabled until ISO and Drive are selected
     mainLayout->addWidget(startButton);
 
+    batchButton = new QPushButton("Run Batch Manifest...", this);
+    mainLayout->addWidget(batchButton);
+
     // 7. Progress and Status
     progressBar = new QProgressBar(this);
     progressBar->setTextVisible(true);
@@ -87,24 +153,122 @@ void InfernoWindow::setupUI() {
 
     // --- Connections (Signals and Slots) ---
     connect(selectIsoButton, &QPushButton::clicked, this, &InfernoWindow::selectDiskImage);
+    connect(libraryComboBox, &QComboBox::activated, this, &InfernoWindow::selectLibraryImage);
+    connect(imageLibrary, &ImageLibrary::libraryChanged, this, &InfernoWindow::updateLibraryList);
+    connect(imageLibrary, &ImageLibrary::importFinished, this, &InfernoWindow::handleLibraryImport);
+    connect(fetchImageButton, &QPushButton::clicked, this, &InfernoWindow::fetchImage);
+    connect(imageFetcher, &ImageFetcher::fetchProgress, this, [this](qint64 received, qint64 total, const QString &message) {
+        progressBar->setValue(total > 0 ? int(received * 100 / total) : 0);
+        statusLabel->setText(message);
+    });
+    connect(imageFetcher, &ImageFetcher::fetchCompleted, this, &InfernoWindow::handleFetchCompletion);
     connect(startButton, &QPushButton::clicked, this, &InfernoWindow::startBurningProcess);
+    connect(batchButton, &QPushButton::clicked, this, &InfernoWindow::runBatchManifest);
     connect(advancedOptionsCheckBox, &QCheckBox::toggled, advancedGroup, &QWidget::setVisible);
     connect(advancedOptionsCheckBox, &QCheckBox::toggled, this, &InfernoWindow::toggleAdvancedOptions);
     
     // Connect DiskUtility signals
     connect(diskUtility, &DiskUtility::progressUpdated, this, &InfernoWindow::handleProgressUpdate);
     connect(diskUtility, &DiskUtility::writeCompleted, this, &InfernoWindow::handleWriteCompletion);
+    connect(daemon, &DaemonClient::jobChanged, this, &InfernoWindow::handleJobChanged);
+    connect(daemon, &DaemonClient::disconnected, this, &InfernoWindow::handleDaemonDisconnected);
 }
 
 void InfernoWindow::selectDiskImage() {
     QString fileName = QFileDialog::getOpenFileName(this,
-        tr("Select Disk Image (ISO/IMG)"), QDir::homePath(), tr("Disk Images (*.iso *.img);;All Files (*)"));
+        tr("Select Disk Image"), QDir::homePath(), tr("All Files (*)"));
 
     if (!fileName.isEmpty()) {
+        // Images are recognised by content; anything else is written only if the user says so
+        ProbeResult probe = FormatProbe::probe(fileName);
+        bool confirmedRaw = false;
+        if (probe.unrecognised) {
+            const QMessageBox::StandardButton reply = QMessageBox::question(this, tr("Unrecognised Image"),
+                tr("%1 is not a disk image format Inferno recognises.\n\nWrite it to the drive byte for byte anyway?")
+                    .arg(QFileInfo(fileName).fileName()),
+                QMessageBox::Yes | QMessageBox::No, QMessageBox::No);
+            if (reply != QMessageBox::Yes) {
+                return;
+            }
+            probe = FormatProbe::probe(fileName, true);
+            confirmedRaw = true;
+        }
+        if (!probe.writable()) {
+            QMessageBox::warning(this, tr("Unsupported Image"),
+                                 tr("%1 cannot be written: %2").arg(QFileInfo(fileName).fileName(), probe.error));
+            return;
+        }
+        selectedLibraryId.clear();
+        acceptRaw = confirmedRaw;
         isoPathLabel->setText(fileName);
         startButton->setEnabled(true); // Enable start button for demonstration
-        statusLabel->setText(tr("Image selected: %1").arg(QFileInfo(fileName).fileName()));
+        statusLabel->setText(tr("Image selected: %1 (%2)").arg(QFileInfo(fileName).fileName(), probe.description));
+    }
+}
+
+void InfernoWindow::selectLibraryImage(int index) {
+    // Index 0 is the "Select from library..." placeholder
+    const QString id = libraryComboBox->itemData(index).toString();
+    const LibraryEntry *entry = imageLibrary->find(id);
+    if (!entry) {
+        return;
     }
+
+    // Chunked entries are stored as an index, which the probe must resolve to the reassembled image
+    const ProbeResult probe = FormatProbe::probe(entry->filePath);
+    if (!probe.writable()) {
+        QMessageBox::warning(this, tr("Unsupported Image"),
+                             tr("%1 cannot be written: %2").arg(entry->displayName, probe.error));
+        return;
+    }
+    selectedLibraryId = id;
+    acceptRaw = false;
+    isoPathLabel->setText(entry->filePath);
+    startButton->setEnabled(true);
+    statusLabel->setText(tr("Library image selected: %1 (%2)").arg(entry->displayName, probe.description));
+}
+
+void InfernoWindow::fetchImage() {
+    if (imageFetcher->isBusy()) {
+        return;
+    }
+    const QString address = QInputDialog::getText(this, tr("Fetch Image"),
+        tr("Download URL (stations listed in peers/list are asked first):"));
+    const QUrl url = QUrl::fromUserInput(address.trimmed());
+    if (!url.isValid() || url.fileName().isEmpty()) {
+        return;
+    }
+    fetchImageButton->setEnabled(false);
+    statusLabel->setText(tr("Fetching %1...").arg(url.fileName()));
+    imageFetcher->fetch(url.fileName(), {url});
+}
+
+void InfernoWindow::handleFetchCompletion(bool success, const QString &id, const QString &errorMessage) {
+    fetchImageButton->setEnabled(true);
+    progressBar->setValue(0);
+    if (!success) {
+        statusLabel->setText(tr("Fetch failed."));
+        QMessageBox::critical(this, tr("Fetch Failed"), errorMessage);
+        return;
+    }
+    const int index = libraryComboBox->findData(id);
+    if (index > 0) {
+        libraryComboBox->setCurrentIndex(index);
+        selectLibraryImage(index);
+    }
+}
+
+void InfernoWindow::updateLibraryList() {
+    libraryComboBox->clear();
+    libraryComboBox->addItem("Select from library..."); // Index 0
+
+    const QList<LibraryEntry> entries = imageLibrary->entries();
+    for (const auto &entry : entries) {
+        QString sizeStr = QString::number(entry.size / (1024.0 * 1024.0 * 1024.0), 'f', 2) + " GB";
+        QString itemText = QString("%1 - %2 (used %3x)").arg(entry.displayName).arg(sizeStr).arg(entry.accessCount);
+        libraryComboBox->addItem(itemText, entry.id);
+    }
+    libraryComboBox->setEnabled(!entries.isEmpty());
 }
 
 void InfernoWindow::selectTargetDrive() {
@@ -133,6 +297,8 @@ void InfernoWindow::startBurningProcess() {
     options["persistence"] = persistenceCheckBox->isChecked();
     options["multiBoot"] = multiBootCheckBox->isChecked();
     options["win11Bypass"] = win11BypassCheckBox->isChecked();
+    options["verifyCapacity"] = verifyCapacityCheckBox->isChecked();
+    if (acceptRaw) options["acceptRaw"] = true;
     
     // Confirmation dialog (Crucial step before wiping a drive)
     QMessageBox::StandardButton reply;
@@ -147,8 +313,29 @@ void InfernoWindow::startBurningProcess() {
         return;
     }
 
+    // Count the burn towards the library's eviction priority
+    if (!selectedLibraryId.isEmpty()) {
+        imageLibrary->acquire(selectedLibraryId);
+    }
+    burnedOutsideLibrary = selectedLibraryId.isEmpty() ? imagePath : QString();
+
     // Start the process
-    if (diskUtility->startImageWrite(imagePath, drivePath, options)) {
+    if (daemon->isConnected()) {
+        Job job;
+        job.kind = "image";
+        job.imagePath = imagePath;
+        job.drives = {drivePath};
+        job.options = options;
+        activeJobId = daemon->submit(job);
+        if (activeJobId == 0) {
+            QMessageBox::critical(this, "Inferno Error",
+                                  QString("The daemon refused the job: %1").arg(daemon->errorString()));
+            return;
+        }
+        startButton->setEnabled(false);
+        statusLabel->setText("Burning job queued...");
+        progressBar->setValue(0);
+    } else if (diskUtility->startImageWrite(imagePath, drivePath, options)) {
         startButton->setEnabled(false);
         statusLabel->setText("Burning process initiated...");
         progressBar->setValue(0);
@@ -162,13 +349,18 @@ void InfernoWindow::toggleAdvancedOptions(bool checked) {
         statusLabel->setText("Advanced Inferno features enabled.");
     } else {
         statusLabel->setText("Advanced Inferno features disabled.");
+    }
 }
 
 void InfernoWindow::updateDriveList() {
     driveComboBox->clear();
     driveComboBox->addItem("Select a USB Drive..."); // Index 0
     
-    QList<DriveInfo> drives = diskUtility->enumerateRemovableDrives();
+    // The daemon keeps its drive table, so asking it is cheaper than enumerating here
+    QList<DriveInfo> drives;
+    if (!daemon->isConnected() || !daemon->listDrives(&drives)) {
+        drives = diskUtility->enumerateRemovableDrives();
+    }
     
     if (drives.isEmpty()) {
         driveComboBox->addItem("No removable drives detected.");
@@ -179,7 +371,8 @@ void InfernoWindow::updateDriveList() {
     driveComboBox->setEnabled(true);
     for (const auto &drive : drives) {
         QString sizeStr = QString::number(drive.size / (1024.0 * 1024.0 * 1024.0), 'f', 2) + " GB";
-        QString itemText = QString("%1 (%2) - %3").arg(drive.driveLetter).arg(drive.model).arg(sizeStr);
+        QString itemText = QString("%1 (%2) - %3")
+            .arg(drive.driveLetter.isEmpty() ? drive.devicePath : drive.driveLetter).arg(drive.model).arg(sizeStr);
         
         // Store the device path as UserData for easy retrieval during burning
         driveComboBox->addItem(itemText, drive.devicePath);
@@ -195,6 +388,11 @@ void InfernoWindow::handleWriteCompletion(bool success, const QString &errorMess
     startButton->setEnabled(true);
     progressBar->setValue(success ? 100 : progressBar->value());
     
+    if (success && !burnedOutsideLibrary.isEmpty()) {
+        keepInLibrary(burnedOutsideLibrary);
+    }
+    burnedOutsideLibrary.clear();
+
     if (success) {
         statusLabel->setText("SUCCESS: Bootable USB created successfully!");
         QMessageBox::information(this, "Inferno Success", "The bootable USB drive has been created successfully!");
@@ -202,5 +400,87 @@ void InfernoWindow::handleWriteCompletion(bool success, const QString &errorMess
         statusLabel->setText(QString("ERROR: %1").arg(errorMessage));
         QMessageBox::critical(this, "Inferno Error", QString("The process failed: %1").arg(errorMessage));
     }
+}
+
+void InfernoWindow::runBatchManifest() {
+    if (!daemon->isConnected()) {
+        QMessageBox::warning(this, "Inferno", "Batch manifests run on the burn-station daemon; start infernod first.");
+        return;
+    }
+    const QString fileName = QFileDialog::getOpenFileName(this, "Select Batch Manifest", QDir::homePath(),
+                                                          "Job Manifests (*.json);;All Files (*)");
+    if (fileName.isEmpty()) {
+        return;
+    }
+    QString errorMessage;
+    JobManifest manifest;
+    if (!manifest.load(fileName, &errorMessage)) {
+        QMessageBox::critical(this, "Inferno Error", QString("Invalid manifest: %1").arg(errorMessage));
+        return;
+    }
+    QFile file(fileName);
+    file.open(QIODevice::ReadOnly);
+    QList<qint64> ids;
+    if (daemon->submitManifest(QJsonDocument::fromJson(file.readAll()).object(), &ids) == 0) {
+        QMessageBox::critical(this, "Inferno Error", QString("The daemon refused the manifest: %1").arg(daemon->errorString()));
+        return;
+    }
+    batchJobs = QSet<qint64>(ids.cbegin(), ids.cend());
+    batchFailures = 0;
+    statusLabel->setText(tr("Batch queued: %n job(s).", nullptr, int(ids.size())));
+}
+
+void InfernoWindow::keepInLibrary(const QString &imagePath) {
+    // Opt-in: copying a multi-gigabyte image costs disk bandwidth and library space the user did not ask for
+    const QFileInfo info(imagePath);
+    if (!QSettings().value("library/keepBurned", false).toBool() || imageLibrary->findByName(info.fileName())
+        || keepingImages.contains(imagePath)) {
+        return;
+    }
+    if (!imageLibrary->deduplicationEnabled() && !imageLibrary->canFit(info.size())) {
+        qDebug() << "Not keeping" << info.fileName() << "in the library: it does not fit the budget.";
+        return;
+    }
+
+    // The library copies on its own worker thread and joins it on shutdown
+    keepingImages.insert(imagePath);
+    imageLibrary->importImageAsync(imagePath, 1.0, false);
+}
+
+void InfernoWindow::handleLibraryImport(const QString &sourcePath, const QString &id, const QString &errorMessage) {
+    if (!keepingImages.remove(sourcePath)) {
+        return; // A download, reported by the fetcher
+    }
+    if (id.isEmpty()) {
+        qDebug() << "Failed to keep" << sourcePath << "in the library:" << errorMessage;
+        statusLabel->setText(tr("Could not keep %1 in the library: %2").arg(QFileInfo(sourcePath).fileName(), errorMessage));
+    }
+}
+
+void InfernoWindow::handleJobChanged(const Job &job) {
+    if (batchJobs.contains(job.id) && job.isFinished()) {
+        batchJobs.remove(job.id);
+        if (job.state != JobState::Succeeded) ++batchFailures;
+        statusLabel->setText(batchJobs.isEmpty()
+            ? tr("Batch finished, %1 job(s) failed.").arg(batchFailures)
+            : tr("Batch: %1 job(s) remaining, %2 failed.").arg(batchJobs.size()).arg(batchFailures));
+    }
+    if (job.id == 0 || job.id != activeJobId) {
+        return; // Another client's job
+    }
+    if (!job.isFinished()) {
+        if (job.state == JobState::Running) handleProgressUpdate(job.percentage, job.message);
+        return;
+    }
+    activeJobId = 0;
+    handleWriteCompletion(job.state == JobState::Succeeded,
+                          job.state == JobState::Cancelled ? QString("Cancelled.") : job.message);
+}
+
+void InfernoWindow::handleDaemonDisconnected() {
+    if (activeJobId == 0) {
+        return;
     }
+    activeJobId = 0;
+    handleWriteCompletion(false, "Lost the connection to the burn-station daemon; the job may still be running there.");
 }
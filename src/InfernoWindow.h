@@ -7,6 +7,14 @@
 #include <QLabel>
 #include <QProgressBar>
 #include <QCheckBox>
+#include <QSet>
+#include "JobQueue.h"
+
+class DaemonClient;
+class DiskUtility;
+class ImageFetcher;
+class ImageLibrary;
+class PeerCacheServer;
 
 /**
  * @brief The main window class for the Inferno application.
@@ -31,18 +39,27 @@ public:
 private slots:
     // Slots for UI interaction
     void selectDiskImage();
+    void selectLibraryImage(int index);
+    void fetchImage();
+    void handleFetchCompletion(bool success, const QString &id, const QString &errorMessage);
+    void updateLibraryList();
     void selectTargetDrive();
     void startBurningProcess();
+    void runBatchManifest();
     void toggleAdvancedOptions(bool checked);
     void updateDriveList();
     void handleProgressUpdate(int percentage, const QString &message);
     void handleWriteCompletion(bool success, const QString &errorMessage);
+    void handleJobChanged(const Job &job);
+    void handleDaemonDisconnected();
 
 private:
     // UI Components
     QLabel *titleLabel;
     QComboBox *driveComboBox;
     QPushButton *selectIsoButton;
+    QComboBox *libraryComboBox;
+    QPushButton *fetchImageButton;
     QLabel *isoPathLabel;
     QCheckBox *advancedOptionsCheckBox;
     
@@ -50,8 +67,10 @@ private:
     QCheckBox *persistenceCheckBox;
     QCheckBox *multiBootCheckBox;
     QCheckBox *win11BypassCheckBox;
+    QCheckBox *verifyCapacityCheckBox;
     
     QPushButton *startButton;
+    QPushButton *batchButton;
     QProgressBar *progressBar;
     QLabel *statusLabel;
 
@@ -59,9 +78,32 @@ private:
      * @brief Sets up the main layout and components of the window.
      */
     void setupUI();
+
+    /**
+     * @brief Copies a successfully burned image into the library (off the GUI thread) for the next burn.
+     *
+     * Only done when the "library/keepBurned" setting is on.
+     */
+    void keepInLibrary(const QString &imagePath);
+
+    /**
+     * @brief Reports the outcome of a keepInLibrary() copy.
+     */
+    void handleLibraryImport(const QString &sourcePath, const QString &id, const QString &errorMessage);
     
     // Backend Utility
-    DiskUtility *diskUtility;
+    DiskUtility *diskUtility; // Runs jobs in process when no daemon is reachable
+    DaemonClient *daemon;     // Thin-client link to infernod, which keeps the engine warm
+    qint64 activeJobId = 0;   // The daemon job this window is following
+    QSet<qint64> batchJobs;   // Unfinished jobs of the batch manifest this window submitted
+    int batchFailures = 0;
+    ImageLibrary *imageLibrary;
+    PeerCacheServer *peerServer; // Shares the library with other stations on the LAN
+    ImageFetcher *imageFetcher;  // Gets images from peer stations, then from mirrors
+    QString selectedLibraryId; // Set when the image came from the library
+    bool acceptRaw = false; // The user agreed to write the selected, unrecognised file as raw data
+    QString burnedOutsideLibrary; // Image of the running burn if it is not in the library yet
+    QSet<QString> keepingImages;  // Burned images being copied into the library
 };
 
 #endif // INFERNOWINDOW_H
@@ -0,0 +1,184 @@
+#include "Instrumentation.h"
+#include <QStringList>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+
+#if defined(INFERNO_PROFILING) && defined(Q_OS_LINUX)
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace Instrumentation {
+
+namespace {
+struct StageTotals {
+    std::atomic<quint64> calls{0};
+    std::atomic<quint64> nanoseconds{0};
+    std::atomic<quint64> bytes{0};
+    std::atomic<quint64> cycles{0};
+    std::atomic<quint64> cacheMisses{0};
+};
+
+std::array<StageTotals, size_t(Stage::Count)> totals;
+
+qint64 nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+#if defined(INFERNO_PROFILING) && defined(Q_OS_LINUX)
+int openCounter(quint64 config, int groupFd) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1; // Allowed at perf_event_paranoid 2; the syscalls show up as wall time instead
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return int(syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0));
+}
+
+// Cycle and cache-miss counters of one thread, opened on first use
+struct ThreadCounters {
+    ThreadCounters() {
+        leader = openCounter(PERF_COUNT_HW_CPU_CYCLES, -1);
+        if (leader >= 0) {
+            misses = openCounter(PERF_COUNT_HW_CACHE_MISSES, leader);
+        }
+    }
+    ~ThreadCounters() {
+        if (misses >= 0) ::close(misses);
+        if (leader >= 0) ::close(leader);
+    }
+
+    int leader = -1;
+    int misses = -1;
+};
+#endif
+} // namespace
+
+const char *stageName(Stage stage) {
+    switch (stage) {
+    case Stage::Read:
+        return "read";
+    case Stage::Hash:
+        return "hash";
+    case Stage::ZeroScan:
+        return "zero-scan";
+    case Stage::Write:
+        return "write";
+    case Stage::Compress:
+        return "compress";
+    case Stage::Count:
+        break;
+    }
+    return "unknown";
+}
+
+void addSample(Stage stage, qint64 bytes, qint64 nanoseconds, quint64 cycles, quint64 cacheMisses) {
+    StageTotals &stageTotals = totals[size_t(stage)];
+    stageTotals.calls.fetch_add(1, std::memory_order_relaxed);
+    stageTotals.nanoseconds.fetch_add(quint64(std::max<qint64>(0, nanoseconds)), std::memory_order_relaxed);
+    stageTotals.bytes.fetch_add(quint64(std::max<qint64>(0, bytes)), std::memory_order_relaxed);
+    stageTotals.cycles.fetch_add(cycles, std::memory_order_relaxed);
+    stageTotals.cacheMisses.fetch_add(cacheMisses, std::memory_order_relaxed);
+}
+
+bool readPerfCounters(quint64 *cycles, quint64 *cacheMisses) {
+#if defined(INFERNO_PROFILING) && defined(Q_OS_LINUX)
+    thread_local ThreadCounters counters;
+    if (counters.leader < 0) {
+        return false;
+    }
+    struct {
+        quint64 count;
+        quint64 values[2];
+    } group = {};
+    if (::read(counters.leader, &group, sizeof(group)) <= 0 || group.count < 1) {
+        return false;
+    }
+    *cycles = group.values[0];
+    *cacheMisses = group.count > 1 ? group.values[1] : 0;
+    return true;
+#else
+    Q_UNUSED(cycles);
+    Q_UNUSED(cacheMisses);
+    return false;
+#endif
+}
+
+QJsonObject snapshot() {
+    QJsonObject object;
+    if constexpr (kEnabled) {
+        for (int i = 0; i < int(Stage::Count); ++i) {
+            const StageTotals &stageTotals = totals[size_t(i)];
+            QJsonObject stage;
+            stage["calls"] = QString::number(stageTotals.calls.load(std::memory_order_relaxed));
+            stage["nanoseconds"] = QString::number(stageTotals.nanoseconds.load(std::memory_order_relaxed));
+            stage["bytes"] = QString::number(stageTotals.bytes.load(std::memory_order_relaxed));
+            stage["cycles"] = QString::number(stageTotals.cycles.load(std::memory_order_relaxed));
+            stage["cacheMisses"] = QString::number(stageTotals.cacheMisses.load(std::memory_order_relaxed));
+            object[stageName(Stage(i))] = stage;
+        }
+    }
+    return object;
+}
+
+QString report() {
+    QStringList lines;
+    if constexpr (kEnabled) {
+        for (int i = 0; i < int(Stage::Count); ++i) {
+            const StageTotals &stageTotals = totals[size_t(i)];
+            const quint64 calls = stageTotals.calls.load(std::memory_order_relaxed);
+            if (calls == 0) {
+                continue;
+            }
+            const double seconds = double(stageTotals.nanoseconds.load(std::memory_order_relaxed)) / 1e9;
+            const double mib = double(stageTotals.bytes.load(std::memory_order_relaxed)) / (1024.0 * 1024.0);
+            const quint64 bytes = std::max<quint64>(1, stageTotals.bytes.load(std::memory_order_relaxed));
+            lines << QString("%1: %2 calls, %3 s, %4 MiB/s, %5 cycles/byte, %6 cache misses/KiB")
+                         .arg(stageName(Stage(i)))
+                         .arg(calls)
+                         .arg(seconds, 0, 'f', 3)
+                         .arg(seconds > 0 ? mib / seconds : 0.0, 0, 'f', 1)
+                         .arg(double(stageTotals.cycles.load(std::memory_order_relaxed)) / double(bytes), 0, 'f', 2)
+                         .arg(double(stageTotals.cacheMisses.load(std::memory_order_relaxed)) * 1024.0 / double(bytes), 0, 'f', 2);
+        }
+    }
+    return lines.join('\n');
+}
+
+void reset() {
+    for (StageTotals &stageTotals : totals) {
+        stageTotals.calls.store(0, std::memory_order_relaxed);
+        stageTotals.nanoseconds.store(0, std::memory_order_relaxed);
+        stageTotals.bytes.store(0, std::memory_order_relaxed);
+        stageTotals.cycles.store(0, std::memory_order_relaxed);
+        stageTotals.cacheMisses.store(0, std::memory_order_relaxed);
+    }
+}
+
+// --- Implementation of BasicStageTimer<true> ---
+
+BasicStageTimer<true>::BasicStageTimer(Stage stage, qint64 bytes) : stage(stage), bytes(bytes), startNs(nowNs()) {
+    counting = readPerfCounters(&startCycles, &startMisses);
+}
+
+BasicStageTimer<true>::~BasicStageTimer() {
+    quint64 cycles = 0;
+    quint64 misses = 0;
+    if (counting && readPerfCounters(&cycles, &misses)) {
+        cycles -= startCycles;
+        misses -= startMisses;
+    } else {
+        cycles = misses = 0;
+    }
+    addSample(stage, bytes, nowNs() - startNs, cycles, misses);
+}
+
+} // namespace Instrumentation
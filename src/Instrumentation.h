@@ -0,0 +1,109 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <QJsonObject>
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * @brief Hot-path counters and timers that only exist in profiling builds.
+ *
+ * Engines put a StageTimer around each stage of a buffer (read, hash,
+ * zero-scan, write, compress). Which implementation StageTimer is, is
+ * decided at compile time by kEnabled, set by the INFERNO_PROFILING CMake
+ * option: in normal builds it is an empty class whose constructor does
+ * nothing, so the timers compile away entirely and stations ship without any
+ * measurement cost. In a profiling build every stage adds its call count,
+ * wall time, bytes and, on Linux, CPU cycles and cache misses read from
+ * perf_event_open counters of the calling thread.
+ *
+ * Unlike PipelineTrace, which is switched on per job and records a
+ * timeline, these are cumulative per-process totals meant for comparing
+ * builds and machines. If perf counters are unavailable (e.g.,
+ * kernel.perf_event_paranoid forbids them), only times are recorded.
+ */
+namespace Instrumentation {
+
+#ifdef INFERNO_PROFILING
+inline constexpr bool kEnabled = true;
+#else
+inline constexpr bool kEnabled = false;
+#endif
+
+/**
+ * @brief Instrumented stages.
+ */
+enum class Stage {
+    Read,     // Reading (and decompressing) the source
+    Hash,     // Checksumming against a bmap
+    ZeroScan, // Looking for all-zero blocks that need not be written
+    Write,    // Device writes by the write queue
+    Compress, // Compressing backup frames
+    Count
+};
+
+/**
+ * @brief Name of a stage as used in reports.
+ */
+const char *stageName(Stage stage);
+
+/**
+ * @brief Adds one measured call to the totals of a stage (profiling builds only).
+ */
+void addSample(Stage stage, qint64 bytes, qint64 nanoseconds, quint64 cycles, quint64 cacheMisses);
+
+/**
+ * @brief Reads the calling thread's cycle and cache-miss counters; false if perf counters are unavailable.
+ */
+bool readPerfCounters(quint64 *cycles, quint64 *cacheMisses);
+
+/**
+ * @brief Per-stage totals (calls, nanoseconds, bytes, cycles, cacheMisses); empty unless kEnabled.
+ */
+QJsonObject snapshot();
+
+/**
+ * @brief The totals as a few log lines; empty unless kEnabled.
+ */
+QString report();
+
+/**
+ * @brief Clears the totals, e.g. at the start of a job.
+ */
+void reset();
+
+/**
+ * @brief RAII timer of one stage; the Enabled = false specialisation is empty.
+ */
+template <bool Enabled>
+class BasicStageTimer;
+
+template <>
+class BasicStageTimer<false> {
+public:
+    explicit BasicStageTimer(Stage, qint64 = 0) {}
+};
+
+template <>
+class BasicStageTimer<true> {
+public:
+    explicit BasicStageTimer(Stage stage, qint64 bytes = 0);
+    ~BasicStageTimer();
+
+    BasicStageTimer(const BasicStageTimer &) = delete;
+    BasicStageTimer &operator=(const BasicStageTimer &) = delete;
+
+private:
+    Stage stage;
+    qint64 bytes;
+    qint64 startNs;
+    quint64 startCycles = 0;
+    quint64 startMisses = 0;
+    bool counting;
+};
+
+using StageTimer = BasicStageTimer<kEnabled>;
+
+} // namespace Instrumentation
+
+#endif // INSTRUMENTATION_H
@@ -0,0 +1,221 @@
+#include "IoStats.h"
+#include <QJsonArray>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QThread>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace {
+std::atomic<quint64> nextStatsId{1};
+
+// The shard the calling thread last recorded into; threads rarely serve more than one device
+struct LocalShard {
+    quint64 owner = 0;
+    IoHistograms *histograms = nullptr;
+};
+thread_local LocalShard localShard;
+
+void addRelaxed(std::atomic<quint64> &counter, quint64 value) {
+    // Only the owning thread writes, so a plain load and store is enough
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+QString formatMicroseconds(quint64 us) {
+    if (us >= 1000000) return QString("%1 s").arg(double(us) / 1e6, 0, 'f', 1);
+    if (us >= 1000) return QString("%1 ms").arg(double(us) / 1e3, 0, 'f', 1);
+    return QString("%1 us").arg(us);
+}
+
+QString latencySummary(const char *name, const HdrHistogram &latency) {
+    return QString("%1: %2, p50 %3, p99 %4, p99.9 %5, max %6")
+        .arg(name)
+        .arg(latency.count())
+        .arg(formatMicroseconds(latency.valueAtPercentile(50.0)), formatMicroseconds(latency.valueAtPercentile(99.0)),
+             formatMicroseconds(latency.valueAtPercentile(99.9)), formatMicroseconds(latency.max()));
+}
+} // namespace
+
+// --- Implementation of HdrHistogram ---
+
+HdrHistogram &HdrHistogram::operator=(const HdrHistogram &other) {
+    if (this != &other) {
+        for (std::atomic<quint64> &bucket : counts) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        total.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+        lowest.store(~quint64(0), std::memory_order_relaxed);
+        highest.store(0, std::memory_order_relaxed);
+        merge(other);
+    }
+    return *this;
+}
+
+int HdrHistogram::bucketIndex(quint64 value) {
+    value = std::min(value, (quint64(1) << kMaxBits) - 1);
+    if (value < quint64(kSubBuckets)) {
+        return int(value);
+    }
+    // The top kSubBucketBits bits select the bucket within the value's power of two
+    const int shift = int(std::bit_width(value)) - kSubBucketBits;
+    return kSubBuckets + (shift - 1) * (kSubBuckets / 2) + int(value >> shift) - kSubBuckets / 2;
+}
+
+quint64 HdrHistogram::bucketHighest(int index) {
+    if (index < kSubBuckets) {
+        return quint64(index);
+    }
+    const int shift = (index - kSubBuckets) / (kSubBuckets / 2) + 1;
+    const quint64 sub = quint64((index - kSubBuckets) % (kSubBuckets / 2) + kSubBuckets / 2);
+    return ((sub + 1) << shift) - 1;
+}
+
+void HdrHistogram::record(quint64 value) {
+    addRelaxed(counts[size_t(bucketIndex(value))], 1);
+    addRelaxed(total, 1);
+    addRelaxed(sum, value);
+    if (value < lowest.load(std::memory_order_relaxed)) lowest.store(value, std::memory_order_relaxed);
+    if (value > highest.load(std::memory_order_relaxed)) highest.store(value, std::memory_order_relaxed);
+}
+
+void HdrHistogram::merge(const HdrHistogram &other) {
+    for (int i = 0; i < kBucketCount; ++i) {
+        const quint64 count = other.counts[size_t(i)].load(std::memory_order_relaxed);
+        if (count > 0) addRelaxed(counts[size_t(i)], count);
+    }
+    addRelaxed(total, other.total.load(std::memory_order_relaxed));
+    addRelaxed(sum, other.sum.load(std::memory_order_relaxed));
+    lowest.store(std::min(lowest.load(std::memory_order_relaxed), other.lowest.load(std::memory_order_relaxed)),
+                 std::memory_order_relaxed);
+    highest.store(std::max(highest.load(std::memory_order_relaxed), other.highest.load(std::memory_order_relaxed)),
+                  std::memory_order_relaxed);
+}
+
+quint64 HdrHistogram::min() const {
+    return count() > 0 ? lowest.load(std::memory_order_relaxed) : 0;
+}
+
+double HdrHistogram::mean() const {
+    const quint64 n = count();
+    return n > 0 ? double(sum.load(std::memory_order_relaxed)) / double(n) : 0;
+}
+
+quint64 HdrHistogram::valueAtPercentile(double percentile) const {
+    const quint64 n = count();
+    if (n == 0) {
+        return 0;
+    }
+    const quint64 rank = std::max<quint64>(1, quint64(std::ceil(std::clamp(percentile, 0.0, 100.0) / 100.0 * double(n))));
+    quint64 seen = 0;
+    for (int i = 0; i < kBucketCount; ++i) {
+        seen += counts[size_t(i)].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::min(bucketHighest(i), max());
+        }
+    }
+    return max();
+}
+
+QJsonObject HdrHistogram::toJson() const {
+    QJsonObject object;
+    object["count"] = qint64(count());
+    object["min"] = qint64(min());
+    object["max"] = qint64(max());
+    object["mean"] = mean();
+    object["p50"] = qint64(valueAtPercentile(50.0));
+    object["p90"] = qint64(valueAtPercentile(90.0));
+    object["p99"] = qint64(valueAtPercentile(99.0));
+    object["p999"] = qint64(valueAtPercentile(99.9));
+
+    // Sparse [highest value of bucket, count] pairs; enough to merge or re-plot offline
+    QJsonArray buckets;
+    for (int i = 0; i < kBucketCount; ++i) {
+        const quint64 bucketCount = counts[size_t(i)].load(std::memory_order_relaxed);
+        if (bucketCount > 0) {
+            buckets.append(QJsonArray{qint64(bucketHighest(i)), qint64(bucketCount)});
+        }
+    }
+    object["buckets"] = buckets;
+    return object;
+}
+
+// --- Implementation of IoHistograms ---
+
+void IoHistograms::merge(const IoHistograms &other) {
+    readLatency.merge(other.readLatency);
+    writeLatency.merge(other.writeLatency);
+    readSize.merge(other.readSize);
+    writeSize.merge(other.writeSize);
+}
+
+QJsonObject IoHistograms::toJson() const {
+    QJsonObject reads;
+    reads["latencyUs"] = readLatency.toJson();
+    reads["bytes"] = readSize.toJson();
+    QJsonObject writes;
+    writes["latencyUs"] = writeLatency.toJson();
+    writes["bytes"] = writeSize.toJson();
+
+    QJsonObject object;
+    object["reads"] = reads;
+    object["writes"] = writes;
+    return object;
+}
+
+// --- Implementation of IoStats ---
+
+IoStats::IoStats() : id(nextStatsId.fetch_add(1)) {
+}
+
+IoStats::~IoStats() = default;
+
+IoHistograms &IoStats::local() {
+    if (localShard.owner != id) {
+        // First record() of this thread here, or it recorded for another device in between
+        const Qt::HANDLE thread = QThread::currentThreadId();
+        QMutexLocker locker(&mutex);
+        IoHistograms *histograms = nullptr;
+        for (size_t i = 0; i < shards.size() && !histograms; ++i) {
+            if (owners[i] == thread) histograms = shards[i].get();
+        }
+        if (!histograms) {
+            shards.push_back(std::make_unique<IoHistograms>());
+            owners.push_back(thread);
+            histograms = shards.back().get();
+        }
+        localShard.owner = id;
+        localShard.histograms = histograms;
+    }
+    return *localShard.histograms;
+}
+
+void IoStats::record(IoKind kind, qint64 bytes, qint64 nanoseconds) {
+    IoHistograms &histograms = local();
+    const quint64 us = quint64(std::max<qint64>(0, nanoseconds) / 1000);
+    if (kind == IoKind::Read) {
+        histograms.readLatency.record(us);
+        histograms.readSize.record(quint64(std::max<qint64>(0, bytes)));
+    } else {
+        histograms.writeLatency.record(us);
+        histograms.writeSize.record(quint64(std::max<qint64>(0, bytes)));
+    }
+}
+
+IoHistograms IoStats::merged() const {
+    IoHistograms result;
+    QMutexLocker locker(&mutex);
+    for (const auto &shard : shards) {
+        result.merge(*shard);
+    }
+    return result;
+}
+
+QString IoStats::summary() const {
+    const IoHistograms histograms = merged();
+    QStringList parts;
+    if (histograms.writeLatency.count() > 0) parts << latencySummary("writes", histograms.writeLatency);
+    if (histograms.readLatency.count() > 0) parts << latencySummary("reads", histograms.readLatency);
+    return parts.isEmpty() ? QString("no I/O") : parts.join("; ");
+}
@@ -0,0 +1,143 @@
+#ifndef IOSTATS_H
+#define IOSTATS_H
+
+#include <QJsonObject>
+#include <QMutex>
+#include <QString>
+#include <QtGlobal>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Log-linear (HDR) histogram of non-negative integers, such as latencies or request sizes.
+ *
+ * Values below kSubBuckets are counted exactly; above that, every power of
+ * two is split into kSubBuckets / 2 equal buckets, so any recorded value is
+ * known to within 1/64 of itself from 1 up to 2^kMaxBits. Percentiles are
+ * reported as the highest value of their bucket, so a tail is never made to
+ * look better than it was.
+ *
+ * record() is lock-free but assumes a single writing thread (see IoStats,
+ * which keeps one histogram per thread). Reading and merging from other
+ * threads is safe at any time and sees a near-consistent snapshot.
+ */
+class HdrHistogram {
+public:
+    static constexpr int kSubBucketBits = 7;
+    static constexpr int kSubBuckets = 1 << kSubBucketBits;
+    static constexpr int kMaxBits = 48; // Larger values are clamped
+    static constexpr int kBucketCount = kSubBuckets + (kMaxBits - kSubBucketBits) * (kSubBuckets / 2);
+
+    HdrHistogram() = default;
+    HdrHistogram(const HdrHistogram &other) { merge(other); }
+    HdrHistogram &operator=(const HdrHistogram &other);
+
+    /**
+     * @brief Counts one value. Single writer only.
+     */
+    void record(quint64 value);
+
+    /**
+     * @brief Adds the counts of other into this histogram. Single writer only.
+     */
+    void merge(const HdrHistogram &other);
+
+    quint64 count() const { return total.load(std::memory_order_relaxed); }
+    quint64 min() const;
+    quint64 max() const { return highest.load(std::memory_order_relaxed); }
+    quint64 valueSum() const { return sum.load(std::memory_order_relaxed); }
+    double mean() const;
+
+    /**
+     * @brief Smallest value that at least percentile percent of the values do not exceed (0 if empty).
+     */
+    quint64 valueAtPercentile(double percentile) const;
+
+    /**
+     * @brief Count, min, max, mean, the usual percentiles and the non-empty buckets.
+     */
+    QJsonObject toJson() const;
+
+    static int bucketIndex(quint64 value);
+    static quint64 bucketHighest(int index);
+
+private:
+    std::array<std::atomic<quint64>, kBucketCount> counts{};
+    std::atomic<quint64> total{0};
+    std::atomic<quint64> sum{0};
+    std::atomic<quint64> lowest{~quint64(0)};
+    std::atomic<quint64> highest{0};
+};
+
+/**
+ * @brief Kinds of device I/O that IoStats tells apart.
+ */
+enum class IoKind {
+    Read,
+    Write
+};
+
+/**
+ * @brief Completion latency (in microseconds) and size histograms of one device's reads and writes.
+ */
+struct IoHistograms {
+    HdrHistogram readLatency;
+    HdrHistogram writeLatency;
+    HdrHistogram readSize;
+    HdrHistogram writeSize;
+
+    void merge(const IoHistograms &other);
+    QJsonObject toJson() const;
+};
+
+/**
+ * @brief I/O statistics of one device during one job.
+ *
+ * BlockDevice calls record() after every positional read and write once
+ * setIoStats() has attached it. Each recording thread gets its own
+ * IoHistograms, found through a thread-local cache, so the writer threads of
+ * a queue never contend; only a thread's first record() takes the mutex.
+ * merged() adds the per-thread histograms up, at the end of a job or, as a
+ * live snapshot, while it runs.
+ *
+ * Averages hide the stalls that matter on USB (a hub that drops out for a
+ * second, a stick that garbage-collects every few hundred megabytes); the
+ * 99th and 99.9th percentile latencies show them.
+ */
+class IoStats {
+public:
+    IoStats();
+    ~IoStats();
+
+    IoStats(const IoStats &) = delete;
+    IoStats &operator=(const IoStats &) = delete;
+
+    /**
+     * @brief Records one completed request of bytes that took nanoseconds. Thread-safe, lock-free after a thread's first call.
+     */
+    void record(IoKind kind, qint64 bytes, qint64 nanoseconds);
+
+    /**
+     * @brief Sum of every thread's histograms. Thread-safe.
+     */
+    IoHistograms merged() const;
+
+    QJsonObject toJson() const { return merged().toJson(); }
+
+    /**
+     * @brief One line for the log, e.g. "writes: 2048, p50 3.1 ms, p99 40.2 ms, p99.9 812.0 ms, max 1.2 s".
+     */
+    QString summary() const;
+
+private:
+    IoHistograms &local();
+
+    const quint64 id; // Distinguishes instances in the thread-local cache, even at a reused address
+    mutable QMutex mutex;
+    std::vector<std::unique_ptr<IoHistograms>> shards; // One per recording thread
+    std::vector<Qt::HANDLE> owners;                     // Thread of each shard
+};
+
+#endif // IOSTATS_H
@@ -0,0 +1,159 @@
+#include "JobJournal.h"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+namespace {
+const int kFormatVersion = 1;
+
+QByteArray encode(const QJsonObject &record) {
+    return QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n';
+}
+} // namespace
+
+// --- Implementation of JobJournal ---
+
+JobJournal::JobJournal(const QString &filePath) : path(filePath), file(filePath) {
+}
+
+QString JobJournal::defaultPath() {
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/jobs.journal";
+}
+
+bool JobJournal::open(QList<Job> *unfinished, QString *errorMessage) {
+    live.clear();
+    QFile existing(path);
+    if (existing.open(QIODevice::ReadOnly)) {
+        int version = 0;
+        while (!existing.atEnd()) {
+            const QJsonDocument document = QJsonDocument::fromJson(existing.readLine());
+            if (!document.isObject()) {
+                continue; // Torn by a crash mid-append
+            }
+            const QJsonObject record = document.object();
+            if (record["op"].toString() == "journal") {
+                version = record["version"].toInt();
+            } else if (version == kFormatVersion) {
+                apply(record);
+            }
+        }
+        existing.close();
+    }
+
+    if (!compact(errorMessage)) {
+        return false;
+    }
+    unfinished->clear();
+    for (const auto &[id, job] : live) {
+        unfinished->append(job);
+    }
+    return true;
+}
+
+void JobJournal::recordSubmitted(const Job &job) {
+    QJsonObject record;
+    record["op"] = "submit";
+    record["job"] = job.toJson();
+    append(record);
+}
+
+void JobJournal::recordCheckpoint(qint64 id, const QString &drive, qint64 offset, const QString &targetStamp) {
+    QJsonObject record;
+    record["op"] = "checkpoint";
+    record["id"] = double(id);
+    record["drive"] = drive;
+    record["offset"] = QString::number(offset);
+    record["target"] = targetStamp; // Identity of the stick the offset holds for (see JobQueue)
+    append(record);
+}
+
+void JobJournal::recordFinished(const Job &job) {
+    QJsonObject record;
+    record["op"] = "finish";
+    record["id"] = double(job.id);
+    record["state"] = Job::stateName(job.state);
+    append(record);
+}
+
+void JobJournal::apply(const QJsonObject &record) {
+    const QString op = record["op"].toString();
+    if (op == "submit") {
+        const Job job = Job::fromJson(record["job"].toObject());
+        if (job.id > 0) live[job.id] = job;
+        return;
+    }
+    const auto it = live.find(qint64(record["id"].toDouble()));
+    if (it == live.end()) {
+        return;
+    }
+    if (op == "checkpoint") {
+        it->second.checkpoints[record["drive"].toString()] = record["offset"].toString().toLongLong();
+        it->second.targetStamps[record["drive"].toString()] = record["target"].toString();
+    } else if (op == "finish") {
+        live.erase(it);
+    }
+}
+
+void JobJournal::append(const QJsonObject &record) {
+    apply(record);
+    if (++appended >= kCompactAfter) {
+        QString errorMessage;
+        if (compact(&errorMessage)) {
+            return; // The compacted log already holds the record
+        }
+        // A failed snapshot leaves the old log in place, so keep appending to it and retry later
+        qDebug() << "Cannot compact the job journal:" << errorMessage;
+        appended = 0;
+    }
+    if (!file.isOpen() && !file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qDebug() << "Cannot open the job journal" << path << ":" << file.errorString();
+        return;
+    }
+    const QByteArray line = encode(record);
+    if (file.write(line) != line.size() || !file.flush()) {
+        qDebug() << "Cannot write to the job journal" << path << ":" << file.errorString();
+        return;
+    }
+#ifdef Q_OS_LINUX
+    fdatasync(file.handle()); // A checkpoint is only worth something once it is on disk
+#endif
+}
+
+bool JobJournal::compact(QString *errorMessage) {
+    file.close();
+
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile snapshot(path);
+    if (!snapshot.open(QIODevice::WriteOnly)) {
+        if (errorMessage) *errorMessage = snapshot.errorString();
+        return false;
+    }
+    QJsonObject header;
+    header["op"] = "journal";
+    header["version"] = kFormatVersion;
+    snapshot.write(encode(header));
+    for (const auto &[id, job] : live) {
+        QJsonObject record;
+        record["op"] = "submit";
+        record["job"] = job.toJson(); // Checkpoints travel inside the job
+        snapshot.write(encode(record));
+    }
+    if (!snapshot.commit()) {
+        if (errorMessage) *errorMessage = snapshot.errorString();
+        return false;
+    }
+    appended = 0;
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        if (errorMessage) *errorMessage = file.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,62 @@
+#ifndef JOBJOURNAL_H
+#define JOBJOURNAL_H
+
+#include "JobQueue.h"
+#include <QFile>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+#include <map>
+
+/**
+ * @brief Append-only, crash-safe log of the daemon's jobs and their checkpoints.
+ *
+ * Every record is one JSON line, flushed to disk before the call returns:
+ *
+ *   {"op":"submit","job":{...}}                            (see Job::toJson)
+ *   {"op":"checkpoint","id":7,"drive":"...","offset":"...","target":"..."}
+ *   {"op":"finish","id":7,"state":"succeeded"}
+ *
+ * open() replays the log to find the jobs that were queued or running when
+ * the daemon stopped, with the last durable offset of each target, and
+ * rewrites the log with only those (atomically, through QSaveFile). The log
+ * is compacted the same way after kCompactAfter appends, so it stays small
+ * however long the daemon runs. If compaction fails, records keep going to
+ * the old log and compaction is tried again later. A line torn by a crash is
+ * ignored.
+ *
+ * Not thread-safe; JobQueue calls it from its own thread.
+ */
+class JobJournal {
+public:
+    static constexpr int kCompactAfter = 1000;
+
+    explicit JobJournal(const QString &filePath = defaultPath());
+
+    /**
+     * @brief The journal in the application data directory.
+     */
+    static QString defaultPath();
+
+    /**
+     * @brief Replays and compacts the log, then opens it for appending.
+     * @param unfinished Receives the jobs that had not finished, in submission order, with their checkpoints.
+     */
+    bool open(QList<Job> *unfinished, QString *errorMessage = nullptr);
+
+    void recordSubmitted(const Job &job);
+    void recordCheckpoint(qint64 id, const QString &drive, qint64 offset, const QString &targetStamp);
+    void recordFinished(const Job &job);
+
+private:
+    void apply(const QJsonObject &record);
+    void append(const QJsonObject &record);
+    bool compact(QString *errorMessage);
+
+    QString path;
+    QFile file;
+    std::map<qint64, Job> live; // Unfinished jobs as the log describes them
+    int appended = 0;
+};
+
+#endif // JOBJOURNAL_H
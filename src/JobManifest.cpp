@@ -0,0 +1,238 @@
+#include "JobManifest.h"
+#include "UsbTopology.h"
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QRegularExpression>
+#include <QSet>
+#include <functional>
+
+namespace {
+const QStringList kVerifyLevels = {"none", "capacity"};
+
+// Sizes may be given as numbers or, like everywhere else in Inferno's JSON, as strings
+qint64 sizeValue(const QJsonValue &value) {
+    return value.isString() ? value.toString().toLongLong() : qint64(value.toDouble());
+}
+
+QVariantMap merged(QVariantMap base, const QVariantMap &overrides) {
+    for (auto it = overrides.cbegin(); it != overrides.cend(); ++it) {
+        base.insert(it.key(), it.value());
+    }
+    return base;
+}
+} // namespace
+
+// --- Implementation of TargetSelector ---
+
+bool TargetSelector::matches(const DriveInfo &drive) const {
+    if (!model.isEmpty()) {
+        const QRegularExpression pattern(QRegularExpression::wildcardToRegularExpression(model),
+                                         QRegularExpression::CaseInsensitiveOption);
+        if (!pattern.match(drive.model).hasMatch()) return false;
+    }
+    if (minSize > 0 && drive.size < minSize) return false;
+    if (maxSize > 0 && drive.size > maxSize) return false;
+    if (!port.isEmpty()) {
+        const UsbLocation usb = UsbTopology::locate(drive.devicePath);
+        if (usb.device != port && !usb.device.startsWith(port + '.')) return false;
+    }
+    return true;
+}
+
+QJsonObject TargetSelector::toJson() const {
+    QJsonObject obj;
+    if (!model.isEmpty()) obj["model"] = model;
+    if (minSize > 0) obj["minSize"] = QString::number(minSize);
+    if (maxSize > 0) obj["maxSize"] = QString::number(maxSize);
+    if (!port.isEmpty()) obj["port"] = port;
+    if (obj.isEmpty()) obj["model"] = "*"; // An empty selector would read as "not pooled"
+    return obj;
+}
+
+TargetSelector TargetSelector::fromJson(const QJsonObject &obj) {
+    TargetSelector selector;
+    selector.model = obj["model"].toString();
+    selector.minSize = sizeValue(obj["minSize"]);
+    selector.maxSize = sizeValue(obj["maxSize"]);
+    selector.port = obj["port"].toString();
+    return selector;
+}
+
+// --- Implementation of JobManifest ---
+
+bool JobManifest::load(const QString &path, QString *errorMessage) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorMessage) *errorMessage = file.errorString();
+        return false;
+    }
+    QJsonParseError parseError;
+    const QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parseError);
+    if (!document.isObject()) {
+        if (errorMessage) *errorMessage = QString("%1 is not a JSON manifest: %2").arg(path, parseError.errorString());
+        return false;
+    }
+    return parse(document.object(), errorMessage);
+}
+
+bool JobManifest::parse(const QJsonObject &obj, QString *errorMessage) {
+    auto fail = [errorMessage](const QString &message) {
+        if (errorMessage) *errorMessage = message;
+        return false;
+    };
+    if (obj["version"].toInt(kFormatVersion) != kFormatVersion) {
+        return fail(QString("Unsupported manifest version %1.").arg(obj["version"].toInt()));
+    }
+    manifestName = obj["name"].toString();
+    verify = obj["verify"].toString("capacity");
+    options = obj["options"].toObject().toVariantMap();
+    if (!kVerifyLevels.contains(verify)) {
+        return fail(QString("Unknown verification level \"%1\".").arg(verify));
+    }
+
+    imageList.clear();
+    for (const QJsonValue &value : obj["images"].toArray()) {
+        const QJsonObject entry = value.toObject();
+        Image image;
+        image.id = entry["id"].toString();
+        image.path = entry["path"].toString();
+        image.options = entry["options"].toObject().toVariantMap();
+        for (const QJsonValue &after : entry["after"].toArray()) {
+            image.after.append(after.toString());
+        }
+        if (image.id.isEmpty() || image.path.isEmpty()) {
+            return fail("Every image needs an id and a path.");
+        }
+        if (findImage(image.id)) {
+            return fail(QString("Image \"%1\" is listed twice.").arg(image.id));
+        }
+        imageList.append(image);
+    }
+    for (const Image &image : std::as_const(imageList)) {
+        for (const QString &after : image.after) {
+            if (!findImage(after) || after == image.id) {
+                return fail(QString("Image \"%1\" waits for unknown image \"%2\".").arg(image.id, after));
+            }
+        }
+    }
+
+    targetList.clear();
+    for (const QJsonValue &value : obj["targets"].toArray()) {
+        const QJsonObject entry = value.toObject();
+        Target target;
+        target.drive = entry["drive"].toString();
+        const QJsonObject select = entry["select"].toObject();
+        target.select = TargetSelector::fromJson(select);
+        target.count = entry["count"].toInt();
+        target.image = entry["image"].toString();
+        target.verify = entry["verify"].toString();
+        target.options = entry["options"].toObject().toVariantMap();
+        if (!findImage(target.image)) {
+            return fail(QString("A target names unknown image \"%1\".").arg(target.image));
+        }
+        if (target.drive.isEmpty() && select.isEmpty()) {
+            return fail("Every target needs a drive or a select.");
+        }
+        if (!target.verify.isEmpty() && !kVerifyLevels.contains(target.verify)) {
+            return fail(QString("Unknown verification level \"%1\".").arg(target.verify));
+        }
+        targetList.append(target);
+    }
+    if (targetList.isEmpty()) {
+        return fail("The manifest has no targets.");
+    }
+
+    // Waiting must not go round in a circle
+    QHash<QString, int> state; // 1: being visited, 2: done
+    std::function<bool(const Image &)> acyclic = [&](const Image &image) {
+        if (state.value(image.id) == 2) return true;
+        if (state.value(image.id) == 1) return false;
+        state[image.id] = 1;
+        for (const QString &after : image.after) {
+            if (!acyclic(*findImage(after))) return false;
+        }
+        state[image.id] = 2;
+        return true;
+    };
+    for (const Image &image : std::as_const(imageList)) {
+        if (!acyclic(image)) {
+            return fail(QString("The \"after\" lists of the images form a cycle through \"%1\".").arg(image.id));
+        }
+    }
+    return true;
+}
+
+bool JobManifest::expand(const QList<DriveInfo> &drives, QList<Job> *jobs, QString *errorMessage) const {
+    jobs->clear();
+    QSet<QString> used;
+    QList<QPair<const Target *, QString>> assignments; // In target order
+
+    // Explicit drives first, so selectors cannot take them
+    for (const Target &target : targetList) {
+        if (target.drive.isEmpty()) continue;
+        if (used.contains(target.drive)) {
+            if (errorMessage) *errorMessage = QString("Drive %1 is a target more than once.").arg(target.drive);
+            return false;
+        }
+        used.insert(target.drive);
+        assignments.append({&target, target.drive});
+    }
+    for (const Target &target : targetList) {
+        if (!target.drive.isEmpty()) continue;
+        int taken = 0;
+        for (const DriveInfo &drive : drives) {
+            if (target.count > 0 && taken == target.count) break;
+            if (used.contains(drive.devicePath) || !target.select.matches(drive)) continue;
+            used.insert(drive.devicePath);
+            assignments.append({&target, drive.devicePath});
+            ++taken;
+        }
+        if (taken < target.count) {
+            if (errorMessage) {
+                *errorMessage = QString("Only %1 of the %2 drives wanted for image \"%3\" are connected.")
+                                    .arg(taken).arg(target.count).arg(target.image);
+            }
+            return false;
+        }
+    }
+
+    QHash<QString, QList<qint64>> jobsOfImage;
+    QList<const Image *> imageOfJob;
+    for (const auto &[target, drive] : assignments) {
+        const Image *image = findImage(target->image);
+        Job job;
+        job.id = jobs->size() + 1; // Provisional
+        job.kind = "image";
+        job.imagePath = image->path;
+        if (target->drive.isEmpty()) {
+            job.pool = target->select.toJson();
+        } else {
+            job.drives = {drive};
+        }
+        job.options = merged(merged(options, image->options), target->options);
+        const QString level = target->verify.isEmpty() ? verify : target->verify;
+        job.options["verifyCapacity"] = level != "none";
+        jobs->append(job);
+        jobsOfImage[image->id].append(job.id);
+        imageOfJob.append(image);
+    }
+    for (qsizetype i = 0; i < jobs->size(); ++i) {
+        for (const QString &after : imageOfJob[i]->after) {
+            (*jobs)[i].after += jobsOfImage.value(after);
+        }
+    }
+    if (jobs->isEmpty()) {
+        if (errorMessage) *errorMessage = "No connected drive matches the manifest's targets.";
+        return false;
+    }
+    return true;
+}
+
+const JobManifest::Image *JobManifest::findImage(const QString &id) const {
+    for (const Image &image : imageList) {
+        if (image.id == id) return &image;
+    }
+    return nullptr;
+}
@@ -0,0 +1,102 @@
+#ifndef JOBMANIFEST_H
+#define JOBMANIFEST_H
+
+#include "DiskUtility.h"
+#include "JobQueue.h"
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+
+/**
+ * @brief Picks drives from the drive table by what they are rather than by path.
+ */
+struct TargetSelector {
+    QString model;       // Wildcard pattern ("SanDisk*"), case-insensitive; empty matches any
+    qint64 minSize = 0;  // Bytes; 0 for no bound
+    qint64 maxSize = 0;
+    QString port;        // USB port the drive is on or behind, e.g. "2-1" (see UsbTopology); empty for any
+
+    bool matches(const DriveInfo &drive) const;
+
+    QJsonObject toJson() const;
+    static TargetSelector fromJson(const QJsonObject &obj);
+};
+
+/**
+ * @brief A declarative batch burn: which images go onto which drives, and how.
+ *
+ * The manifest is JSON:
+ *
+ *   {
+ *     "version": 1,
+ *     "name": "Release 24.04",
+ *     "verify": "capacity",                       // or "none"; default for every job
+ *     "options": {"directIo": true},              // defaults for every job
+ *     "images": [
+ *       {"id": "desktop", "path": "/srv/desktop.img", "options": {...}},
+ *       {"id": "server", "path": "/srv/server.img.xz", "after": ["desktop"]}
+ *     ],
+ *     "targets": [
+ *       {"drive": "/dev/sdb", "image": "server"},
+ *       {"select": {"model": "SanDisk*", "minSize": "16000000000", "port": "2-1"},
+ *        "count": 10, "image": "desktop", "verify": "none", "options": {...}}
+ *     ]
+ *   }
+ *
+ * Options are merged manifest < image < target, as DiskUtility::startImageWrite
+ * takes them. "verify" is "capacity" (the fake-capacity check, the default) or
+ * "none"; bmap checksums are always verified. An image's "after" lists images
+ * whose jobs must all succeed before any of its own start. Targets naming a
+ * drive are taken first; selectors then count matching drives in table order,
+ * up to "count" (all remaining if absent), and no drive is counted twice.
+ * Which of the matching drives gets which image is left to BatchScheduler.
+ */
+class JobManifest {
+public:
+    static constexpr int kFormatVersion = 1;
+
+    struct Image {
+        QString id;
+        QString path;
+        QVariantMap options;
+        QStringList after;
+    };
+
+    struct Target {
+        QString drive;         // Explicit device path, or empty to use select
+        TargetSelector select;
+        int count = 0;         // Drives to take with select; 0 for all that match
+        QString image;         // Image::id
+        QString verify;        // Overrides the manifest's level if set
+        QVariantMap options;
+    };
+
+    bool load(const QString &path, QString *errorMessage = nullptr);
+    bool parse(const QJsonObject &obj, QString *errorMessage = nullptr);
+
+    /**
+     * @brief Expands the manifest into one image job per target drive.
+     *
+     * Jobs get provisional ids 1..n, which their "after" lists refer to;
+     * JobQueue::submitBatch replaces them with real ones. Jobs for selector
+     * targets are pooled: they carry the selector and no drive yet.
+     */
+    bool expand(const QList<DriveInfo> &drives, QList<Job> *jobs, QString *errorMessage = nullptr) const;
+
+    QString name() const { return manifestName; }
+    const QList<Image> &images() const { return imageList; }
+    const QList<Target> &targets() const { return targetList; }
+
+private:
+    const Image *findImage(const QString &id) const;
+
+    QString manifestName;
+    QString verify = "capacity";
+    QVariantMap options;
+    QList<Image> imageList;
+    QList<Target> targetList;
+};
+
+#endif // JOBMANIFEST_H
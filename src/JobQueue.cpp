@@ -0,0 +1,584 @@
+#include "JobQueue.h"
+#include "DiskUtility.h"
+#include "JobJournal.h"
+#include <QDebug>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <algorithm>
+
+namespace {
+const QStringList kKinds = {"image", "backup", "clone", "erase", "capacity"};
+
+QJsonObject progressToJson(const ProgressRecord &record) {
+    QJsonObject obj;
+    obj["bytesDone"] = QString::number(record.bytesDone);
+    obj["bytesTotal"] = QString::number(record.bytesTotal);
+    obj["bytesPerSecond"] = record.bytesPerSecond;
+    obj["secondsRemaining"] = double(record.secondsRemaining);
+    obj["queueDepth"] = record.queue.depth;
+    if (!record.phase.isEmpty()) obj["phase"] = record.phase;
+    return obj;
+}
+
+ProgressRecord progressFromJson(const QJsonObject &obj) {
+    ProgressRecord record;
+    record.bytesDone = obj["bytesDone"].toString().toLongLong();
+    record.bytesTotal = obj["bytesTotal"].toString().toLongLong();
+    record.bytesPerSecond = obj["bytesPerSecond"].toDouble();
+    record.secondsRemaining = qint64(obj["secondsRemaining"].toDouble(-1));
+    record.queue.depth = obj["queueDepth"].toInt();
+    record.phase = obj["phase"].toString();
+    return record;
+}
+
+JobState stateFromName(const QString &name) {
+    for (const JobState state : {JobState::Queued, JobState::Running, JobState::Succeeded, JobState::Failed,
+                                 JobState::Cancelled}) {
+        if (Job::stateName(state) == name) return state;
+    }
+    return JobState::Failed;
+}
+} // namespace
+
+// --- Implementation of Job ---
+
+bool Job::validate(QString *errorMessage) const {
+    auto fail = [errorMessage](const QString &message) {
+        if (errorMessage) *errorMessage = message;
+        return false;
+    };
+    if (!kKinds.contains(kind)) {
+        return fail(QString("Unknown job kind \"%1\"; expected one of %2.").arg(kind, kKinds.join(", ")));
+    }
+    if (isPooled() && kind != "image") {
+        return fail("Only image jobs can take their drive from a pool.");
+    }
+    if (drives.isEmpty() && !isPooled()) {
+        return fail("The job names no drive.");
+    }
+    if (QSet<QString>(drives.cbegin(), drives.cend()).size() != drives.size()) {
+        return fail("The job names a drive more than once.");
+    }
+    if ((kind == "image" || kind == "backup") && imagePath.isEmpty()) {
+        return fail(QString("A %1 job needs an image path.").arg(kind));
+    }
+    if ((kind == "image" || kind == "backup" || kind == "capacity") && drives.size() != 1 && !(isPooled() && drives.isEmpty())) {
+        return fail(QString("A %1 job works on exactly one drive.").arg(kind));
+    }
+    if (kind == "clone" && drives.size() < 2) {
+        return fail("A clone job needs a source and at least one target drive.");
+    }
+    return true;
+}
+
+QJsonObject Job::toJson() const {
+    QJsonObject obj;
+    obj["id"] = double(id);
+    obj["kind"] = kind;
+    if (!imagePath.isEmpty()) obj["imagePath"] = imagePath;
+    obj["drives"] = QJsonArray::fromStringList(drives);
+    if (!options.isEmpty()) obj["options"] = QJsonObject::fromVariantMap(options);
+    if (!checkpoints.isEmpty()) {
+        QJsonObject marks;
+        for (auto it = checkpoints.cbegin(); it != checkpoints.cend(); ++it) {
+            marks[it.key()] = QString::number(it.value());
+        }
+        obj["checkpoints"] = marks;
+    }
+    if (!targetStamps.isEmpty()) {
+        QJsonObject stamps;
+        for (auto it = targetStamps.cbegin(); it != targetStamps.cend(); ++it) {
+            stamps[it.key()] = it.value();
+        }
+        obj["targetStamps"] = stamps;
+    }
+    if (!imageStamp.isEmpty()) obj["imageStamp"] = imageStamp;
+    if (batch != 0) obj["batch"] = double(batch);
+    if (!after.isEmpty()) {
+        QJsonArray ids;
+        for (const qint64 id : after) ids.append(double(id));
+        obj["after"] = ids;
+    }
+    if (!pool.isEmpty()) obj["pool"] = pool;
+    if (rank != 0) obj["rank"] = rank;
+    if (attempts != 0) obj["attempts"] = attempts;
+    obj["state"] = stateName(state);
+    obj["percentage"] = percentage;
+    if (!message.isEmpty()) obj["message"] = message;
+    if (state != JobState::Queued) obj["progress"] = progressToJson(progress);
+    if (submitted.isValid()) obj["submitted"] = submitted.toString(Qt::ISODate);
+    if (started.isValid()) obj["started"] = started.toString(Qt::ISODate);
+    if (finished.isValid()) obj["finished"] = finished.toString(Qt::ISODate);
+    return obj;
+}
+
+Job Job::fromJson(const QJsonObject &obj) {
+    Job job;
+    job.id = qint64(obj["id"].toDouble());
+    job.kind = obj["kind"].toString();
+    job.imagePath = obj["imagePath"].toString();
+    for (const QJsonValue &drive : obj["drives"].toArray()) {
+        job.drives.append(drive.toString());
+    }
+    job.options = obj["options"].toObject().toVariantMap();
+    const QJsonObject marks = obj["checkpoints"].toObject();
+    for (auto it = marks.constBegin(); it != marks.constEnd(); ++it) {
+        job.checkpoints.insert(it.key(), it.value().toString().toLongLong());
+    }
+    const QJsonObject stamps = obj["targetStamps"].toObject();
+    for (auto it = stamps.constBegin(); it != stamps.constEnd(); ++it) {
+        job.targetStamps.insert(it.key(), it.value().toString());
+    }
+    job.imageStamp = obj["imageStamp"].toString();
+    job.batch = qint64(obj["batch"].toDouble());
+    for (const QJsonValue &after : obj["after"].toArray()) {
+        job.after.append(qint64(after.toDouble()));
+    }
+    job.pool = obj["pool"].toObject();
+    job.rank = obj["rank"].toInt();
+    job.attempts = obj["attempts"].toInt();
+    job.state = obj.contains("state") ? stateFromName(obj["state"].toString()) : JobState::Queued;
+    job.percentage = obj["percentage"].toInt();
+    job.message = obj["message"].toString();
+    job.progress = progressFromJson(obj["progress"].toObject());
+    job.submitted = QDateTime::fromString(obj["submitted"].toString(), Qt::ISODate);
+    job.started = QDateTime::fromString(obj["started"].toString(), Qt::ISODate);
+    job.finished = QDateTime::fromString(obj["finished"].toString(), Qt::ISODate);
+    return job;
+}
+
+QString Job::stateName(JobState state) {
+    switch (state) {
+    case JobState::Queued: return "queued";
+    case JobState::Running: return "running";
+    case JobState::Succeeded: return "succeeded";
+    case JobState::Failed: return "failed";
+    case JobState::Cancelled: return "cancelled";
+    }
+    return QString();
+}
+
+// --- Implementation of JobQueue ---
+
+JobQueue::JobQueue(QObject *parent) : QObject(parent), enumerator(new DiskUtility(this)) {
+}
+
+qint64 JobQueue::submit(Job job, QString *errorMessage) {
+    job.batch = 0;
+    job.after.clear();
+    job.pool = QJsonObject();
+    job.rank = 0;
+    if (!job.validate(errorMessage)) {
+        return 0;
+    }
+    const qint64 id = enqueue(job);
+    // Started from the event loop, so the submitter has the id before the job's first update
+    QMetaObject::invokeMethod(this, &JobQueue::startReady, Qt::QueuedConnection);
+    return id;
+}
+
+QList<qint64> JobQueue::submitBatch(QList<Job> jobs, QString *errorMessage) {
+    for (qsizetype i = 0; i < jobs.size(); ++i) {
+        if (!jobs[i].validate(errorMessage)) {
+            if (errorMessage) *errorMessage = tr("Job %1 of the batch: %2").arg(i + 1).arg(*errorMessage);
+            return {};
+        }
+        for (const qint64 after : std::as_const(jobs[i].after)) {
+            if (after < 1 || after > jobs.size() || after == i + 1) {
+                if (errorMessage) *errorMessage = tr("Job %1 of the batch waits for a job not in it.").arg(i + 1);
+                return {};
+            }
+        }
+    }
+
+    const qint64 first = nextId;
+    QList<qint64> ids;
+    for (Job &job : jobs) {
+        job.batch = first;
+        for (qint64 &after : job.after) {
+            after += first - 1;
+        }
+        ids.append(enqueue(job));
+    }
+    qDebug() << "Queued a batch of" << ids.size() << "jobs from" << first;
+    QMetaObject::invokeMethod(this, &JobQueue::startReady, Qt::QueuedConnection);
+    return ids;
+}
+
+qint64 JobQueue::enqueue(Job job) {
+    job.id = nextId++;
+    job.state = JobState::Queued;
+    job.percentage = 0;
+    job.message.clear();
+    job.progress = ProgressRecord();
+    job.checkpoints.clear();
+    job.targetStamps.clear();
+    job.attempts = 0;
+    job.imageStamp = job.kind == "image" ? stampOf(job.imagePath) : QString();
+    job.submitted = QDateTime::currentDateTimeUtc();
+    job.started = QDateTime();
+    job.finished = QDateTime();
+    const qint64 id = job.id;
+    jobList.emplace(id, job);
+    if (journal) journal->recordSubmitted(job);
+    qDebug() << "Queued job" << id << ":" << job.kind << job.drives;
+    emit jobChanged(job);
+    return id;
+}
+
+bool JobQueue::cancel(qint64 id) {
+    const auto it = jobList.find(id);
+    if (it == jobList.end() || it->second.isFinished()) {
+        return false;
+    }
+    Job &job = it->second;
+    if (job.state == JobState::Queued) {
+        job.state = JobState::Cancelled;
+        job.finished = QDateTime::currentDateTimeUtc();
+        if (journal) journal->recordFinished(job);
+        emit jobChanged(job);
+        pruneHistory();
+        startReady(); // Jobs held back behind it may go now
+        return true;
+    }
+    cancelRequested.insert(id);
+    running.value(id)->cancel(); // It reports back through writeCompleted
+    return true;
+}
+
+void JobQueue::setMaxRunning(int count) {
+    maxRunning = qMax(0, count);
+    startReady();
+}
+
+bool JobQueue::assign(qint64 id, const QString &drive) {
+    const auto it = jobList.find(id);
+    if (it == jobList.end() || it->second.state != JobState::Queued || !it->second.isPooled()) {
+        return false;
+    }
+    Job &job = it->second;
+    const QStringList drives = drive.isEmpty() ? QStringList() : QStringList{drive};
+    if (job.drives == drives) {
+        return true;
+    }
+    for (const auto &[otherId, other] : jobList) {
+        if (otherId != id && !other.isFinished() && other.drives.contains(drive)) {
+            return false;
+        }
+    }
+    job.drives = drives;
+    if (journal) journal->recordSubmitted(job);
+    qDebug() << "Job" << id << "assigned to" << (drive.isEmpty() ? QString("no drive") : drive);
+    emit jobChanged(job);
+    QMetaObject::invokeMethod(this, &JobQueue::startReady, Qt::QueuedConnection);
+    return true;
+}
+
+bool JobQueue::setRank(qint64 id, int rank) {
+    const auto it = jobList.find(id);
+    if (it == jobList.end() || it->second.state != JobState::Queued) {
+        return false;
+    }
+    it->second.rank = rank;
+    return true;
+}
+
+bool JobQueue::attachJournal(JobJournal *journal, QString *errorMessage) {
+    QList<Job> unfinished;
+    if (!journal->open(&unfinished, errorMessage)) {
+        return false;
+    }
+    this->journal = journal;
+
+    for (Job job : unfinished) {
+        if (!job.checkpoints.isEmpty() && stampOf(job.imagePath) != job.imageStamp) {
+            qDebug() << "Image of job" << job.id << "changed since it was interrupted; writing it from the start";
+            job.checkpoints.clear();
+            job.targetStamps.clear();
+        }
+        job.state = JobState::Queued;
+        job.percentage = 0;
+        job.message = tr("Resumed after a restart");
+        job.progress = ProgressRecord();
+        job.started = QDateTime();
+        nextId = std::max(nextId, job.id + 1);
+        qDebug() << "Resuming job" << job.id << ":" << job.kind << job.drives << job.checkpoints;
+        jobList.emplace(job.id, job);
+        emit jobChanged(job);
+    }
+    QMetaObject::invokeMethod(this, &JobQueue::startReady, Qt::QueuedConnection);
+    return true;
+}
+
+QList<Job> JobQueue::jobs() const {
+    QList<Job> list;
+    list.reserve(qsizetype(jobList.size()));
+    for (const auto &[id, job] : jobList) {
+        list.append(job);
+    }
+    return list;
+}
+
+const Job *JobQueue::find(qint64 id) const {
+    const auto it = jobList.find(id);
+    return it == jobList.end() ? nullptr : &it->second;
+}
+
+void JobQueue::startReady() {
+    // One job per pass: each start changes the link loads the next choice depends on
+    while (maxRunning <= 0 || running.size() < maxRunning) {
+        // A queued job also holds its drives against later jobs, so each drive is served in submission order
+        QSet<QString> claimed = busyDrives;
+        Job *best = nullptr;
+        double bestUtilization = 0;
+        auto better = [&best, &bestUtilization](const Job &job, double utilization) {
+            if (!best || job.rank != best->rank) return !best || job.rank < best->rank;
+            return utilization < bestUtilization;
+        };
+        for (auto &[id, job] : jobList) {
+            if (job.state != JobState::Queued) {
+                continue;
+            }
+            const Readiness ready = readiness(job);
+            if (ready == Readiness::Blocked) {
+                skip(job);
+                continue;
+            }
+            const bool free = std::none_of(job.drives.cbegin(), job.drives.cend(),
+                                           [&claimed](const QString &drive) { return claimed.contains(drive); });
+            for (const QString &drive : job.drives) claimed.insert(drive);
+            double utilization = 0;
+            if (free && ready == Readiness::Ready && fitsBandwidth(job, &utilization) && better(job, utilization)) {
+                best = &job;
+                bestUtilization = utilization;
+            }
+        }
+        if (!best || !launch(*best)) {
+            return; // A failed launch has run startReady() again from finish()
+        }
+    }
+}
+
+JobQueue::Readiness JobQueue::readiness(const Job &job) const {
+    Readiness ready = job.drives.isEmpty() ? Readiness::Waiting : Readiness::Ready; // Pooled, not assigned yet
+    for (const qint64 after : job.after) {
+        const Job *other = find(after);
+        if (!other) {
+            continue; // Long finished and pruned from the history
+        }
+        if (other->state == JobState::Failed || other->state == JobState::Cancelled) {
+            return Readiness::Blocked;
+        }
+        if (other->state != JobState::Succeeded) {
+            ready = Readiness::Waiting;
+        }
+    }
+    return ready;
+}
+
+void JobQueue::skip(Job &job) {
+    // Finished without running; the history is pruned on the next finish
+    job.state = JobState::Failed;
+    job.message = tr("Skipped: a job it waits for did not succeed");
+    job.finished = QDateTime::currentDateTimeUtc();
+    if (journal) journal->recordFinished(job);
+    qDebug() << "Job" << job.id << "skipped";
+    emit jobChanged(job);
+}
+
+bool JobQueue::launch(Job &job) {
+    auto *utility = new DiskUtility(this);
+    job.state = JobState::Running;
+    job.started = QDateTime::currentDateTimeUtc();
+    ++job.attempts;
+    running.insert(job.id, utility);
+    for (const QString &drive : job.drives) {
+        busyDrives.insert(drive);
+    }
+    const QHash<QString, double> demand = demandOf(job);
+    for (auto it = demand.cbegin(); it != demand.cend(); ++it) {
+        linkLoad[it.key()] += it.value();
+    }
+    reservations.insert(job.id, demand);
+    emit jobChanged(job);
+    if (!start(job, utility)) {
+        finish(job.id, false, tr("The %1 job could not be started.").arg(job.kind));
+        return false;
+    }
+    return true;
+}
+
+bool JobQueue::start(Job &job, DiskUtility *utility) {
+    const qint64 id = job.id;
+    connect(utility, &DiskUtility::progressUpdated, this, [this, id](int percentage, const QString &message) {
+        const auto it = jobList.find(id);
+        if (it == jobList.end() || it->second.state != JobState::Running) return;
+        it->second.percentage = percentage;
+        it->second.message = message;
+        emit jobChanged(it->second);
+    });
+    connect(utility, &DiskUtility::transferProgress, this, [this, id](const ProgressRecord &record) {
+        const auto it = jobList.find(id);
+        if (it == jobList.end() || it->second.state != JobState::Running) return;
+        it->second.progress = record; // Sent with the next progressUpdated, which follows right away
+    });
+    connect(utility, &DiskUtility::checkpointReached, this, [this, id](const QString &drivePath, qint64 offset) {
+        const auto it = jobList.find(id);
+        if (it == jobList.end() || it->second.state != JobState::Running) return;
+        it->second.checkpoints[drivePath] = offset;
+        if (journal) journal->recordCheckpoint(id, drivePath, offset, it->second.targetStamps.value(drivePath));
+    });
+    connect(utility, &DiskUtility::writeCompleted, this, [this, id](bool success, const QString &errorMessage) {
+        finish(id, success, errorMessage);
+    });
+
+    qDebug() << "Starting job" << id << ":" << job.kind << job.drives;
+    const QString &drive = job.drives.first();
+    if (job.kind == "image") {
+        // A checkpoint is only worth something on the stick it was written to
+        const QString target = targetStampOf(drive);
+        if (job.checkpoints.contains(drive) && (target.isEmpty() || job.targetStamps.value(drive) != target)) {
+            qDebug() << "Drive" << drive << "of job" << job.id << "is not the one it was interrupted on; writing it from the start";
+            job.checkpoints.remove(drive);
+        }
+        job.targetStamps.insert(drive, target);
+        QVariantMap options = job.options;
+        if (job.checkpoints.contains(drive)) options["resumeOffset"] = job.checkpoints.value(drive);
+        return utility->startImageWrite(job.imagePath, drive, options);
+    }
+    if (job.kind == "backup") return utility->startDriveBackup(drive, job.imagePath, job.options);
+    if (job.kind == "clone") return utility->startDriveClone(drive, job.drives.mid(1), job.options);
+    if (job.kind == "erase") return utility->startDriveErase(job.drives, job.options);
+    if (job.kind == "capacity") return utility->startCapacityCheck(drive);
+    return false;
+}
+
+void JobQueue::finish(qint64 id, bool success, const QString &errorMessage) {
+    const auto it = jobList.find(id);
+    if (it == jobList.end() || it->second.state != JobState::Running) {
+        return;
+    }
+    Job &job = it->second;
+    const QStringList drives = job.drives;
+    const bool retry = !success && !cancelRequested.contains(id) && job.isPooled() && job.attempts < kPooledAttempts;
+    if (success) {
+        job.state = JobState::Succeeded;
+        job.percentage = 100;
+    } else if (retry) {
+        job.state = JobState::Queued;
+        job.message = tr("Failed on %1 (%2); waiting for another drive").arg(drives.join(", "), errorMessage);
+        job.drives.clear();
+        job.checkpoints.clear();
+        job.targetStamps.clear();
+        job.percentage = 0;
+        job.progress = ProgressRecord();
+        job.started = QDateTime();
+    } else {
+        job.state = cancelRequested.contains(id) ? JobState::Cancelled : JobState::Failed;
+        job.message = errorMessage;
+    }
+    if (retry) {
+        if (journal) journal->recordSubmitted(job);
+        qDebug() << "Job" << id << "failed on" << drives << ", queued again:" << errorMessage;
+    } else {
+        job.finished = QDateTime::currentDateTimeUtc();
+        if (journal) journal->recordFinished(job);
+        qDebug() << "Job" << id << Job::stateName(job.state) << (success ? QString() : errorMessage);
+    }
+
+    cancelRequested.remove(id);
+    for (const QString &drive : drives) {
+        busyDrives.remove(drive);
+        driveSlots.remove(drive);
+    }
+    const QHash<QString, double> reserved = reservations.take(id);
+    for (auto it = reserved.cbegin(); it != reserved.cend(); ++it) {
+        linkLoad[it.key()] -= it.value();
+        if (linkLoad[it.key()] < 1.0) linkLoad.remove(it.key()); // Rounding leftovers
+    }
+    if (DiskUtility *utility = running.take(id)) {
+        utility->deleteLater(); // Its worker thread may still be unwinding after the signal
+    }
+    emit jobChanged(job);
+    pruneHistory();
+    startReady();
+}
+
+const JobQueue::DriveSlot &JobQueue::slotOf(const QString &drive) {
+    const auto cached = driveSlots.constFind(drive);
+    if (cached != driveSlots.cend()) {
+        return *cached;
+    }
+
+    DriveSlot slot;
+    slot.usb = UsbTopology::locate(drive);
+    slot.bytesPerSecond = expectedBytesPerSecond(DeviceProfileStore().find(enumerator->modelOf(drive)), slot.usb);
+    if (slot.usb.isValid()) {
+        for (const UsbLink &link : slot.usb.upstream) {
+            linkCapacity.insert(link.name, link.bytesPerSecond());
+        }
+        qDebug() << "Drive" << drive << "is USB device" << slot.usb.device << "at" << slot.usb.speedMbps
+                 << "Mbit/s on root port" << slot.usb.rootPort() << ", expected" << slot.bytesPerSecond / 1e6 << "MB/s";
+    }
+    return *driveSlots.insert(drive, slot);
+}
+
+double JobQueue::expectedBytesPerSecond(const std::optional<DeviceProfile> &profile, const UsbLocation &usb) {
+    double bytesPerSecond = profile && profile->sustainedBytesPerSecond > 0 ? profile->sustainedBytesPerSecond
+                                                                          : kDefaultDriveBytesPerSecond;
+    // A stick cannot go faster than its own link
+    const double ownLink = UsbLink{usb.device, usb.speedMbps}.bytesPerSecond();
+    if (usb.isValid() && ownLink > 0) bytesPerSecond = std::min(bytesPerSecond, ownLink);
+    return bytesPerSecond;
+}
+
+QHash<QString, double> JobQueue::demandOf(const Job &job) {
+    QHash<QString, double> demand;
+    for (const QString &drive : job.drives) {
+        const DriveSlot &slot = slotOf(drive);
+        for (const UsbLink &link : slot.usb.upstream) {
+            demand[link.name] += slot.bytesPerSecond;
+        }
+    }
+    return demand;
+}
+
+bool JobQueue::fitsBandwidth(const Job &job, double *utilization) {
+    *utilization = 0;
+    const QHash<QString, double> demand = demandOf(job);
+    for (auto it = demand.cbegin(); it != demand.cend(); ++it) {
+        const double capacity = linkCapacity.value(it.key());
+        if (capacity <= 0) {
+            continue; // Speed unknown: no basis for holding the job back
+        }
+        const double load = linkLoad.value(it.key());
+        if (load > 0 && load + it.value() > capacity) {
+            return false;
+        }
+        *utilization = std::max(*utilization, (load + it.value()) / capacity);
+    }
+    return true;
+}
+
+QString JobQueue::stampOf(const QString &imagePath) {
+    const QFileInfo info(imagePath);
+    return info.exists() ? QString("%1:%2").arg(info.size()).arg(info.lastModified().toMSecsSinceEpoch()) : QString();
+}
+
+QString JobQueue::targetStampOf(const QString &drive) {
+    const DriveIdentity identity = DiskUtility::identify(drive);
+    return identity.isValid() ? QString("%1:%2:%3").arg(identity.size).arg(identity.model, identity.serial) : QString();
+}
+
+void JobQueue::pruneHistory() {
+    qsizetype finishedCount = std::count_if(jobList.cbegin(), jobList.cend(),
+                                            [](const auto &entry) { return entry.second.isFinished(); });
+    for (auto it = jobList.begin(); it != jobList.end() && finishedCount > kHistorySize;) {
+        if (it->second.isFinished()) {
+            it = jobList.erase(it);
+            --finishedCount;
+        } else {
+            ++it;
+        }
+    }
+}
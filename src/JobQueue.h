@@ -0,0 +1,206 @@
+#ifndef JOBQUEUE_H
+#define JOBQUEUE_H
+
+#include "DeviceProfile.h"
+#include "ProgressRecord.h"
+#include "UsbTopology.h"
+#include <QDateTime>
+#include <QHash>
+#include <QJsonObject>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+#include <map>
+
+class DiskUtility;
+class JobJournal;
+
+enum class JobState {
+    Queued,
+    Running,
+    Succeeded,
+    Failed,
+    Cancelled
+};
+
+/**
+ * @brief A unit of work for the burn station: one DiskUtility operation and its outcome.
+ */
+struct Job {
+    qint64 id = 0;          // Assigned by JobQueue::submit
+    QString kind;           // "image", "backup", "clone", "erase" or "capacity"
+    QString imagePath;      // Image to write ("image") or to create ("backup")
+    QStringList drives;     // Drives the job uses; for "clone" the source comes first
+    QVariantMap options;    // As for the matching DiskUtility::start* call
+    QMap<QString, qint64> checkpoints; // Durable high-water mark per target drive (see DiskUtility::checkpointReached)
+    QString imageStamp;     // Size and modification time of the image at submission; checkpoints only hold for it
+    QMap<QString, QString> targetStamps; // Size, model and serial of each checkpointed drive; its checkpoint only holds for it
+    qint64 batch = 0;       // Id of the batch's first job (see JobQueue::submitBatch); 0 if submitted alone
+    QList<qint64> after;    // Jobs that must succeed before this one starts
+    QJsonObject pool;       // Pooled image jobs: the drives BatchScheduler may pick from (see TargetSelector::toJson)
+    int rank = 0;           // Planned start order (see BatchScheduler); lower goes first, 0 for unplanned jobs
+    int attempts = 0;       // Times the job has been started
+    JobState state = JobState::Queued;
+    int percentage = 0;
+    QString message;        // Last status line, or the error once failed
+    ProgressRecord progress;
+    QDateTime submitted;
+    QDateTime started;
+    QDateTime finished;
+
+    bool isFinished() const { return state != JobState::Queued && state != JobState::Running; }
+    bool isPooled() const { return !pool.isEmpty(); }
+
+    /**
+     * @brief Checks that the kind is known and that it has the paths it needs.
+     *
+     * A pooled image job may have no drive yet; it waits in the queue until it is assigned one.
+     */
+    bool validate(QString *errorMessage = nullptr) const;
+
+    QJsonObject toJson() const;
+    static Job fromJson(const QJsonObject &obj);
+
+    static QString stateName(JobState state);
+};
+
+/**
+ * @brief Runs submitted jobs as soon as the drives they use, and the USB links in front of them, are free.
+ *
+ * Jobs on different drives run concurrently, each on its own DiskUtility so
+ * their progress and cancellation stay apart; a job waits while any of its
+ * drives is in use by an earlier one. Finished jobs are kept (up to
+ * kHistorySize) so clients can still ask how they ended.
+ *
+ * Drives behind one hub or root port share its bandwidth (see UsbTopology):
+ * twenty sticks behind a USB 3 hub get about 450 MB/s between them, and
+ * starting them all at once only makes them stall each other. Each running
+ * drive therefore reserves its expected throughput (its model's sustained
+ * rate from DeviceProfileStore, or kDefaultDriveBytesPerSecond) on every
+ * link up to the host, and a job only starts while the links it needs have
+ * room; a link with nothing running admits any job, so no job waits forever.
+ * Of the jobs that fit, the one whose busiest link is least loaded goes
+ * first, which spreads work over idle root ports before doubling up.
+ *
+ * Planned jobs (see BatchScheduler) start in the order of their rank, ahead
+ * of which go unplanned ones. A pooled job that fails is queued again
+ * without a drive, up to kPooledAttempts times: with a choice of sticks, a bad
+ * stick is a likelier culprit than the image.
+ *
+ * Lives on the thread that created it; DiskUtility's worker threads report back
+ * through queued signals.
+ */
+class JobQueue : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr int kHistorySize = 200;
+    static constexpr double kDefaultDriveBytesPerSecond = 30e6; // A typical stick's sustained write rate
+    static constexpr int kPooledAttempts = 3;
+
+    explicit JobQueue(QObject *parent = nullptr);
+
+    /**
+     * @brief Queues a job and starts it if its drives are free.
+     * @return The job id, or 0 (with a description) if the job is invalid.
+     */
+    qint64 submit(Job job, QString *errorMessage = nullptr);
+
+    /**
+     * @brief Queues several jobs at once (e.g., from JobManifest::expand), so they are scheduled as a whole.
+     *
+     * Ids in the jobs' "after" lists are positions in the list, counted from 1;
+     * they are replaced with the real ids. Nothing is queued if any job is invalid.
+     *
+     * @return The jobs' ids, in order, or an empty list.
+     */
+    QList<qint64> submitBatch(QList<Job> jobs, QString *errorMessage = nullptr);
+
+    /**
+     * @brief Drops a queued job, or asks a running one to stop.
+     * @return False if there is no such job or it has already finished.
+     */
+    bool cancel(qint64 id);
+
+    /**
+     * @brief Limits how many jobs run at once; 0 (the default) leaves it to the drives.
+     */
+    void setMaxRunning(int count);
+    int runningLimit() const { return maxRunning; }
+
+    /**
+     * @brief Gives a queued pooled job its drive, or takes it back with an empty one.
+     * @return False if the job is not queued and pooled, or the drive is taken by another unfinished job.
+     */
+    bool assign(qint64 id, const QString &drive);
+
+    /**
+     * @brief Sets the planned start order of a queued job.
+     */
+    bool setRank(qint64 id, int rank);
+
+    /**
+     * @brief Write rate to expect from a drive: its model's sustained rate, capped by its own USB link.
+     */
+    static double expectedBytesPerSecond(const std::optional<DeviceProfile> &profile, const UsbLocation &usb);
+
+    /**
+     * @brief Makes the queue persistent and takes back the jobs an earlier run left unfinished.
+     *
+     * Interrupted image writes resume from their last checkpoint if the image
+     * is unchanged and the same stick is still at the drive's path; other
+     * interrupted jobs start over. Call before submitting
+     * anything; the journal must outlive the queue.
+     */
+    bool attachJournal(JobJournal *journal, QString *errorMessage = nullptr);
+
+    QList<Job> jobs() const;
+    const Job *find(qint64 id) const;
+
+signals:
+    /**
+     * @brief Emitted whenever a job changes state or reports progress.
+     */
+    void jobChanged(const Job &job);
+
+private:
+    struct DriveSlot {
+        UsbLocation usb;
+        double bytesPerSecond = 0; // Expected throughput of the drive
+    };
+
+    enum class Readiness { Ready, Waiting, Blocked };
+
+    qint64 enqueue(Job job);
+    void startReady();
+    Readiness readiness(const Job &job) const;
+    void skip(Job &job);
+    bool launch(Job &job);
+    bool start(Job &job, DiskUtility *utility);
+    const DriveSlot &slotOf(const QString &drive);
+    QHash<QString, double> demandOf(const Job &job);
+    bool fitsBandwidth(const Job &job, double *utilization);
+    void finish(qint64 id, bool success, const QString &errorMessage);
+    void pruneHistory();
+    static QString stampOf(const QString &imagePath);
+    static QString targetStampOf(const QString &drive);
+
+    std::map<qint64, Job> jobList; // By id, which is submission order
+    QHash<qint64, DiskUtility *> running;
+    QSet<qint64> cancelRequested;
+    QSet<QString> busyDrives;
+    DiskUtility *enumerator;              // Looks up drive models for their profiles
+    QHash<QString, DriveSlot> driveSlots; // Forgotten when a job on the drive ends; sticks get swapped
+    QHash<QString, double> linkCapacity;  // Bytes per second, by UsbLink::name
+    QHash<QString, double> linkLoad;      // Reserved by running jobs
+    QHash<qint64, QHash<QString, double>> reservations;
+    JobJournal *journal = nullptr;
+    qint64 nextId = 1;
+    int maxRunning = 0;
+};
+
+#endif // JOBQUEUE_H
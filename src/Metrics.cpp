@@ -0,0 +1,231 @@
+#include "Metrics.h"
+#include "IoStats.h"
+#include <QDebug>
+#include <QHostAddress>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+namespace {
+const int kMaxRequest = 4096;
+
+QByteArray label(const QString &value) {
+    QByteArray escaped = value.toUtf8();
+    escaped.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n");
+    return '"' + escaped + '"';
+}
+
+void family(QByteArray &out, const char *name, const char *type, const char *help) {
+    out += QByteArray("# HELP ") + name + ' ' + help + '\n';
+    out += QByteArray("# TYPE ") + name + ' ' + type + '\n';
+}
+
+QByteArray httpResponse(const QByteArray &status, const QByteArray &contentType, const QByteArray &body) {
+    return "HTTP/1.1 " + status + "\r\nContent-Type: " + contentType + "\r\nContent-Length: "
+           + QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+}
+} // namespace
+
+// --- Implementation of Metrics ---
+
+Metrics &Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::Device *Metrics::device(const QString &path) {
+    QMutexLocker locker(&mutex);
+    std::unique_ptr<Device> &entry = devices[path];
+    if (!entry) {
+        entry = std::make_unique<Device>();
+    }
+    return entry.get();
+}
+
+void Metrics::attachIoStats(const QString &path, IoStats *stats) {
+    Device *target = device(path);
+    QMutexLocker locker(&mutex);
+    if (IoStats *previous = attached.take(path)) {
+        const IoHistograms histograms = previous->merged();
+        target->writtenBytes += qint64(histograms.writeSize.valueSum());
+        target->readBytes += qint64(histograms.readSize.valueSum());
+    }
+    if (stats) {
+        attached.insert(path, stats);
+    }
+}
+
+void Metrics::jobStarted() {
+    ++activeJobs;
+}
+
+void Metrics::jobFinished(const QString &kind, bool success, qint64 bytes, qint64 milliseconds) {
+    --activeJobs;
+    {
+        QMutexLocker locker(&mutex);
+        ++jobs[kind + '\n' + (success ? "success" : "failure")];
+    }
+    if (!success || bytes <= 0 || milliseconds <= 0) {
+        return;
+    }
+    const qint64 rate = bytes * 1000 / milliseconds;
+    for (size_t i = 0; i < kThroughputBuckets.size(); ++i) {
+        if (rate <= kThroughputBuckets[i]) ++throughputBuckets[i]; // Cumulative, as Prometheus expects
+    }
+    ++throughputCount;
+    throughputSum += rate;
+}
+
+QByteArray Metrics::exposition() const {
+    QMutexLocker locker(&mutex);
+    QByteArray out;
+
+    family(out, "inferno_active_jobs", "gauge", "Jobs currently running.");
+    out += "inferno_active_jobs " + QByteArray::number(activeJobs.load()) + '\n';
+
+    family(out, "inferno_jobs_total", "counter", "Finished jobs by kind and result.");
+    for (auto it = jobs.cbegin(); it != jobs.cend(); ++it) {
+        const QStringList parts = it.key().split('\n');
+        out += "inferno_jobs_total{kind=" + label(parts.value(0)) + ",result=" + label(parts.value(1)) + "} "
+               + QByteArray::number(it.value()) + '\n';
+    }
+
+    // Running jobs' byte counts come from their IoStats, as of now
+    QHash<QString, IoHistograms> live;
+    for (auto it = attached.cbegin(); it != attached.cend(); ++it) {
+        live.insert(it.key(), it.value()->merged());
+    }
+    auto perDevice = [&](const char *name, const char *type, const char *help, auto value) {
+        family(out, name, type, help);
+        for (const auto &[path, device] : devices) {
+            out += QByteArray(name) + "{device=" + label(path) + "} " + QByteArray::number(value(path, *device)) + '\n';
+        }
+    };
+    perDevice("inferno_device_written_bytes_total", "counter", "Bytes written to the device.",
+              [&](const QString &path, const Device &device) {
+                  const auto it = live.constFind(path);
+                  return device.writtenBytes.load() + (it == live.cend() ? 0 : qint64(it->writeSize.valueSum()));
+              });
+    perDevice("inferno_device_read_bytes_total", "counter", "Bytes read from the device.",
+              [&](const QString &path, const Device &device) {
+                  const auto it = live.constFind(path);
+                  return device.readBytes.load() + (it == live.cend() ? 0 : qint64(it->readSize.valueSum()));
+              });
+    perDevice("inferno_device_queue_depth", "gauge", "Write requests the adaptive queue allows in flight.",
+              [](const QString &, const Device &device) { return qint64(device.queueDepth.load()); });
+    perDevice("inferno_device_throughput_bytes", "gauge", "Smoothed throughput of the running job, in bytes per second.",
+              [](const QString &, const Device &device) { return device.bytesPerSecond.load(); });
+    perDevice("inferno_device_verify_failures_total", "counter", "Capacity check read-backs that did not match.",
+              [](const QString &, const Device &device) { return device.verifyFailures.load(); });
+
+    family(out, "inferno_device_write_latency_seconds", "summary", "Write completion latency of the running job.");
+    for (auto it = live.cbegin(); it != live.cend(); ++it) {
+        const HdrHistogram &latency = it->writeLatency;
+        const QByteArray device = "device=" + label(it.key());
+        for (const double quantile : {0.5, 0.9, 0.99, 0.999}) {
+            out += "inferno_device_write_latency_seconds{" + device + ",quantile=\"" + QByteArray::number(quantile)
+                   + "\"} " + QByteArray::number(double(latency.valueAtPercentile(quantile * 100.0)) / 1e6) + '\n';
+        }
+        out += "inferno_device_write_latency_seconds_sum{" + device + "} "
+               + QByteArray::number(double(latency.valueSum()) / 1e6) + '\n';
+        out += "inferno_device_write_latency_seconds_count{" + device + "} " + QByteArray::number(latency.count()) + '\n';
+    }
+
+    family(out, "inferno_job_throughput_bytes", "histogram", "Average throughput of successful jobs, in bytes per second.");
+    for (size_t i = 0; i < kThroughputBuckets.size(); ++i) {
+        out += "inferno_job_throughput_bytes_bucket{le=\"" + QByteArray::number(kThroughputBuckets[i]) + "\"} "
+               + QByteArray::number(throughputBuckets[i].load()) + '\n';
+    }
+    out += "inferno_job_throughput_bytes_bucket{le=\"+Inf\"} " + QByteArray::number(throughputCount.load()) + '\n';
+    out += "inferno_job_throughput_bytes_sum " + QByteArray::number(throughputSum.load()) + '\n';
+    out += "inferno_job_throughput_bytes_count " + QByteArray::number(throughputCount.load()) + '\n';
+    return out;
+}
+
+// --- Implementation of MetricsServer ---
+
+MetricsServer::MetricsServer(QObject *parent) : QObject(parent) {
+}
+
+bool MetricsServer::listen(quint16 port) {
+    if (!tcpServer) {
+        tcpServer = new QTcpServer(this);
+        connect(tcpServer, &QTcpServer::newConnection, this, [this]() {
+            while (QTcpSocket *socket = tcpServer->nextPendingConnection()) {
+                serve(socket);
+            }
+        });
+    }
+    // Metrics are for the local agent only; never listen on a public interface
+    if (!tcpServer->listen(QHostAddress::LocalHost, port)) {
+        qDebug() << "Metrics server failed to listen:" << tcpServer->errorString();
+        return false;
+    }
+    qDebug() << "Metrics server listening on 127.0.0.1 port" << tcpServer->serverPort();
+    return true;
+}
+
+bool MetricsServer::listenLocal(const QString &name) {
+    if (!localServer) {
+        localServer = new QLocalServer(this);
+        connect(localServer, &QLocalServer::newConnection, this, [this]() {
+            while (QLocalSocket *socket = localServer->nextPendingConnection()) {
+                serve(socket);
+            }
+        });
+    }
+    QLocalServer::removeServer(name); // A stale socket file from a crashed run
+    if (!localServer->listen(name)) {
+        qDebug() << "Metrics server failed to listen on" << name << ":" << localServer->errorString();
+        return false;
+    }
+    qDebug() << "Metrics server listening on" << localServer->fullServerName();
+    return true;
+}
+
+quint16 MetricsServer::serverPort() const {
+    return tcpServer ? tcpServer->serverPort() : 0;
+}
+
+void MetricsServer::serve(QIODevice *connection) {
+    // One request per connection; the socket is deleted once the response has been flushed
+    auto close = [connection]() {
+        if (auto *socket = qobject_cast<QTcpSocket *>(connection)) {
+            socket->disconnectFromHost();
+        } else if (auto *local = qobject_cast<QLocalSocket *>(connection)) {
+            local->disconnectFromServer();
+        }
+    };
+    auto release = [this, connection]() {
+        pending.remove(connection);
+        connection->deleteLater();
+    };
+    if (auto *socket = qobject_cast<QTcpSocket *>(connection)) {
+        connect(socket, &QTcpSocket::disconnected, this, release);
+    } else if (auto *local = qobject_cast<QLocalSocket *>(connection)) {
+        connect(local, &QLocalSocket::disconnected, this, release);
+    }
+
+    connect(connection, &QIODevice::readyRead, this, [this, connection, close]() {
+        QByteArray &request = pending[connection];
+        request.append(connection->readAll());
+        if (!request.contains("\r\n\r\n") && !request.contains("\n\n")) {
+            if (request.size() > kMaxRequest) close();
+            return; // Headers not complete yet
+        }
+        const QList<QByteArray> requestLine = request.left(request.indexOf('\n')).trimmed().split(' ');
+        const QByteArray method = requestLine.value(0);
+        const QByteArray path = requestLine.value(1);
+        request.clear();
+        if (method == "GET" && (path == "/metrics" || path.startsWith("/metrics?"))) {
+            connection->write(httpResponse("200 OK", "text/plain; version=0.0.4; charset=utf-8",
+                                           Metrics::instance().exposition()));
+        } else {
+            connection->write(httpResponse("404 Not Found", "text/plain", "Only GET /metrics is served.\n"));
+        }
+        close();
+    });
+}
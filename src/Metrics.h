@@ -0,0 +1,136 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
+
+class IoStats;
+class QIODevice;
+class QLocalServer;
+class QTcpServer;
+
+/**
+ * @brief Process-wide counters and gauges of the burn engine, in Prometheus text format.
+ *
+ * DiskUtility keeps them up to date as jobs start, report progress and end;
+ * the writer threads themselves never touch them. Bytes moved and latency
+ * quantiles are read from the IoStats a running job has attached (atomics
+ * only), and folded into per-device totals when the job ends, so a scrape
+ * costs the hot path nothing.
+ *
+ * Exported families:
+ *
+ *   inferno_active_jobs                           gauge
+ *   inferno_jobs_total{kind,result}               counter
+ *   inferno_device_written_bytes_total{device}    counter
+ *   inferno_device_read_bytes_total{device}       counter
+ *   inferno_device_queue_depth{device}            gauge (requests in flight allowed)
+ *   inferno_device_throughput_bytes{device}       gauge (bytes per second, smoothed)
+ *   inferno_device_verify_failures_total{device}  counter (fake-capacity read-back mismatches)
+ *   inferno_device_write_latency_seconds{device,quantile}  summary of the running job
+ *   inferno_job_throughput_bytes                  histogram of whole-job average throughput
+ *
+ * Thread-safe.
+ */
+class Metrics {
+public:
+    /**
+     * @brief Live figures of one device. Addresses are stable, so callers may keep the pointer.
+     */
+    struct Device {
+        std::atomic<qint64> writtenBytes{0}; // Of finished jobs; the running job's IoStats adds to it
+        std::atomic<qint64> readBytes{0};
+        std::atomic<int> queueDepth{0};
+        std::atomic<qint64> bytesPerSecond{0};
+        std::atomic<qint64> verifyFailures{0};
+    };
+
+    // Upper bounds of the job throughput histogram, in bytes per second
+    static constexpr std::array<qint64, 10> kThroughputBuckets = {
+        1LL << 20, 2LL << 20, 5LL << 20, 10LL << 20, 20LL << 20,
+        40LL << 20, 80LL << 20, 160LL << 20, 320LL << 20, 640LL << 20};
+
+    static Metrics &instance();
+
+    /**
+     * @brief The figures of a device, created on first use.
+     */
+    Device *device(const QString &path);
+
+    /**
+     * @brief Makes a running job's I/O statistics visible to scrapes; null detaches them.
+     *
+     * Detaching adds the bytes they counted to the device totals, so
+     * detach before the IoStats is destroyed.
+     */
+    void attachIoStats(const QString &path, IoStats *stats);
+
+    void jobStarted();
+
+    /**
+     * @brief Counts a finished job of kind ("image", "backup", ...) and its average throughput.
+     */
+    void jobFinished(const QString &kind, bool success, qint64 bytes, qint64 milliseconds);
+
+    /**
+     * @brief All metrics in the Prometheus text exposition format (version 0.0.4).
+     */
+    QByteArray exposition() const;
+
+private:
+    Metrics() = default;
+
+    mutable QMutex mutex; // Guards the maps, not the atomics inside them
+    std::map<QString, std::unique_ptr<Device>> devices;
+    QHash<QString, IoStats *> attached;
+    QHash<QString, qint64> jobs; // "kind\nresult" -> count
+    std::atomic<int> activeJobs{0};
+    std::array<std::atomic<qint64>, kThroughputBuckets.size()> throughputBuckets{};
+    std::atomic<qint64> throughputCount{0};
+    std::atomic<qint64> throughputSum{0};
+};
+
+/**
+ * @brief Serves Metrics::exposition() to Prometheus over HTTP on localhost or a local socket.
+ *
+ * Only "GET /metrics" is answered; the connection is closed after every
+ * response. The local socket variant suits stations where no TCP port may
+ * be opened (scrape with, e.g., curl --unix-socket).
+ */
+class MetricsServer : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr quint16 kDefaultPort = 9464;
+
+    explicit MetricsServer(QObject *parent = nullptr);
+
+    /**
+     * @brief Listens on 127.0.0.1.
+     * @param port TCP port (0 picks a free port, see serverPort()).
+     */
+    bool listen(quint16 port = kDefaultPort);
+
+    /**
+     * @brief Listens on a local socket (a Unix domain socket path, or a named pipe on Windows).
+     */
+    bool listenLocal(const QString &name);
+
+    quint16 serverPort() const;
+
+private:
+    void serve(QIODevice *connection);
+
+    QTcpServer *tcpServer = nullptr;
+    QLocalServer *localServer = nullptr;
+    QHash<QIODevice *, QByteArray> pending; // Partial requests per connection
+};
+
+#endif // METRICS_H
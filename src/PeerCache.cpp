@@ -0,0 +1,335 @@
+#include "PeerCache.h"
+#include "ImageLibrary.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThreadPool>
+#include <QFile>
+#include <QSet>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QDebug>
+
+namespace {
+const int kMaxRequestLine = 256;
+const qint64 kMaxPayload = 64LL * 1024 * 1024;
+const int kIoTimeoutMs = 10000;
+// Disk reads serving peers at once; more would only compete with a running burn
+const int kChunkReaderThreads = 4;
+// Requests read ahead per connection before earlier responses must be sent
+const quint64 kMaxRequestsInFlight = 64;
+
+QByteArray okResponse(const QByteArray &payload) {
+    return "OK " + QByteArray::number(payload.size()) + "\n" + payload;
+}
+
+QByteArray errorResponse(const QByteArray &message) {
+    return "ERR " + message + "\n";
+}
+} // namespace
+
+// --- Implementation of PeerCacheServer ---
+
+PeerCacheServer::PeerCacheServer(ImageLibrary *library, QObject *parent)
+    : QObject(parent), library(library), server(new QTcpServer(this)), chunkReaders(new QThreadPool(this)) {
+    chunkReaders->setMaxThreadCount(kChunkReaderThreads);
+    connect(server, &QTcpServer::newConnection, this, &PeerCacheServer::acceptConnections);
+}
+
+PeerCacheServer::~PeerCacheServer() {
+    // Replies the readers still post are dropped along with this object
+    chunkReaders->waitForDone();
+}
+
+bool PeerCacheServer::listen(const QHostAddress &address, quint16 port, const QByteArray &token) {
+    if (token.isEmpty()) {
+        qDebug() << "Peer cache server not started: no shared token is configured.";
+        return false;
+    }
+    this->token = token;
+    if (!server->listen(address, port)) {
+        qDebug() << "Peer cache server failed to listen:" << server->errorString();
+        return false;
+    }
+    qDebug() << "Peer cache server listening on" << address.toString() << "port" << server->serverPort();
+    return true;
+}
+
+quint16 PeerCacheServer::serverPort() const {
+    return server->serverPort();
+}
+
+void PeerCacheServer::acceptConnections() {
+    while (QTcpSocket *socket = server->nextPendingConnection()) {
+        Connection connection;
+        connection.serial = ++connectionSerial;
+        connections.insert(socket, connection);
+        connect(socket, &QTcpSocket::readyRead, this, &PeerCacheServer::readRequests);
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            connections.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void PeerCacheServer::readRequests() {
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket || !connections.contains(socket)) {
+        return;
+    }
+    connections[socket].buffer.append(socket->readAll());
+    processRequests(socket);
+}
+
+void PeerCacheServer::processRequests(QTcpSocket *socket) {
+    Connection &connection = connections[socket];
+
+    // Stops reading ahead while many responses are outstanding; queueReply's caller resumes
+    qsizetype newline;
+    while (connection.nextRequest - connection.nextReply < kMaxRequestsInFlight
+           && (newline = connection.buffer.indexOf('\n')) >= 0) {
+        const QByteArray line = connection.buffer.left(newline).trimmed();
+        connection.buffer.remove(0, newline + 1);
+        const quint64 sequence = connection.nextRequest++;
+        if (connection.authenticated) {
+            if (line.startsWith("CHUNK ")) {
+                readChunk(socket, sequence, line.mid(6));
+            } else {
+                queueReply(socket, sequence, handleRequest(line));
+            }
+        } else if (line.startsWith("AUTH ") && checkToken(line.mid(5))) {
+            connection.authenticated = true;
+            queueReply(socket, sequence, okResponse(QByteArray()));
+        } else {
+            qDebug() << "Peer cache: refused unauthenticated client" << socket->peerAddress().toString();
+            socket->write(errorResponse("unauthorized"));
+            socket->disconnectFromHost();
+            return;
+        }
+    }
+
+    if (connection.buffer.size() > kMaxRequestLine && connection.buffer.indexOf('\n') < 0) {
+        socket->write(errorResponse("request too long"));
+        socket->disconnectFromHost();
+    }
+}
+
+void PeerCacheServer::readChunk(QTcpSocket *socket, quint64 sequence, const QByteArray &argument) {
+    const QByteArray hash = QByteArray::fromHex(argument);
+    if (hash.size() != 32) {
+        queueReply(socket, sequence, errorResponse("unknown chunk"));
+        return;
+    }
+
+    // Reading from disk can stall behind a burn, so it happens on the pool.
+    // The reader only touches the chunk file; the reply is queued back on
+    // this thread, where a connection that has gone away is skipped.
+    const QString path = ChunkStore::chunkPathInStore(library->chunkStore()->rootPath(), hash);
+    const quint64 serial = connections.value(socket).serial;
+    chunkReaders->start([this, socket, serial, sequence, path]() {
+        QFile file(path);
+        const QByteArray reply = file.open(QIODevice::ReadOnly) ? okResponse(file.readAll())
+                                                                : errorResponse("unknown chunk");
+        QMetaObject::invokeMethod(this, [this, socket, serial, sequence, reply]() {
+            const auto it = connections.constFind(socket);
+            if (it == connections.cend() || it->serial != serial) {
+                return;
+            }
+            queueReply(socket, sequence, reply);
+            processRequests(socket);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void PeerCacheServer::queueReply(QTcpSocket *socket, quint64 sequence, const QByteArray &reply) {
+    Connection &connection = connections[socket];
+    connection.replies.insert(sequence, reply);
+    // Responses go out in request order, whichever read finished first
+    for (auto it = connection.replies.begin(); it != connection.replies.end() && it.key() == connection.nextReply;
+         it = connection.replies.erase(it)) {
+        socket->write(it.value());
+        ++connection.nextReply;
+    }
+}
+
+QByteArray PeerCacheServer::handleRequest(const QByteArray &line) const {
+    const qsizetype space = line.indexOf(' ');
+    const QByteArray command = space < 0 ? line : line.left(space);
+    const QByteArray argument = space < 0 ? QByteArray() : line.mid(space + 1);
+
+    if (command == "LIST") {
+        QJsonArray array;
+        for (const LibraryEntry &entry : library->entries()) {
+            if (!entry.chunked) {
+                continue;
+            }
+            QJsonObject obj;
+            obj["id"] = entry.id;
+            obj["displayName"] = entry.displayName;
+            obj["size"] = QString::number(entry.size);
+            array.append(obj);
+        }
+        return okResponse(QJsonDocument(array).toJson(QJsonDocument::Compact));
+    }
+
+    if (command == "INDEX") {
+        // Only ids from the library are served, never arbitrary paths
+        const LibraryEntry *entry = library->find(QString::fromUtf8(argument));
+        if (!entry || !entry->chunked) {
+            return errorResponse("unknown image");
+        }
+        QFile file(entry->filePath);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return errorResponse("index unavailable");
+        }
+        return okResponse(file.readAll());
+    }
+
+    return errorResponse("unknown command");
+}
+
+bool PeerCacheServer::checkToken(const QByteArray &candidate) const {
+    // Compares every byte, so the time taken does not tell how much of a guess was right
+    if (candidate.size() != token.size()) {
+        return false;
+    }
+    char difference = 0;
+    for (qsizetype i = 0; i < token.size(); ++i) {
+        difference |= char(candidate[i] ^ token[i]);
+    }
+    return difference == 0;
+}
+
+// --- Implementation of PeerCacheClient ---
+
+PeerCacheClient::PeerCacheClient() : socket(new QTcpSocket()) {
+}
+
+PeerCacheClient::~PeerCacheClient() {
+    delete socket;
+}
+
+bool PeerCacheClient::connectToPeer(const PeerAddress &peer, const QByteArray &token, int timeoutMs) {
+    socket->connectToHost(peer.host, peer.port);
+    if (!socket->waitForConnected(timeoutMs)) {
+        lastError = QString("Cannot reach peer %1:%2 (%3)").arg(peer.host).arg(peer.port).arg(socket->errorString());
+        return false;
+    }
+    QByteArray payload;
+    if (!sendRequest("AUTH " + token) || !readResponse(&payload)) {
+        lastError = QString("Peer %1 refused this station: %2").arg(peer.host, lastError);
+        return false;
+    }
+    return true;
+}
+
+bool PeerCacheClient::listImages(QList<PeerImage> *images) {
+    QByteArray payload;
+    if (!sendRequest("LIST") || !readResponse(&payload)) {
+        return false;
+    }
+
+    images->clear();
+    for (const QJsonValue &value : QJsonDocument::fromJson(payload).array()) {
+        const QJsonObject obj = value.toObject();
+        PeerImage image;
+        image.id = obj["id"].toString();
+        image.displayName = obj["displayName"].toString();
+        image.size = obj["size"].toString().toLongLong();
+        images->append(image);
+    }
+    return true;
+}
+
+bool PeerCacheClient::fetchIndex(const QString &id, ChunkIndex *index) {
+    QByteArray payload;
+    if (!sendRequest("INDEX " + id.toUtf8()) || !readResponse(&payload)) {
+        return false;
+    }
+    return ChunkStore::parseIndex(payload, index, &lastError);
+}
+
+bool PeerCacheClient::fetchChunks(const QString &storeRoot, const QList<ChunkRef> &chunks, int window,
+                                  const std::function<void(qint64)> &progress, const std::atomic<bool> *cancelled) {
+    // Skip chunks this station already has (shared with an earlier release)
+    QList<ChunkRef> missing;
+    QSet<QByteArray> requested;
+    qint64 received = 0;
+    for (const ChunkRef &ref : chunks) {
+        if (requested.contains(ref.hash) || QFile::exists(ChunkStore::chunkPathInStore(storeRoot, ref.hash))) {
+            received += ref.size;
+            continue;
+        }
+        requested.insert(ref.hash);
+        missing.append(ref);
+    }
+    if (progress) progress(received);
+
+    // Keep `window` requests in flight so a round trip is never left idle
+    qsizetype sent = 0;
+    for (qsizetype done = 0; done < missing.size(); ++done) {
+        if (cancelled && cancelled->load()) {
+            lastError = "Cancelled";
+            return false;
+        }
+        while (sent < missing.size() && sent - done < window) {
+            if (!sendRequest("CHUNK " + missing[sent].hash.toHex())) {
+                return false;
+            }
+            ++sent;
+        }
+
+        QByteArray data;
+        if (!readResponse(&data)) {
+            return false;
+        }
+        if (!ChunkStore::writeChunkFile(storeRoot, missing[done].hash, data)) {
+            lastError = QString("Chunk %1 failed hash verification").arg(QString::fromLatin1(missing[done].hash.toHex()));
+            return false;
+        }
+        received += data.size();
+        if (progress) progress(received);
+    }
+    return true;
+}
+
+bool PeerCacheClient::sendRequest(const QByteArray &line) {
+    if (socket->write(line + "\n") < 0) {
+        lastError = socket->errorString();
+        return false;
+    }
+    return true;
+}
+
+bool PeerCacheClient::readResponse(QByteArray *payload) {
+    socket->flush();
+    while (!socket->canReadLine()) {
+        if (!socket->waitForReadyRead(kIoTimeoutMs)) {
+            lastError = QString("Peer did not answer: %1").arg(socket->errorString());
+            return false;
+        }
+    }
+
+    const QByteArray header = socket->readLine().trimmed();
+    if (header.startsWith("ERR")) {
+        lastError = QString::fromUtf8(header.mid(4));
+        return false;
+    }
+    bool ok = false;
+    const qint64 length = header.startsWith("OK ") ? header.mid(3).toLongLong(&ok) : -1;
+    if (!ok || length < 0 || length > kMaxPayload) {
+        lastError = "Malformed response from peer";
+        return false;
+    }
+
+    payload->clear();
+    payload->reserve(length);
+    while (payload->size() < length) {
+        if (socket->bytesAvailable() == 0 && !socket->waitForReadyRead(kIoTimeoutMs)) {
+            lastError = QString("Peer connection stalled: %1").arg(socket->errorString());
+            return false;
+        }
+        payload->append(socket->read(length - payload->size()));
+    }
+    return true;
+}
@@ -0,0 +1,147 @@
+#ifndef PEERCACHE_H
+#define PEERCACHE_H
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QMap>
+#include <QByteArray>
+#include <QHostAddress>
+#include <atomic>
+#include <functional>
+#include "ChunkStore.h"
+
+class QTcpServer;
+class QTcpSocket;
+class QThreadPool;
+class ImageLibrary;
+
+/**
+ * @brief Address of another burn station serving its image cache.
+ */
+struct PeerAddress {
+    QString host;
+    quint16 port = 0;
+};
+
+/**
+ * @brief An image offered by a peer (only chunk-stored images are shared).
+ */
+struct PeerImage {
+    QString id;
+    QString displayName;
+    qint64 size = 0;
+};
+
+/**
+ * @brief Serves this station's chunk-stored library images to other stations.
+ *
+ * The protocol is line based; every request is a single line and every
+ * response is either "OK <length>\n" followed by exactly <length> bytes of
+ * payload, or "ERR <message>\n".
+ *
+ *   AUTH <token>         Empty payload; must come first, anything else closes the connection
+ *   LIST                 JSON array of {id, displayName, size}
+ *   INDEX <id>           The image's raw .cidx chunk index
+ *   CHUNK <sha256 hex>   The chunk contents
+ *
+ * Clients may pipeline requests; responses are sent in request order. Chunks
+ * are read from disk on a small thread pool, so serving a peer never stalls
+ * the event loop of the station that runs the server. Chunks carry no extra
+ * checksum because the client verifies every chunk against the SHA-256 it
+ * asked for.
+ *
+ * The stations of one site share a token (setting "peers/token"), so only
+ * they can read the library; the server listens on one configured address
+ * rather than on every interface.
+ */
+class PeerCacheServer : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr quint16 kDefaultPort = 47800;
+
+    explicit PeerCacheServer(ImageLibrary *library, QObject *parent = nullptr);
+
+    /**
+     * @brief Waits for chunk reads still in progress.
+     */
+    ~PeerCacheServer() override;
+
+    /**
+     * @brief Starts listening on one address.
+     * @param address Interface address to serve on, e.g. the station's LAN address.
+     * @param port TCP port (0 picks a free port, see serverPort()).
+     * @param token Shared secret clients must present; the server refuses to start without one.
+     * @return bool True if the server is listening.
+     */
+    bool listen(const QHostAddress &address, quint16 port, const QByteArray &token);
+    quint16 serverPort() const;
+
+private slots:
+    void acceptConnections();
+    void readRequests();
+
+private:
+    struct Connection {
+        quint64 serial = 0;                // Tells a new connection from an old one at the same address
+        QByteArray buffer;                 // Partial request lines
+        bool authenticated = false;
+        quint64 nextRequest = 0;           // Sequence number of the next request read
+        quint64 nextReply = 0;             // Sequence number of the next response to send
+        QMap<quint64, QByteArray> replies; // Finished responses waiting for earlier ones
+    };
+
+    void processRequests(QTcpSocket *socket);
+    QByteArray handleRequest(const QByteArray &line) const;
+    void readChunk(QTcpSocket *socket, quint64 sequence, const QByteArray &argument);
+    void queueReply(QTcpSocket *socket, quint64 sequence, const QByteArray &reply);
+    bool checkToken(const QByteArray &candidate) const;
+
+    ImageLibrary *library;
+    QTcpServer *server;
+    QThreadPool *chunkReaders;
+    QByteArray token;
+    QHash<QTcpSocket *, Connection> connections;
+    quint64 connectionSerial = 0;
+};
+
+/**
+ * @brief Blocking client for PeerCacheServer, meant to run on a worker thread.
+ */
+class PeerCacheClient {
+public:
+    PeerCacheClient();
+    ~PeerCacheClient();
+
+    /**
+     * @brief Connects and authenticates with the site's shared token.
+     */
+    bool connectToPeer(const PeerAddress &peer, const QByteArray &token, int timeoutMs = 3000);
+    bool listImages(QList<PeerImage> *images);
+    bool fetchIndex(const QString &id, ChunkIndex *index);
+
+    /**
+     * @brief Fetches chunks with up to `window` requests in flight.
+     *
+     * Every chunk is verified against its hash and written to the store at
+     * storeRoot before this returns; already present chunks are skipped.
+     *
+     * @param progress Called with the number of bytes received so far.
+     * @param cancelled Checked between chunks; the fetch fails once it is set.
+     */
+    bool fetchChunks(const QString &storeRoot, const QList<ChunkRef> &chunks, int window,
+                     const std::function<void(qint64)> &progress, const std::atomic<bool> *cancelled = nullptr);
+
+    QString errorString() const { return lastError; }
+
+private:
+    bool sendRequest(const QByteArray &line);
+    bool readResponse(QByteArray *payload);
+
+    QTcpSocket *socket;
+    QString lastError;
+};
+
+#endif // PEERCACHE_H
@@ -0,0 +1,98 @@
+#include "PipelineTrace.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+
+// --- Implementation of PipelineTrace ---
+
+PipelineTrace::PipelineTrace() {
+    clock.start();
+    events.reserve(4096);
+}
+
+void PipelineTrace::addSpan(const char *stage, qint64 startNs, qint64 offset, qint64 bytes) {
+    const qint64 end = now();
+    append(Event{stage, QThread::currentThreadId(), startNs, end - startNs, offset, bytes});
+}
+
+void PipelineTrace::addCounter(const char *name, qint64 value) {
+    append(Event{name, QThread::currentThreadId(), now(), -1, value, 0});
+}
+
+void PipelineTrace::append(const Event &event) {
+    QMutexLocker locker(&mutex);
+    if (qsizetype(events.size()) >= kMaxEvents) {
+        ++dropped;
+        return;
+    }
+    events.push_back(event);
+}
+
+void PipelineTrace::nameThread(const QString &name) {
+    QMutexLocker locker(&mutex);
+    threadNames.insert(QThread::currentThreadId(), name);
+}
+
+bool PipelineTrace::save(const QString &path, QString *errorMessage) const {
+    QMutexLocker locker(&mutex);
+    const qint64 pid = QCoreApplication::applicationPid();
+
+    // Small, stable thread ids in order of first appearance
+    QHash<Qt::HANDLE, int> tids;
+    auto tidOf = [&tids](Qt::HANDLE thread) {
+        auto it = tids.find(thread);
+        if (it == tids.end()) it = tids.insert(thread, int(tids.size()) + 1);
+        return it.value();
+    };
+
+    QJsonArray traceEvents;
+    for (const Event &event : events) {
+        QJsonObject object;
+        object["name"] = QString::fromLatin1(event.name);
+        object["pid"] = pid;
+        object["tid"] = tidOf(event.thread);
+        object["ts"] = double(event.startNs) / 1000.0; // Microseconds
+        if (event.durationNs < 0) {
+            object["ph"] = "C";
+            object["args"] = QJsonObject{{"value", event.offset}};
+        } else {
+            object["ph"] = "X";
+            object["cat"] = "pipeline";
+            object["dur"] = double(event.durationNs) / 1000.0;
+            QJsonObject args;
+            if (event.offset >= 0) args["offset"] = QString::number(event.offset);
+            if (event.bytes > 0) args["bytes"] = event.bytes;
+            if (!args.isEmpty()) object["args"] = args;
+        }
+        traceEvents.append(object);
+    }
+    for (auto it = tids.cbegin(); it != tids.cend(); ++it) {
+        const QString name = threadNames.value(it.key(), QString("thread %1").arg(it.value()));
+        traceEvents.append(QJsonObject{{"name", "thread_name"}, {"ph", "M"}, {"pid", pid}, {"tid", it.value()},
+                                       {"args", QJsonObject{{"name", name}}}});
+    }
+
+    QJsonObject top;
+    top["traceEvents"] = traceEvents;
+    top["displayTimeUnit"] = "ms";
+    top["otherData"] = QJsonObject{{"droppedEvents", dropped}};
+
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorMessage) *errorMessage = file.errorString();
+        return false;
+    }
+    file.write(QJsonDocument(top).toJson(QJsonDocument::Compact));
+    if (!file.commit()) {
+        if (errorMessage) *errorMessage = file.errorString();
+        return false;
+    }
+    return true;
+}
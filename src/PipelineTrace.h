@@ -0,0 +1,103 @@
+#ifndef PIPELINETRACE_H
+#define PIPELINETRACE_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QtGlobal>
+#include <vector>
+
+/**
+ * @brief Timeline of a job's pipeline stages, saved as a Chrome trace (chrome://tracing, ui.perfetto.dev).
+ *
+ * Engines open a Span around each stage a buffer goes through (acquire,
+ * read, hash, zero-scan, submit, write, sync, verify, compress) on whichever
+ * thread runs it, and may sample counters such as the write queue's depth.
+ * Laid out per thread, the trace shows at a glance which stage is busy and
+ * which one is starved waiting for it.
+ *
+ * Tracing is off unless a job is given a trace ("traceFile" option), and a
+ * Span on a null trace costs one branch. Events are appended under a mutex;
+ * at one event per stage per buffer of several megabytes, that never shows
+ * up next to the I/O. Thread-safe.
+ */
+class PipelineTrace {
+public:
+    static constexpr qsizetype kMaxEvents = 1000000; // Later events are dropped (and counted)
+
+    /**
+     * @brief Records the time from construction to destruction as one stage of one buffer.
+     */
+    class Span {
+    public:
+        /**
+         * @param trace Trace to add to; null to do nothing.
+         * @param stage Stage name; must be a string literal (it is stored as a pointer).
+         * @param offset Device or image offset of the buffer, or -1.
+         * @param bytes Size of the buffer, or 0.
+         */
+        Span(PipelineTrace *trace, const char *stage, qint64 offset = -1, qint64 bytes = 0)
+            : trace(trace), stage(stage), offset(offset), bytes(bytes), start(trace ? trace->now() : 0) {}
+        ~Span() {
+            if (trace) trace->addSpan(stage, start, offset, bytes);
+        }
+
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+
+    private:
+        PipelineTrace *trace;
+        const char *stage;
+        qint64 offset;
+        qint64 bytes;
+        qint64 start;
+    };
+
+    PipelineTrace();
+
+    /**
+     * @brief Nanoseconds since the trace started.
+     */
+    qint64 now() const { return clock.nsecsElapsed(); }
+
+    /**
+     * @brief Adds a span of stage from startNs until now on the calling thread.
+     */
+    void addSpan(const char *stage, qint64 startNs, qint64 offset = -1, qint64 bytes = 0);
+
+    /**
+     * @brief Samples a counter (drawn as a graph above the threads), e.g. requests in flight.
+     */
+    void addCounter(const char *name, qint64 value);
+
+    /**
+     * @brief Labels the calling thread in the trace (e.g., "queue writer 2").
+     */
+    void nameThread(const QString &name);
+
+    /**
+     * @brief Writes the Chrome trace event JSON to path.
+     */
+    bool save(const QString &path, QString *errorMessage = nullptr) const;
+
+private:
+    struct Event {
+        const char *name;
+        Qt::HANDLE thread;
+        qint64 startNs;
+        qint64 durationNs; // -1 for a counter sample
+        qint64 offset;     // Counter value for a counter sample
+        qint64 bytes;
+    };
+
+    void append(const Event &event);
+
+    QElapsedTimer clock;
+    mutable QMutex mutex;
+    std::vector<Event> events;
+    QHash<Qt::HANDLE, QString> threadNames;
+    qint64 dropped = 0;
+};
+
+#endif // PIPELINETRACE_H
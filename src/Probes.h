@@ -0,0 +1,61 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/**
+ * @file Probes.h
+ * @brief USDT (user-level statically defined tracing) probes in the write and verify paths.
+ *
+ * With systemtap's <sys/sdt.h> available (Linux), each INFERNO_PROBE is a
+ * single nop plus an ELF note describing where its arguments live. Nothing
+ * runs unless a tracer attaches, so the probes stay in production builds;
+ * bpftrace or perf can then measure a running station without a rebuild or
+ * restart. Elsewhere, or with INFERNO_NO_USDT (CMake: -DINFERNO_USDT=OFF),
+ * they expand to nothing. Where they are compiled in, their arguments are
+ * evaluated every time, so keep them cheap.
+ *
+ * Provider "inferno":
+ *
+ *  - job_start(const char *kind, const char *device)
+ *  - job_end(const char *kind, const char *device, int ok)
+ *      kind is "image", "bmap", "backup", "clone", "erase" or "capacity".
+ *  - buffer_submit(qint64 offset, qint64 length)
+ *      A request entered the write queue.
+ *  - buffer_complete(qint64 offset, qint64 length, qint64 latencyNs, int ok)
+ *      A queued device write returned.
+ *  - verify_mismatch(qint64 offset, qint64 length)
+ *      Data read back (capacity check) or read from the image (bmap
+ *      checksum) is not what it should be.
+ *  - io_retry(int write, qint64 offset, qint64 done, int error)
+ *      A positional read or write was interrupted (error is EINTR) or came
+ *      back short (error is 0) and is being continued.
+ *  - erase_retry(const char *device)
+ *      Discard is unsupported; the erase starts over zeroing the drive.
+ *
+ * The probes are linked into both executables, Inferno (GUI) and infernod
+ * (daemon), which the build puts in its bin/ directory; attach to the one
+ * running the burn. For example, the write latency histogram of a burn the
+ * daemon runs:
+ *
+ *     bpftrace -e 'usdt:build/bin/infernod:inferno:buffer_complete { @us = hist(arg2 / 1000); }'
+ */
+
+#if defined(__has_include) && !defined(INFERNO_NO_USDT)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define INFERNO_HAVE_USDT 1
+#endif
+#endif
+
+#ifdef INFERNO_HAVE_USDT
+#define INFERNO_PROBE1(name, a) DTRACE_PROBE1(inferno, name, a)
+#define INFERNO_PROBE2(name, a, b) DTRACE_PROBE2(inferno, name, a, b)
+#define INFERNO_PROBE3(name, a, b, c) DTRACE_PROBE3(inferno, name, a, b, c)
+#define INFERNO_PROBE4(name, a, b, c, d) DTRACE_PROBE4(inferno, name, a, b, c, d)
+#else
+#define INFERNO_PROBE1(name, a) do { } while (0)
+#define INFERNO_PROBE2(name, a, b) do { } while (0)
+#define INFERNO_PROBE3(name, a, b, c) do { } while (0)
+#define INFERNO_PROBE4(name, a, b, c, d) do { } while (0)
+#endif
+
+#endif // PROBES_H
@@ -0,0 +1,35 @@
+#ifndef PROGRESSRECORD_H
+#define PROGRESSRECORD_H
+
+#include <QMetaType>
+#include <QString>
+
+/**
+ * @brief Snapshot of a write engine's adaptive queue (see AimdController).
+ */
+struct QueueControlState {
+    int depth = 0;             // Requests allowed in flight; 0 if the engine has no adaptive queue
+    qint64 requestSize = 0;    // Bytes per request producers are asked to submit
+    double latencyMs = 0;      // 90th percentile completion latency of the last window
+    double bytesPerSecond = 0; // Throughput of the last window
+};
+
+/**
+ * @brief Everything known about a running job's progress, as reported by DiskUtility::transferProgress.
+ *
+ * Bytes count work rather than file positions: expanded bytes for compressed
+ * images, data bytes for sparse ones (see TransferProgress).
+ */
+struct ProgressRecord {
+    qint64 bytesDone = 0;
+    qint64 bytesTotal = 0;
+    int percentage = 0;
+    double bytesPerSecond = 0;    // Smoothed throughput, or 0 while warming up
+    qint64 secondsRemaining = -1; // -1 if not known yet
+    QueueControlState queue;
+    QString phase;                // Why the speed changed, if it did (see ThroughputPhase::description)
+};
+
+Q_DECLARE_METATYPE(ProgressRecord)
+
+#endif // PROGRESSRECORD_H
@@ -0,0 +1,261 @@
+#include "ImageSource.h"
+#include <QHash>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+#ifdef INFERNO_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef INFERNO_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+const quint64 kOffsetMask = 0x00FFFFFFFFFFFE00ULL;
+const quint64 kCompressedFlag = 1ULL << 62;
+const quint64 kZeroFlag = 1ULL;
+const int kMaxCachedTables = 64;
+
+quint64 be64(const QByteArray &bytes, qsizetype offset) {
+    return qFromBigEndian<quint64>(bytes.constData() + offset);
+}
+
+quint32 be32(const QByteArray &bytes, qsizetype offset) {
+    return qFromBigEndian<quint32>(bytes.constData() + offset);
+}
+
+/**
+ * @brief QEMU copy-on-write images, versions 2 and 3.
+ *
+ * Clusters are located through the two-level L1/L2 table. Unallocated and
+ * zero-flagged clusters are holes; compressed clusters (deflate, or zstd for
+ * images created with compression_type=zstd) are inflated on demand. Images
+ * with a backing file, encryption, an external data file or extended L2
+ * entries are refused, since their contents are not all in this file.
+ */
+class Qcow2Source : public ImageSource {
+public:
+    bool open(const QString &path) override {
+        file.setFileName(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            error = file.errorString();
+            return false;
+        }
+        const QByteArray header = file.peek(112);
+        if (header.size() < 72 || !header.startsWith("QFI\xFB")) {
+            return false;
+        }
+
+        const quint32 version = be32(header, 4);
+        clusterBits = int(be32(header, 20));
+        expandedSize = qint64(be64(header, 24));
+        const quint32 l1Size = be32(header, 36);
+        const qint64 l1Offset = qint64(be64(header, 40));
+        if ((version != 2 && version != 3) || clusterBits < 9 || clusterBits > 21 || expandedSize < 0) {
+            error = QString("Unsupported qcow2 version %1").arg(version);
+            return false;
+        }
+        if (be64(header, 8) != 0) {
+            error = "Images with a backing file are not supported; flatten it first";
+            return false;
+        }
+        if (be32(header, 32) != 0) {
+            error = "Encrypted images are not supported";
+            return false;
+        }
+        if (version == 3 && header.size() >= 104) {
+            const quint64 incompatible = be64(header, 72);
+            if (incompatible & ~0x9ULL) {
+                error = "Image uses unsupported features (corrupt flag, external data file or extended L2)";
+                return false;
+            }
+            if ((incompatible & 0x8) && header.size() > 104) {
+                compressionType = uchar(header[104]);
+            }
+        }
+
+        clusterSize = 1LL << clusterBits;
+        l2Entries = clusterSize / 8;
+        const qint64 clusters = (expandedSize + clusterSize - 1) / clusterSize;
+        if (qint64(l1Size) < (clusters + l2Entries - 1) / l2Entries || l1Size > 32 * 1024 * 1024) {
+            error = "L1 table is too small for the image size";
+            return false;
+        }
+        QByteArray l1(qint64(l1Size) * 8, Qt::Uninitialized);
+        if (!readFile(file, l1Offset, l1.data(), l1.size())) {
+            return false;
+        }
+        l1Table.resize(l1Size);
+        for (quint32 i = 0; i < l1Size; ++i) {
+            l1Table[i] = be64(l1, qsizetype(i) * 8) & kOffsetMask;
+        }
+        return true;
+    }
+
+    QString formatName() const override { return "qcow2"; }
+    qint64 size() const override { return expandedSize; }
+
+    SourceExtent extentAt(qint64 offset) override {
+        if (offset < 0 || offset >= expandedSize) {
+            return SourceExtent{};
+        }
+        const qint64 cluster = offset >> clusterBits;
+        const qint64 tableIndex = cluster / l2Entries;
+        const qint64 tableStart = tableIndex * l2Entries;
+        const qint64 tableEnd = std::min(tableStart + l2Entries, (expandedSize + clusterSize - 1) >> clusterBits);
+
+        const QByteArray *table = l2Table(tableIndex);
+        if (!table) {
+            // Unallocated L2 table: the whole range it covers is a hole
+            if (!error.isEmpty()) return SourceExtent{};
+            return clampExtent(tableStart, tableEnd, true);
+        }
+
+        // Extend over following clusters of the same kind in this table
+        const bool hole = isHole(be64(*table, (cluster - tableStart) * 8));
+        qint64 last = cluster + 1;
+        while (last < tableEnd && isHole(be64(*table, (last - tableStart) * 8)) == hole) {
+            ++last;
+        }
+        return clampExtent(cluster, last, hole);
+    }
+
+protected:
+    qint64 readData(char *data, qint64 length, qint64 offset) override {
+        qint64 done = 0;
+        while (done < length) {
+            const qint64 position = offset + done;
+            const qint64 cluster = position >> clusterBits;
+            const qint64 within = position - (cluster << clusterBits);
+            const qint64 count = std::min(length - done, clusterSize - within);
+            const QByteArray *table = l2Table(cluster / l2Entries);
+            if (!table) {
+                return -1;
+            }
+            const quint64 entry = be64(*table, (cluster % l2Entries) * 8);
+            if (entry & kCompressedFlag) {
+                if (!loadCompressedCluster(cluster, entry)) {
+                    return -1;
+                }
+                std::memcpy(data + done, cachedCluster.constData() + within, size_t(count));
+            } else if (!readFile(file, qint64(entry & kOffsetMask) + within, data + done, count)) {
+                return -1;
+            }
+            done += count;
+        }
+        return done;
+    }
+
+private:
+    bool isHole(quint64 entry) const {
+        if (entry & kCompressedFlag) {
+            return false;
+        }
+        return (entry & kOffsetMask) == 0 || (entry & kZeroFlag);
+    }
+
+    SourceExtent clampExtent(qint64 firstCluster, qint64 endCluster, bool hole) const {
+        const qint64 start = firstCluster << clusterBits;
+        const qint64 end = std::min(endCluster << clusterBits, expandedSize);
+        return SourceExtent{start, end - start, hole};
+    }
+
+    /**
+     * @brief Returns the L2 table for an L1 index, or nullptr if it is unallocated (or unreadable, with error set).
+     */
+    const QByteArray *l2Table(qint64 index) {
+        if (index >= l1Table.size() || l1Table[index] == 0) {
+            return nullptr;
+        }
+        auto cached = l2Cache.constFind(index);
+        if (cached != l2Cache.cend()) {
+            return &cached.value();
+        }
+        if (l2Cache.size() >= kMaxCachedTables) {
+            l2Cache.clear();
+        }
+        QByteArray table(clusterSize, Qt::Uninitialized);
+        if (!readFile(file, qint64(l1Table[index]), table.data(), table.size())) {
+            return nullptr;
+        }
+        return &l2Cache.insert(index, table).value();
+    }
+
+    bool loadCompressedCluster(qint64 cluster, quint64 entry) {
+        if (cluster == cachedClusterIndex) {
+            return true;
+        }
+        // Layout of a compressed entry: host offset in the low x bits, extra 512-byte sectors above
+        const int offsetBits = 62 - (clusterBits - 8);
+        const qint64 hostOffset = qint64(entry & ((1ULL << offsetBits) - 1));
+        const qint64 sectors = qint64((entry & ~kCompressedFlag) >> offsetBits);
+        const qint64 compressedSize = std::min((sectors + 1) * 512 - (hostOffset & 511), file.size() - hostOffset);
+        QByteArray input(compressedSize, Qt::Uninitialized);
+        if (compressedSize <= 0 || !readFile(file, hostOffset, input.data(), input.size())) {
+            if (error.isEmpty()) error = QString("Compressed cluster %1 lies outside the file").arg(cluster);
+            return false;
+        }
+        cachedCluster.resize(clusterSize);
+        cachedClusterIndex = -1;
+
+        if (compressionType == 0) {
+#ifdef INFERNO_HAVE_ZLIB
+            z_stream stream{};
+            if (inflateInit2(&stream, -12) != Z_OK) {
+                error = "Cannot initialise zlib";
+                return false;
+            }
+            stream.next_in = reinterpret_cast<Bytef *>(input.data());
+            stream.avail_in = uInt(input.size());
+            stream.next_out = reinterpret_cast<Bytef *>(cachedCluster.data());
+            stream.avail_out = uInt(clusterSize);
+            const int result = inflate(&stream, Z_FINISH);
+            inflateEnd(&stream);
+            // The stored size is rounded up to sectors, so the output filling up is success too
+            if ((result != Z_STREAM_END && result != Z_BUF_ERROR) || stream.avail_out != 0) {
+                error = QString("Corrupt compressed cluster %1").arg(cluster);
+                return false;
+            }
+#else
+            error = "This build of Inferno cannot read compressed qcow2 clusters (no zlib)";
+            return false;
+#endif
+        } else {
+#ifdef INFERNO_HAVE_ZSTD
+            const size_t frameSize = ZSTD_findFrameCompressedSize(input.constData(), size_t(input.size()));
+            const size_t result = ZSTD_isError(frameSize) ? frameSize
+                : ZSTD_decompress(cachedCluster.data(), size_t(clusterSize), input.constData(), frameSize);
+            if (ZSTD_isError(result) || result != size_t(clusterSize)) {
+                error = QString("Corrupt compressed cluster %1").arg(cluster);
+                return false;
+            }
+#else
+            error = "This build of Inferno cannot read zstd-compressed qcow2 clusters";
+            return false;
+#endif
+        }
+        cachedClusterIndex = cluster;
+        return true;
+    }
+
+    QFile file;
+    int clusterBits = 16;
+    qint64 clusterSize = 0;
+    qint64 l2Entries = 0;
+    qint64 expandedSize = 0;
+    int compressionType = 0; // 0 = deflate, 1 = zstd
+    QList<quint64> l1Table;
+    QHash<qint64, QByteArray> l2Cache;
+    qint64 cachedClusterIndex = -1;
+    QByteArray cachedCluster;
+};
+} // namespace
+
+namespace ImageSources {
+
+std::unique_ptr<ImageSource> createQcow2() {
+    return std::make_unique<Qcow2Source>();
+}
+
+} // namespace ImageSources
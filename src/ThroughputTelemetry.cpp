@@ -0,0 +1,127 @@
+#include "ThroughputTelemetry.h"
+#include <QJsonObject>
+#include <QLocale>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+QString causeName(PhaseCause cause) {
+    switch (cause) {
+    case PhaseCause::Initial:
+        return "initial";
+    case PhaseCause::CacheExhausted:
+        return "cacheExhausted";
+    case PhaseCause::ThermalThrottle:
+        return "thermalThrottle";
+    case PhaseCause::Recovered:
+        return "recovered";
+    }
+    return QString();
+}
+} // namespace
+
+QString ThroughputPhase::description() const {
+    const QLocale locale;
+    const QString rate = locale.formattedDataSize(qint64(bytesPerSecond())) + "/s";
+    switch (cause) {
+    case PhaseCause::Initial:
+        return QString("Writing at %1").arg(rate);
+    case PhaseCause::CacheExhausted:
+        return QString("Drive's fast write cache is full after %1; now %2").arg(locale.formattedDataSize(startBytes), rate);
+    case PhaseCause::ThermalThrottle:
+        return QString("Drive slowed down after %1, probably overheating; now %2").arg(locale.formattedDataSize(startBytes), rate);
+    case PhaseCause::Recovered:
+        return QString("Drive speed recovered to %1").arg(rate);
+    }
+    return QString();
+}
+
+// --- Implementation of ThroughputTelemetry ---
+
+ThroughputTelemetry::ThroughputTelemetry() {
+    clock.start();
+    phaseList.append(ThroughputPhase());
+}
+
+bool ThroughputTelemetry::sample(qint64 bytesDone) {
+    const qint64 now = clock.elapsed();
+    bool changed = false;
+    while (qint64(bins.size()) < now / kBinMs) {
+        changed = closeBin() || changed;
+    }
+    currentBinBytes += std::max<qint64>(0, bytesDone - lastBytes);
+    lastBytes = std::max(lastBytes, bytesDone);
+
+    ThroughputPhase &phase = phaseList.last();
+    phase.bytes = lastBytes - phase.startBytes;
+    phase.durationMs = now - phase.startMs;
+    return changed;
+}
+
+bool ThroughputTelemetry::closeBin() {
+    bins.push_back(currentBinBytes);
+    currentBinBytes = 0;
+
+    const qsizetype count = qsizetype(bins.size());
+    if (count - phaseStartBin < kMinPhaseBins + kConfirmBins) {
+        return false;
+    }
+    const qsizetype trailingStart = count - kConfirmBins;
+    const double phaseMean = meanRate(phaseStartBin + kWarmUpBins, trailingStart);
+    const double trailing = meanRate(trailingStart, count);
+    if (phaseMean <= 0 || std::abs(trailing - phaseMean) <= kStep * phaseMean) {
+        return false;
+    }
+
+    PhaseCause cause = PhaseCause::Recovered;
+    if (trailing < phaseMean) {
+        // A cache running out is a cliff; throttling creeps in, or comes after the cache is gone
+        const bool abrupt = double(bins[size_t(trailingStart)]) * 1000.0 / kBinMs < (1.0 - kStep) * phaseMean;
+        const bool cacheGone = std::any_of(phaseList.begin(), phaseList.end(), [](const ThroughputPhase &p) {
+            return p.cause == PhaseCause::CacheExhausted;
+        });
+        cause = abrupt && !cacheGone ? PhaseCause::CacheExhausted : PhaseCause::ThermalThrottle;
+    }
+
+    // The new phase began where the trailing window did
+    const qint64 startBytes = std::accumulate(bins.begin(), bins.begin() + trailingStart, qint64(0));
+    ThroughputPhase &previous = phaseList.last();
+    previous.bytes = startBytes - previous.startBytes;
+    previous.durationMs = trailingStart * kBinMs - previous.startMs;
+
+    ThroughputPhase next;
+    next.cause = cause;
+    next.startBytes = startBytes;
+    next.startMs = trailingStart * kBinMs;
+    phaseList.append(next);
+    phaseStartBin = trailingStart;
+    return true;
+}
+
+double ThroughputTelemetry::meanRate(qsizetype from, qsizetype to) const {
+    if (to <= from) {
+        return 0;
+    }
+    const qint64 bytes = std::accumulate(bins.begin() + from, bins.begin() + to, qint64(0));
+    return double(bytes) * 1000.0 / double((to - from) * kBinMs);
+}
+
+QList<ThroughputPhase> ThroughputTelemetry::phases() const {
+    return phaseList;
+}
+
+QJsonArray ThroughputTelemetry::phasesToJson() const {
+    QJsonArray array;
+    for (const ThroughputPhase &phase : phaseList) {
+        QJsonObject object;
+        object["cause"] = causeName(phase.cause);
+        object["startBytes"] = QString::number(phase.startBytes);
+        object["bytes"] = QString::number(phase.bytes);
+        object["startMs"] = phase.startMs;
+        object["durationMs"] = phase.durationMs;
+        object["bytesPerSecond"] = phase.bytesPerSecond();
+        array.append(object);
+    }
+    return array;
+}
@@ -0,0 +1,94 @@
+#ifndef THROUGHPUTTELEMETRY_H
+#define THROUGHPUTTELEMETRY_H
+
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QList>
+#include <QString>
+#include <vector>
+
+/**
+ * @brief Why a write's throughput changed.
+ */
+enum class PhaseCause {
+    Initial,         // Start of the write
+    CacheExhausted,  // Abrupt first drop: the stick's SLC write cache is full
+    ThermalThrottle, // Later or gradual drop: the controller slowed down to cool off
+    Recovered        // Throughput came back up
+};
+
+/**
+ * @brief A stretch of a write with steady throughput.
+ */
+struct ThroughputPhase {
+    PhaseCause cause = PhaseCause::Initial;
+    qint64 startBytes = 0; // Bytes done when the phase began
+    qint64 bytes = 0;
+    qint64 startMs = 0;
+    qint64 durationMs = 0;
+
+    double bytesPerSecond() const { return durationMs > 0 ? double(bytes) * 1000.0 / double(durationMs) : 0; }
+
+    /**
+     * @brief One line for the status bar, e.g. "Drive's fast write cache is full after 3.2 GB; now 14 MB/s".
+     */
+    QString description() const;
+};
+
+/**
+ * @brief Throughput time series of one write, split into phases at step changes.
+ *
+ * Progress samples are binned into one-second buckets of bytes written. A
+ * new phase starts when the mean of the last kConfirmBins buckets differs
+ * from the current phase's mean by more than kStep, once that phase has
+ * lasted kMinPhaseBins; the new phase is back-dated to where the trailing
+ * window began. The first abrupt drop is attributed to the SLC cache running
+ * out, later or gradual drops to thermal throttling.
+ *
+ * Phases feed the GUI (why did the stick slow down?) and, at the end of a
+ * write, the model's DeviceProfile, from which finish times of later writes
+ * are predicted. Not thread-safe; one instance per write.
+ */
+class ThroughputTelemetry {
+public:
+    static constexpr qint64 kBinMs = 1000;
+    static constexpr int kConfirmBins = 5;
+    static constexpr int kMinPhaseBins = 8;
+    static constexpr int kWarmUpBins = 2;  // Ignored at the start of a phase's mean
+    static constexpr double kStep = 0.30;  // Relative change that counts as a step
+
+    ThroughputTelemetry();
+
+    /**
+     * @brief Records progress.
+     * @return bool True if a new phase began with this sample.
+     */
+    bool sample(qint64 bytesDone);
+
+    /**
+     * @brief Phases so far; the last one is still running.
+     */
+    QList<ThroughputPhase> phases() const;
+
+    const ThroughputPhase &currentPhase() const { return phaseList.last(); }
+
+    /**
+     * @brief Bytes written in each one-second bucket.
+     */
+    const std::vector<qint64> &series() const { return bins; }
+
+    QJsonArray phasesToJson() const;
+
+private:
+    bool closeBin();
+    double meanRate(qsizetype from, qsizetype to) const;
+
+    QElapsedTimer clock;
+    std::vector<qint64> bins;
+    qint64 currentBinBytes = 0;
+    qint64 lastBytes = 0;
+    QList<ThroughputPhase> phaseList;
+    qsizetype phaseStartBin = 0;
+};
+
+#endif // THROUGHPUTTELEMETRY_H
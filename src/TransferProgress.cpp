@@ -0,0 +1,68 @@
+#include "TransferProgress.h"
+#include <QCoreApplication>
+#include <algorithm>
+#include <cmath>
+
+// --- Implementation of TransferProgress ---
+
+TransferProgress::TransferProgress() {
+    clock.start();
+}
+
+bool TransferProgress::update(qint64 bytesDone, qint64 bytesTotal) {
+    const qint64 now = clock.elapsed();
+    done = std::max<qint64>(0, bytesDone);
+    total = std::max<qint64>(0, bytesTotal);
+
+    // Rate samples are spaced out so a burst of small updates does not dominate
+    if (now - sampleTime >= kSampleInterval) {
+        const double sample = double(done - sampleBytes) * 1000.0 / double(now - sampleTime);
+        if (sample >= 0) {
+            rate = rate > 0 ? kSmoothing * sample + (1.0 - kSmoothing) * rate : sample;
+        }
+        sampleTime = now;
+        sampleBytes = done;
+    }
+
+    const int current = total > 0 ? int(std::min<qint64>(done, total) * 100 / total) : 0;
+    const bool percentChanged = current > percent;
+    percent = std::max(percent, current);
+
+    if (percentChanged || lastReport < 0 || now - lastReport >= kReportInterval) {
+        lastReport = now;
+        return true;
+    }
+    return false;
+}
+
+qint64 TransferProgress::secondsRemaining() const {
+    if (clock.elapsed() < kWarmUp || rate <= 0 || total <= 0) {
+        return -1;
+    }
+    return qint64(std::ceil(double(std::max<qint64>(0, total - done)) / rate));
+}
+
+ProgressRecord TransferProgress::record() const {
+    ProgressRecord result;
+    result.bytesDone = done;
+    result.bytesTotal = total;
+    result.percentage = percent;
+    result.bytesPerSecond = rate;
+    result.secondsRemaining = secondsRemaining();
+    return result;
+}
+
+QString TransferProgress::remainingText() const {
+    const qint64 seconds = secondsRemaining();
+    if (seconds < 0) {
+        return QString();
+    }
+    if (seconds < 60) {
+        return QCoreApplication::translate("TransferProgress", "less than a minute left");
+    }
+    if (seconds < 3600) {
+        return QCoreApplication::translate("TransferProgress", "about %n min left", nullptr, int((seconds + 30) / 60));
+    }
+    return QCoreApplication::translate("TransferProgress", "about %1 h %2 min left")
+        .arg(seconds / 3600).arg((seconds % 3600) / 60);
+}
@@ -0,0 +1,75 @@
+#ifndef TRANSFERPROGRESS_H
+#define TRANSFERPROGRESS_H
+
+#include "ProgressRecord.h"
+#include <QElapsedTimer>
+#include <QString>
+
+/**
+ * @brief Turns (bytesDone, bytesTotal) samples into a steady percentage, rate and ETA.
+ *
+ * The byte counts must measure work, not file positions: the expanded size
+ * of a compressed image, or only the data bytes of a sparse one. Every write
+ * engine reports in those units (see ImageWriter, BmapWriter, DriveBackup),
+ * so the ETA tracks the time actually left rather than how far through the
+ * input file the reader happens to be.
+ *
+ * The rate is an exponentially weighted average over samples at least
+ * kSampleInterval apart, which smooths out the bursts caused by buffering
+ * and skipped holes. Not thread-safe; one instance per job.
+ */
+class TransferProgress {
+public:
+    static constexpr qint64 kSampleInterval = 500; // ms between rate samples
+    static constexpr qint64 kReportInterval = 1000; // ms between reports when only the ETA moved
+    static constexpr qint64 kWarmUp = 3000;         // ms before an ETA is trusted
+    static constexpr double kSmoothing = 0.2;       // Weight of the newest rate sample
+
+    TransferProgress();
+
+    /**
+     * @brief Records a sample.
+     * @return bool True if the percentage changed or the ETA is due for a refresh.
+     */
+    bool update(qint64 bytesDone, qint64 bytesTotal);
+
+    qint64 bytesDone() const { return done; }
+    qint64 bytesTotal() const { return total; }
+
+    /**
+     * @brief Percentage complete (0-100); never goes backwards.
+     */
+    int percentage() const { return percent; }
+
+    /**
+     * @brief Smoothed throughput in bytes per second, or 0 while warming up.
+     */
+    double bytesPerSecond() const { return rate; }
+
+    /**
+     * @brief Estimated seconds until completion, or -1 if not known yet.
+     */
+    qint64 secondsRemaining() const;
+
+    /**
+     * @brief The current figures as a record (without queue state).
+     */
+    ProgressRecord record() const;
+
+    /**
+     * @brief Short human-readable ETA (e.g., "about 4 min left"), or empty if not known yet.
+     */
+    QString remainingText() const;
+
+private:
+    QElapsedTimer clock;
+    qint64 done = 0;
+    qint64 total = 0;
+    int percent = 0;
+    double rate = 0;
+    qint64 sampleTime = 0;
+    qint64 sampleBytes = 0;
+    qint64 lastReport = -1;
+};
+
+#endif // TRANSFERPROGRESS_H
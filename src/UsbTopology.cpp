@@ -0,0 +1,92 @@
+#include "UsbTopology.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QRegularExpression>
+
+namespace {
+int readSpeed(const QString &deviceDir) {
+    QFile file(deviceDir + "/speed");
+    if (!file.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    return int(file.readAll().trimmed().toDouble()); // "1.5" for low speed rounds to 1
+}
+} // namespace
+
+// --- Implementation of UsbLink ---
+
+double UsbLink::bytesPerSecond() const {
+    // Protocol overhead leaves well under the signalling rate for bulk transfers
+    if (speedMbps >= 20000) return 2000e6;
+    if (speedMbps >= 10000) return 1000e6;
+    if (speedMbps >= 5000) return 450e6;
+    if (speedMbps >= 480) return 40e6;
+    if (speedMbps >= 12) return 1e6;
+    if (speedMbps > 0) return 0.1e6;
+    return 0;
+}
+
+// --- Implementation of UsbLocation ---
+
+QString UsbLocation::rootPort() const {
+    // "2-1.3.4" hangs off root port "2-1"
+    const qsizetype dot = device.indexOf('.');
+    return dot < 0 ? device : device.left(dot);
+}
+
+QJsonObject UsbLocation::toJson() const {
+    QJsonObject obj;
+    obj["device"] = device;
+    obj["speedMbps"] = speedMbps;
+    obj["rootPort"] = rootPort();
+    QJsonArray hubs;
+    for (const UsbLink &link : upstream) {
+        QJsonObject hub;
+        hub["name"] = link.name;
+        hub["speedMbps"] = link.speedMbps;
+        hubs.append(hub);
+    }
+    obj["upstream"] = hubs;
+    return obj;
+}
+
+// --- Implementation of UsbTopology ---
+
+UsbLocation UsbTopology::locate(const QString &devicePath, const QString &sysfsRoot) {
+    UsbLocation location;
+#ifdef Q_OS_LINUX
+    static const QRegularExpression usbDevice("^\\d+-\\d+(\\.\\d+)*$");
+    static const QRegularExpression rootHub("^usb\\d+$");
+
+    const QString blockLink = sysfsRoot + "/block/" + QFileInfo(devicePath).fileName();
+    const QString real = QFileInfo(blockLink).canonicalFilePath();
+    if (real.isEmpty()) {
+        return location;
+    }
+
+    // Walk down from the root; USB device directories are named "usbN" or "bus-port[.port...]"
+    QList<UsbLink> chain; // Root hub first
+    QString prefix;
+    for (const QString &part : real.split('/', Qt::SkipEmptyParts)) {
+        prefix += '/' + part;
+        if (rootHub.match(part).hasMatch() || usbDevice.match(part).hasMatch()) {
+            chain.append(UsbLink{part, readSpeed(prefix)});
+        }
+    }
+    if (chain.size() < 2) {
+        return location; // Not behind a USB root hub
+    }
+
+    const UsbLink drive = chain.takeLast();
+    location.device = drive.name;
+    location.speedMbps = drive.speedMbps;
+    for (auto it = chain.crbegin(); it != chain.crend(); ++it) {
+        location.upstream.append(*it);
+    }
+#else
+    Q_UNUSED(devicePath);
+    Q_UNUSED(sysfsRoot);
+#endif
+    return location;
+}
@@ -0,0 +1,55 @@
+#ifndef USBTOPOLOGY_H
+#define USBTOPOLOGY_H
+
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+
+/**
+ * @brief A shared USB link: the upstream connection of a hub, or a root hub's bus.
+ */
+struct UsbLink {
+    QString name;       // sysfs device name, e.g. "2-1" for a hub or "usb2" for a root hub
+    int speedMbps = 0;  // Negotiated signalling rate; 0 if unknown
+
+    /**
+     * @brief Bulk throughput the link sustains in practice, in bytes per second.
+     */
+    double bytesPerSecond() const;
+};
+
+/**
+ * @brief Where a drive sits in the USB tree.
+ */
+struct UsbLocation {
+    QString device;          // sysfs name of the drive's USB device, e.g. "2-1.3"
+    int speedMbps = 0;       // Negotiated by the drive itself
+    QList<UsbLink> upstream; // Hubs between the drive and the host, nearest first; the root hub comes last
+
+    bool isValid() const { return !device.isEmpty(); }
+
+    /**
+     * @brief The root hub port the drive's branch starts at, e.g. "2-1"; drives behind it share its bandwidth.
+     */
+    QString rootPort() const;
+
+    QJsonObject toJson() const;
+};
+
+/**
+ * @brief Reads the USB topology of block devices from sysfs (Linux).
+ *
+ * /sys/block/<name> links to the device's place in the device tree, e.g.
+ * .../usb2/2-1/2-1.3/2-1.3:1.0/host6/.../block/sdb: root hub usb2, a hub on
+ * its port 1, and the stick on that hub's port 3. Each USB device directory
+ * has a "speed" file with the negotiated rate in Mbit/s.
+ */
+class UsbTopology {
+public:
+    /**
+     * @brief Locates a drive such as /dev/sdb; invalid if it is not on USB or this is not Linux.
+     */
+    static UsbLocation locate(const QString &devicePath, const QString &sysfsRoot = "/sys");
+};
+
+#endif // USBTOPOLOGY_H
@@ -0,0 +1,341 @@
+#include "ImageSource.h"
+#include <QUuid>
+#include <QtEndian>
+#include <algorithm>
+
+namespace {
+const qint64 kVhdFooterSize = 512;
+const quint32 kVhdUnallocated = 0xFFFFFFFF;
+
+/**
+ * @brief Reads a Microsoft GUID (first three fields little endian).
+ */
+QUuid guidAt(const QByteArray &bytes, qsizetype offset) {
+    const uchar *p = reinterpret_cast<const uchar *>(bytes.constData() + offset);
+    return QUuid(qFromLittleEndian<quint32>(p), qFromLittleEndian<quint16>(p + 4), qFromLittleEndian<quint16>(p + 6),
+                 p[8], p[9], p[10], p[11], p[12], p[13], p[14], p[15]);
+}
+
+/**
+ * @brief Builds the extent from the block containing offset over following blocks of the same kind.
+ *
+ * The look-ahead is capped so that callers stepping through a long run do not rescan it every time.
+ */
+template <typename IsHole>
+SourceExtent blockRunExtent(qint64 offset, qint64 blockSize, qint64 blockCount, qint64 imageSize, IsHole isHole) {
+    if (offset < 0 || offset >= imageSize) {
+        return SourceExtent{};
+    }
+    const qint64 block = offset / blockSize;
+    const bool hole = isHole(block);
+    const qint64 limit = std::min(blockCount, block + 1024);
+    qint64 last = block + 1;
+    while (last < limit && isHole(last) == hole) {
+        ++last;
+    }
+    const qint64 start = block * blockSize;
+    return SourceExtent{start, std::min(last * blockSize, imageSize) - start, hole};
+}
+
+/**
+ * @brief Virtual PC / Hyper-V VHD images, fixed and dynamic.
+ *
+ * Fixed images are raw data followed by a 512-byte footer. Dynamic images map
+ * fixed-size blocks through the block allocation table (BAT); unallocated
+ * blocks are holes. Differencing images need their parent and are refused.
+ */
+class VhdSource : public ImageSource {
+public:
+    bool open(const QString &path) override {
+        file.setFileName(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            error = file.errorString();
+            return false;
+        }
+        if (file.size() < kVhdFooterSize) {
+            return false;
+        }
+        QByteArray footer(kVhdFooterSize, Qt::Uninitialized);
+        if (!readFile(file, file.size() - kVhdFooterSize, footer.data(), kVhdFooterSize)) {
+            error.clear();
+            return false;
+        }
+        if (!footer.startsWith("conectix")) {
+            return false;
+        }
+
+        expandedSize = qint64(qFromBigEndian<quint64>(footer.constData() + 48));
+        const quint32 diskType = qFromBigEndian<quint32>(footer.constData() + 60);
+        if (diskType == 2) {
+            fixed = true;
+            if (expandedSize > file.size() - kVhdFooterSize) {
+                error = "Fixed image is shorter than its declared size";
+                return false;
+            }
+            return true;
+        }
+        if (diskType == 4) {
+            error = "Differencing images need their parent; merge them first";
+            return false;
+        }
+        if (diskType != 3) {
+            error = QString("Unknown disk type %1").arg(diskType);
+            return false;
+        }
+
+        QByteArray header(1024, Qt::Uninitialized);
+        const qint64 headerOffset = qint64(qFromBigEndian<quint64>(footer.constData() + 16));
+        if (!readFile(file, headerOffset, header.data(), header.size()) || !header.startsWith("cxsparse")) {
+            if (error.isEmpty()) error = "Dynamic disk header is missing";
+            return false;
+        }
+        const qint64 tableOffset = qint64(qFromBigEndian<quint64>(header.constData() + 16));
+        const qint64 entries = qFromBigEndian<quint32>(header.constData() + 28);
+        blockSize = qFromBigEndian<quint32>(header.constData() + 32);
+        if (blockSize < 512 || blockSize % 512 != 0 || entries * blockSize < expandedSize) {
+            error = "Dynamic disk header is inconsistent";
+            return false;
+        }
+        // Each block starts with a sector bitmap, padded to whole sectors
+        bitmapSize = ((blockSize / 512 + 7) / 8 + 511) / 512 * 512;
+
+        QByteArray table(entries * 4, Qt::Uninitialized);
+        if (!readFile(file, tableOffset, table.data(), table.size())) {
+            return false;
+        }
+        bat.resize(entries);
+        for (qint64 i = 0; i < entries; ++i) {
+            bat[i] = qFromBigEndian<quint32>(table.constData() + i * 4);
+        }
+        return true;
+    }
+
+    QString formatName() const override { return "VHD"; }
+    qint64 size() const override { return expandedSize; }
+
+    SourceExtent extentAt(qint64 offset) override {
+        if (fixed) {
+            return offset < expandedSize ? SourceExtent{0, expandedSize, false} : SourceExtent{};
+        }
+        return blockRunExtent(offset, blockSize, bat.size(), expandedSize,
+                              [this](qint64 block) { return bat[block] == kVhdUnallocated; });
+    }
+
+protected:
+    qint64 readData(char *data, qint64 length, qint64 offset) override {
+        if (fixed) {
+            return readFile(file, offset, data, length) ? length : -1;
+        }
+        qint64 done = 0;
+        while (done < length) {
+            const qint64 block = (offset + done) / blockSize;
+            const qint64 within = offset + done - block * blockSize;
+            const qint64 count = std::min(length - done, blockSize - within);
+            const qint64 blockStart = qint64(bat[block]) * 512 + bitmapSize;
+            if (!readFile(file, blockStart + within, data + done, count)) {
+                return -1;
+            }
+            done += count;
+        }
+        return done;
+    }
+
+private:
+    QFile file;
+    bool fixed = false;
+    qint64 expandedSize = 0;
+    qint64 blockSize = 0;
+    qint64 bitmapSize = 0;
+    QList<quint32> bat;
+};
+
+// --- VHDX ---
+
+const QUuid kBatRegion("{2DC27766-F623-4200-9D64-115E9BFD4A08}");
+const QUuid kMetadataRegion("{8B7CA206-4790-4B9A-B8FE-575F050F886E}");
+const QUuid kFileParameters("{CAA16737-FA36-4D43-B3B6-33F0AA44E76B}");
+const QUuid kVirtualDiskSize("{2FA54224-CD1B-4876-B211-5DBED83BF4B8}");
+const QUuid kLogicalSectorSize("{8141BF1D-A96F-4709-BA47-F233A8FAAB5F}");
+
+enum VhdxBlockState : quint64 {
+    PayloadNotPresent = 0,
+    PayloadUndefined = 1,
+    PayloadZero = 2,
+    PayloadUnmapped = 3,
+    PayloadFullyPresent = 6,
+    PayloadPartiallyPresent = 7,
+};
+
+/**
+ * @brief Hyper-V VHDX images (dynamic and fixed; both use a BAT).
+ *
+ * The current header is the valid one with the higher sequence number. Images
+ * with a pending log must be replayed by Hyper-V before their metadata can be
+ * trusted, so they are refused, as are differencing images.
+ */
+class VhdxSource : public ImageSource {
+public:
+    bool open(const QString &path) override {
+        file.setFileName(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            error = file.errorString();
+            return false;
+        }
+        if (!file.peek(8).startsWith("vhdxfile")) {
+            return false;
+        }
+
+        // Two header copies at 64 KiB and 128 KiB
+        QByteArray current;
+        quint64 bestSequence = 0;
+        for (qint64 at : {64 * 1024, 128 * 1024}) {
+            QByteArray header(4096, Qt::Uninitialized);
+            if (readFile(file, at, header.data(), header.size()) && header.startsWith("head")) {
+                const quint64 sequence = qFromLittleEndian<quint64>(header.constData() + 8);
+                if (current.isEmpty() || sequence > bestSequence) {
+                    current = header;
+                    bestSequence = sequence;
+                }
+            }
+        }
+        if (current.isEmpty()) {
+            error = "No valid header";
+            return false;
+        }
+        if (!guidAt(current, 48).isNull()) {
+            error = "Image has an unreplayed log; attach it once in Hyper-V to clean it";
+            return false;
+        }
+
+        QByteArray regions(64 * 1024, Qt::Uninitialized);
+        if (!readFile(file, 192 * 1024, regions.data(), regions.size()) || !regions.startsWith("regi")) {
+            if (error.isEmpty()) error = "No region table";
+            return false;
+        }
+        qint64 batOffset = 0;
+        qint64 batLength = 0;
+        qint64 metadataOffset = 0;
+        qint64 metadataLength = 0;
+        const quint32 regionCount = std::min<quint32>(qFromLittleEndian<quint32>(regions.constData() + 8), 2047);
+        for (quint32 i = 0; i < regionCount; ++i) {
+            const qsizetype entry = 16 + qsizetype(i) * 32;
+            const QUuid id = guidAt(regions, entry);
+            const qint64 offset = qint64(qFromLittleEndian<quint64>(regions.constData() + entry + 16));
+            const qint64 length = qFromLittleEndian<quint32>(regions.constData() + entry + 24);
+            if (id == kBatRegion) {
+                batOffset = offset;
+                batLength = length;
+            } else if (id == kMetadataRegion) {
+                metadataOffset = offset;
+                metadataLength = length;
+            } else if (qFromLittleEndian<quint32>(regions.constData() + entry + 28) & 1) {
+                error = "Image requires an unknown region";
+                return false;
+            }
+        }
+        if (batLength <= 0 || metadataLength <= 0 || metadataLength > 16 * 1024 * 1024) {
+            error = "Region table lacks the BAT or metadata";
+            return false;
+        }
+
+        QByteArray metadata(metadataLength, Qt::Uninitialized);
+        if (!readFile(file, metadataOffset, metadata.data(), metadata.size()) || !metadata.startsWith("metadata")) {
+            if (error.isEmpty()) error = "Metadata region is corrupt";
+            return false;
+        }
+        qint64 logicalSectorSize = 512;
+        bool hasParent = false;
+        const quint16 itemCount = std::min<quint16>(qFromLittleEndian<quint16>(metadata.constData() + 10), 2047);
+        for (quint16 i = 0; i < itemCount; ++i) {
+            const qsizetype entry = 32 + qsizetype(i) * 32;
+            const QUuid id = guidAt(metadata, entry);
+            const qsizetype item = qFromLittleEndian<quint32>(metadata.constData() + entry + 16);
+            if (item + 8 > metadata.size()) {
+                continue;
+            }
+            if (id == kFileParameters) {
+                blockSize = qFromLittleEndian<quint32>(metadata.constData() + item);
+                hasParent = qFromLittleEndian<quint32>(metadata.constData() + item + 4) & 0x2;
+            } else if (id == kVirtualDiskSize) {
+                expandedSize = qint64(qFromLittleEndian<quint64>(metadata.constData() + item));
+            } else if (id == kLogicalSectorSize) {
+                logicalSectorSize = qFromLittleEndian<quint32>(metadata.constData() + item);
+            }
+        }
+        if (hasParent) {
+            error = "Differencing images need their parent; merge them first";
+            return false;
+        }
+        if (blockSize < 1024 * 1024 || expandedSize <= 0 || (logicalSectorSize != 512 && logicalSectorSize != 4096)) {
+            error = "Metadata is missing or inconsistent";
+            return false;
+        }
+
+        // Payload entries are interleaved with one sector bitmap entry every chunkRatio entries
+        chunkRatio = (qint64(1) << 23) * logicalSectorSize / blockSize;
+        const qint64 blocks = (expandedSize + blockSize - 1) / blockSize;
+        const qint64 entriesNeeded = blocks + (blocks - 1) / chunkRatio;
+        if (entriesNeeded * 8 > batLength) {
+            error = "BAT is too small for the disk size";
+            return false;
+        }
+        QByteArray table(entriesNeeded * 8, Qt::Uninitialized);
+        if (!readFile(file, batOffset, table.data(), table.size())) {
+            return false;
+        }
+        bat.resize(blocks);
+        for (qint64 block = 0; block < blocks; ++block) {
+            bat[block] = qFromLittleEndian<quint64>(table.constData() + (block + block / chunkRatio) * 8);
+            const quint64 state = bat[block] & 0x7;
+            if (state == PayloadPartiallyPresent) {
+                error = "Partially present blocks belong to differencing images";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    QString formatName() const override { return "VHDX"; }
+    qint64 size() const override { return expandedSize; }
+
+    SourceExtent extentAt(qint64 offset) override {
+        return blockRunExtent(offset, blockSize, bat.size(), expandedSize,
+                              [this](qint64 block) { return (bat[block] & 0x7) != PayloadFullyPresent; });
+    }
+
+protected:
+    qint64 readData(char *data, qint64 length, qint64 offset) override {
+        qint64 done = 0;
+        while (done < length) {
+            const qint64 block = (offset + done) / blockSize;
+            const qint64 within = offset + done - block * blockSize;
+            const qint64 count = std::min(length - done, blockSize - within);
+            const qint64 blockStart = qint64(bat[block] >> 20) * 1024 * 1024;
+            if (!readFile(file, blockStart + within, data + done, count)) {
+                return -1;
+            }
+            done += count;
+        }
+        return done;
+    }
+
+private:
+    QFile file;
+    qint64 expandedSize = 0;
+    qint64 blockSize = 0;
+    qint64 chunkRatio = 1;
+    QList<quint64> bat;
+};
+} // namespace
+
+namespace ImageSources {
+
+std::unique_ptr<ImageSource> createVhd() {
+    return std::make_unique<VhdSource>();
+}
+
+std::unique_ptr<ImageSource> createVhdx() {
+    return std::make_unique<VhdxSource>();
+}
+
+} // namespace ImageSources
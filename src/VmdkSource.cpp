@@ -0,0 +1,352 @@
+#include "ImageSource.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QRegularExpression>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#ifdef INFERNO_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+const quint32 kSparseMagic = 0x564D444B; // "KDMV"
+const quint64 kGdAtEnd = 0xFFFFFFFFFFFFFFFFULL;
+const quint32 kFlagCompressed = 1u << 16;
+const qint64 kSector = 512;
+
+/**
+ * @brief One hosted sparse extent ("monolithicSparse", "streamOptimized" or a -sNNN.vmdk piece).
+ *
+ * Grains are found through the grain directory and grain tables. A grain
+ * table entry of 0 is unallocated and 1 is an explicit zero grain; both are
+ * holes. Stream-optimized extents store each grain deflate-compressed behind
+ * a small marker, and keep their real header in a footer at the end.
+ */
+class SparseExtent : public ImageSource {
+public:
+    bool open(const QString &path) override {
+        file.setFileName(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            error = file.errorString();
+            return false;
+        }
+        QByteArray header(kSector, Qt::Uninitialized);
+        if (!readFile(file, 0, header.data(), kSector)) {
+            return false;
+        }
+        if (qFromLittleEndian<quint32>(header.constData()) != kSparseMagic) {
+            error = "Not a sparse extent";
+            return false;
+        }
+        if (qFromLittleEndian<quint64>(header.constData() + 56) == kGdAtEnd) {
+            // Stream-optimized: footer marker, footer (a header copy), end-of-stream marker
+            if (!readFile(file, file.size() - 2 * kSector, header.data(), kSector)
+                || qFromLittleEndian<quint32>(header.constData()) != kSparseMagic) {
+                if (error.isEmpty()) error = "Stream-optimized footer is missing";
+                return false;
+            }
+        }
+
+        flags = qFromLittleEndian<quint32>(header.constData() + 8);
+        expandedSize = qint64(qFromLittleEndian<quint64>(header.constData() + 12)) * kSector;
+        grainSize = qint64(qFromLittleEndian<quint64>(header.constData() + 20)) * kSector;
+        gtEntries = qFromLittleEndian<quint32>(header.constData() + 44);
+        const qint64 gdOffset = qint64(qFromLittleEndian<quint64>(header.constData() + 56)) * kSector;
+        if (grainSize <= 0 || grainSize > 64 * 1024 * 1024 || gtEntries == 0 || expandedSize <= 0) {
+            error = "Sparse extent header is inconsistent";
+            return false;
+        }
+        if ((flags & kFlagCompressed) && qFromLittleEndian<quint16>(header.constData() + 77) != 1) {
+            error = "Unknown grain compression";
+            return false;
+        }
+
+        const qint64 grains = (expandedSize + grainSize - 1) / grainSize;
+        const qint64 tables = (grains + gtEntries - 1) / gtEntries;
+        QByteArray directory(tables * 4, Qt::Uninitialized);
+        if (!readFile(file, gdOffset, directory.data(), directory.size())) {
+            return false;
+        }
+        grainDirectory.resize(tables);
+        for (qint64 i = 0; i < tables; ++i) {
+            grainDirectory[i] = qFromLittleEndian<quint32>(directory.constData() + i * 4);
+        }
+        return true;
+    }
+
+    QString formatName() const override { return "VMDK"; }
+    qint64 size() const override { return expandedSize; }
+
+    SourceExtent extentAt(qint64 offset) override {
+        if (offset < 0 || offset >= expandedSize) {
+            return SourceExtent{};
+        }
+        const qint64 grain = offset / grainSize;
+        const qint64 tableEnd = std::min((grain / gtEntries + 1) * gtEntries, (expandedSize + grainSize - 1) / grainSize);
+        quint32 entry = 0;
+        if (!grainEntry(grain, &entry)) {
+            return SourceExtent{};
+        }
+        const bool hole = entry <= 1;
+        qint64 last = grain + 1;
+        while (last < tableEnd && grainEntry(last, &entry) && (entry <= 1) == hole) {
+            ++last;
+        }
+        const qint64 start = grain * grainSize;
+        return SourceExtent{start, std::min(last * grainSize, expandedSize) - start, hole};
+    }
+
+protected:
+    qint64 readData(char *data, qint64 length, qint64 offset) override {
+        qint64 done = 0;
+        while (done < length) {
+            const qint64 grain = (offset + done) / grainSize;
+            const qint64 within = offset + done - grain * grainSize;
+            const qint64 count = std::min(length - done, grainSize - within);
+            quint32 entry = 0;
+            if (!grainEntry(grain, &entry)) {
+                return -1;
+            }
+            if (entry <= 1) {
+                std::memset(data + done, 0, size_t(count));
+            } else if (flags & kFlagCompressed) {
+                if (!loadCompressedGrain(grain, entry)) {
+                    return -1;
+                }
+                std::memcpy(data + done, cachedGrain.constData() + within, size_t(count));
+            } else if (!readFile(file, qint64(entry) * kSector + within, data + done, count)) {
+                return -1;
+            }
+            done += count;
+        }
+        return done;
+    }
+
+private:
+    bool grainEntry(qint64 grain, quint32 *entry) {
+        const qint64 table = grain / gtEntries;
+        if (table >= grainDirectory.size()) {
+            return false;
+        }
+        if (grainDirectory[table] == 0) {
+            *entry = 0; // Whole table unallocated
+            return true;
+        }
+        auto cached = grainTables.constFind(table);
+        if (cached == grainTables.cend()) {
+            QByteArray data(qint64(gtEntries) * 4, Qt::Uninitialized);
+            if (!readFile(file, qint64(grainDirectory[table]) * kSector, data.data(), data.size())) {
+                return false;
+            }
+            cached = grainTables.insert(table, data);
+        }
+        *entry = qFromLittleEndian<quint32>(cached.value().constData() + (grain % gtEntries) * 4);
+        return true;
+    }
+
+    bool loadCompressedGrain(qint64 grain, quint32 entry) {
+        if (grain == cachedGrainIndex) {
+            return true;
+        }
+        // Grain marker: LBA (8 bytes), compressed size (4 bytes), then zlib data
+        char marker[12];
+        const qint64 markerOffset = qint64(entry) * kSector;
+        if (!readFile(file, markerOffset, marker, 12)) {
+            return false;
+        }
+        const qint64 compressedSize = qFromLittleEndian<quint32>(marker + 8);
+        QByteArray input(compressedSize, Qt::Uninitialized);
+        if (compressedSize <= 0 || !readFile(file, markerOffset + 12, input.data(), input.size())) {
+            if (error.isEmpty()) error = QString("Grain %1 is corrupt").arg(grain);
+            return false;
+        }
+        cachedGrain.resize(grainSize);
+        cachedGrainIndex = -1;
+#ifdef INFERNO_HAVE_ZLIB
+        uLongf outputSize = uLongf(grainSize);
+        const int result = uncompress(reinterpret_cast<Bytef *>(cachedGrain.data()), &outputSize,
+                                      reinterpret_cast<const Bytef *>(input.constData()), uLong(input.size()));
+        if (result != Z_OK) {
+            error = QString("Grain %1 does not decompress").arg(grain);
+            return false;
+        }
+        // The last grain of a disk may be short
+        std::memset(cachedGrain.data() + outputSize, 0, size_t(grainSize - qint64(outputSize)));
+#else
+        error = "This build of Inferno cannot read compressed VMDK grains (no zlib)";
+        return false;
+#endif
+        cachedGrainIndex = grain;
+        return true;
+    }
+
+    QFile file;
+    quint32 flags = 0;
+    qint64 expandedSize = 0;
+    qint64 grainSize = 0;
+    quint32 gtEntries = 0;
+    QList<quint32> grainDirectory;
+    QHash<qint64, QByteArray> grainTables;
+    qint64 cachedGrainIndex = -1;
+    QByteArray cachedGrain;
+};
+
+/**
+ * @brief VMware VMDK images: a single sparse file, or a text descriptor listing extents.
+ *
+ * Descriptor extents of type FLAT/VMFS (raw files), ZERO and SPARSE are
+ * supported, so split (2 GB) and flat disks work as well as monolithic ones.
+ */
+class VmdkSource : public ImageSource {
+public:
+    bool open(const QString &path) override {
+        QFile probe(path);
+        if (!probe.open(QIODevice::ReadOnly)) {
+            error = probe.errorString();
+            return false;
+        }
+        const QByteArray head = probe.peek(1024);
+        if (head.size() >= 4 && qFromLittleEndian<quint32>(head.constData()) == kSparseMagic) {
+            auto sparse = std::make_unique<SparseExtent>();
+            if (!sparse->open(path)) {
+                error = sparse->errorString();
+                return false;
+            }
+            extents.append(Extent{0, sparse->size(), Sparse, QString(), 0, 0});
+            sparseExtents.push_back(std::move(sparse));
+            expandedSize = extents.last().length;
+            return true;
+        }
+        if (!head.startsWith("# Disk DescriptorFile") || probe.size() > 1024 * 1024) {
+            return false;
+        }
+        return parseDescriptor(QString::fromUtf8(probe.readAll()), QFileInfo(path).dir());
+    }
+
+    QString formatName() const override { return "VMDK"; }
+    qint64 size() const override { return expandedSize; }
+
+    SourceExtent extentAt(qint64 offset) override {
+        const int index = extentIndex(offset);
+        if (index < 0) {
+            return SourceExtent{};
+        }
+        const Extent &extent = extents[index];
+        if (extent.type != Sparse) {
+            return SourceExtent{extent.start, extent.length, extent.type == Zero};
+        }
+        SourceExtent inner = sparseExtents[size_t(extent.sparseIndex)]->extentAt(offset - extent.start);
+        if (inner.length <= 0) {
+            error = sparseExtents[size_t(extent.sparseIndex)]->errorString();
+            return SourceExtent{};
+        }
+        inner.offset += extent.start;
+        return inner;
+    }
+
+protected:
+    qint64 readData(char *data, qint64 length, qint64 offset) override {
+        const int index = extentIndex(offset);
+        if (index < 0) {
+            return -1;
+        }
+        const Extent &extent = extents[index];
+        if (extent.type == Flat) {
+            QFile &flat = *flatFiles[size_t(extent.sparseIndex)];
+            return readFile(flat, extent.fileOffset + (offset - extent.start), data, length) ? length : -1;
+        }
+        ImageSource &sparse = *sparseExtents[size_t(extent.sparseIndex)];
+        if (sparse.readAt(data, length, offset - extent.start) != length) {
+            error = sparse.errorString();
+            return -1;
+        }
+        return length;
+    }
+
+private:
+    enum ExtentType { Flat, Zero, Sparse };
+
+    struct Extent {
+        qint64 start;
+        qint64 length;
+        ExtentType type;
+        QString fileName;
+        qint64 fileOffset;
+        int sparseIndex = -1; // Index into flatFiles or sparseExtents
+    };
+
+    bool parseDescriptor(const QString &text, const QDir &directory) {
+        // e.g.: RW 4192256 SPARSE "disk-s001.vmdk"   or   RW 2097152 FLAT "disk-flat.vmdk" 0
+        static const QRegularExpression extentLine(
+            R"(^\s*(RW|RDONLY|NOACCESS)\s+(\d+)\s+(\w+)(?:\s+"([^"]*)")?(?:\s+(\d+))?)");
+        for (const QString &line : text.split('\n')) {
+            const QRegularExpressionMatch match = extentLine.match(line);
+            if (line.trimmed().startsWith("parentFileNameHint")) {
+                error = "Child disks need their parent; consolidate the snapshot first";
+                return false;
+            }
+            if (!match.hasMatch()) {
+                continue;
+            }
+            Extent extent{expandedSize, match.captured(2).toLongLong() * kSector, Flat, match.captured(4),
+                          match.captured(5).toLongLong() * kSector};
+            const QString type = match.captured(3).toUpper();
+            if (type == "FLAT" || type == "VMFS") {
+                auto flat = std::make_unique<QFile>(directory.filePath(extent.fileName));
+                if (!flat->open(QIODevice::ReadOnly)) {
+                    error = QString("Cannot open extent %1: %2").arg(extent.fileName, flat->errorString());
+                    return false;
+                }
+                extent.sparseIndex = int(flatFiles.size());
+                flatFiles.push_back(std::move(flat));
+            } else if (type == "ZERO") {
+                extent.type = Zero;
+            } else if (type == "SPARSE") {
+                auto sparse = std::make_unique<SparseExtent>();
+                if (!sparse->open(directory.filePath(extent.fileName))) {
+                    error = QString("Extent %1: %2").arg(extent.fileName, sparse->errorString());
+                    return false;
+                }
+                extent.type = Sparse;
+                extent.sparseIndex = int(sparseExtents.size());
+                sparseExtents.push_back(std::move(sparse));
+            } else {
+                error = QString("Unsupported extent type %1").arg(type);
+                return false;
+            }
+            if (extent.length > 0) {
+                extents.append(extent);
+                expandedSize += extent.length;
+            }
+        }
+        if (extents.isEmpty()) {
+            error = "Descriptor lists no extents";
+            return false;
+        }
+        return true;
+    }
+
+    int extentIndex(qint64 offset) const {
+        auto it = std::upper_bound(extents.cbegin(), extents.cend(), offset,
+                                   [](qint64 value, const Extent &extent) { return value < extent.start + extent.length; });
+        return it != extents.cend() && it->start <= offset ? int(it - extents.cbegin()) : -1;
+    }
+
+    qint64 expandedSize = 0;
+    QList<Extent> extents;
+    std::vector<std::unique_ptr<QFile>> flatFiles;
+    std::vector<std::unique_ptr<SparseExtent>> sparseExtents;
+};
+} // namespace
+
+namespace ImageSources {
+
+std::unique_ptr<ImageSource> createVmdk() {
+    return std::make_unique<VmdkSource>();
+}
+
+} // namespace ImageSources
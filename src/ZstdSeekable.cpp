@@ -0,0 +1,72 @@
+#include "ZstdSeekable.h"
+#include <QIODevice>
+#include <QtEndian>
+
+namespace {
+void appendLittleEndian32(QByteArray *bytes, quint32 value) {
+    char raw[4];
+    qToLittleEndian(value, raw);
+    bytes->append(raw, 4);
+}
+} // namespace
+
+namespace ZstdSeekable {
+
+QByteArray encodeSeekTable(const QList<SeekTableEntry> &frames) {
+    const quint32 payloadSize = quint32(frames.size() * 8 + kFooterSize);
+
+    QByteArray table;
+    table.reserve(8 + payloadSize);
+    appendLittleEndian32(&table, kSkippableMagic);
+    appendLittleEndian32(&table, payloadSize);
+    for (const SeekTableEntry &frame : frames) {
+        appendLittleEndian32(&table, frame.compressedSize);
+        appendLittleEndian32(&table, frame.decompressedSize);
+    }
+    appendLittleEndian32(&table, quint32(frames.size()));
+    table.append(char(0)); // Descriptor: no per-frame checksums
+    appendLittleEndian32(&table, kSeekableMagic);
+    return table;
+}
+
+bool readSeekTable(QIODevice *device, QList<SeekTableEntry> *frames, QString *errorMessage) {
+    const qint64 fileSize = device->size();
+    if (fileSize < 8 + kFooterSize || !device->seek(fileSize - kFooterSize)) {
+        if (errorMessage) *errorMessage = "File too small for a seek table";
+        return false;
+    }
+
+    const QByteArray footer = device->read(kFooterSize);
+    if (footer.size() != kFooterSize || qFromLittleEndian<quint32>(footer.constData() + 5) != kSeekableMagic) {
+        if (errorMessage) *errorMessage = "No zstd seek table found";
+        return false;
+    }
+
+    const quint32 frameCount = qFromLittleEndian<quint32>(footer.constData());
+    const bool checksums = (uchar(footer[4]) & 0x80) != 0;
+    const int entrySize = checksums ? 12 : 8;
+    const qint64 tableSize = 8 + qint64(frameCount) * entrySize + kFooterSize;
+    if (tableSize > fileSize || !device->seek(fileSize - tableSize)) {
+        if (errorMessage) *errorMessage = "Corrupt zstd seek table";
+        return false;
+    }
+
+    const QByteArray table = device->read(tableSize - kFooterSize);
+    if (table.size() != tableSize - kFooterSize || qFromLittleEndian<quint32>(table.constData()) != kSkippableMagic) {
+        if (errorMessage) *errorMessage = "Corrupt zstd seek table";
+        return false;
+    }
+
+    frames->clear();
+    frames->reserve(frameCount);
+    for (quint32 i = 0; i < frameCount; ++i) {
+        const char *entry = table.constData() + 8 + qint64(i) * entrySize;
+        SeekTableEntry frame;
+        frame.compressedSize = qFromLittleEndian<quint32>(entry);
+        frame.decompressedSize = qFromLittleEndian<quint32>(entry + 4);
+        frames->append(frame);
+    }
+    return true;
+}
+
+} // namespace ZstdSeekable
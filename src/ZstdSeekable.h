@@ -0,0 +1,45 @@
+#ifndef ZSTDSEEKABLE_H
+#define ZSTDSEEKABLE_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+class QIODevice;
+
+/**
+ * @brief One frame of a seekable zstd file.
+ */
+struct SeekTableEntry {
+    quint32 compressedSize = 0;
+    quint32 decompressedSize = 0;
+};
+
+/**
+ * @brief Helpers for the zstd seekable format (contrib/seekable_format in zstd).
+ *
+ * A seekable file is a sequence of independent zstd frames followed by a
+ * skippable frame holding the size of every frame. Any zstd tool can still
+ * decompress the file as a whole, while Inferno can jump to a frame and
+ * decompress frames in parallel.
+ */
+namespace ZstdSeekable {
+
+constexpr quint32 kSkippableMagic = 0x184D2A5E;
+constexpr quint32 kSeekableMagic = 0x8F92EAB1;
+constexpr int kFooterSize = 9;
+
+/**
+ * @brief Encodes the seek table skippable frame for the given frames (no checksums).
+ */
+QByteArray encodeSeekTable(const QList<SeekTableEntry> &frames);
+
+/**
+ * @brief Reads the seek table from the end of a seekable file.
+ * @return bool False if the device does not end with a valid seek table.
+ */
+bool readSeekTable(QIODevice *device, QList<SeekTableEntry> *frames, QString *errorMessage = nullptr);
+
+} // namespace ZstdSeekable
+
+#endif // ZSTDSEEKABLE_H
@@ -0,0 +1,146 @@
+#include <QFile>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QtTest>
+#include "AdaptiveWriteQueue.h"
+#include <cstring>
+
+namespace {
+const qint64 kMiB = 1024 * 1024;
+
+/**
+ * @brief Feeds one window of five equal completions, 125 ms apart, starting at start.
+ * @return qint64 The time the window closed, where the next one starts.
+ */
+qint64 runWindow(AimdController &controller, qint64 start, qint64 bytes, double latencyMs) {
+    for (int i = 0; i <= AimdController::kWindowCompletions; ++i) {
+        controller.recordCompletion(bytes, latencyMs, start + i * AimdController::kWindowTime / AimdController::kWindowCompletions);
+    }
+    return start + AimdController::kWindowTime;
+}
+} // namespace
+
+/**
+ * @brief The AIMD controller's depth and request size decisions, and the queue's writes reaching the device.
+ */
+class TestAdaptiveWriteQueue : public QObject {
+    Q_OBJECT
+
+private slots:
+    void startsShallowWithinBounds();
+    void risingThroughputDeepensThenGrowsRequests();
+    void highLatencyBacksOff();
+    void throughputDropWithRisingLatencyBacksOff();
+    void quietWindowsProbeUpwards();
+    void queueWritesEveryRequest();
+};
+
+void TestAdaptiveWriteQueue::startsShallowWithinBounds() {
+    const AimdController controller(6, kMiB, 8 * kMiB, 64 * kMiB);
+    QCOMPARE(controller.depth(), 2);
+    QCOMPARE(controller.requestSize(), 8 * kMiB);
+    QCOMPARE(AimdController(1, kMiB, 8 * kMiB, 100).depth(), 1);
+    QCOMPARE(AimdController(1, kMiB, 8 * kMiB, 100).requestSize(), kMiB);
+}
+
+void TestAdaptiveWriteQueue::risingThroughputDeepensThenGrowsRequests() {
+    AimdController controller(3, kMiB, 8 * kMiB, 2 * kMiB);
+    qint64 now = runWindow(controller, 0, kMiB, 10); // The first window has nothing to compare with
+    QCOMPARE(controller.depth(), 3);
+    QCOMPARE(controller.requestSize(), 2 * kMiB);
+
+    // At full depth, faster windows double the request size up to its maximum
+    now = runWindow(controller, now, 2 * kMiB, 10);
+    QCOMPARE(controller.depth(), 3);
+    QCOMPARE(controller.requestSize(), 4 * kMiB);
+    now = runWindow(controller, now, 4 * kMiB, 10);
+    now = runWindow(controller, now, 8 * kMiB, 10);
+    QCOMPARE(controller.requestSize(), 8 * kMiB);
+
+    const QueueControlState state = controller.state();
+    QCOMPARE(state.latencyMs, 10.0);
+    QCOMPARE(state.bytesPerSecond, 5.0 * 8 * kMiB * 1000 / AimdController::kWindowTime);
+}
+
+void TestAdaptiveWriteQueue::highLatencyBacksOff() {
+    AimdController controller(6, kMiB, 8 * kMiB, 4 * kMiB);
+    const double slow = AimdController::kLatencyCeiling + 100;
+    qint64 now = runWindow(controller, 0, kMiB, slow);
+    QCOMPARE(controller.depth(), 1);
+    QCOMPARE(controller.requestSize(), 4 * kMiB);
+
+    // Once the depth is 1 the request size halves, down to its minimum
+    now = runWindow(controller, now, kMiB, slow);
+    QCOMPARE(controller.requestSize(), 2 * kMiB);
+    now = runWindow(controller, now, kMiB, slow);
+    now = runWindow(controller, now, kMiB, slow);
+    QCOMPARE(controller.depth(), 1);
+    QCOMPARE(controller.requestSize(), kMiB);
+}
+
+void TestAdaptiveWriteQueue::throughputDropWithRisingLatencyBacksOff() {
+    AimdController controller(6, kMiB, 8 * kMiB, 4 * kMiB);
+    qint64 now = runWindow(controller, 0, 4 * kMiB, 10);
+    now = runWindow(controller, now, 4 * kMiB, 10);
+    QCOMPARE(controller.depth(), 3);
+
+    // Half the throughput at higher latency: the stick is queueing internally
+    now = runWindow(controller, now, 2 * kMiB, 20);
+    QCOMPARE(controller.depth(), 1);
+
+    // A drop without more latency is left alone
+    now = runWindow(controller, now, 2 * kMiB, 20);
+    runWindow(controller, now, kMiB, 20);
+    QCOMPARE(controller.depth(), 1);
+    QCOMPARE(controller.requestSize(), 4 * kMiB);
+}
+
+void TestAdaptiveWriteQueue::quietWindowsProbeUpwards() {
+    AimdController controller(6, kMiB, 8 * kMiB, 4 * kMiB);
+    qint64 now = runWindow(controller, 0, 4 * kMiB, 10);
+    QCOMPARE(controller.depth(), 3);
+    for (int i = 1; i < AimdController::kProbeWindows; ++i) {
+        now = runWindow(controller, now, 4 * kMiB, 10);
+        QCOMPARE(controller.depth(), 3);
+    }
+    runWindow(controller, now, 4 * kMiB, 10);
+    QCOMPARE(controller.depth(), 4);
+}
+
+void TestAdaptiveWriteQueue::queueWritesEveryRequest() {
+    QTemporaryDir dir;
+    const QString path = dir.filePath("target.img");
+    const qint64 total = 16 * kMiB;
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        QVERIFY(file.resize(total));
+    }
+    BlockDevice device;
+    QVERIFY(device.open(path, true, false));
+
+    QByteArray expected(total, Qt::Uninitialized);
+    QRandomGenerator(7).fillRange(reinterpret_cast<quint32 *>(expected.data()), total / 4);
+
+    AdaptiveWriteQueue queue(device, kMiB);
+    qint64 offset = 0;
+    while (offset < total) {
+        AlignedBuffer *buffer = queue.acquire();
+        QVERIFY(buffer);
+        const qint64 length = std::min(queue.requestSize(), total - offset);
+        memcpy(buffer->data(), expected.constData() + offset, size_t(length));
+        queue.submit(buffer, offset, length, length);
+        offset += length;
+    }
+    QVERIFY2(queue.finish(), qPrintable(queue.errorString()));
+    QCOMPARE(queue.bytesCompleted(), total);
+    QCOMPARE(queue.completedThrough(), total);
+    device.close();
+
+    QFile written(path);
+    QVERIFY(written.open(QIODevice::ReadOnly));
+    QVERIFY(written.readAll() == expected);
+}
+
+QTEST_APPLESS_MAIN(TestAdaptiveWriteQueue)
+#include "tst_adaptivewritequeue.moc"
@@ -0,0 +1,123 @@
+#include <QTemporaryDir>
+#include <QtEndian>
+#include <QtTest>
+#include "AllocationMap.h"
+#include "BlockDevice.h"
+#include <cstring>
+
+// Next to ByteRange, where QCOMPARE finds them
+static bool operator==(const ByteRange &a, const ByteRange &b) {
+    return a.offset == b.offset && a.length == b.length;
+}
+
+static char *toString(const ByteRange &range) {
+    return QTest::toString(QString("[%1, %2)").arg(range.offset).arg(range.end()));
+}
+
+/**
+ * @brief Range arithmetic behind sparse backups (merging, alignment and gaps), and scanning a FAT32 volume.
+ */
+class TestAllocationMap : public QObject {
+    Q_OBJECT
+
+private slots:
+    void normalizeSortsAlignsAndMerges();
+    void normalizeKeepsDistantRangesApart();
+    void normalizeClipsToTheDevice();
+    void invertFindsTheGaps();
+    void unknownDataIsKeptWhole();
+    void fat32ScanKeepsOnlyUsedClusters();
+
+private:
+    QString writeImage(const QString &name, const QByteArray &contents);
+
+    QTemporaryDir dir;
+};
+
+QString TestAllocationMap::writeImage(const QString &name, const QByteArray &contents) {
+    const QString path = dir.filePath(name);
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(contents) != contents.size()) {
+        qFatal("Cannot write %s", qPrintable(path));
+    }
+    return path;
+}
+
+void TestAllocationMap::normalizeSortsAlignsAndMerges() {
+    const QList<ByteRange> ranges = AllocationMap::normalize({{5000, 100}, {0, 10}, {4000, 200}, {300, 0}}, 4096, 0,
+                                                            1 << 20);
+    // 0-10 and 4000-4200 align out to 0-8192, which touches 5000-5100's block
+    QCOMPARE(ranges.size(), qsizetype(1));
+    QCOMPARE(ranges[0], (ByteRange{0, 8192}));
+}
+
+void TestAllocationMap::normalizeKeepsDistantRangesApart() {
+    const QList<ByteRange> input = {{0, 4096}, {3 * 4096, 4096}};
+    QCOMPARE(AllocationMap::normalize(input, 4096, 0, 1 << 20).size(), qsizetype(2));
+    // A gap up to mergeGap is cheaper to read than to skip
+    const QList<ByteRange> merged = AllocationMap::normalize(input, 4096, 2 * 4096, 1 << 20);
+    QCOMPARE(merged.size(), qsizetype(1));
+    QCOMPARE(merged[0], (ByteRange{0, 4 * 4096}));
+}
+
+void TestAllocationMap::normalizeClipsToTheDevice() {
+    const QList<ByteRange> ranges = AllocationMap::normalize({{9000, 500}, {20000, 10}}, 4096, 0, 10000);
+    QCOMPARE(ranges.size(), qsizetype(1));
+    QCOMPARE(ranges[0], (ByteRange{8192, 10000 - 8192}));
+}
+
+void TestAllocationMap::invertFindsTheGaps() {
+    const QList<ByteRange> gaps = AllocationMap::invert({{100, 50}, {200, 100}}, 1000);
+    QCOMPARE(gaps.size(), qsizetype(3));
+    QCOMPARE(gaps[0], (ByteRange{0, 100}));
+    QCOMPARE(gaps[1], (ByteRange{150, 50}));
+    QCOMPARE(gaps[2], (ByteRange{300, 700}));
+    QCOMPARE(AllocationMap::totalLength(gaps), qint64(850));
+    QVERIFY(AllocationMap::invert({{0, 1000}}, 1000).isEmpty());
+}
+
+void TestAllocationMap::unknownDataIsKeptWhole() {
+    BlockDevice device;
+    QVERIFY(device.open(writeImage("blank.img", QByteArray(2 * 1024 * 1024, '\0')), false, false));
+    QList<ByteRange> allocated;
+    QVERIFY(AllocationMap::scan(device, &allocated));
+    QCOMPARE(allocated.size(), qsizetype(1));
+    QCOMPARE(allocated[0], (ByteRange{0, device.size()}));
+}
+
+void TestAllocationMap::fat32ScanKeepsOnlyUsedClusters() {
+    // A partitionless ("superfloppy") FAT32 volume: 4 KB clusters, 32 reserved sectors, one 64-sector FAT
+    const qint64 kVolume = 32 * 1024 * 1024;
+    const qint64 kDataStart = (32 + 64) * 512;
+    QByteArray image(kVolume, '\0');
+    char *boot = image.data();
+    qToLittleEndian<quint16>(512, boot + 0x0B);
+    boot[0x0D] = 8;
+    qToLittleEndian<quint16>(32, boot + 0x0E);
+    boot[0x10] = 1;
+    qToLittleEndian<quint32>(quint32(kVolume / 512), boot + 0x20);
+    qToLittleEndian<quint32>(64, boot + 0x24);
+    memcpy(boot + 0x52, "FAT32   ", 8);
+
+    // Reserved entries, the root directory (cluster 2) and a file in clusters 1000-1009
+    char *fat = image.data() + 32 * 512;
+    for (const int cluster : {0, 1, 2}) {
+        qToLittleEndian<quint32>(0x0FFFFFFF, fat + cluster * 4);
+    }
+    for (int cluster = 1000; cluster < 1010; ++cluster) {
+        qToLittleEndian<quint32>(cluster == 1009 ? 0x0FFFFFFF : cluster + 1, fat + cluster * 4);
+    }
+
+    BlockDevice device;
+    QVERIFY(device.open(writeImage("fat32.img", image), false, false));
+    QList<ByteRange> allocated;
+    QString summary;
+    QVERIFY(AllocationMap::scan(device, &allocated, &summary));
+    QVERIFY2(summary.contains("FAT32"), qPrintable(summary));
+    QCOMPARE(allocated.size(), qsizetype(2));
+    QCOMPARE(allocated[0], (ByteRange{0, kDataStart + 4096})); // Boot sector, FAT and the root directory
+    QCOMPARE(allocated[1], (ByteRange{kDataStart + (1000 - 2) * 4096, 10 * 4096}));
+}
+
+QTEST_APPLESS_MAIN(TestAllocationMap)
+#include "tst_allocationmap.moc"
@@ -0,0 +1,158 @@
+#include <QtTest>
+#include "BatchPlanner.h"
+#include <algorithm>
+
+namespace {
+PlanStick stick(const QString &drive, double bytesPerSecond, const QStringList &links = {}, qint64 size = 0) {
+    PlanStick result;
+    result.drive = drive;
+    result.bytesPerSecond = bytesPerSecond;
+    result.links = links;
+    result.size = size;
+    return result;
+}
+
+PlanTask task(const QString &image, qint64 bytes, const QStringList &candidates, const QList<int> &after = {}) {
+    PlanTask result;
+    result.image = image;
+    result.bytes = bytes;
+    result.size = bytes;
+    result.candidates = candidates;
+    result.after = after;
+    return result;
+}
+
+const PlanEntry *entryOf(const BatchPlan &plan, int task) {
+    for (const PlanEntry &entry : plan.entries) {
+        if (entry.task == task) return &entry;
+    }
+    return nullptr;
+}
+} // namespace
+
+/**
+ * @brief Which stick each write goes to, and when, under link and concurrency limits.
+ */
+class TestBatchPlanner : public QObject {
+    Q_OBJECT
+
+private slots:
+    void durationFollowsRateOrProfile();
+    void biggestImageGetsFastestStick();
+    void eachStickTakesOneImage();
+    void dependentWriteStartsAfterItsDependency();
+    void tooSmallStickIsSkipped();
+    void runningLimitSerialisesWrites();
+    void sharedLinkDelaysSecondWrite();
+    void runningWriteHoldsItsLink();
+    void taskWaitsUntilReady();
+};
+
+void TestBatchPlanner::durationFollowsRateOrProfile() {
+    PlanStick plain = stick("/dev/sdb", 10e6);
+    QCOMPARE(plain.millisecondsFor(100000000), qint64(10000));
+
+    // A profile with history wins, unless the stick's own link is slower
+    PlanStick profiled = stick("/dev/sdc", 40e6);
+    profiled.profile.sustainedBytesPerSecond = 20e6;
+    QCOMPARE(profiled.millisecondsFor(100000000), qint64(5000));
+    profiled.bytesPerSecond = 10e6;
+    QCOMPARE(profiled.millisecondsFor(100000000), qint64(10000));
+}
+
+void TestBatchPlanner::biggestImageGetsFastestStick() {
+    const QList<PlanStick> sticks = {stick("slow", 10e6), stick("fast", 100e6)};
+    const QList<PlanTask> tasks = {task("small", 100000000, {"slow", "fast"}),
+                                   task("big", 1000000000, {"slow", "fast"})};
+    const BatchPlan plan = BatchPlanner().plan(tasks, sticks);
+    QCOMPARE(plan.entries.size(), qsizetype(2));
+    QVERIFY(plan.unplaced.isEmpty());
+    QCOMPARE(entryOf(plan, 1)->drive, QString("fast"));
+    QCOMPARE(entryOf(plan, 0)->drive, QString("slow"));
+    QCOMPARE(plan.makespanMs, qint64(10000));
+}
+
+void TestBatchPlanner::eachStickTakesOneImage() {
+    const QList<PlanStick> sticks = {stick("only", 100e6)};
+    const QList<PlanTask> tasks = {task("a", 1000000, {"only"}), task("b", 1000000, {"only"})};
+    const BatchPlan plan = BatchPlanner().plan(tasks, sticks);
+    QCOMPARE(plan.entries.size(), qsizetype(1));
+    QCOMPARE(plan.unplaced.size(), qsizetype(1));
+}
+
+void TestBatchPlanner::dependentWriteStartsAfterItsDependency() {
+    const QList<PlanStick> sticks = {stick("sdb", 10e6), stick("sdc", 10e6)};
+    const QList<PlanTask> tasks = {task("second", 100000000, {"sdb", "sdc"}, {1}),
+                                   task("first", 100000000, {"sdb", "sdc"})};
+    const BatchPlan plan = BatchPlanner().plan(tasks, sticks);
+    QCOMPARE(plan.entries.size(), qsizetype(2));
+    QCOMPARE(plan.entries[0].task, 1); // Entries are in start order
+    QCOMPARE(plan.entries[1].startMs, plan.entries[0].finishMs);
+    QCOMPARE(plan.makespanMs, qint64(20000));
+
+    // An unplaced dependency leaves its dependants unplaced too
+    const BatchPlan blocked = BatchPlanner().plan({task("second", 1000, {"sdb"}, {1}), task("first", 1000, {})}, sticks);
+    QVERIFY(blocked.entries.isEmpty());
+    QCOMPARE(blocked.unplaced.size(), qsizetype(2));
+}
+
+void TestBatchPlanner::tooSmallStickIsSkipped() {
+    const QList<PlanStick> sticks = {stick("small", 100e6, {}, 1000000), stick("large", 10e6, {}, 0)};
+    PlanTask sparse = task("image", 500000, {"small", "large"});
+    sparse.size = 4000000; // Writes little, but needs the room
+    const BatchPlan plan = BatchPlanner().plan({sparse}, sticks);
+    QCOMPARE(plan.entries.size(), qsizetype(1));
+    QCOMPARE(plan.entries[0].drive, QString("large"));
+}
+
+void TestBatchPlanner::runningLimitSerialisesWrites() {
+    BatchPlanner planner;
+    planner.setMaxRunning(1);
+    const QList<PlanStick> sticks = {stick("sdb", 10e6), stick("sdc", 10e6)};
+    const BatchPlan plan = planner.plan({task("a", 100000000, {"sdb"}), task("b", 100000000, {"sdc"})}, sticks);
+    QCOMPARE(plan.entries.size(), qsizetype(2));
+    QCOMPARE(plan.entries[0].startMs, qint64(0));
+    QCOMPARE(plan.entries[1].startMs, plan.entries[0].finishMs);
+}
+
+void TestBatchPlanner::sharedLinkDelaysSecondWrite() {
+    BatchPlanner planner;
+    planner.setLinkCapacity({{"hub", 30e6}});
+    const QList<PlanStick> sticks = {stick("sdb", 20e6, {"hub"}), stick("sdc", 20e6, {"hub"}),
+                                     stick("sdd", 20e6, {"other"})};
+    const QList<PlanTask> tasks = {task("a", 200000000, {"sdb"}), task("b", 200000000, {"sdc"}),
+                                   task("c", 200000000, {"sdd"})};
+    const BatchPlan plan = planner.plan(tasks, sticks);
+    QCOMPARE(plan.entries.size(), qsizetype(3));
+    // Two sticks at 20 MB/s do not fit through a 30 MB/s hub together; the third is elsewhere
+    QCOMPARE(entryOf(plan, 2)->startMs, qint64(0));
+    const qint64 hubStarts[] = {entryOf(plan, 0)->startMs, entryOf(plan, 1)->startMs};
+    QCOMPARE(std::min(hubStarts[0], hubStarts[1]), qint64(0));
+    QCOMPARE(std::max(hubStarts[0], hubStarts[1]), qint64(10000));
+}
+
+void TestBatchPlanner::runningWriteHoldsItsLink() {
+    BatchPlanner planner;
+    planner.setLinkCapacity({{"hub", 30e6}});
+    const PlanStick busy = stick("sdb", 20e6, {"hub"});
+    planner.addRunning(busy, 5000);
+    const BatchPlan plan = planner.plan({task("a", 20000000, {"sdc"})}, {busy, stick("sdc", 20e6, {"hub"})});
+    QCOMPARE(plan.entries.size(), qsizetype(1));
+    QCOMPARE(plan.entries[0].startMs, qint64(5000));
+    QCOMPARE(plan.makespanMs, qint64(6000));
+}
+
+void TestBatchPlanner::taskWaitsUntilReady() {
+    // A dependency still running outside the plan holds the task back, and its chain with it
+    const QList<PlanStick> sticks = {stick("sdb", 10e6), stick("sdc", 10e6)};
+    PlanTask waiting = task("later", 100000000, {"sdb", "sdc"});
+    waiting.readyMs = 3000;
+    const BatchPlan plan = BatchPlanner().plan({waiting, task("next", 100000000, {"sdb", "sdc"}, {0})}, sticks);
+    QCOMPARE(plan.entries.size(), qsizetype(2));
+    QCOMPARE(entryOf(plan, 0)->startMs, qint64(3000));
+    QCOMPARE(entryOf(plan, 1)->startMs, qint64(13000));
+    QCOMPARE(plan.makespanMs, qint64(23000));
+}
+
+QTEST_APPLESS_MAIN(TestBatchPlanner)
+#include "tst_batchplanner.moc"
@@ -0,0 +1,156 @@
+#include <QCryptographicHash>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QtTest>
+#include "BmapFile.h"
+
+namespace {
+const QByteArray kDigest1 = QByteArray(64, 'a');
+const QByteArray kDigest2 = QByteArray(64, 'b');
+
+QByteArray bmapXml(const QByteArray &version, const QByteArray &blockSize, const QByteArray &ranges,
+                   const QByteArray &fileChecksum = QByteArray()) {
+    QByteArray xml = "<?xml version=\"1.0\" ?>\n<bmap version=\"" + version + "\">\n"
+                     "    <ImageSize> 10000 </ImageSize>\n"
+                     "    <BlockSize> " + blockSize + " </BlockSize>\n"
+                     "    <BlocksCount> 3 </BlocksCount>\n"
+                     "    <MappedBlocksCount> 2 </MappedBlocksCount>\n"
+                     "    <ChecksumType> sha256 </ChecksumType>\n";
+    if (!fileChecksum.isEmpty()) {
+        xml += "    <BmapFileChecksum> " + fileChecksum + " </BmapFileChecksum>\n";
+    }
+    return xml + "    <BlockMap>\n" + ranges + "    </BlockMap>\n</bmap>\n";
+}
+
+const QByteArray kRanges = "        <Range chksum=\"" + kDigest2 + "\"> 2 </Range>\n"
+                           "        <Range chksum=\"" + kDigest1 + "\"> 0-0 </Range>\n";
+} // namespace
+
+/**
+ * @brief Parsing and validation of bmaptool block maps.
+ */
+class TestBmapFile : public QObject {
+    Q_OBJECT
+
+private slots:
+    void rangesAreSortedAndClipped();
+    void fileChecksumIsVerified();
+    void corruptFileIsRejected();
+    void overlappingRangesAreRejected();
+    void badBlockSizeIsRejected();
+    void unsupportedVersionIsRejected();
+    void findsBmapOfCompressedImage();
+    void version1UsesSha1();
+    void wrongDigestLengthIsRejected();
+
+private:
+    QString write(const QString &name, const QByteArray &contents);
+
+    QTemporaryDir dir;
+};
+
+QString TestBmapFile::write(const QString &name, const QByteArray &contents) {
+    const QString path = dir.filePath(name);
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(contents) != contents.size()) {
+        qFatal("Cannot write %s", qPrintable(path));
+    }
+    return path;
+}
+
+void TestBmapFile::rangesAreSortedAndClipped() {
+    BmapFile bmap;
+    QString error;
+    QVERIFY2(bmap.load(write("image.bmap", bmapXml("2.0", "4096", kRanges)), &error), qPrintable(error));
+    QCOMPARE(bmap.version(), QString("2.0"));
+    QCOMPARE(bmap.imageSize(), qint64(10000));
+    QCOMPARE(bmap.blockSize(), qint64(4096));
+    QCOMPARE(bmap.checksumAlgorithm(), QCryptographicHash::Sha256);
+    QVERIFY(bmap.hasChecksums());
+
+    const QList<BmapRange> &ranges = bmap.ranges();
+    QCOMPARE(ranges.size(), qsizetype(2));
+    QCOMPARE(ranges[0].offset, qint64(0));
+    QCOMPARE(ranges[0].length, qint64(4096));
+    QCOMPARE(ranges[0].checksum, QByteArray::fromHex(kDigest1));
+    // The last block ends with the image
+    QCOMPARE(ranges[1].offset, qint64(8192));
+    QCOMPARE(ranges[1].length, qint64(10000 - 8192));
+    QCOMPARE(bmap.mappedBytes(), qint64(4096 + 10000 - 8192));
+}
+
+void TestBmapFile::fileChecksumIsVerified() {
+    // The checksum is taken over the file with its own value zeroed
+    const QByteArray zeroed = bmapXml("2.0", "4096", kRanges, QByteArray(64, '0'));
+    const QByteArray digest = QCryptographicHash::hash(zeroed, QCryptographicHash::Sha256).toHex();
+    BmapFile bmap;
+    QString error;
+    QVERIFY2(bmap.load(write("signed.bmap", bmapXml("2.0", "4096", kRanges, digest)), &error), qPrintable(error));
+}
+
+void TestBmapFile::corruptFileIsRejected() {
+    BmapFile bmap;
+    QString error;
+    QVERIFY(!bmap.load(write("corrupt.bmap", bmapXml("2.0", "4096", kRanges, QByteArray(64, 'c'))), &error));
+    QVERIFY(error.contains("checksum mismatch"));
+}
+
+void TestBmapFile::overlappingRangesAreRejected() {
+    const QByteArray ranges = "        <Range chksum=\"" + kDigest1 + "\"> 0-1 </Range>\n"
+                              "        <Range chksum=\"" + kDigest2 + "\"> 1-2 </Range>\n";
+    BmapFile bmap;
+    QString error;
+    QVERIFY(!bmap.load(write("overlap.bmap", bmapXml("2.0", "4096", ranges)), &error));
+    QVERIFY(error.contains("overlaps"));
+}
+
+void TestBmapFile::badBlockSizeIsRejected() {
+    BmapFile bmap;
+    QVERIFY(!bmap.load(write("block.bmap", bmapXml("2.0", "3000", kRanges))));
+}
+
+void TestBmapFile::unsupportedVersionIsRejected() {
+    BmapFile bmap;
+    QString error;
+    QVERIFY(!bmap.load(write("future.bmap", bmapXml("3.0", "4096", kRanges)), &error));
+    QVERIFY(error.contains("version"));
+}
+
+void TestBmapFile::findsBmapOfCompressedImage() {
+    const QString image = write("release.img.xz", "data");
+    QVERIFY(BmapFile::findFor(image).isEmpty());
+    const QString bmap = write("release.img.bmap", bmapXml("2.0", "4096", kRanges));
+    QCOMPARE(BmapFile::findFor(image), bmap);
+}
+
+void TestBmapFile::version1UsesSha1() {
+    // 1.x files have no ChecksumType and name the digest attribute sha1
+    const QByteArray sha1 = QByteArray(40, 'd');
+    const QByteArray xml = "<?xml version=\"1.0\" ?>\n<bmap version=\"1.3\">\n"
+                           "    <ImageSize> 8192 </ImageSize>\n"
+                           "    <BlockSize> 4096 </BlockSize>\n"
+                           "    <BlocksCount> 2 </BlocksCount>\n"
+                           "    <BlockMap>\n"
+                           "        <Range sha1=\"" + sha1 + "\"> 1 </Range>\n"
+                           "    </BlockMap>\n</bmap>\n";
+    BmapFile bmap;
+    QString error;
+    QVERIFY2(bmap.load(write("old.bmap", xml), &error), qPrintable(error));
+    QCOMPARE(bmap.checksumAlgorithm(), QCryptographicHash::Sha1);
+    QVERIFY(bmap.hasChecksums());
+    QCOMPARE(bmap.ranges().size(), qsizetype(1));
+    QCOMPARE(bmap.ranges()[0].offset, qint64(4096));
+    QCOMPARE(bmap.ranges()[0].checksum, QByteArray::fromHex(sha1));
+}
+
+void TestBmapFile::wrongDigestLengthIsRejected() {
+    // A SHA-1 sized digest in a SHA-256 bmap could never match, so the file is refused up front
+    const QByteArray ranges = "        <Range chksum=\"" + QByteArray(40, 'e') + "\"> 0 </Range>\n";
+    BmapFile bmap;
+    QString error;
+    QVERIFY(!bmap.load(write("short.bmap", bmapXml("2.0", "4096", ranges)), &error));
+    QVERIFY2(error.contains("malformed checksum"), qPrintable(error));
+}
+
+QTEST_APPLESS_MAIN(TestBmapFile)
+#include "tst_bmapfile.moc"
@@ -0,0 +1,133 @@
+#include <QFile>
+#include <QMap>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QtTest>
+#include "BlockDevice.h"
+#include "CapacityCheck.h"
+
+namespace {
+const qint64 kMiB = 1024 * 1024;
+const quint64 kNonce = 0x1234567890ABCDEFULL;
+
+using ProbeResult = CapacityCheck::ProbeResult;
+
+/**
+ * @brief Writes every probe of a run to a fake stick and reads them back, as CapacityCheck::run does.
+ *
+ * The stick reports reportedSize but has realSize of flash. Addresses beyond
+ * it either wrap around onto lower ones or drop the write and read zeros.
+ */
+QMap<qint64, ProbeResult> probeFake(qint64 reportedSize, qint64 realSize, bool wraps) {
+    QByteArray flash(realSize, '\0');
+    QByteArray expected(CapacityCheck::kProbeSize, Qt::Uninitialized);
+    const QList<qint64> offsets = CapacityCheck::probeOffsets(reportedSize, 512);
+    for (const qint64 offset : offsets) {
+        if (offset < realSize || wraps) {
+            CapacityCheck::fillProbe(flash.data() + offset % realSize, expected.size(), kNonce, offset);
+        }
+    }
+    QMap<qint64, ProbeResult> results;
+    const QByteArray zeros(expected.size(), '\0');
+    for (const qint64 offset : offsets) {
+        CapacityCheck::fillProbe(expected.data(), expected.size(), kNonce, offset);
+        const char *data = offset < realSize || wraps ? flash.constData() + offset % realSize : zeros.constData();
+        results[offset] = CapacityCheck::checkProbe(data, expected.constData(), expected.size(), kNonce);
+    }
+    return results;
+}
+} // namespace
+
+/**
+ * @brief Probe placement, probe classification on fake sticks, and a full check on a genuine image file.
+ */
+class TestCapacityCheck : public QObject {
+    Q_OBJECT
+
+private slots:
+    void probesAreAlignedAndReachTheEnd();
+    void wrappedAddressesAreDetected();
+    void lostWritesAreNotWraparound();
+    void staleProbeFromAnotherRunIsLost();
+    void genuineImageIsLeftUntouched();
+};
+
+void TestCapacityCheck::probesAreAlignedAndReachTheEnd() {
+    const qint64 size = 64 * kMiB + 512; // Not a whole number of probes
+    const QList<qint64> offsets = CapacityCheck::probeOffsets(size, 512);
+    QCOMPARE(offsets.first(), CapacityCheck::kFirstProbe);
+    QVERIFY(offsets.contains(3 * kMiB / 2));
+    QCOMPARE(offsets.last(), 64 * kMiB - CapacityCheck::kProbeSize);
+    for (qsizetype i = 0; i < offsets.size(); ++i) {
+        QCOMPARE(offsets[i] % CapacityCheck::kProbeSize, qint64(0));
+        QVERIFY(offsets[i] + CapacityCheck::kProbeSize <= size);
+        if (i > 0) QVERIFY(offsets[i] > offsets[i - 1]);
+    }
+    QCOMPARE(CapacityCheck::probeOffsets(kMiB, 512).size(), qsizetype(1)); // Only the last block
+}
+
+void TestCapacityCheck::wrappedAddressesAreDetected() {
+    // 128 MiB reported, 32 MiB real: the probe at 48 MiB lands on the one at 16 MiB
+    const QMap<qint64, ProbeResult> results = probeFake(128 * kMiB, 32 * kMiB, true);
+    for (const qint64 offset : {1 * kMiB, 4 * kMiB, 12 * kMiB}) {
+        QCOMPARE(results.value(offset), ProbeResult::Intact);
+    }
+    QCOMPARE(results.value(16 * kMiB), ProbeResult::Aliased);
+    QCOMPARE(results.value(32 * kMiB), ProbeResult::Aliased); // Address 0 holds the probe at 96 MiB
+    QCOMPARE(results.value(64 * kMiB), ProbeResult::Aliased);
+}
+
+void TestCapacityCheck::lostWritesAreNotWraparound() {
+    const QMap<qint64, ProbeResult> results = probeFake(128 * kMiB, 32 * kMiB, false);
+    for (auto it = results.cbegin(); it != results.cend(); ++it) {
+        QCOMPARE(it.value(), it.key() < 32 * kMiB ? ProbeResult::Intact : ProbeResult::Lost);
+    }
+}
+
+void TestCapacityCheck::staleProbeFromAnotherRunIsLost() {
+    // Left behind by an interrupted run: the right offset but another nonce
+    QByteArray stale(CapacityCheck::kProbeSize, Qt::Uninitialized);
+    QByteArray expected(CapacityCheck::kProbeSize, Qt::Uninitialized);
+    CapacityCheck::fillProbe(stale.data(), stale.size(), kNonce + 1, 8 * kMiB);
+    CapacityCheck::fillProbe(expected.data(), expected.size(), kNonce, 8 * kMiB);
+    QCOMPARE(CapacityCheck::checkProbe(stale.constData(), expected.constData(), expected.size(), kNonce),
+             ProbeResult::Lost);
+
+    // The right probe with a corrupted tail is damaged flash, not aliasing
+    QByteArray damaged = expected;
+    damaged[damaged.size() - 1] = char(~damaged[damaged.size() - 1]);
+    QCOMPARE(CapacityCheck::checkProbe(damaged.constData(), expected.constData(), expected.size(), kNonce),
+             ProbeResult::Lost);
+}
+
+void TestCapacityCheck::genuineImageIsLeftUntouched() {
+    QTemporaryDir dir;
+    const QString path = dir.filePath("genuine.img");
+    QByteArray contents(16 * kMiB, Qt::Uninitialized);
+    QRandomGenerator(3).fillRange(reinterpret_cast<quint32 *>(contents.data()), contents.size() / 4);
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        QCOMPARE(file.write(contents), qint64(contents.size()));
+    }
+
+    BlockDevice device;
+    QVERIFY(device.open(path, true, false));
+    CapacityReport report;
+    const std::atomic<bool> cancelled = false;
+    QString error;
+    QVERIFY2(CapacityCheck::run(device, &report, cancelled, &error), qPrintable(error));
+    QVERIFY(report.genuine());
+    QVERIFY(!report.wrapsAround);
+    QCOMPARE(report.reportedSize, 16 * kMiB);
+    QCOMPARE(report.verifiedSize, 16 * kMiB);
+    QCOMPARE(report.probes, int(CapacityCheck::probeOffsets(16 * kMiB, device.logicalBlockSize()).size()));
+    device.close();
+
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QVERIFY(file.readAll() == contents);
+}
+
+QTEST_APPLESS_MAIN(TestCapacityCheck)
+#include "tst_capacitycheck.moc"
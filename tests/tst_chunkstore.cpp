@@ -0,0 +1,174 @@
+#include <QBuffer>
+#include <QRandomGenerator>
+#include <QSet>
+#include <QTemporaryDir>
+#include <QtTest>
+#include "ChunkStore.h"
+#include <algorithm>
+#include <memory>
+
+namespace {
+QByteArray randomBytes(qsizetype size, quint32 seed) {
+    QByteArray data(size, Qt::Uninitialized);
+    QRandomGenerator generator(seed);
+    generator.fillRange(reinterpret_cast<quint32 *>(data.data()), size / 4);
+    return data;
+}
+
+// Serves the first failAt bytes of data, then fails every read
+class FailingBuffer : public QBuffer {
+public:
+    FailingBuffer(QByteArray *data, qint64 failAt) : failAt(failAt) { setBuffer(data); }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override {
+        if (pos() >= failAt) {
+            setErrorString("Simulated read error");
+            return -1;
+        }
+        return QBuffer::readData(data, std::min(maxSize, failAt - pos()));
+    }
+
+private:
+    qint64 failAt;
+};
+
+QSet<QByteArray> hashesOf(const ChunkIndex &index) {
+    QSet<QByteArray> hashes;
+    for (const ChunkRef &ref : index.chunks) {
+        hashes.insert(ref.hash);
+    }
+    return hashes;
+}
+} // namespace
+
+/**
+ * @brief Content-defined chunking, deduplication and reference counting in the library's chunk store.
+ */
+class TestChunkStore : public QObject {
+    Q_OBJECT
+
+private slots:
+    void init();
+    void chunksStayWithinBounds();
+    void readerReassemblesTheImage();
+    void insertionOnlyChangesNearbyChunks();
+    void identicalImageStoresNothingNew();
+    void removalKeepsSharedChunks();
+    void reopenRebuildsReferences();
+    void readErrorFailsTheImport();
+
+private:
+    bool import(const QString &id, const QByteArray &data, ChunkIndex *index = nullptr);
+
+    std::unique_ptr<QTemporaryDir> dir;
+    std::unique_ptr<ChunkStore> store;
+    const QByteArray image = randomBytes(3 * 1024 * 1024, 1);
+};
+
+void TestChunkStore::init() {
+    dir = std::make_unique<QTemporaryDir>();
+    store = std::make_unique<ChunkStore>(dir->path());
+    QVERIFY(store->open());
+}
+
+bool TestChunkStore::import(const QString &id, const QByteArray &data, ChunkIndex *index) {
+    QByteArray copy = data;
+    QBuffer buffer(&copy);
+    buffer.open(QIODevice::ReadOnly);
+    QString error;
+    const bool ok = store->importImage(id, &buffer, &error, index);
+    if (!ok) qWarning() << error;
+    return ok;
+}
+
+void TestChunkStore::chunksStayWithinBounds() {
+    ChunkIndex index;
+    QVERIFY(import("image", image, &index));
+    QCOMPARE(index.imageSize, qint64(image.size()));
+    QVERIFY(index.chunks.size() > 10);
+    qint64 offset = 0;
+    for (qsizetype i = 0; i < index.chunks.size(); ++i) {
+        const quint32 size = index.chunks[i].size;
+        QCOMPARE(index.offsets[i], offset);
+        QVERIFY(size <= ChunkStore::kMaxChunkSize);
+        if (i + 1 < index.chunks.size()) QVERIFY(size >= ChunkStore::kMinChunkSize);
+        offset += size;
+    }
+    QCOMPARE(offset, index.imageSize);
+    QCOMPARE(store->storedBytes(), qint64(image.size())); // Random data has no repeats
+}
+
+void TestChunkStore::readerReassemblesTheImage() {
+    QVERIFY(import("image", image));
+    ChunkedImageReader reader(store->indexPath("image"));
+    QVERIFY(reader.open(QIODevice::ReadOnly));
+    QCOMPARE(reader.size(), qint64(image.size()));
+    QVERIFY(reader.readAll() == image);
+
+    // Seeking lands in the middle of a chunk
+    QVERIFY(reader.seek(1000001));
+    QVERIFY(reader.read(70000) == image.mid(1000001, 70000));
+}
+
+void TestChunkStore::insertionOnlyChangesNearbyChunks() {
+    QByteArray edited = image;
+    edited.insert(image.size() / 2, randomBytes(100, 2));
+    ChunkIndex original;
+    ChunkIndex changed;
+    QVERIFY(import("original", image, &original));
+    QVERIFY(import("changed", edited, &changed));
+
+    // Boundaries resynchronise right after the insertion, so only a chunk or two differ
+    const QSet<QByteArray> added = hashesOf(changed) - hashesOf(original);
+    QVERIFY2(added.size() <= 3, qPrintable(QString::number(added.size())));
+    QVERIFY(store->storedBytes() < image.size() + 3 * qint64(ChunkStore::kMaxChunkSize));
+}
+
+void TestChunkStore::identicalImageStoresNothingNew() {
+    QVERIFY(import("first", image));
+    const qint64 stored = store->storedBytes();
+    QVERIFY(import("second", image));
+    QCOMPARE(store->storedBytes(), stored);
+    QCOMPARE(store->uniqueBytes("first"), qint64(0)); // Removing one frees nothing while the other exists
+}
+
+void TestChunkStore::removalKeepsSharedChunks() {
+    QVERIFY(import("first", image));
+    QVERIFY(import("second", image));
+    QVERIFY(store->removeImage("first"));
+    QVERIFY(!store->hasImage("first"));
+    QCOMPARE(store->storedBytes(), qint64(image.size()));
+
+    ChunkedImageReader reader(store->indexPath("second"));
+    QVERIFY(reader.open(QIODevice::ReadOnly));
+    QVERIFY(reader.readAll() == image);
+
+    QCOMPARE(store->uniqueBytes("second"), qint64(image.size()));
+    QVERIFY(store->removeImage("second"));
+    QCOMPARE(store->storedBytes(), qint64(0));
+}
+
+void TestChunkStore::reopenRebuildsReferences() {
+    QVERIFY(import("first", image));
+    QVERIFY(import("second", image.left(image.size() / 2)));
+    const qint64 stored = store->storedBytes();
+
+    ChunkStore reopened(dir->path());
+    QVERIFY(reopened.open());
+    QCOMPARE(reopened.storedBytes(), stored);
+    QCOMPARE(reopened.uniqueBytes("second"), store->uniqueBytes("second"));
+}
+
+void TestChunkStore::readErrorFailsTheImport() {
+    QByteArray copy = image;
+    FailingBuffer failing(&copy, image.size() / 3);
+    QVERIFY(failing.open(QIODevice::ReadOnly | QIODevice::Unbuffered));
+    QString error;
+    QVERIFY(!store->importImage("broken", &failing, &error));
+    QVERIFY2(error.contains("Simulated read error"), qPrintable(error));
+    QVERIFY(!store->hasImage("broken")); // Never listed as a shorter image
+}
+
+QTEST_APPLESS_MAIN(TestChunkStore)
+#include "tst_chunkstore.moc"
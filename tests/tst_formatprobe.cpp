@@ -0,0 +1,129 @@
+#include <QFile>
+#include <QTemporaryDir>
+#include <QtTest>
+#include "FormatProbe.h"
+
+/**
+ * @brief Format detection by content, and the write engine the probe picks.
+ */
+class TestFormatProbe : public QObject {
+    Q_OBJECT
+
+private slots:
+    void isoIsWrittenDirectly();
+    void hybridIsoIsRecognised();
+    void partitionedDiskIsRecognised();
+    void unknownDataIsWrittenRaw();
+    void unknownDataNeedsRawName();
+    void containerIsDecoded();
+    void libraryImageIsDecoded();
+    void bmapNextToImageSelectsBmapEngine();
+    void unsupportedCompressionIsRefused();
+    void missingFileIsRefused();
+
+private:
+    // Writes size bytes of zeros with patches at the given offsets
+    QString makeImage(const QString &name, qint64 size, const QList<QPair<qint64, QByteArray>> &patches);
+
+    QTemporaryDir dir;
+};
+
+QString TestFormatProbe::makeImage(const QString &name, qint64 size, const QList<QPair<qint64, QByteArray>> &patches) {
+    QByteArray data(size, '\0');
+    for (const auto &[offset, bytes] : patches) {
+        data.replace(offset, bytes.size(), bytes);
+    }
+    const QString path = dir.filePath(name);
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size()) {
+        qFatal("Cannot write %s", qPrintable(path));
+    }
+    return path;
+}
+
+void TestFormatProbe::isoIsWrittenDirectly() {
+    const ProbeResult result = FormatProbe::probe(makeImage("plain.iso", 64 * 1024, {{0x8001, "CD001"}}));
+    QCOMPARE(result.formatName, QString("ISO 9660"));
+    QCOMPARE(result.engine, WriteEngine::Direct);
+    QVERIFY(result.iso);
+    QVERIFY(!result.hybrid);
+    QVERIFY(result.createReader);
+}
+
+void TestFormatProbe::hybridIsoIsRecognised() {
+    const ProbeResult result = FormatProbe::probe(
+        makeImage("hybrid.iso", 64 * 1024, {{510, "\x55\xAA"}, {512, "EFI PART"}, {0x8001, "CD001"}}));
+    QCOMPARE(result.formatName, QString("ISO 9660"));
+    QVERIFY(result.hybrid);
+    QCOMPARE(result.description, QString("ISO 9660 (hybrid, MBR + GPT)"));
+}
+
+void TestFormatProbe::partitionedDiskIsRecognised() {
+    const ProbeResult result = FormatProbe::probe(makeImage("disk.img", 8192, {{510, "\x55\xAA"}}));
+    QCOMPARE(result.formatName, QString("Raw disk image"));
+    QCOMPARE(result.description, QString("Raw disk image (MBR)"));
+    QCOMPARE(result.engine, WriteEngine::Direct);
+}
+
+void TestFormatProbe::unknownDataIsWrittenRaw() {
+    const ProbeResult result = FormatProbe::probe(makeImage("data.bin", 4096, {{0, "hello"}}));
+    QCOMPARE(result.formatName, QString("raw"));
+    QCOMPARE(result.description, QString("Unrecognised data (written as raw)"));
+    QCOMPARE(result.engine, WriteEngine::Direct);
+}
+
+void TestFormatProbe::unknownDataNeedsRawName() {
+    const QString path = makeImage("notes.txt", 4096, {{0, "hello"}});
+    const ProbeResult refused = FormatProbe::probe(path);
+    QVERIFY(!refused.writable());
+    QVERIFY(refused.unrecognised);
+    QVERIFY(!refused.createReader);
+
+    // Once the user confirms, it is written as is
+    const ProbeResult confirmed = FormatProbe::probe(path, true);
+    QCOMPARE(confirmed.formatName, QString("raw"));
+    QCOMPARE(confirmed.engine, WriteEngine::Direct);
+    QVERIFY(!confirmed.unrecognised);
+
+    // Recognised formats never need confirmation, whatever the name
+    QVERIFY(!FormatProbe::probe(makeImage("disk.dat", 8192, {{510, "\x55\xAA"}})).unrecognised);
+}
+
+void TestFormatProbe::containerIsDecoded() {
+    // The magic alone decides; the name does not
+    const ProbeResult result = FormatProbe::probe(makeImage("disk.img", 4096, {{0, "QFI\xFB"}}));
+    QCOMPARE(result.formatName, QString("qcow2"));
+    QCOMPARE(result.engine, WriteEngine::Decode);
+    QVERIFY(result.sparse);
+    QVERIFY(result.bmapPath.isEmpty());
+}
+
+void TestFormatProbe::libraryImageIsDecoded() {
+    const ProbeResult result = FormatProbe::probe(makeImage("entry.cidx", 512, {{0, "INFCIDX1"}}));
+    QCOMPARE(result.formatName, QString("Inferno library image"));
+    QCOMPARE(result.engine, WriteEngine::Decode);
+}
+
+void TestFormatProbe::bmapNextToImageSelectsBmapEngine() {
+    const QString image = makeImage("sparse.img", 8192, {{510, "\x55\xAA"}});
+    makeImage("sparse.bmap", 16, {});
+    const ProbeResult result = FormatProbe::probe(image);
+    QCOMPARE(result.engine, WriteEngine::Bmap);
+    QCOMPARE(result.bmapPath, dir.filePath("sparse.bmap"));
+}
+
+void TestFormatProbe::unsupportedCompressionIsRefused() {
+    const ProbeResult result = FormatProbe::probe(makeImage("image.gz", 1024, {{0, "\x1F\x8B"}}));
+    QCOMPARE(result.formatName, QString("gzip"));
+    QVERIFY(!result.writable());
+    QVERIFY(!result.error.isEmpty());
+}
+
+void TestFormatProbe::missingFileIsRefused() {
+    const ProbeResult result = FormatProbe::probe(dir.filePath("missing.iso"));
+    QVERIFY(!result.writable());
+    QVERIFY(!result.error.isEmpty());
+}
+
+QTEST_APPLESS_MAIN(TestFormatProbe)
+#include "tst_formatprobe.moc"
@@ -0,0 +1,303 @@
+#include <QFile>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QtEndian>
+#include <QtTest>
+#include "ImageSource.h"
+#include <cstring>
+
+// Next to SourceExtent, where QCOMPARE finds them
+static bool operator==(const SourceExtent &a, const SourceExtent &b) {
+    return a.offset == b.offset && a.length == b.length && a.hole == b.hole;
+}
+
+static char *toString(const SourceExtent &extent) {
+    return QTest::toString(QString("[%1, %2)%3").arg(extent.offset).arg(extent.end()).arg(extent.hole ? " hole" : ""));
+}
+
+namespace {
+const qint64 kBlock = 4096;
+
+QByteArray randomBytes(qsizetype size, quint32 seed) {
+    QByteArray data(size, Qt::Uninitialized);
+    QRandomGenerator generator(seed);
+    generator.fillRange(reinterpret_cast<quint32 *>(data.data()), size / 4);
+    return data;
+}
+
+QByteArray readRange(ImageSource &source, qint64 offset, qint64 length) {
+    QByteArray data(length, Qt::Uninitialized);
+    if (source.readAt(data.data(), length, offset) != length) {
+        qWarning() << source.errorString();
+        return {};
+    }
+    return data;
+}
+
+QByteArray sparseHeader(quint32 totalBlocks, quint32 totalChunks) {
+    QByteArray header(28, '\0');
+    qToLittleEndian<quint32>(0xED26FF3A, header.data());
+    qToLittleEndian<quint16>(1, header.data() + 4);
+    qToLittleEndian<quint16>(28, header.data() + 8);
+    qToLittleEndian<quint16>(12, header.data() + 10);
+    qToLittleEndian<quint32>(quint32(kBlock), header.data() + 12);
+    qToLittleEndian<quint32>(totalBlocks, header.data() + 16);
+    qToLittleEndian<quint32>(totalChunks, header.data() + 20);
+    return header;
+}
+
+QByteArray sparseChunk(quint16 type, quint32 blocks, const QByteArray &payload) {
+    QByteArray chunk(12, '\0');
+    qToLittleEndian<quint16>(type, chunk.data());
+    qToLittleEndian<quint32>(blocks, chunk.data() + 4);
+    qToLittleEndian<quint32>(quint32(chunk.size() + payload.size()), chunk.data() + 8);
+    return chunk + payload;
+}
+} // namespace
+
+/**
+ * @brief Expanding Android sparse, qcow2, VHD and VMDK images into their data and holes.
+ *
+ * Each image is built by hand, a few blocks long, with data, unallocated
+ * ranges and explicit zeros, so every mapping path of the decoders is hit.
+ */
+class TestImageSource : public QObject {
+    Q_OBJECT
+
+private slots:
+    void androidSparseExpandsChunks();
+    void androidSparseChunksMustAddUp();
+    void qcow2FollowsClusterTables();
+    void qcow2WithBackingFileIsRefused();
+    void vhdDynamicMapsBlocks();
+    void vhdFixedIsRawData();
+    void vmdkSparseFollowsGrainTables();
+    void vmdkDescriptorJoinsExtents();
+
+private:
+    QString writeImage(const QString &name, const QByteArray &contents);
+    QByteArray qcow2Image(QByteArray *expected);
+
+    QTemporaryDir dir;
+};
+
+QString TestImageSource::writeImage(const QString &name, const QByteArray &contents) {
+    const QString path = dir.filePath(name);
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(contents) != contents.size()) {
+        qFatal("Cannot write %s", qPrintable(path));
+    }
+    return path;
+}
+
+void TestImageSource::androidSparseExpandsChunks() {
+    const QByteArray first = randomBytes(2 * kBlock, 1);
+    const QByteArray last = randomBytes(kBlock, 2);
+    QByteArray fill(4, '\0');
+    qToLittleEndian<quint32>(0xDEADBEEF, fill.data());
+    const QByteArray image = sparseHeader(8, 6) + sparseChunk(0xCAC1, 2, first) + sparseChunk(0xCAC3, 3, {})
+        + sparseChunk(0xCAC2, 1, fill) + sparseChunk(0xCAC2, 1, QByteArray(4, '\0'))
+        + sparseChunk(0xCAC4, 0, QByteArray(4, '\0')) + sparseChunk(0xCAC1, 1, last);
+    const QByteArray expected = first + QByteArray(3 * kBlock, '\0') + fill.repeated(kBlock / 4)
+        + QByteArray(kBlock, '\0') + last;
+
+    std::unique_ptr<ImageSource> source = ImageSources::createAndroidSparse();
+    QVERIFY2(source->open(writeImage("system.simg", image)), qPrintable(source->errorString()));
+    QCOMPARE(source->size(), 8 * kBlock);
+    // A fill of zeros counts as a hole; the CRC chunk covers nothing
+    const QList<SourceExtent> extents = {{0, 2 * kBlock, false}, {2 * kBlock, 3 * kBlock, true},
+                                         {5 * kBlock, kBlock, false}, {6 * kBlock, kBlock, true},
+                                         {7 * kBlock, kBlock, false}};
+    QCOMPARE(source->extents(), extents);
+    QCOMPARE(source->dataBytes(), 4 * kBlock);
+    QVERIFY(readRange(*source, 0, source->size()) == expected);
+    QVERIFY(readRange(*source, 5 * kBlock + 3, 1001) == expected.mid(5 * kBlock + 3, 1001)); // Fill out of phase
+}
+
+void TestImageSource::androidSparseChunksMustAddUp() {
+    const QByteArray image = sparseHeader(4, 1) + sparseChunk(0xCAC1, 2, randomBytes(2 * kBlock, 1));
+    std::unique_ptr<ImageSource> source = ImageSources::createAndroidSparse();
+    QVERIFY(!source->open(writeImage("short.simg", image)));
+    QVERIFY2(source->errorString().contains("image size"), qPrintable(source->errorString()));
+}
+
+QByteArray TestImageSource::qcow2Image(QByteArray *expected) {
+    // 512-byte clusters, so an L2 table maps 64 clusters and three tables cover the image:
+    // header, L1, L2 for table 0, L2 for table 2 (table 1 is unallocated), then the data clusters
+    const qint64 kCluster = 512;
+    const qint64 kSize = 3 * 64 * kCluster;
+    const quint64 kCopied = 1ULL << 63;
+    QByteArray image(8 * kCluster, '\0');
+    char *header = image.data();
+    std::memcpy(header, "QFI\xFB", 4);
+    qToBigEndian<quint32>(3, header + 4);
+    qToBigEndian<quint32>(9, header + 20);
+    qToBigEndian<quint64>(kSize, header + 24);
+    qToBigEndian<quint32>(3, header + 36);
+    qToBigEndian<quint64>(kCluster, header + 40);
+    qToBigEndian<quint32>(4, header + 96);
+    qToBigEndian<quint32>(104, header + 100);
+
+    char *l1 = image.data() + kCluster;
+    qToBigEndian<quint64>(2 * kCluster | kCopied, l1);
+    qToBigEndian<quint64>(3 * kCluster | kCopied, l1 + 16);
+    char *l2 = image.data() + 2 * kCluster;
+    qToBigEndian<quint64>(4 * kCluster | kCopied, l2);
+    qToBigEndian<quint64>(5 * kCluster | kCopied, l2 + 8);
+    qToBigEndian<quint64>(7 * kCluster | 1, l2 + 5 * 8); // Preallocated but flagged zero
+    qToBigEndian<quint64>(6 * kCluster | kCopied, image.data() + 3 * kCluster + 10 * 8);
+
+    const QByteArray head = randomBytes(2 * kCluster, 3);
+    const QByteArray tail = randomBytes(kCluster, 4);
+    image.replace(4 * kCluster, head.size(), head);
+    image.replace(6 * kCluster, tail.size(), tail);
+    image.replace(7 * kCluster, kCluster, randomBytes(kCluster, 5)); // Stale data the zero flag hides
+
+    *expected = QByteArray(kSize, '\0');
+    expected->replace(0, head.size(), head);
+    expected->replace(138 * kCluster, tail.size(), tail);
+    return image;
+}
+
+void TestImageSource::qcow2FollowsClusterTables() {
+    QByteArray expected;
+    const QString path = writeImage("vm.qcow2", qcow2Image(&expected));
+    QString error;
+    std::unique_ptr<ImageSource> source = ImageSource::openImage(path, &error);
+    QVERIFY2(source, qPrintable(error));
+    QCOMPARE(source->formatName(), QString("qcow2"));
+    QCOMPARE(source->size(), qint64(expected.size()));
+    const QList<SourceExtent> extents = {{0, 1024, false}, {1024, 138 * 512 - 1024, true},
+                                         {138 * 512, 512, false}, {139 * 512, expected.size() - 139 * 512, true}};
+    QCOMPARE(source->extents(), extents);
+    QVERIFY(readRange(*source, 0, source->size()) == expected);
+    QVERIFY(readRange(*source, 700, 2000) == expected.mid(700, 2000)); // Across clusters into the zero one
+}
+
+void TestImageSource::qcow2WithBackingFileIsRefused() {
+    QByteArray expected;
+    QByteArray image = qcow2Image(&expected);
+    qToBigEndian<quint64>(3000, image.data() + 8);
+    std::unique_ptr<ImageSource> source = ImageSources::createQcow2();
+    QVERIFY(!source->open(writeImage("child.qcow2", image)));
+    QVERIFY2(source->errorString().contains("backing file"), qPrintable(source->errorString()));
+}
+
+void TestImageSource::vhdDynamicMapsBlocks() {
+    // Header at 512, BAT at 1536, then blocks 0 and 2 (each a sector bitmap and 4 KB of data), then the footer
+    const qint64 kSize = 4 * kBlock;
+    QByteArray image(11264 + 512, '\0');
+    char *header = image.data() + 512;
+    std::memcpy(header, "cxsparse", 8);
+    qToBigEndian<quint64>(1536, header + 16);
+    qToBigEndian<quint32>(4, header + 28);
+    qToBigEndian<quint32>(quint32(kBlock), header + 32);
+    const quint32 bat[] = {4, 0xFFFFFFFF, 13, 0xFFFFFFFF};
+    for (int i = 0; i < 4; ++i) {
+        qToBigEndian<quint32>(bat[i], image.data() + 1536 + i * 4);
+    }
+    const QByteArray first = randomBytes(kBlock, 6);
+    const QByteArray third = randomBytes(kBlock, 7);
+    image.replace(2048, 512, QByteArray(512, '\xFF'));
+    image.replace(2048 + 512, kBlock, first);
+    image.replace(6656, 512, QByteArray(512, '\xFF'));
+    image.replace(6656 + 512, kBlock, third);
+
+    char *footer = image.data() + 11264;
+    std::memcpy(footer, "conectix", 8);
+    qToBigEndian<quint64>(512, footer + 16);
+    qToBigEndian<quint64>(kSize, footer + 48);
+    qToBigEndian<quint32>(3, footer + 60);
+    image.replace(0, 512, image.mid(11264, 512)); // Dynamic images keep a copy in front
+
+    std::unique_ptr<ImageSource> source = ImageSources::createVhd();
+    QVERIFY2(source->open(writeImage("disk.vhd", image)), qPrintable(source->errorString()));
+    QCOMPARE(source->size(), kSize);
+    const QList<SourceExtent> extents = {{0, kBlock, false}, {kBlock, kBlock, true},
+                                         {2 * kBlock, kBlock, false}, {3 * kBlock, kBlock, true}};
+    QCOMPARE(source->extents(), extents);
+    const QByteArray expected = first + QByteArray(kBlock, '\0') + third + QByteArray(kBlock, '\0');
+    QVERIFY(readRange(*source, 0, kSize) == expected);
+    QVERIFY(readRange(*source, kBlock - 100, kBlock + 200) == expected.mid(kBlock - 100, kBlock + 200));
+}
+
+void TestImageSource::vhdFixedIsRawData() {
+    const QByteArray data = randomBytes(2 * kBlock, 8);
+    QByteArray footer(512, '\0');
+    std::memcpy(footer.data(), "conectix", 8);
+    qToBigEndian<quint64>(0xFFFFFFFFFFFFFFFFULL, footer.data() + 16);
+    qToBigEndian<quint64>(data.size(), footer.data() + 48);
+    qToBigEndian<quint32>(2, footer.data() + 60);
+
+    std::unique_ptr<ImageSource> source = ImageSources::createVhd();
+    QVERIFY2(source->open(writeImage("fixed.vhd", data + footer)), qPrintable(source->errorString()));
+    QCOMPARE(source->size(), qint64(data.size()));
+    QCOMPARE(source->extents(), (QList<SourceExtent>{{0, data.size(), false}}));
+    QVERIFY(readRange(*source, 0, source->size()) == data); // The footer is not part of the disk
+}
+
+void TestImageSource::vmdkSparseFollowsGrainTables() {
+    // 4 KB grains, 4 per table: directory at sector 1, tables 0 and 2 at sectors 2 and 3 (table 1 is
+    // unallocated), grains at sectors 4, 12 and 20. Grain 2 is an explicit zero grain
+    QByteArray image(28 * 512, '\0');
+    char *header = image.data();
+    qToLittleEndian<quint32>(0x564D444B, header);
+    qToLittleEndian<quint32>(1, header + 4);
+    qToLittleEndian<quint32>(1, header + 8);
+    qToLittleEndian<quint64>(96, header + 12);
+    qToLittleEndian<quint64>(8, header + 20);
+    qToLittleEndian<quint32>(4, header + 44);
+    qToLittleEndian<quint64>(1, header + 56);
+    qToLittleEndian<quint64>(4, header + 64);
+    const quint32 directory[] = {2, 0, 3};
+    const quint32 firstTable[] = {4, 0, 1, 12};
+    const quint32 thirdTable[] = {0, 20, 0, 0};
+    for (int i = 0; i < 3; ++i) {
+        qToLittleEndian<quint32>(directory[i], image.data() + 512 + i * 4);
+    }
+    for (int i = 0; i < 4; ++i) {
+        qToLittleEndian<quint32>(firstTable[i], image.data() + 1024 + i * 4);
+        qToLittleEndian<quint32>(thirdTable[i], image.data() + 1536 + i * 4);
+    }
+    const QByteArray grains = randomBytes(3 * kBlock, 9);
+    image.replace(4 * 512, grains.size(), grains);
+
+    QByteArray expected(96 * 512, '\0');
+    expected.replace(0, kBlock, grains.left(kBlock));
+    expected.replace(3 * kBlock, kBlock, grains.mid(kBlock, kBlock));
+    expected.replace(9 * kBlock, kBlock, grains.right(kBlock));
+
+    std::unique_ptr<ImageSource> source = ImageSources::createVmdk();
+    QVERIFY2(source->open(writeImage("disk.vmdk", image)), qPrintable(source->errorString()));
+    QCOMPARE(source->size(), qint64(expected.size()));
+    const QList<SourceExtent> extents = {{0, kBlock, false}, {kBlock, 2 * kBlock, true},
+                                         {3 * kBlock, kBlock, false}, {4 * kBlock, 5 * kBlock, true},
+                                         {9 * kBlock, kBlock, false}, {10 * kBlock, 2 * kBlock, true}};
+    QCOMPARE(source->extents(), extents);
+    QVERIFY(readRange(*source, 0, source->size()) == expected);
+}
+
+void TestImageSource::vmdkDescriptorJoinsExtents() {
+    const QByteArray flat = randomBytes(2 * kBlock, 10);
+    writeImage("split-flat.vmdk", flat);
+    const QString descriptor = writeImage("split.vmdk",
+                                          "# Disk DescriptorFile\n"
+                                          "version=1\n"
+                                          "createType=\"twoGbMaxExtentFlat\"\n"
+                                          "\n"
+                                          "# Extent description\n"
+                                          "RW 8 FLAT \"split-flat.vmdk\" 0\n"
+                                          "RW 8 ZERO\n"
+                                          "RW 4 FLAT \"split-flat.vmdk\" 8\n");
+
+    std::unique_ptr<ImageSource> source = ImageSources::createVmdk();
+    QVERIFY2(source->open(descriptor), qPrintable(source->errorString()));
+    QCOMPARE(source->size(), 5 * kBlock / 2);
+    const QList<SourceExtent> extents = {{0, kBlock, false}, {kBlock, kBlock, true}, {2 * kBlock, kBlock / 2, false}};
+    QCOMPARE(source->extents(), extents);
+    const QByteArray expected = flat.left(kBlock) + QByteArray(kBlock, '\0') + flat.mid(kBlock, kBlock / 2);
+    QVERIFY(readRange(*source, 0, source->size()) == expected);
+}
+
+QTEST_APPLESS_MAIN(TestImageSource)
+#include "tst_imagesource.moc"
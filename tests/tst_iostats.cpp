@@ -0,0 +1,136 @@
+#include <QThread>
+#include <QtTest>
+#include "IoStats.h"
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Bucketing, percentiles and merging of the HDR histogram, and IoStats' per-thread recording.
+ */
+class TestIoStats : public QObject {
+    Q_OBJECT
+
+private slots:
+    void emptyHistogramReportsZero();
+    void smallValuesAreExact();
+    void bucketsBoundTheRelativeError();
+    void hugeValuesAreClamped();
+    void percentilesNeverUnderstate();
+    void mergeAddsCountsAndBounds();
+    void recordsFromEveryThreadAreMerged();
+    void instancesOnOneThreadStayApart();
+};
+
+void TestIoStats::emptyHistogramReportsZero() {
+    const HdrHistogram histogram;
+    QCOMPARE(histogram.count(), quint64(0));
+    QCOMPARE(histogram.min(), quint64(0));
+    QCOMPARE(histogram.valueAtPercentile(99.0), quint64(0));
+    QCOMPARE(histogram.mean(), 0.0);
+}
+
+void TestIoStats::smallValuesAreExact() {
+    HdrHistogram histogram;
+    for (quint64 value = 0; value < quint64(HdrHistogram::kSubBuckets); ++value) {
+        QCOMPARE(HdrHistogram::bucketHighest(HdrHistogram::bucketIndex(value)), value);
+        histogram.record(value);
+    }
+    QCOMPARE(histogram.valueAtPercentile(50.0), quint64(63));
+    QCOMPARE(histogram.valueAtPercentile(100.0), quint64(127));
+    QCOMPARE(histogram.min(), quint64(0));
+    QCOMPARE(histogram.mean(), 63.5);
+}
+
+void TestIoStats::bucketsBoundTheRelativeError() {
+    int previous = -1;
+    for (quint64 value = 1; value < (quint64(1) << HdrHistogram::kMaxBits); value = value * 3 / 2 + 1) {
+        const int index = HdrHistogram::bucketIndex(value);
+        QVERIFY(index >= previous); // Monotonic
+        QVERIFY(index < HdrHistogram::kBucketCount);
+        const quint64 highest = HdrHistogram::bucketHighest(index);
+        QVERIFY2(highest >= value && highest - value <= value / 64, qPrintable(QString::number(value)));
+        previous = index;
+    }
+}
+
+void TestIoStats::hugeValuesAreClamped() {
+    const quint64 largest = (quint64(1) << HdrHistogram::kMaxBits) - 1;
+    QCOMPARE(HdrHistogram::bucketIndex(quint64(1) << 60), HdrHistogram::bucketIndex(largest));
+    QCOMPARE(HdrHistogram::bucketIndex(largest), HdrHistogram::kBucketCount - 1);
+}
+
+void TestIoStats::percentilesNeverUnderstate() {
+    HdrHistogram histogram;
+    for (quint64 value = 1000; value < 2000; ++value) {
+        histogram.record(value);
+    }
+    QVERIFY(histogram.valueAtPercentile(50.0) >= 1499);
+    QVERIFY(histogram.valueAtPercentile(99.0) >= 1989);
+    QCOMPARE(histogram.valueAtPercentile(100.0), quint64(1999)); // Capped at the maximum seen
+}
+
+void TestIoStats::mergeAddsCountsAndBounds() {
+    HdrHistogram a;
+    HdrHistogram b;
+    a.record(10);
+    a.record(20);
+    b.record(5);
+    b.record(5000);
+    a.merge(b);
+    QCOMPARE(a.count(), quint64(4));
+    QCOMPARE(a.valueSum(), quint64(5035));
+    QCOMPARE(a.min(), quint64(5));
+    QCOMPARE(a.max(), quint64(5000));
+
+    const HdrHistogram copy(a);
+    QCOMPARE(copy.count(), a.count());
+    QCOMPARE(copy.valueAtPercentile(50.0), a.valueAtPercentile(50.0));
+}
+
+void TestIoStats::recordsFromEveryThreadAreMerged() {
+    IoStats stats;
+    const int kThreads = 4;
+    const int kRecords = 1000;
+    std::vector<std::unique_ptr<QThread>> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back(QThread::create([&stats]() {
+            for (int i = 0; i < kRecords; ++i) {
+                stats.record(IoKind::Write, 4096, 2000000); // 2 ms
+            }
+        }));
+        threads.back()->start();
+    }
+    stats.record(IoKind::Read, 512, 1000);
+    for (const auto &thread : threads) {
+        QVERIFY(thread->wait(10000));
+    }
+
+    const IoHistograms merged = stats.merged();
+    QCOMPARE(merged.writeLatency.count(), quint64(kThreads * kRecords));
+    QCOMPARE(merged.writeSize.valueSum(), quint64(kThreads) * kRecords * 4096);
+    QCOMPARE(merged.writeLatency.max(), quint64(2000)); // Recorded in microseconds
+    QCOMPARE(merged.readLatency.count(), quint64(1));
+    QCOMPARE(merged.readSize.max(), quint64(512));
+}
+
+void TestIoStats::instancesOnOneThreadStayApart() {
+    // The thread-local cache must not hand one device's histograms to another
+    IoStats first;
+    IoStats second;
+    first.record(IoKind::Write, 1, 1000);
+    second.record(IoKind::Write, 1, 1000);
+    second.record(IoKind::Write, 1, 1000);
+    first.record(IoKind::Write, 1, 1000);
+    first.record(IoKind::Write, 1, 1000);
+    QCOMPARE(first.merged().writeLatency.count(), quint64(3));
+    QCOMPARE(second.merged().writeLatency.count(), quint64(2));
+
+    // A new instance starts empty, whatever this thread recorded before
+    const std::unique_ptr<IoStats> fresh = std::make_unique<IoStats>();
+    fresh->record(IoKind::Read, 1, 1000);
+    QCOMPARE(fresh->merged().readLatency.count(), quint64(1));
+    QCOMPARE(fresh->merged().writeLatency.count(), quint64(0));
+}
+
+QTEST_APPLESS_MAIN(TestIoStats)
+#include "tst_iostats.moc"
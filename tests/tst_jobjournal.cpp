@@ -0,0 +1,165 @@
+#include <QFile>
+#include <QTemporaryDir>
+#include <QtTest>
+#include "JobJournal.h"
+#include <memory>
+
+namespace {
+Job imageJob(qint64 id, const QString &drive) {
+    Job job;
+    job.id = id;
+    job.kind = "image";
+    job.imagePath = "/srv/release.img";
+    job.drives = {drive};
+    return job;
+}
+
+QList<QByteArray> linesOf(const QString &path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return {};
+    }
+    QList<QByteArray> lines = file.readAll().split('\n');
+    lines.removeAll(QByteArray());
+    return lines;
+}
+} // namespace
+
+/**
+ * @brief Replay, crash tolerance and compaction of the daemon's job journal.
+ */
+class TestJobJournal : public QObject {
+    Q_OBJECT
+
+private slots:
+    void init();
+    void replayKeepsUnfinishedJobsAndCheckpoints();
+    void tornLineIsIgnored();
+    void otherVersionsAreIgnored();
+    void compactionKeepsOnlyLiveJobs();
+    void failedCompactionKeepsAppending();
+
+private:
+    QList<Job> reopen();
+
+    std::unique_ptr<QTemporaryDir> dir;
+    QString path;
+};
+
+void TestJobJournal::init() {
+    dir = std::make_unique<QTemporaryDir>();
+    path = dir->filePath("state/jobs.journal");
+}
+
+QList<Job> TestJobJournal::reopen() {
+    JobJournal journal(path);
+    QList<Job> unfinished;
+    QString error;
+    if (!journal.open(&unfinished, &error)) qWarning() << error;
+    return unfinished;
+}
+
+void TestJobJournal::replayKeepsUnfinishedJobsAndCheckpoints() {
+    {
+        JobJournal journal(path);
+        QList<Job> unfinished;
+        QVERIFY(journal.open(&unfinished));
+        QVERIFY(unfinished.isEmpty());
+
+        journal.recordSubmitted(imageJob(1, "/dev/sdb"));
+        journal.recordSubmitted(imageJob(2, "/dev/sdc"));
+        journal.recordSubmitted(imageJob(3, "/dev/sdd"));
+        journal.recordCheckpoint(1, "/dev/sdb", 4096, "16000000000:SanDisk:1234");
+        journal.recordCheckpoint(1, "/dev/sdb", 8192, "16000000000:SanDisk:1234");
+        Job done = imageJob(2, "/dev/sdc");
+        done.state = JobState::Succeeded;
+        journal.recordFinished(done);
+        journal.recordCheckpoint(2, "/dev/sdc", 4096, "late"); // After its finish; dropped
+    }
+
+    const QList<Job> unfinished = reopen();
+    QCOMPARE(unfinished.size(), qsizetype(2));
+    QCOMPARE(unfinished[0].id, qint64(1));
+    QCOMPARE(unfinished[0].checkpoints.value("/dev/sdb"), qint64(8192));
+    QCOMPARE(unfinished[0].targetStamps.value("/dev/sdb"), QString("16000000000:SanDisk:1234"));
+    QCOMPARE(unfinished[1].id, qint64(3));
+    QVERIFY(unfinished[1].checkpoints.isEmpty());
+
+    // Opening compacted the log down to the header and the live jobs
+    QCOMPARE(linesOf(path).size(), qsizetype(3));
+    QCOMPARE(reopen().size(), qsizetype(2));
+}
+
+void TestJobJournal::tornLineIsIgnored() {
+    {
+        JobJournal journal(path);
+        QList<Job> unfinished;
+        QVERIFY(journal.open(&unfinished));
+        journal.recordSubmitted(imageJob(1, "/dev/sdb"));
+    }
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::Append));
+    file.write(R"({"op":"checkpoint","id":1,"drive":"/dev/sdb","off)"); // Crash mid-append
+    file.close();
+
+    const QList<Job> unfinished = reopen();
+    QCOMPARE(unfinished.size(), qsizetype(1));
+    QVERIFY(unfinished[0].checkpoints.isEmpty());
+}
+
+void TestJobJournal::otherVersionsAreIgnored() {
+    QVERIFY(QDir().mkpath(QFileInfo(path).absolutePath()));
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("{\"op\":\"journal\",\"version\":99}\n");
+    file.write("{\"op\":\"submit\",\"job\":{\"id\":1,\"kind\":\"image\"}}\n");
+    file.close();
+    QVERIFY(reopen().isEmpty());
+}
+
+void TestJobJournal::compactionKeepsOnlyLiveJobs() {
+    JobJournal journal(path);
+    QList<Job> unfinished;
+    QVERIFY(journal.open(&unfinished));
+    journal.recordSubmitted(imageJob(1, "/dev/sdb"));
+    for (int i = 1; i <= JobJournal::kCompactAfter + 10; ++i) {
+        journal.recordCheckpoint(1, "/dev/sdb", qint64(i) * 4096, "stamp");
+    }
+
+    // One compaction happened, so only the records since then are in the log
+    QVERIFY2(linesOf(path).size() < 20, qPrintable(QString::number(linesOf(path).size())));
+    const QList<Job> replayed = reopen();
+    QCOMPARE(replayed.size(), qsizetype(1));
+    QCOMPARE(replayed[0].checkpoints.value("/dev/sdb"), qint64(JobJournal::kCompactAfter + 10) * 4096);
+}
+
+void TestJobJournal::failedCompactionKeepsAppending() {
+    JobJournal journal(path);
+    QList<Job> unfinished;
+    QVERIFY(journal.open(&unfinished));
+    journal.recordSubmitted(imageJob(1, "/dev/sdb"));
+
+    // The snapshot is written next to the log, so a read-only directory makes compaction fail
+    const QString stateDir = QFileInfo(path).absolutePath();
+    QVERIFY(QFile::setPermissions(stateDir, QFile::ReadOwner | QFile::ExeOwner));
+    QFile probe(stateDir + "/probe");
+    if (probe.open(QIODevice::WriteOnly)) {
+        probe.remove();
+        QFile::setPermissions(stateDir, QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+        QSKIP("Directory permissions are not enforced for this user");
+    }
+
+    for (int i = 1; i <= JobJournal::kCompactAfter + 10; ++i) {
+        journal.recordCheckpoint(1, "/dev/sdb", qint64(i) * 4096, "stamp");
+    }
+    QVERIFY(QFile::setPermissions(stateDir, QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner));
+
+    // Every record after the failed compaction still reached the log
+    QVERIFY(linesOf(path).size() > JobJournal::kCompactAfter);
+    const QList<Job> replayed = reopen();
+    QCOMPARE(replayed.size(), qsizetype(1));
+    QCOMPARE(replayed[0].checkpoints.value("/dev/sdb"), qint64(JobJournal::kCompactAfter + 10) * 4096);
+}
+
+QTEST_APPLESS_MAIN(TestJobJournal)
+#include "tst_jobjournal.moc"
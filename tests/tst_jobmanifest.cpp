@@ -0,0 +1,211 @@
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QtTest>
+#include "JobManifest.h"
+
+namespace {
+QJsonObject json(const char *text) {
+    return QJsonDocument::fromJson(text).object();
+}
+
+DriveInfo drive(const QString &path, const QString &model, qint64 size) {
+    DriveInfo info;
+    info.devicePath = path;
+    info.model = model;
+    info.size = size;
+    info.isRemovable = true;
+    return info;
+}
+
+// Three SanDisk sticks and one Kingston, in table order
+const QList<DriveInfo> kDrives = {
+    drive("/dev/sdb", "SanDisk Cruzer Blade", 16000000000LL),
+    drive("/dev/sdc", "Kingston DataTraveler", 32000000000LL),
+    drive("/dev/sdd", "SanDisk Ultra", 32000000000LL),
+    drive("/dev/sde", "SanDisk Ultra", 64000000000LL),
+};
+} // namespace
+
+/**
+ * @brief Parsing, validation and expansion of batch manifests.
+ */
+class TestJobManifest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void parsesImagesAndTargets();
+    void rejectsInvalidManifests_data();
+    void rejectsInvalidManifests();
+    void selectorTakesCountInTableOrder();
+    void selectorFailsWhenTooFewDrivesMatch();
+    void explicitDrivesAreTakenBeforeSelectors();
+    void explicitDriveTwiceIsRejected();
+    void dependenciesAndOptionsCarryOver();
+    void selectorMatchesModelAndSize();
+    void selectorSurvivesJson();
+};
+
+void TestJobManifest::parsesImagesAndTargets() {
+    JobManifest manifest;
+    QString error;
+    QVERIFY2(manifest.parse(json(R"({"name": "Release", "images": [{"id": "a", "path": "/srv/a.img"}],
+                                    "targets": [{"drive": "/dev/sdb", "image": "a"},
+                                                {"select": {"model": "SanDisk*"}, "count": 2, "image": "a"}]})"),
+                            &error), qPrintable(error));
+    QCOMPARE(manifest.name(), QString("Release"));
+    QCOMPARE(manifest.images().size(), qsizetype(1));
+    QCOMPARE(manifest.targets().size(), qsizetype(2));
+    QCOMPARE(manifest.targets()[1].select.model, QString("SanDisk*"));
+    QCOMPARE(manifest.targets()[1].count, 2);
+}
+
+void TestJobManifest::rejectsInvalidManifests_data() {
+    QTest::addColumn<QString>("manifest");
+    QTest::addColumn<QString>("error");
+
+    QTest::newRow("version") << QString(R"({"version": 2, "images": [], "targets": []})") << QString("version");
+    QTest::newRow("no targets") << QString(R"({"images": [{"id": "a", "path": "/a"}], "targets": []})") << QString("no targets");
+    QTest::newRow("unknown image") << QString(R"({"images": [{"id": "a", "path": "/a"}],
+                                         "targets": [{"drive": "/dev/sdb", "image": "b"}]})") << QString("unknown image");
+    QTest::newRow("duplicate image") << QString(R"({"images": [{"id": "a", "path": "/a"}, {"id": "a", "path": "/b"}],
+                                           "targets": [{"drive": "/dev/sdb", "image": "a"}]})") << QString("twice");
+    QTest::newRow("no drive or select") << QString(R"({"images": [{"id": "a", "path": "/a"}],
+                                              "targets": [{"image": "a"}]})") << QString("drive or a select");
+    QTest::newRow("verify level") << QString(R"({"verify": "full", "images": [{"id": "a", "path": "/a"}],
+                                        "targets": [{"drive": "/dev/sdb", "image": "a"}]})") << QString("verification level");
+    QTest::newRow("waits for itself") << QString(R"({"images": [{"id": "a", "path": "/a", "after": ["a"]}],
+                                            "targets": [{"drive": "/dev/sdb", "image": "a"}]})") << QString("waits for");
+    QTest::newRow("cycle") << QString(R"({"images": [{"id": "a", "path": "/a", "after": ["c"]},
+                                             {"id": "b", "path": "/b", "after": ["a"]},
+                                             {"id": "c", "path": "/c", "after": ["b"]}],
+                                 "targets": [{"drive": "/dev/sdb", "image": "a"}]})") << QString("cycle");
+}
+
+void TestJobManifest::rejectsInvalidManifests() {
+    QFETCH(QString, manifest);
+    QFETCH(QString, error);
+    JobManifest parsed;
+    QString message;
+    QVERIFY(!parsed.parse(QJsonDocument::fromJson(manifest.toUtf8()).object(), &message));
+    QVERIFY2(message.contains(error), qPrintable(message));
+}
+
+void TestJobManifest::selectorTakesCountInTableOrder() {
+    JobManifest manifest;
+    QVERIFY(manifest.parse(json(R"({"images": [{"id": "a", "path": "/a"}],
+                                    "targets": [{"select": {"model": "sandisk ultra"}, "count": 1, "image": "a"},
+                                                {"select": {"minSize": "20000000000"}, "image": "a"}]})")));
+    QList<Job> jobs;
+    QString error;
+    QVERIFY2(manifest.expand(kDrives, &jobs, &error), qPrintable(error));
+
+    // sdd goes to the first selector, so the second takes the rest that are big enough
+    QCOMPARE(jobs.size(), qsizetype(3));
+    for (const Job &job : jobs) {
+        QVERIFY(job.isPooled());
+        QVERIFY(job.drives.isEmpty());
+    }
+    QCOMPARE(TargetSelector::fromJson(jobs[0].pool).model, QString("sandisk ultra"));
+    QCOMPARE(TargetSelector::fromJson(jobs[1].pool).minSize, 20000000000LL);
+    QCOMPARE(jobs[0].id, qint64(1));
+    QCOMPARE(jobs[2].id, qint64(3));
+}
+
+void TestJobManifest::selectorFailsWhenTooFewDrivesMatch() {
+    JobManifest manifest;
+    QVERIFY(manifest.parse(json(R"({"images": [{"id": "a", "path": "/a"}],
+                                    "targets": [{"select": {"model": "SanDisk*"}, "count": 5, "image": "a"}]})")));
+    QList<Job> jobs;
+    QString error;
+    QVERIFY(!manifest.expand(kDrives, &jobs, &error));
+    QVERIFY2(error.contains("Only 3 of the 5"), qPrintable(error));
+}
+
+void TestJobManifest::explicitDrivesAreTakenBeforeSelectors() {
+    // The selector comes first in the file, but may not claim sdb
+    JobManifest manifest;
+    QVERIFY(manifest.parse(json(R"({"images": [{"id": "a", "path": "/a"}, {"id": "b", "path": "/b"}],
+                                    "targets": [{"select": {"model": "SanDisk*"}, "image": "a"},
+                                                {"drive": "/dev/sdb", "image": "b"}]})")));
+    QList<Job> jobs;
+    QVERIFY(manifest.expand(kDrives, &jobs));
+    QCOMPARE(jobs.size(), qsizetype(3));
+    QCOMPARE(jobs[0].drives, QStringList{"/dev/sdb"});
+    QCOMPARE(jobs[0].imagePath, QString("/b"));
+    QVERIFY(!jobs[0].isPooled());
+    QCOMPARE(jobs[1].imagePath, QString("/a"));
+    QCOMPARE(jobs[2].imagePath, QString("/a"));
+}
+
+void TestJobManifest::explicitDriveTwiceIsRejected() {
+    JobManifest manifest;
+    QVERIFY(manifest.parse(json(R"({"images": [{"id": "a", "path": "/a"}],
+                                    "targets": [{"drive": "/dev/sdb", "image": "a"},
+                                                {"drive": "/dev/sdb", "image": "a"}]})")));
+    QList<Job> jobs;
+    QString error;
+    QVERIFY(!manifest.expand(kDrives, &jobs, &error));
+    QVERIFY2(error.contains("more than once"), qPrintable(error));
+}
+
+void TestJobManifest::dependenciesAndOptionsCarryOver() {
+    JobManifest manifest;
+    QVERIFY(manifest.parse(json(R"({"verify": "none", "options": {"directIo": false, "erase": "discard"},
+                                    "images": [{"id": "a", "path": "/a", "options": {"erase": "zero"}},
+                                               {"id": "b", "path": "/b", "after": ["a"]}],
+                                    "targets": [{"drive": "/dev/sdb", "image": "a"},
+                                                {"drive": "/dev/sdc", "image": "a", "verify": "capacity",
+                                                 "options": {"directIo": true}},
+                                                {"drive": "/dev/sdd", "image": "b"}]})")));
+    QList<Job> jobs;
+    QVERIFY(manifest.expand(kDrives, &jobs));
+    QCOMPARE(jobs.size(), qsizetype(3));
+
+    // manifest < image < target
+    QCOMPARE(jobs[0].options.value("erase").toString(), QString("zero"));
+    QCOMPARE(jobs[0].options.value("directIo").toBool(), false);
+    QCOMPARE(jobs[0].options.value("verifyCapacity").toBool(), false);
+    QCOMPARE(jobs[1].options.value("directIo").toBool(), true);
+    QCOMPARE(jobs[1].options.value("verifyCapacity").toBool(), true);
+    QCOMPARE(jobs[2].options.value("erase").toString(), QString("discard"));
+
+    // b's job waits for both of a's
+    QCOMPARE(jobs[2].after, (QList<qint64>{1, 2}));
+    QVERIFY(jobs[0].after.isEmpty());
+}
+
+void TestJobManifest::selectorMatchesModelAndSize() {
+    TargetSelector selector;
+    selector.model = "sandisk*";
+    QVERIFY(selector.matches(kDrives[0]));
+    QVERIFY(!selector.matches(kDrives[1]));
+
+    // Size bounds are inclusive
+    selector.minSize = 32000000000LL;
+    selector.maxSize = 32000000000LL;
+    QVERIFY(!selector.matches(kDrives[0]));
+    QVERIFY(selector.matches(kDrives[2]));
+    QVERIFY(!selector.matches(kDrives[3]));
+}
+
+void TestJobManifest::selectorSurvivesJson() {
+    TargetSelector selector;
+    selector.model = "Kingston*";
+    selector.minSize = 20000000000LL;
+    selector.port = "2-1";
+    const TargetSelector parsed = TargetSelector::fromJson(selector.toJson());
+    QCOMPARE(parsed.model, selector.model);
+    QCOMPARE(parsed.minSize, selector.minSize);
+    QCOMPARE(parsed.maxSize, qint64(0));
+    QCOMPARE(parsed.port, selector.port);
+
+    // A selector that matches everything still marks its job as pooled
+    const QJsonObject any = TargetSelector().toJson();
+    QVERIFY(!any.isEmpty());
+    for (const DriveInfo &drive : kDrives) {
+        QVERIFY(TargetSelector::fromJson(any).matches(drive));
+    }
+}
+
+QTEST_APPLESS_MAIN(TestJobManifest)
+#include "tst_jobmanifest.moc"